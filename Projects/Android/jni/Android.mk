@@ -8,13 +8,23 @@ LOCAL_MODULE := vaporworldvr
 LOCAL_SRC_FILES := ../../../src/vaporworldvr.cpp\
                    ../../../src/runnable_thread.cpp\
                    ../../../src/thread_utils.cpp\
+                   ../../../src/block_pool.cpp\
                    ../../../src/collision_utils.cpp\
+                   ../../../src/aabb_tree.cpp\
+                   ../../../src/density_field.cpp\
+                   ../../../src/triangle_bvh.cpp\
+                   ../../../src/terrain_collision.cpp\
+                   ../../../src/occlusion_buffer.cpp\
+                   ../../../src/broadphase.cpp\
+                   ../../../src/parallel_for.cpp\
+                   ../../../src/transform_batch.cpp\
+                   ../../../src/pack_batch.cpp\
                    ../../../src/vwgl.cpp
 LOCAL_CPP_FEATURES := rtti
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../../include\
                     $(LOCAL_PATH)/../../../external/gcem/include
 LOCAL_CFLAGS += -std=c11 -Werror
-LOCAL_CPPFLAGS += -std=c++2a -Werror
+LOCAL_CPPFLAGS += -std=c++2a -Werror -fno-math-errno
 LOCAL_LDLIBS := -lEGL -lGLESv3 -landroid -llog
 LOCAL_SHARED_LIBRARIES := vrapi
 LOCAL_EXPORT_C_INCLUDES := $(LOCAL_C_INCLUDES)
@@ -42,6 +52,36 @@ LOCAL_STATIC_LIBRARIES := googletest_main
 # Build the test executable
 include $(BUILD_EXECUTABLE)
 
+# Clear local variables
+include $(CLEAR_VARS)
+
+# Define the collision test module
+LOCAL_MODULE := vaporworldvr_test_collision
+LOCAL_SRC_FILES := ../../../test/test_collision.cpp
+LOCAL_CPP_FEATURES := rtti
+LOCAL_CFLAGS := -std=c11
+LOCAL_CPPFLAGS := -std=c++2a
+LOCAL_SHARED_LIBRARIES := vaporworldvr
+LOCAL_STATIC_LIBRARIES := googletest_main
+
+# Build the test executable
+include $(BUILD_EXECUTABLE)
+
+# Clear local variables
+include $(CLEAR_VARS)
+
+# Define the message test module
+LOCAL_MODULE := vaporworldvr_test_message
+LOCAL_SRC_FILES := ../../../test/test_message.cpp
+LOCAL_CPP_FEATURES := rtti
+LOCAL_CFLAGS := -std=c11
+LOCAL_CPPFLAGS := -std=c++2a
+LOCAL_SHARED_LIBRARIES := vaporworldvr
+LOCAL_STATIC_LIBRARIES := googletest_main
+
+# Build the test executable
+include $(BUILD_EXECUTABLE)
+
 # Import the VrApi library
 $(call import-module,VrApi/Projects/AndroidPrebuilt/jni)
 
@@ -0,0 +1,28 @@
+# Runs a benchmark executable and writes the results to a JSON file, tagged
+# with the current commit. Used by the bench_json target.
+#
+# Arguments:
+#   VW_ROOT_DIR   The repository root directory
+#   VW_BENCH      The benchmark executable
+#   VW_BENCH_OUT  The output JSON file
+
+set(VW_BENCH_COMMIT "unknown")
+find_package(Git QUIET)
+if(GIT_FOUND)
+	execute_process(COMMAND "${GIT_EXECUTABLE}" rev-parse --short HEAD
+	                WORKING_DIRECTORY "${VW_ROOT_DIR}"
+	                OUTPUT_VARIABLE VW_BENCH_COMMIT
+	                OUTPUT_STRIP_TRAILING_WHITESPACE
+	                ERROR_QUIET)
+endif()
+
+execute_process(COMMAND "${VW_BENCH}"
+                        --benchmark_out_format=json
+                        "--benchmark_out=${VW_BENCH_OUT}"
+                        --benchmark_repetitions=5
+                        --benchmark_report_aggregates_only=true
+                        "--benchmark_context=commit=${VW_BENCH_COMMIT}"
+                RESULT_VARIABLE VW_BENCH_RESULT)
+if(NOT VW_BENCH_RESULT EQUAL 0)
+	message(FATAL_ERROR "${VW_BENCH} failed: ${VW_BENCH_RESULT}")
+endif()
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "math/vec3.h"
+#include "collision_utils.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	/**
+	 * @brief A dynamic bounding volume hierarchy of axis-aligned boxes, used
+	 * to accelerate spatial queries on chunks and objects.
+	 *
+	 * Each object is stored in a leaf (a proxy), with a box fattened by a
+	 * margin, so that objects that move slightly don't need to be
+	 * reinserted. Leaves are inserted next to the sibling that minimizes the
+	 * surface area of the tree, and the tree is rebalanced with rotations
+	 * after each insertion and removal, such that its height stays
+	 * logarithmic in the number of proxies.
+	 *
+	 * Queries return the user data of the proxies whose fat box passes the
+	 * test, so they are conservative.
+	 */
+	class AABBTree
+	{
+	public:
+		/* Index of a node that does not exist. */
+		static constexpr uint32_t nullNode = UINT32_MAX;
+
+		/* Maximum depth of the traversal stack. The tree is balanced, so its
+		   height is at most ~1.44 log2(n). */
+		static constexpr int maxStackSize = 64;
+
+		/**
+		 * @brief Constructs an empty tree.
+		 *
+		 * @param margin The distance by which the boxes of the proxies are
+		 *               fattened on each side
+		 */
+		explicit AABBTree(float margin = 0.f);
+
+		/**
+		 * @brief Returns the number of proxies in the tree.
+		 */
+		FORCE_INLINE size_t getNumProxies() const
+		{
+			return numProxies;
+		}
+
+		/**
+		 * @brief Returns the height of the tree, 0 if the tree is empty or
+		 * has a single proxy.
+		 */
+		FORCE_INLINE int getHeight() const
+		{
+			return root == nullNode ? 0 : nodes[root].height;
+		}
+
+		/**
+		 * @brief Returns the user data of the given proxy.
+		 */
+		FORCE_INLINE uint32_t getUserData(uint32_t proxy) const
+		{
+			return nodes[proxy].userData;
+		}
+
+		/**
+		 * @brief Returns the fat box of the given proxy.
+		 *
+		 * @param proxy The proxy
+		 * @param[out] min The minimum corner of the box
+		 * @param[out] max The maximum corner of the box
+		 */
+		FORCE_INLINE void getFatAABB(uint32_t proxy, float3& min, float3& max) const
+		{
+			min = nodes[proxy].min;
+			max = nodes[proxy].max;
+		}
+
+		/**
+		 * @brief Inserts a new proxy in the tree.
+		 *
+		 * @param min The minimum corner of the box of the object
+		 * @param max The maximum corner of the box of the object
+		 * @param userData The value returned by queries, e.g. the index of
+		 *                 the object
+		 * @return The proxy, used to update and remove the object. Proxies
+		 *         of removed objects are reused
+		 */
+		uint32_t insert(float3 const& min, float3 const& max, uint32_t userData);
+
+		/**
+		 * @brief Removes the given proxy from the tree.
+		 *
+		 * @param proxy The proxy returned by insert()
+		 */
+		void remove(uint32_t proxy);
+
+		/**
+		 * @brief Updates the box of the given proxy.
+		 *
+		 * If the new box is still contained in the fat box, nothing changes.
+		 * Otherwise, the proxy is removed and inserted again with the new
+		 * box, which keeps the tree balanced.
+		 *
+		 * @param proxy The proxy returned by insert()
+		 * @param min The new minimum corner of the box of the object
+		 * @param max The new maximum corner of the box of the object
+		 * @return true if the proxy was reinserted
+		 * @return false otherwise
+		 */
+		bool refit(uint32_t proxy, float3 const& min, float3 const& max);
+
+		/**
+		 * @brief Finds the proxies visible in the given frustum.
+		 *
+		 * Nodes are tested with Frustum::testAABB(). The planes that fully
+		 * contain a node are not tested again for its children, and the
+		 * leaves of a node that is fully inside the frustum are collected
+		 * without testing them.
+		 *
+		 * @param frustum The frustum to test against
+		 * @param outUserData The user data of the visible proxies, in no
+		 *                    particular order. If too small, the extra
+		 *                    proxies are not written
+		 * @return The number of visible proxies, may be greater than the
+		 *         size of the output
+		 */
+		size_t cullFrustum(Frustum const& frustum, ::std::span<uint32_t> outUserData) const;
+
+		/**
+		 * @brief Finds the proxies that overlap the given sphere.
+		 *
+		 * @param center The center of the sphere
+		 * @param radius The radius of the sphere
+		 * @param outUserData The user data of the overlapping proxies, see
+		 *                    cullFrustum()
+		 * @return The number of overlapping proxies, see cullFrustum()
+		 */
+		size_t querySphere(float3 const& center, float radius, ::std::span<uint32_t> outUserData) const;
+
+		/**
+		 * @brief Finds the proxies that overlap the given box.
+		 *
+		 * @param min The minimum corner of the box
+		 * @param max The maximum corner of the box
+		 * @param outUserData The user data of the overlapping proxies, see
+		 *                    cullFrustum()
+		 * @return The number of overlapping proxies, see cullFrustum()
+		 */
+		size_t queryAABB(float3 const& min, float3 const& max, ::std::span<uint32_t> outUserData) const;
+
+		/**
+		 * @brief Calls the given function for each proxy hit by the ray.
+		 *
+		 * Children are visited front to back, and the function can clip the
+		 * ray to the closest hit, such that the nodes behind it are skipped.
+		 *
+		 * @param rayStart The starting point of the ray
+		 * @param rayDir The direction of the ray (does not need to be
+		 *               normalized, distances are in units of its length)
+		 * @param maxDist The maximum distance along the ray
+		 * @param fn A callable with signature float(uint32_t userData, float
+		 *           maxDist), that returns the new maximum distance, e.g.
+		 *           the distance of the hit with the object or maxDist if
+		 *           missed. Return 0 to stop the traversal
+		 */
+		template<typename FnT>
+		void raycast(float3 const& rayStart, float3 const& rayDir, float maxDist, FnT&& fn) const
+		{
+			if (root == nullNode)
+				return;
+
+			// Avoid NaN when the ray starts on the side of a box and is
+			// parallel to it
+			float3 const invDir{rayDir[0] != 0.f ? 1.f / rayDir[0] : 1e30f,
+			                    rayDir[1] != 0.f ? 1.f / rayDir[1] : 1e30f,
+			                    rayDir[2] != 0.f ? 1.f / rayDir[2] : 1e30f};
+
+			uint32_t stack[maxStackSize];
+			float stackDists[maxStackSize];
+			int stackSize = 0;
+			float const rootDist = getRayEntryDist(nodes[root], rayStart, invDir, maxDist);
+			if (rootDist > maxDist)
+				return;
+			stack[stackSize] = root;
+			stackDists[stackSize++] = rootDist;
+
+			while (stackSize > 0)
+			{
+				--stackSize;
+				if (stackDists[stackSize] > maxDist)
+					// The ray was clipped by a closer hit
+					continue;
+
+				Node const& node = nodes[stack[stackSize]];
+				if (node.isLeaf())
+				{
+					maxDist = fn(node.userData, maxDist);
+					if (maxDist <= 0.f)
+						return;
+					continue;
+				}
+
+				// Push the furthest child first, so the closest is visited
+				// first
+				uint32_t near = node.children[0], far = node.children[1];
+				float nearDist = getRayEntryDist(nodes[near], rayStart, invDir, maxDist);
+				float farDist = getRayEntryDist(nodes[far], rayStart, invDir, maxDist);
+				if (farDist < nearDist)
+				{
+					::std::swap(near, far);
+					::std::swap(nearDist, farDist);
+				}
+
+				VW_CHECKF(stackSize + 2 <= maxStackSize, "AABB tree traversal stack overflow");
+				if (farDist <= maxDist)
+				{
+					stack[stackSize] = far;
+					stackDists[stackSize++] = farDist;
+				}
+				if (nearDist <= maxDist)
+				{
+					stack[stackSize] = near;
+					stackDists[stackSize++] = nearDist;
+				}
+			}
+		}
+
+	protected:
+		/* A node of the tree, either a leaf that holds a proxy or an internal
+		   node with exactly two children. */
+		struct Node
+		{
+			/* The bounds of the node, fattened for leaves. */
+			/// @{
+			float3 min;
+			float3 max;
+			/// @}
+
+			/* The parent of the node, or the next free node if the node is
+			   not in use. */
+			uint32_t parent;
+
+			/* The children of the node, nullNode for leaves. */
+			uint32_t children[2];
+
+			/* The height of the subtree, 0 for leaves and -1 for free
+			   nodes. */
+			int32_t height;
+
+			/* The user data of the proxy. */
+			uint32_t userData;
+
+			/**
+			 * @brief Returns true if the node is a leaf.
+			 */
+			constexpr FORCE_INLINE bool isLeaf() const
+			{
+				return children[0] == nullNode;
+			}
+		};
+
+		/* The pool of nodes, including the free ones. */
+		::std::vector<Node> nodes;
+
+		/* The root of the tree. */
+		uint32_t root;
+
+		/* The first node of the list of free nodes. */
+		uint32_t freeList;
+
+		/* The number of proxies. */
+		size_t numProxies;
+
+		/* The margin of the fat boxes. */
+		float margin;
+
+		/* Returns the distance along the ray at which it enters the node, or
+		   infinity if the ray misses the node within the maximum
+		   distance. */
+		static FORCE_INLINE float getRayEntryDist(Node const& node, float3 const& rayStart, float3 const& invDir,
+		                                          float maxDist)
+		{
+			float tMin = 0.f, tMax = maxDist;
+			for (int i = 0; i < 3; ++i)
+			{
+				float const t0 = (node.min[i] - rayStart[i]) * invDir[i];
+				float const t1 = (node.max[i] - rayStart[i]) * invDir[i];
+				tMin = Math::max(tMin, Math::min(t0, t1));
+				tMax = Math::min(tMax, Math::max(t0, t1));
+			}
+			return tMin <= tMax ? tMin : __builtin_inff();
+		}
+
+		uint32_t allocateNode();
+
+		void freeNode(uint32_t nodeIdx);
+
+		void insertLeaf(uint32_t leaf);
+
+		void removeLeaf(uint32_t leaf);
+
+		/* Updates the bounds and height of the ancestors of the given node,
+		   and rebalances them. */
+		void refitAncestors(uint32_t nodeIdx);
+
+		/* Rotates the subtree if it is unbalanced, returns the new root of
+		   the subtree. */
+		uint32_t balance(uint32_t nodeIdx);
+	};
+} // namespace VaporWorldVR
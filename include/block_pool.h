@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include "core_types.h"
+
+
+namespace VaporWorldVR
+{
+	class Mutex;
+
+
+	/**
+	 * @brief Usage statistics of a BlockPool, used to size its initial
+	 * capacity.
+	 */
+	struct BlockPoolStats
+	{
+		/* The number of blocks allocated from the heap. */
+		size_t capacity;
+
+		/* The number of blocks in use. */
+		size_t numUsed;
+
+		/* The largest number of blocks in use at the same time. */
+		size_t highWaterMark;
+
+		/* The number of slabs allocated from the heap, including the
+		   initial one. */
+		size_t numSlabs;
+	};
+
+
+	/**
+	 * @brief A thread-safe pool of fixed size blocks.
+	 *
+	 * Blocks are carved out of slabs allocated from the heap, and free blocks
+	 * are linked in an intrusive lock-free list, so blocks can be allocated
+	 * and freed by any thread without locks. Each block has a small header
+	 * with its index and the index of the next free block, the list head
+	 * packs the index of the first free block with a counter that is
+	 * incremented at each update, to detect concurrent pops and pushes of
+	 * the same block.
+	 *
+	 * The pool never shrinks. When it runs out of blocks a new slab is
+	 * allocated under a mutex, twice as large as the previous one, hence the
+	 * heap is only used until the pool reaches its high water mark, and not
+	 * at all if the initial capacity is large enough.
+	 */
+	class BlockPool
+	{
+	public:
+		/**
+		 * @brief Constructs a new pool, and allocates its first slab.
+		 *
+		 * @param inBlockSize The size of a block
+		 * @param inBlockAlign The alignment of a block, at most the alignment
+		 *                     of the memory returned by operator new
+		 * @param initialCapacity The number of blocks of the first slab
+		 */
+		BlockPool(size_t inBlockSize, size_t inBlockAlign, size_t initialCapacity);
+
+		/**
+		 * @brief Destroys the pool, and frees its slabs. All blocks must have
+		 * been freed.
+		 */
+		~BlockPool();
+
+		BlockPool(BlockPool const&) = delete;
+		BlockPool& operator=(BlockPool const&) = delete;
+
+		/**
+		 * @brief Returns a free block, allocating a new slab if there are
+		 * none, or null if the pool is full.
+		 */
+		void* allocate();
+
+		/**
+		 * @brief Returns a block to the pool.
+		 *
+		 * @param block A block returned by allocate()
+		 */
+		void free(void* block);
+
+		/**
+		 * @brief Returns the usage statistics of the pool. Values are read
+		 * separately, and may be inconsistent while other threads use the
+		 * pool.
+		 */
+		BlockPoolStats getStats() const;
+
+	protected:
+		/* The header in front of each block. */
+		struct BlockHeader
+		{
+			/* The index of the next free block, when the block is free. */
+			::std::atomic<uint32_t> nextFree;
+
+			/* The index of this block. */
+			uint32_t index;
+		};
+
+		/* Index of a block that does not exist. */
+		static constexpr uint32_t nullIndex = UINT32_MAX;
+
+		/* The maximum number of slabs, each slab is twice as large as the
+		   previous one. */
+		static constexpr uint32_t maxSlabs = 32;
+
+		/* The distance between two blocks in a slab, and the offset of a
+		   block from its header. */
+		/// @{
+		size_t blockStride;
+		size_t headerSize;
+		/// @}
+
+		/* The number of blocks of the first slab. Slab i has firstSlabSize
+		   << i blocks, the first of which has index firstSlabSize * ((1 << i)
+		   - 1). */
+		size_t firstSlabSize;
+
+		/* The slabs of the pool. */
+		::std::atomic<uint8_t*> slabs[maxSlabs];
+
+		/* The number of slabs, only written under the grow mutex. */
+		::std::atomic<uint32_t> numSlabs;
+
+		/* The first free block in the low 32 bits, and the update counter in
+		   the high 32 bits. */
+		alignas(64) ::std::atomic<uint64_t> freeList;
+
+		/* The usage counters. */
+		/// @{
+		alignas(64) ::std::atomic<size_t> numUsed;
+		::std::atomic<size_t> highWaterMark;
+		/// @}
+
+		/* Serializes the allocation of new slabs. */
+		Mutex* growMutex;
+
+		/* Returns the header of the block with the given index. */
+		BlockHeader* getHeader(uint32_t index) const;
+
+		/* Pushes a linked chain of free blocks to the free list. */
+		void pushFree(uint32_t first, BlockHeader* last);
+
+		/* Allocates a new slab, unless another thread added free blocks
+		   while this thread was waiting. Returns false if the pool is
+		   full. */
+		bool grow();
+	};
+} // namespace VaporWorldVR
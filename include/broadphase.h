@@ -0,0 +1,254 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "math/vec3.h"
+#include "collision_utils.h"
+#include "transform_batch.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	/**
+	 * @brief A pair of overlapping proxies, see SpatialHash::findPairs().
+	 */
+	struct BroadphasePair
+	{
+		/* The user data of the two proxies. */
+		/// @{
+		uint32_t a;
+		uint32_t b;
+		/// @}
+	};
+
+
+	/* Batches with more pairs than this are split between the parallelFor()
+	   workers. Sphere tests are cheap, so batches are larger than for the
+	   terrain queries. */
+	constexpr size_t pairQueryParallelThreshold = 256;
+
+
+	/**
+	 * @brief A multi-level spatial hash of spheres, used to find the
+	 * overlapping pairs of many moving objects.
+	 *
+	 * Each level is a uniform grid with cells twice as large as the previous
+	 * level. A sphere is stored in the cell that contains its center, in the
+	 * finest level whose cells are at least as large as its diameter. Hence
+	 * it may only overlap the spheres of the same level in the 27 cells
+	 * around its own, and the spheres of coarser levels in the 27 cells
+	 * around the ancestor of its cell. Cells are keyed by their quantized
+	 * coordinates and their level in an open addressing hash table, and only
+	 * occupied cells are stored.
+	 *
+	 * Moving a proxy only relinks it if its cell changed, so updates cost
+	 * O(1) for each moved object, and finding the pairs is linear in the
+	 * number of proxies when their density is bounded.
+	 */
+	class SpatialHash
+	{
+	public:
+		/* Index of a proxy that does not exist. */
+		static constexpr uint32_t nullProxy = UINT32_MAX;
+
+		/* The number of levels of the hash. Spheres larger than the cells
+		   of the coarsest level are not supported. */
+		static constexpr int numLevels = 16;
+
+		/* The number of bits of each quantized coordinate of a cell. Cells
+		   further than 2^19 cells of the finest level from the origin are
+		   clamped. */
+		static constexpr int coordBits = 20;
+
+		/**
+		 * @brief Constructs an empty hash.
+		 *
+		 * @param inCellSize The size of the cells of the finest level,
+		 *                   ideally about the diameter of the smallest
+		 *                   objects
+		 */
+		explicit SpatialHash(float inCellSize);
+
+		/**
+		 * @brief Returns the number of proxies in the hash.
+		 */
+		FORCE_INLINE size_t getNumProxies() const
+		{
+			return numProxies;
+		}
+
+		/**
+		 * @brief Returns the number of occupied cells.
+		 */
+		FORCE_INLINE size_t getNumCells() const
+		{
+			return numCells;
+		}
+
+		/**
+		 * @brief Returns the user data of the given proxy.
+		 */
+		FORCE_INLINE uint32_t getUserData(uint32_t proxy) const
+		{
+			return proxies[proxy].userData;
+		}
+
+		/**
+		 * @brief Inserts a new proxy in the hash.
+		 *
+		 * @param center The center of the sphere of the object
+		 * @param radius The radius of the sphere of the object
+		 * @param userData The value returned in the pairs, e.g. the index of
+		 *                 the object
+		 * @return The proxy, used to update and remove the object. Proxies
+		 *         of removed objects are reused
+		 */
+		uint32_t insert(float3 const& center, float radius, uint32_t userData);
+
+		/**
+		 * @brief Removes the given proxy from the hash.
+		 *
+		 * @param proxy The proxy returned by insert()
+		 */
+		void remove(uint32_t proxy);
+
+		/**
+		 * @brief Updates the sphere of the given proxy.
+		 *
+		 * @param proxy The proxy returned by insert()
+		 * @param center The new center of the sphere of the object
+		 * @param radius The new radius of the sphere of the object
+		 * @return true if the proxy moved to another cell
+		 * @return false otherwise
+		 */
+		bool move(uint32_t proxy, float3 const& center, float radius);
+
+		/**
+		 * @brief Finds all pairs of overlapping spheres.
+		 *
+		 * Each pair is reported once, in no particular order.
+		 *
+		 * @param[out] outPairs The vector in which the pairs are written,
+		 *                      cleared first
+		 * @return The number of pairs
+		 */
+		size_t findPairs(::std::vector<BroadphasePair>& outPairs) const;
+
+	protected:
+		/* A proxy, linked in the list of its cell. */
+		struct Proxy
+		{
+			/* The sphere of the object. */
+			/// @{
+			float3 center;
+			float radius;
+			/// @}
+
+			/* The user data of the proxy. */
+			uint32_t userData;
+
+			/* The key of the cell of the proxy, or emptyKey if the proxy is
+			   not in use. */
+			uint64_t cellKey;
+
+			/* The previous proxy in the cell, or nullProxy if first. */
+			uint32_t prev;
+
+			/* The next proxy in the cell, or the next free proxy if the
+			   proxy is not in use. */
+			uint32_t next;
+		};
+
+		/* A slot of the hash table. */
+		struct Cell
+		{
+			/* The key of the cell, or emptyKey if the slot is empty. */
+			uint64_t key;
+
+			/* The first proxy of the cell. */
+			uint32_t firstProxy;
+
+			/* The number of proxies in the cell. */
+			uint32_t numProxies;
+		};
+
+		/* The key of empty slots, which no cell can have. */
+		static constexpr uint64_t emptyKey = UINT64_MAX;
+
+		/* The pool of proxies, including the free ones. */
+		::std::vector<Proxy> proxies;
+
+		/* The hash table, with a power of two size. */
+		::std::vector<Cell> cells;
+
+		/* The first proxy of the list of free proxies. */
+		uint32_t freeList;
+
+		/* The number of proxies. */
+		size_t numProxies;
+
+		/* The number of occupied cells. */
+		size_t numCells;
+
+		/* The number of proxies in each level. */
+		uint32_t levelCounts[numLevels];
+
+		/* The size of the cells of the finest level, and its inverse. */
+		/// @{
+		float cellSize;
+		float invCellSize;
+		/// @}
+
+		/* Returns the key of the cell that contains the center of the given
+		   sphere. */
+		uint64_t getCellKey(float3 const& center, float radius) const;
+
+		/* Returns the slot of the cell with the given key, or the empty slot
+		   where it would be inserted. */
+		FORCE_INLINE size_t findSlot(uint64_t key) const
+		{
+			size_t const mask = cells.size() - 1;
+			size_t slot = getKeyHash(key) & mask;
+			while (cells[slot].key != key && cells[slot].key != emptyKey)
+			{
+				slot = (slot + 1) & mask;
+			}
+			return slot;
+		}
+
+		/* Returns the hash of a key. Coordinates are mixed by multiplying by
+		   the golden ratio, and the high bits are the most mixed. */
+		static FORCE_INLINE size_t getKeyHash(uint64_t key)
+		{
+			return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 32);
+		}
+
+		/* Links the proxy to the list of its cell, adding the cell if
+		   needed. */
+		void linkProxy(uint32_t proxy);
+
+		/* Unlinks the proxy from the list of its cell, removing the cell if
+		   empty. */
+		void unlinkProxy(uint32_t proxy);
+
+		/* Doubles the size of the hash table. */
+		void growCells();
+	};
+
+
+	/**
+	 * @brief Computes the contacts of a sequence of pairs of spheres, see
+	 * overlapSphereSphere(). Large batches are processed in parallel.
+	 *
+	 * @param pairs The pairs, whose user data are the indices of the spheres
+	 * @param centers The centers of the spheres
+	 * @param radii The radii of the spheres, same size as the centers
+	 * @param[out] outContacts The contact of each pair, same size as the
+	 *                         pairs. The normal points towards the first
+	 *                         sphere of the pair
+	 */
+	void overlapSpherePairs(::std::span<BroadphasePair const> pairs, Vec3SoA<float const> const& centers,
+	                        ::std::span<float const> radii, ::std::span<ContactResult> outContacts);
+} // namespace VaporWorldVR
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <span>
+
 #include "math/vec3.h"
 #include "math/vec4.h"
 #include "math/mat4.h"
+#include "transform_batch.h"
 
 
 namespace VaporWorldVR
 {
+	class DensityField;
+
+
 	/**
 	 * @brief This struct holds informations about hit and intersection tests.
 	 */
@@ -31,6 +37,284 @@ namespace VaporWorldVR
 	};
 
 
+	/**
+	 * @brief This struct holds informations about the contact between a
+	 * shape and the terrain, or between two shapes.
+	 */
+	struct ContactResult
+	{
+		/* Flag set to false if no contact occured. */
+		bool contactOccured = false;
+
+		/* The point of the surface closest to the deepest point of the
+		   shape. */
+		float3 contactPoint;
+
+		/* The normal of the surface at the contact point, pointing out of
+		   the terrain or the other shape. */
+		float3 contactNormal;
+
+		/* The distance by which the shape must be moved along the normal to
+		   resolve the contact. */
+		float penetrationDepth = 0.f;
+
+		/**
+		 * @brief Returns true if a contact occured.
+		 */
+		constexpr FORCE_INLINE operator bool() const
+		{
+			return contactOccured;
+		}
+	};
+
+
+	/**
+	 * @brief The closest hit of a batch of ray intersection tests: the index
+	 * of the object or ray that was hit first, and the distance along the
+	 * ray. See getRaySphereHit() and getRayAABBHit() to compute the position
+	 * and normal of the hit.
+	 */
+	struct BatchHitResult
+	{
+		/* The index used when no hit occured. */
+		static constexpr uint32_t invalidIndex = ~0u;
+
+		/* The index of the object or ray, or invalidIndex if no hit
+		   occured. */
+		uint32_t index = invalidIndex;
+
+		/* The distance of the hit, in units of the length of the ray
+		   direction. */
+		float dist = __builtin_inff();
+
+		/**
+		 * @brief Returns true if a hit occured.
+		 */
+		constexpr FORCE_INLINE operator bool() const
+		{
+			return index != invalidIndex;
+		}
+	};
+
+
+	/**
+	 * @brief The planes of a camera frustum.
+	 *
+	 * Planes are extracted once from the view-projection matrix, e.g. once
+	 * per frame, and reused for all tests. They are normalized and face
+	 * inwards, such that the signed distance of a point inside the frustum
+	 * is positive for all planes.
+	 */
+	struct Frustum
+	{
+		/* The frustum planes, in the order left, right, bottom, top, near
+		   and far. XYZ is the normal and W the distance from the origin. */
+		float4 planes[6];
+
+		/**
+		 * @brief Constructs a frustum that contains everything.
+		 */
+		constexpr FORCE_INLINE Frustum() : planes{} {}
+
+		/**
+		 * @brief Extracts the planes of the frustum described by the given
+		 * view-projection matrix.
+		 *
+		 * The clip space is the one of OpenGL (i.e. clip = m.dot(v), with Z
+		 * in [-W, W]). The far plane may be at infinity, as in the projection
+		 * matrices created by VrApi.
+		 *
+		 * @param viewProj The view-projection matrix
+		 */
+		explicit Frustum(float4x4 const& viewProj);
+
+		/**
+		 * @brief Returns true if the given sphere is inside or intersects
+		 * the frustum.
+		 *
+		 * The test is conservative: a sphere near a corner of the frustum
+		 * may pass the test, even if it is outside.
+		 *
+		 * @param center The center of the sphere
+		 * @param radius The radius of the sphere
+		 */
+		constexpr FORCE_INLINE bool testSphere(float3 const& center, float radius) const
+		{
+			for (int i = 0; i < 6; ++i)
+			{
+				float const dist = planes[i][0] * center[0] + planes[i][1] * center[1] + planes[i][2] * center[2]
+				                 + planes[i][3];
+				if (dist < -radius)
+					// Sphere is completely outside of this plane
+					return false;
+			}
+
+			return true;
+		}
+
+		/**
+		 * @brief Returns true if the given AABB is inside or intersects the
+		 * frustum.
+		 *
+		 * For each plane, only the vertex that is furthest along the plane
+		 * normal (i.e. the p-vertex) is tested. The test is conservative like
+		 * testSphere().
+		 *
+		 * @param min The minimum corner of the AABB
+		 * @param max The maximum corner of the AABB
+		 */
+		constexpr FORCE_INLINE bool testAABB(float3 const& min, float3 const& max) const
+		{
+			for (int i = 0; i < 6; ++i)
+			{
+				float3 const p{planes[i][0] >= 0.f ? max[0] : min[0],
+				               planes[i][1] >= 0.f ? max[1] : min[1],
+				               planes[i][2] >= 0.f ? max[2] : min[2]};
+				if (planes[i][0] * p[0] + planes[i][1] * p[1] + planes[i][2] * p[2] + planes[i][3] < 0.f)
+					// The p-vertex is outside, so is the whole box
+					return false;
+			}
+
+			return true;
+		}
+	};
+
+
+	/**
+	 * @brief The frusta of the eyes of a stereo camera, and a single frustum
+	 * that contains both.
+	 *
+	 * Objects are culled once against the combined frustum, and only the
+	 * visible ones are tested against each eye, see cullAABBs_Stereo().
+	 */
+	struct StereoFrustum
+	{
+		/* A conservative frustum that contains both eye frusta. */
+		Frustum combined;
+
+		/* The frusta of the left and right eye. */
+		Frustum eyes[2];
+
+		/**
+		 * @brief Constructs a stereo frustum that contains everything.
+		 */
+		constexpr FORCE_INLINE StereoFrustum() = default;
+
+		/**
+		 * @brief Constructs the frusta of the eyes described by the given
+		 * view and projection matrices, e.g. those in ovrTracking2::Eye.
+		 *
+		 * For each side plane, the combined frustum uses the plane of an eye
+		 * frustum that contains the other eye frustum, or, for canted eyes,
+		 * the plane through the outermost edges of both eyes, moved back to
+		 * contain both eyes. The near and far planes are those of an eye
+		 * frustum, moved back to contain the other eye. A plane is only
+		 * dropped in degenerate cases, e.g. if the eye frusta have no plane
+		 * that contains both.
+		 *
+		 * @param views The view matrices of the left and right eye
+		 * @param projections The projection matrices of the left and right
+		 *                    eye
+		 */
+		StereoFrustum(float4x4 const (&views)[2], float4x4 const (&projections)[2]);
+	};
+
+
+	/**
+	 * @brief Returns the number of 32-bit words of a visibility mask of the
+	 * given number of objects.
+	 *
+	 * @param count The number of objects
+	 * @return The size of the mask
+	 */
+	constexpr FORCE_INLINE size_t getVisibilityMaskSize(size_t count)
+	{
+		return (count + 31) / 32;
+	}
+
+	/**
+	 * @brief Tests a sequence of spheres against the frustum, and writes a
+	 * visibility mask. Bit i % 32 of word i / 32 is set if the i-th sphere
+	 * passes Frustum::testSphere().
+	 *
+	 * @param frustum The frustum to test against
+	 * @param centers The centers of the spheres
+	 * @param radii The radii of the spheres, same size as the centers
+	 * @param outVisibleMask The visibility mask, with at least
+	 *                       getVisibilityMaskSize() words
+	 * @return The number of visible spheres
+	 */
+	size_t cullSpheres(Frustum const& frustum, Vec3SoA<float const> const& centers, ::std::span<float const> radii,
+	                   ::std::span<uint32_t> outVisibleMask);
+
+	/**
+	 * @brief Like cullSpheres(), but writes the indices of the visible
+	 * spheres in increasing order.
+	 *
+	 * @param frustum The frustum to test against
+	 * @param centers The centers of the spheres
+	 * @param radii The radii of the spheres, same size as the centers
+	 * @param outVisibleIndices The indices of the visible spheres, with room
+	 *                          for all spheres
+	 * @return The number of visible spheres
+	 */
+	size_t cullSpheres_Compact(Frustum const& frustum, Vec3SoA<float const> const& centers,
+	                           ::std::span<float const> radii, ::std::span<uint32_t> outVisibleIndices);
+
+	/**
+	 * @brief Tests a sequence of AABBs against the frustum, and writes a
+	 * visibility mask. Bit i % 32 of word i / 32 is set if the i-th box
+	 * passes Frustum::testAABB().
+	 *
+	 * @param frustum The frustum to test against
+	 * @param mins The minimum corners of the boxes
+	 * @param maxs The maximum corners of the boxes, same size as the minimum
+	 *             corners
+	 * @param outVisibleMask The visibility mask, with at least
+	 *                       getVisibilityMaskSize() words
+	 * @return The number of visible boxes
+	 */
+	size_t cullAABBs(Frustum const& frustum, Vec3SoA<float const> const& mins, Vec3SoA<float const> const& maxs,
+	                 ::std::span<uint32_t> outVisibleMask);
+
+	/**
+	 * @brief Like cullAABBs(), but writes the indices of the visible boxes in
+	 * increasing order.
+	 *
+	 * @param frustum The frustum to test against
+	 * @param mins The minimum corners of the boxes
+	 * @param maxs The maximum corners of the boxes, same size as the minimum
+	 *             corners
+	 * @param outVisibleIndices The indices of the visible boxes, with room
+	 *                          for all boxes
+	 * @return The number of visible boxes
+	 */
+	size_t cullAABBs_Compact(Frustum const& frustum, Vec3SoA<float const> const& mins,
+	                         Vec3SoA<float const> const& maxs, ::std::span<uint32_t> outVisibleIndices);
+
+	/**
+	 * @brief Culls a sequence of AABBs for both eyes of a stereo camera.
+	 *
+	 * Boxes are culled against the combined frustum, then the visible boxes
+	 * are tested against each eye. The result is shared by both eye passes:
+	 * the indices of the boxes visible in at least one eye, and for each of
+	 * them a mask with bit 0 set if visible in the left eye, and bit 1 set if
+	 * visible in the right eye.
+	 *
+	 * @param frustum The stereo frustum to test against
+	 * @param mins The minimum corners of the boxes
+	 * @param maxs The maximum corners of the boxes, same size as the minimum
+	 *             corners
+	 * @param outVisibleIndices The indices of the visible boxes, with room
+	 *                          for all boxes
+	 * @param outEyeMasks The eye mask of each visible box, same size as the
+	 *                    indices
+	 * @return The number of visible boxes
+	 */
+	size_t cullAABBs_Stereo(StereoFrustum const& frustum, Vec3SoA<float const> const& mins,
+	                        Vec3SoA<float const> const& maxs, ::std::span<uint32_t> outVisibleIndices,
+	                        ::std::span<uint8_t> outEyeMasks);
+
 	/**
 	 * @brief Compute the intersection between a ray and a sphere.
 	 *
@@ -76,11 +360,140 @@ namespace VaporWorldVR
 	bool raySphereIntersectTest(float3 const& rayStart, float3 const& rayDir, float3 const& sphereOrigin,
 	                            float sphereRadius);
 
+	/**
+	 * @brief Finds the closest sphere hit by a ray, testing four spheres at
+	 * a time.
+	 *
+	 * Like raySphereIntersect(), a sphere that contains the start of the
+	 * ray is hit where the ray exits it.
+	 *
+	 * @param rayStart The starting point of the ray
+	 * @param rayDir The direction of the ray (does not need to be normalized)
+	 * @param centers The centers of the spheres
+	 * @param radii The radii of the spheres, same size as the centers
+	 * @param maxDist The maximum distance along the ray
+	 * @return The index of the closest sphere and the distance of the hit,
+	 *         or no hit
+	 */
+	BatchHitResult raySpheresIntersect(float3 const& rayStart, float3 const& rayDir,
+	                                   Vec3SoA<float const> const& centers, ::std::span<float const> radii,
+	                                   float maxDist);
+
+	/**
+	 * @brief Intersects a sequence of rays with a sphere, four rays at a
+	 * time.
+	 *
+	 * @param rayStarts The starting points of the rays
+	 * @param rayDirs The directions of the rays, same size as the starting
+	 *                points
+	 * @param sphereOrigin The position of the center of the sphere
+	 * @param sphereRadius The radius of the sphere
+	 * @param maxDist The maximum distance along the rays
+	 * @param[out] outDists The distance of the hit of each ray, or infinity
+	 *                      if the ray misses the sphere. Same size as the
+	 *                      rays
+	 * @return The index of the ray with the closest hit and its distance, or
+	 *         no hit
+	 */
+	BatchHitResult raysSphereIntersect(Vec3SoA<float const> const& rayStarts, Vec3SoA<float const> const& rayDirs,
+	                                   float3 const& sphereOrigin, float sphereRadius, float maxDist,
+	                                   ::std::span<float> outDists);
+
+	/**
+	 * @brief Finds the closest AABB hit by a ray with the slab test, testing
+	 * four boxes at a time.
+	 *
+	 * A box that contains the start of the ray is hit at the start of the
+	 * ray.
+	 *
+	 * @param rayStart The starting point of the ray
+	 * @param rayDir The direction of the ray (does not need to be normalized)
+	 * @param mins The minimum corners of the boxes
+	 * @param maxs The maximum corners of the boxes, same size as the minimum
+	 *             corners
+	 * @param maxDist The maximum distance along the ray
+	 * @return The index of the closest box and the distance of the hit, or
+	 *         no hit
+	 */
+	BatchHitResult rayAABBsIntersect(float3 const& rayStart, float3 const& rayDir, Vec3SoA<float const> const& mins,
+	                                 Vec3SoA<float const> const& maxs, float maxDist);
+
+	/**
+	 * @brief Like raysSphereIntersect(), but intersects the rays with an
+	 * AABB.
+	 *
+	 * @param rayStarts The starting points of the rays
+	 * @param rayDirs The directions of the rays, same size as the starting
+	 *                points
+	 * @param min The minimum corner of the AABB
+	 * @param max The maximum corner of the AABB
+	 * @param maxDist The maximum distance along the rays
+	 * @param[out] outDists The distance of the hit of each ray, or infinity
+	 *                      if the ray misses the box. Same size as the rays
+	 * @return The index of the ray with the closest hit and its distance, or
+	 *         no hit
+	 */
+	BatchHitResult raysAABBIntersect(Vec3SoA<float const> const& rayStarts, Vec3SoA<float const> const& rayDirs,
+	                                 float3 const& min, float3 const& max, float maxDist, ::std::span<float> outDists);
+
+	/**
+	 * @brief Returns the hit of a ray with a sphere at the given distance,
+	 * e.g. the one found by raySpheresIntersect().
+	 *
+	 * @param rayStart The starting point of the ray
+	 * @param rayDir The direction of the ray
+	 * @param dist The distance of the hit along the ray
+	 * @param sphereOrigin The position of the center of the sphere
+	 * @param sphereRadius The radius of the sphere
+	 * @return The hit, with the normal pointing out of the sphere
+	 */
+	HitResult getRaySphereHit(float3 const& rayStart, float3 const& rayDir, float dist, float3 const& sphereOrigin,
+	                          float sphereRadius);
+
+	/**
+	 * @brief Returns the hit of a ray with an AABB at the given distance,
+	 * e.g. the one found by rayAABBsIntersect().
+	 *
+	 * @param rayStart The starting point of the ray
+	 * @param rayDir The direction of the ray
+	 * @param dist The distance of the hit along the ray
+	 * @param min The minimum corner of the AABB
+	 * @param max The maximum corner of the AABB
+	 * @return The hit, with the normal of the face closest to the hit. If the
+	 *         ray starts inside the box, the normal faces the ray
+	 */
+	HitResult getRayAABBHit(float3 const& rayStart, float3 const& rayDir, float dist, float3 const& min,
+	                        float3 const& max);
+
+	/**
+	 * @brief Computes the first intersection between a ray and the terrain
+	 * described by the density field.
+	 *
+	 * The ray marches the chunk grid, then the voxel grid of each chunk with
+	 * a 3D-DDA, and evaluates the density at the voxel boundaries. Chunks
+	 * and voxels in which the density cannot change sign, according to the
+	 * bound of its gradient, are skipped. The zero crossing is refined with
+	 * bisection. Like the generated mesh, features smaller than a voxel may
+	 * be missed.
+	 *
+	 * @param field The density field of the terrain
+	 * @param rayStart The starting point of the ray
+	 * @param rayDir The direction of the ray (does not need to be normalized)
+	 * @param maxDist The maximum distance along the ray
+	 * @return The first hit, with the normal computed from the analytic
+	 *         gradient of the density. If the ray starts inside the terrain,
+	 *         the hit is at the start of the ray
+	 */
+	HitResult raycastTerrain(DensityField const& field, float3 const& rayStart, float3 const& rayDir, float maxDist);
+
 	/**
 	 * @brief This method tests if a sphere overlaps with the given camera
 	 * frustum.
 	 *
-	 * @param frustum The frustum matrix
+	 * Extracts the frustum planes on every call, use Frustum to test many
+	 * spheres.
+	 *
+	 * @param frustum The view-projection matrix, see Frustum
 	 * @param origin The position of center of the sphere
 	 * @param radius The radius of the sphere. If not specified, the default
 	 *               value is zero
@@ -93,13 +506,27 @@ namespace VaporWorldVR
 	 * @brief This method tests if a AABB object overlaps with the given camera
 	 * frustum.
 	 *
-	 * The box overlaps if at least one of its vertices overlaps.
+	 * Extracts the frustum planes on every call, use Frustum to test many
+	 * boxes.
 	 *
-	 * @param frustum The frustum matrix
+	 * @param frustum The view-projection matrix, see Frustum
 	 * @param min The first corner of the AABB to test
 	 * @param max The second corner of the AABB to test
 	 * @return true if the AABB overlaps with the frustum
 	 * @return false otherwise
 	 */
 	bool frustumAABBOverlapTest(float4x4 const& frustum, float3 const& min, float3 const& max);
+
+	/**
+	 * @brief Computes the contact between two spheres.
+	 *
+	 * @param centerA The center of the first sphere
+	 * @param radiusA The radius of the first sphere
+	 * @param centerB The center of the second sphere
+	 * @param radiusB The radius of the second sphere
+	 * @return The contact, or no contact. The contact point is on the
+	 *         surface of the second sphere, and the normal points towards
+	 *         the first one
+	 */
+	ContactResult overlapSphereSphere(float3 const& centerA, float radiusA, float3 const& centerB, float radiusB);
 } // namespace VaporWorldVR
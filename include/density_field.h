@@ -0,0 +1,301 @@
+#pragma once
+
+#include <math.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "math/vec3.h"
+#include "math/packet.h"
+
+
+namespace VaporWorldVR
+{
+	/**
+	 * @brief A 3D texture of noise values, sampled on the CPU like a GL_R32F
+	 * texture with linear filtering and repeat wrapping.
+	 *
+	 * Texels are stored in the GL order, i.e. X is the fastest changing
+	 * coordinate, such that the same data can be uploaded to the GPU.
+	 */
+	struct NoiseTexture
+	{
+		/* The resolution of the texture. */
+		uint3 resolution;
+
+		/* The texel values. */
+		::std::vector<float> texels;
+
+		/**
+		 * @brief Returns the filtered value of the texture at the given
+		 * texture coordinates, like texture() in GLSL.
+		 *
+		 * @param uvw The normalized texture coordinates
+		 * @param[out] outGradient If not null, the gradient of the value
+		 *                         with respect to the texture coordinates
+		 * @return The filtered value
+		 */
+		float sample(float3 const& uvw, float3* outGradient = nullptr) const;
+
+		/**
+		 * @brief Like sample(), but samples a packet of coordinates. The
+		 * texels are gathered lane by lane, and filtered for all lanes at
+		 * once.
+		 *
+		 * @tparam N The number of lanes, 4 or 8
+		 * @param uvw The normalized texture coordinates
+		 * @param[out] outGradient If not null, the gradient of the values
+		 * @return The filtered values
+		 */
+		template<int N>
+		Math::Packet<float, N> sample_Packet(Math::Packet<float3, N> const& uvw,
+		                                     Math::Packet<float3, N>* outGradient = nullptr) const;
+	};
+
+
+	/**
+	 * @brief The density field of the terrain, and the grid of chunks and
+	 * voxels in which it is polygonized.
+	 *
+	 * The density is positive inside the terrain and negative outside. It
+	 * is the same function evaluated by the chunk generation compute
+	 * shader: a sum of octaves of noise, each sampled from a noise texture,
+	 * minus the height.
+	 */
+	class DensityField
+	{
+	public:
+		/* The number of octaves of noise. */
+		static constexpr uint32_t numOctaves = 3;
+
+		/* The scale of the position and the weight of each octave. */
+		/// @{
+		static constexpr float octaveScales[numOctaves] = {0.007f, 0.05f, 0.25f};
+		static constexpr float octaveWeights[numOctaves] = {0.2f, 0.3f, 0.5f};
+		/// @}
+
+		/**
+		 * @brief Constructs a field with no noise, i.e. a flat terrain.
+		 *
+		 * @param inGridOrigin The origin of the chunk grid
+		 * @param inChunkSize The size of a chunk
+		 * @param inChunkResolution The number of voxels along each side of a
+		 *                          chunk
+		 */
+		DensityField(float3 const& inGridOrigin, float inChunkSize, uint32_t inChunkResolution);
+
+		/**
+		 * @brief Generates the noise textures, with Perlin noise.
+		 *
+		 * The random generator of the C library is used, seed it with srand()
+		 * to get a deterministic field.
+		 *
+		 * @param textureRes The resolution of the noise textures
+		 */
+		void initNoiseTextures(uint3 const& textureRes);
+
+		/**
+		 * @brief Returns the noise texture of the given octave.
+		 */
+		FORCE_INLINE NoiseTexture const& getNoiseTexture(uint32_t octave) const
+		{
+			return noiseTextures[octave];
+		}
+
+		/**
+		 * @brief Returns the origin of the chunk grid.
+		 */
+		FORCE_INLINE float3 const& getGridOrigin() const
+		{
+			return gridOrigin;
+		}
+
+		/**
+		 * @brief Returns the size of a chunk.
+		 */
+		FORCE_INLINE float getChunkSize() const
+		{
+			return chunkSize;
+		}
+
+		/**
+		 * @brief Returns the number of voxels along each side of a chunk.
+		 */
+		FORCE_INLINE uint32_t getChunkResolution() const
+		{
+			return chunkResolution;
+		}
+
+		/**
+		 * @brief Returns the size of a voxel.
+		 */
+		FORCE_INLINE float getVoxelSize() const
+		{
+			return chunkSize / chunkResolution;
+		}
+
+		/**
+		 * @brief Returns the range of heights in which the surface may be.
+		 * The field is solid below and empty above.
+		 *
+		 * @param[out] outMinHeight The minimum height of the surface
+		 * @param[out] outMaxHeight The maximum height of the surface
+		 */
+		FORCE_INLINE void getSurfaceHeightRange(float& outMinHeight, float& outMaxHeight) const
+		{
+			outMinHeight = minSurfaceHeight;
+			outMaxHeight = maxSurfaceHeight;
+		}
+
+		/**
+		 * @brief Returns an upper bound of the length of the gradient of the
+		 * density, i.e. the density changes by at most this much per unit of
+		 * distance.
+		 */
+		FORCE_INLINE float getMaxGradient() const
+		{
+			return maxGradient;
+		}
+
+		/**
+		 * @brief Returns the density at the given position, the same as
+		 * sampleDensity() in the chunk generation compute shader.
+		 *
+		 * @param pos The position in world space
+		 * @param[out] outGradient If not null, the analytic gradient of the
+		 *                         density
+		 * @return The density
+		 */
+		float sample(float3 const& pos, float3* outGradient = nullptr) const;
+
+		/**
+		 * @brief Like sample(), but samples a packet of positions.
+		 *
+		 * @tparam N The number of lanes, 4 or 8
+		 * @param pos The positions in world space
+		 * @param[out] outGradient If not null, the analytic gradients
+		 * @return The densities
+		 */
+		template<int N>
+		Math::Packet<float, N> sample_Packet(Math::Packet<float3, N> const& pos,
+		                                     Math::Packet<float3, N>* outGradient = nullptr) const;
+
+		/**
+		 * @brief Returns the index of the chunk that contains the given
+		 * position.
+		 */
+		FORCE_INLINE int3 getChunkIndex(float3 const& pos) const
+		{
+			float3 const chunkPos = (pos - gridOrigin) / chunkSize;
+			return {static_cast<int>(floorf(chunkPos.x)), static_cast<int>(floorf(chunkPos.y)),
+			        static_cast<int>(floorf(chunkPos.z))};
+		}
+
+	protected:
+		/* The noise textures, one per octave. */
+		NoiseTexture noiseTextures[numOctaves];
+
+		/* The origin of the chunk grid. */
+		float3 gridOrigin;
+
+		/* The size of a chunk. */
+		float chunkSize;
+
+		/* The number of voxels along each side of a chunk. */
+		uint32_t chunkResolution;
+
+		/* The range of heights in which the surface may be. */
+		/// @{
+		float minSurfaceHeight;
+		float maxSurfaceHeight;
+		/// @}
+
+		/* An upper bound of the length of the gradient. */
+		float maxGradient;
+	};
+
+
+	/**
+	 * @brief A cache of the density of a field, sampled on a coarse grid
+	 * in each chunk.
+	 *
+	 * The cached density is interpolated between the grid points, and is
+	 * only used to bound the distance from the surface, e.g. to reject or
+	 * step queries far from the terrain without evaluating the octaves of
+	 * noise. Chunks are added with prepare(); lookups are read-only, so
+	 * that queries can run in parallel.
+	 */
+	class DensityGridCache
+	{
+	public:
+		/* The number of cells along each side of a chunk. */
+		static constexpr uint32_t cellsPerChunk = 8;
+
+		/**
+		 * @brief Constructs an empty cache of the given field.
+		 *
+		 * @param inField The density field, must outlive the cache
+		 */
+		explicit DensityGridCache(DensityField const& inField);
+
+		/**
+		 * @brief Samples the chunks that overlap the given box and are not
+		 * cached yet. Chunks are sampled in parallel.
+		 *
+		 * @param min The minimum corner of the box
+		 * @param max The maximum corner of the box
+		 */
+		void prepare(float3 const& min, float3 const& max);
+
+		/**
+		 * @brief Removes all chunks from the cache.
+		 */
+		void clear();
+
+		/**
+		 * @brief Returns the number of cached chunks.
+		 */
+		FORCE_INLINE size_t getNumChunks() const
+		{
+			return chunks.size();
+		}
+
+		/**
+		 * @brief Returns the field of the cache.
+		 */
+		FORCE_INLINE DensityField const& getField() const
+		{
+			return field;
+		}
+
+		/**
+		 * @brief Returns a lower bound of the distance of the given position
+		 * from the surface, if the chunk that contains it is cached.
+		 *
+		 * The interpolated density differs from the actual one by at most the
+		 * bound of the gradient times the diagonal of a cell, which is
+		 * subtracted from the distance.
+		 *
+		 * @param pos The position in world space
+		 * @param[out] outDist A lower bound of the distance, negative or zero
+		 *                     if the position may be inside the terrain
+		 * @return true if the chunk is cached, false otherwise
+		 */
+		bool getDistanceLowerBound(float3 const& pos, float& outDist) const;
+
+	protected:
+		/* Returns the key of the chunk with the given index. */
+		static FORCE_INLINE uint64_t getChunkKey(int3 const& chunkIdx)
+		{
+			return (static_cast<uint64_t>(chunkIdx.x & 0x1fffff) << 42)
+			     | (static_cast<uint64_t>(chunkIdx.y & 0x1fffff) << 21) | static_cast<uint64_t>(chunkIdx.z & 0x1fffff);
+		}
+
+		/* The field of the cache. */
+		DensityField const& field;
+
+		/* The densities at the grid points of each chunk, X is the fastest
+		   changing coordinate. */
+		::std::unordered_map<uint64_t, ::std::vector<float>> chunks;
+	};
+} // namespace VaporWorldVR
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+
+#include "core_types.h"
+
+
+namespace VaporWorldVR
+{
+	/**
+	 * @brief Blocks the calling thread while the given atomic holds the
+	 * expected value, until another thread calls futexWake() on it.
+	 *
+	 * The value is compared atomically with going to sleep, so a wake that
+	 * follows a change of the value is never missed. The thread may also
+	 * wake up spuriously, hence callers must check their condition again.
+	 *
+	 * @param value The atomic to wait on
+	 * @param expected The value for which the thread sleeps
+	 * @param timeoutNs The maximum time to sleep, in nanoseconds, or a
+	 *                  negative value to sleep indefinitely
+	 * @return false if the timeout expired, true otherwise
+	 */
+	bool futexWait(::std::atomic<uint32_t>& value, uint32_t expected, int64_t timeoutNs = -1);
+
+	/**
+	 * @brief Wakes up threads sleeping in futexWait() on the given atomic.
+	 *
+	 * @param value The atomic the threads are waiting on
+	 * @param wakeAll If true, wakes up all threads, otherwise only one
+	 */
+	void futexWake(::std::atomic<uint32_t>& value, bool wakeAll = true);
+} // namespace VaporWorldVR
@@ -2,11 +2,63 @@
 
 #include <unistd.h>
 
-#include <android/log.h>
+#if defined(__ANDROID__)
+# include <android/log.h>
+#else
+# include <stdarg.h>
+# include <stdio.h>
+# include <stdlib.h>
+#endif
 
 #include "build.h"
 
 
+// ===========
+// Log backend
+// ===========
+#if defined(__ANDROID__)
+# define __VW_LOG_VERBOSE ANDROID_LOG_VERBOSE
+# define __VW_LOG_WARN ANDROID_LOG_WARN
+# define __VW_LOG_ERROR ANDROID_LOG_ERROR
+# define __VW_LOG_PRINT __android_log_print
+# define __VW_LOG_ASSERT __android_log_assert
+#else
+// Host shim, used to compile and test platform-independent code without the
+// Android NDK. Messages are printed to stderr.
+# define __VW_LOG_VERBOSE 2
+# define __VW_LOG_WARN 5
+# define __VW_LOG_ERROR 6
+# define __VW_LOG_PRINT ::VaporWorldVR::hostLogPrint
+# define __VW_LOG_ASSERT ::VaporWorldVR::hostLogAssert
+
+namespace VaporWorldVR
+{
+	inline int hostLogPrint(int verb, char const* tag, char const* fmt, ...)
+	{
+		static char const verbChars[] = "??VDIWEF";
+		va_list args;
+		va_start(args, fmt);
+		fprintf(stderr, "%c/%s: ", verbChars[verb & 0x7], tag);
+		int len = vfprintf(stderr, fmt, args);
+		fputc('\n', stderr);
+		va_end(args);
+		return len;
+	}
+
+	[[noreturn]] inline void hostLogAssert(char const* cond, char const* tag, char const* fmt, ...)
+	{
+		va_list args;
+		va_start(args, fmt);
+		fprintf(stderr, "F/%s: assertion '%s' failed: ", tag, cond);
+		vfprintf(stderr, fmt, args);
+		fputc('\n', stderr);
+		va_end(args);
+		abort();
+	}
+} // namespace VaporWorldVR
+#endif
+
+
 // ===============
 // Log definitions
 // ===============
@@ -14,23 +66,23 @@
 #define __VW_LOG_FMT(fmt) "[tid=%d] " fmt, gettid()
 
 #if VW_BUILD_DEBUG
-# define VW_LOG(verb, fmt, ...) __android_log_print(verb, __VW_ANDROID_LOG_TAG, __VW_LOG_FMT(fmt), ##__VA_ARGS__)
+# define VW_LOG(verb, fmt, ...) __VW_LOG_PRINT(verb, __VW_ANDROID_LOG_TAG, __VW_LOG_FMT(fmt), ##__VA_ARGS__)
 # define VW_LOG_IF(cond, verb, fmt, ...) (static_cast<bool>((cond))\
-                                          ? __android_log_print(verb, __VW_ANDROID_LOG_TAG, __VW_LOG_FMT(fmt),\
-                                                                ##__VA_ARGS__)\
+                                          ? __VW_LOG_PRINT(verb, __VW_ANDROID_LOG_TAG, __VW_LOG_FMT(fmt),\
+                                                           ##__VA_ARGS__)\
                                           : int(0))
 #else
-# define VW_LOG(verb, tag, fmt, ...)
-# define VW_LOG_IF(cond, verb, tag, fmt, ...)
+# define VW_LOG(verb, fmt, ...)
+# define VW_LOG_IF(cond, verb, fmt, ...)
 #endif
 
-# define VW_LOG_DEBUG(fmt, ...) VW_LOG(ANDROID_LOG_VERBOSE, fmt, ##__VA_ARGS__)
-# define VW_LOG_ERROR(fmt, ...) VW_LOG(ANDROID_LOG_ERROR, fmt, ##__VA_ARGS__)
-# define VW_LOG_WARN(fmt, ...) VW_LOG(ANDROID_LOG_WARN, fmt, ##__VA_ARGS__)
+# define VW_LOG_DEBUG(fmt, ...) VW_LOG(__VW_LOG_VERBOSE, fmt, ##__VA_ARGS__)
+# define VW_LOG_ERROR(fmt, ...) VW_LOG(__VW_LOG_ERROR, fmt, ##__VA_ARGS__)
+# define VW_LOG_WARN(fmt, ...) VW_LOG(__VW_LOG_WARN, fmt, ##__VA_ARGS__)
 
-#define VW_LOG_DEBUG_IF(cond, fmt, ...) VW_LOG_IF(cond, ANDROID_LOG_VERBOSE, fmt, ##__VA_ARGS__)
-#define VW_LOG_ERROR_IF(cond, fmt, ...) VW_LOG_IF(cond, ANDROID_LOG_ERROR, fmt, ##__VA_ARGS__)
-#define VW_LOG_WARN_IF(cond, fmt, ...) VW_LOG_IF(cond, ANDROID_LOG_WARN, fmt, ##__VA_ARGS__)
+#define VW_LOG_DEBUG_IF(cond, fmt, ...) VW_LOG_IF(cond, __VW_LOG_VERBOSE, fmt, ##__VA_ARGS__)
+#define VW_LOG_ERROR_IF(cond, fmt, ...) VW_LOG_IF(cond, __VW_LOG_ERROR, fmt, ##__VA_ARGS__)
+#define VW_LOG_WARN_IF(cond, fmt, ...) VW_LOG_IF(cond, __VW_LOG_WARN, fmt, ##__VA_ARGS__)
 
 
 // ==================
@@ -41,12 +93,12 @@
 #if VW_BUILD_DEBUG
 # define VW_ASSERTF(cond, fmt, ...) (static_cast<bool>((cond))\
                                      ? void(0)\
-                                     : __android_log_assert(#cond, __VW_ANDROID_LOG_TAG, __VW_ASSERT_FMT(fmt),\
-                                                            ##__VA_ARGS__));
+                                     : __VW_LOG_ASSERT(#cond, __VW_ANDROID_LOG_TAG, __VW_ASSERT_FMT(fmt),\
+                                                       ##__VA_ARGS__));
 # define VW_CHECKF(cond, fmt, ...) (static_cast<bool>((cond))\
                                     ? int(0)\
-                                    : __android_log_print(ANDROID_LOG_WARN, __VW_ANDROID_LOG_TAG, __VW_ASSERT_FMT(fmt),\
-                                                          ##__VA_ARGS__));
+                                    : __VW_LOG_PRINT(__VW_LOG_WARN, __VW_ANDROID_LOG_TAG, __VW_ASSERT_FMT(fmt),\
+                                                     ##__VA_ARGS__));
 # define VW_ASSERT(cond) VW_ASSERTF(cond, #cond)
 # define VW_CHECK(cond) VW_ASSERTF(cond, #cond)
 #else
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <type_traits>
+
+#include "mat4.h"
+#include "quat.h"
+#include "simd.h"
+
+
+namespace VaporWorldVR::Math
+{
+	/**
+	 * @brief Row-major 3x4 matrix that describes an affine transformation.
+	 *
+	 * The implicit last row is always <0, 0, 0, 1>, which makes this matrix
+	 * 25% smaller than a Mat4 and allows cheaper composition and inversion.
+	 * Use the explicit conversions to and from Mat4 to upload to the GPU.
+	 */
+	struct AffineMatrix
+	{
+		/* AffineMatrix static values. */
+		/// @{
+		static const AffineMatrix eye;
+		/// @}
+
+		/* Row vectors, the last column is the translation. */
+		Vec4<float> rows[3];
+
+		/**
+		 * @brief Constructs a new AffineMatrix that describes the identity
+		 * transformation.
+		 */
+		constexpr FORCE_INLINE AffineMatrix()
+			: rows{{1.f, 0.f, 0.f, 0.f},
+			       {0.f, 1.f, 0.f, 0.f},
+			       {0.f, 0.f, 1.f, 0.f}}
+		{}
+
+		/**
+		 * @brief Constructs a new AffineMatrix with the given values.
+		 *
+		 * @param a..l The values of the matrix
+		 */
+		constexpr FORCE_INLINE AffineMatrix(float a, float b, float c, float d,
+		                                    float e, float f, float g, float h,
+		                                    float i, float j, float k, float l)
+			: rows{{a, b, c, d},
+			       {e, f, g, h},
+			       {i, j, k, l}}
+		{}
+
+		/**
+		 * @brief Constructs a new AffineMatrix with the given row vectors.
+		 *
+		 * @param i,j,k The row vectors
+		 */
+		constexpr FORCE_INLINE AffineMatrix(Vec4<float> const& i, Vec4<float> const& j, Vec4<float> const& k)
+			: rows{i, j, k}
+		{}
+
+		/**
+		 * @brief Constructs a new AffineMatrix with the given translation and
+		 * no rotation nor scale.
+		 *
+		 * @param translation The given translation
+		 */
+		constexpr FORCE_INLINE explicit AffineMatrix(Vec3<float> const& translation)
+			: rows{{1.f, 0.f, 0.f, translation[0]},
+			       {0.f, 1.f, 0.f, translation[1]},
+			       {0.f, 0.f, 1.f, translation[2]}}
+		{}
+
+		/**
+		 * @brief Constructs a new AffineMatrix with the given translation,
+		 * rotation and scale. Scale is applied first, translation last.
+		 *
+		 * @param translation The given translation
+		 * @param rotation The given rotation
+		 * @param scale The given scale
+		 */
+		constexpr AffineMatrix(Vec3<float> const& translation, Quat const& rotation,
+		                       Vec3<float> const& scale = Vec3<float>::one)
+		{
+			float const rx2 = rotation.x * rotation.x,
+			            rxy = rotation.x * rotation.y,
+			            rxz = rotation.x * rotation.z,
+			            rxw = rotation.x * rotation.w,
+			            ry2 = rotation.y * rotation.y,
+			            ryz = rotation.y * rotation.z,
+			            ryw = rotation.y * rotation.w,
+			            rz2 = rotation.z * rotation.z,
+			            rzw = rotation.z * rotation.w;
+
+			rows[0] = {(1.f - 2.f * (ry2 + rz2)) * scale[0],
+			           2.f * (rxy - rzw) * scale[1],
+			           2.f * (rxz + ryw) * scale[2],
+			           translation[0]};
+			rows[1] = {2.f * (rxy + rzw) * scale[0],
+			           (1.f - 2.f * (rx2 + rz2)) * scale[1],
+			           2.f * (ryz - rxw) * scale[2],
+			           translation[1]};
+			rows[2] = {2.f * (rxz - ryw) * scale[0],
+			           2.f * (ryz + rxw) * scale[1],
+			           (1.f - 2.f * (rx2 + ry2)) * scale[2],
+			           translation[2]};
+		}
+
+		/**
+		 * @brief Constructs a new AffineMatrix from the first three rows of a
+		 * Mat4. The last row of the Mat4 is assumed to be <0, 0, 0, 1>.
+		 *
+		 * @param m A Mat4
+		 */
+		constexpr FORCE_INLINE explicit AffineMatrix(Mat4<float> const& m)
+			: rows{{m.data[0], m.data[1], m.data[2],  m.data[3]},
+			       {m.data[4], m.data[5], m.data[6],  m.data[7]},
+			       {m.data[8], m.data[9], m.data[10], m.data[11]}}
+		{}
+
+		/**
+		 * @brief Returns a Mat4 that describes the same transformation.
+		 */
+		constexpr FORCE_INLINE explicit operator Mat4<float>() const
+		{
+			return {rows[0][0], rows[0][1], rows[0][2], rows[0][3],
+			        rows[1][0], rows[1][1], rows[1][2], rows[1][3],
+			        rows[2][0], rows[2][1], rows[2][2], rows[2][3],
+			        0.f,        0.f,        0.f,        1.f};
+		}
+
+		/**
+		 * @brief Return a ref to the i-th row vector.
+		 *
+		 * @param idx Index of the row vector
+		 * @return Ref to i-th row vector
+		 * @{
+		 */
+		constexpr FORCE_INLINE Vec4<float>& operator[](int idx)
+		{
+			VW_CHECK(idx >= 0 && idx < 3);
+			return rows[idx];
+		}
+
+		constexpr FORCE_INLINE Vec4<float> const& operator[](int idx) const
+		{
+			return const_cast<AffineMatrix&>(*this)[idx];
+		}
+		/// @}
+
+		/**
+		 * @brief Returns the translation component of this transformation.
+		 */
+		constexpr FORCE_INLINE Vec3<float> getTranslation() const
+		{
+			return {rows[0][3], rows[1][3], rows[2][3]};
+		}
+
+		/**
+		 * @brief Sets the translation component of this transformation.
+		 *
+		 * @param translation The new translation component
+		 * @return Ref to self
+		 */
+		constexpr FORCE_INLINE AffineMatrix& setTranslation(Vec3<float> const& translation)
+		{
+			rows[0][3] = translation[0];
+			rows[1][3] = translation[1];
+			rows[2][3] = translation[2];
+			return *this;
+		}
+
+		/**
+		 * @brief Returns the scale component of this transformation, i.e. the
+		 * size of the columns of the linear part.
+		 */
+		constexpr Vec3<float> getScale() const
+		{
+			return {Vec3<float>{rows[0][0], rows[1][0], rows[2][0]}.getSize(),
+			        Vec3<float>{rows[0][1], rows[1][1], rows[2][1]}.getSize(),
+			        Vec3<float>{rows[0][2], rows[1][2], rows[2][2]}.getSize()};
+		}
+
+		/**
+		 * @brief Applies this transformation to a position vector.
+		 *
+		 * @param v The Vec3 to transform
+		 * @return M(v)
+		 */
+		constexpr FORCE_INLINE Vec3<float> transformPoint(Vec3<float> const& v) const
+		{
+			return {rows[0][0] * v[0] + rows[0][1] * v[1] + rows[0][2] * v[2] + rows[0][3],
+			        rows[1][0] * v[0] + rows[1][1] * v[1] + rows[1][2] * v[2] + rows[1][3],
+			        rows[2][0] * v[0] + rows[2][1] * v[1] + rows[2][2] * v[2] + rows[2][3]};
+		}
+
+		/**
+		 * @brief Applies this transformation to a direction vector, which is
+		 * not affected by the translation.
+		 *
+		 * @param v The Vec3 to transform
+		 * @return M(v)
+		 */
+		constexpr FORCE_INLINE Vec3<float> transformDirection(Vec3<float> const& v) const
+		{
+			return {rows[0][0] * v[0] + rows[0][1] * v[1] + rows[0][2] * v[2],
+			        rows[1][0] * v[0] + rows[1][1] * v[1] + rows[1][2] * v[2],
+			        rows[2][0] * v[0] + rows[2][1] * v[1] + rows[2][2] * v[2]};
+		}
+
+		/**
+		 * @brief Returns the composition of this transformation with another
+		 * transformation. The other transformation is applied first.
+		 *
+		 * @param other Another AffineMatrix
+		 * @return m dot n
+		 */
+		constexpr AffineMatrix dot(AffineMatrix const& other) const
+		{
+#if VW_MATH_SIMD
+			if (!::std::is_constant_evaluated())
+			{
+				// Each row of the result is a linear combination of the rows of
+				// the other matrix, plus the translation of this matrix
+				using namespace Simd;
+				Float32x4 const o0 = load(other.rows[0].coords), o1 = load(other.rows[1].coords),
+				                o2 = load(other.rows[2].coords), t = set(0.f, 0.f, 0.f, 1.f);
+
+				AffineMatrix result;
+				for (int i = 0; i < 3; ++i)
+				{
+					Float32x4 const r = load(rows[i].coords);
+					Float32x4 v = mul(r, t);
+					v = madd(broadcast<0>(r), o0, v);
+					v = madd(broadcast<1>(r), o1, v);
+					v = madd(broadcast<2>(r), o2, v);
+					store(result.rows[i].coords, v);
+				}
+				return result;
+			}
+#endif
+
+			AffineMatrix result;
+			for (int i = 0; i < 3; ++i)
+			{
+				for (int j = 0; j < 4; ++j)
+				{
+					result.rows[i][j] = rows[i][0] * other.rows[0][j]
+					                  + rows[i][1] * other.rows[1][j]
+					                  + rows[i][2] * other.rows[2][j]
+					                  + (j == 3 ? rows[i][3] : 0.f);
+				}
+			}
+			return result;
+		}
+
+		/**
+		 * @brief Invert this transformation in place.
+		 */
+		constexpr FORCE_INLINE AffineMatrix& invert()
+		{
+			return *this = !(*this);
+		}
+
+		/**
+		 * @brief Returns the inverse of this transformation.
+		 *
+		 * Works for any invertible affine transformation. Use
+		 * getInverseRigid() if the transformation has no scale nor shear.
+		 */
+		constexpr AffineMatrix operator!() const
+		{
+			// The columns of the inverse of the linear part are the cross
+			// products of its rows, divided by the determinant
+			Vec3<float> const r0{rows[0][0], rows[0][1], rows[0][2]},
+			                  r1{rows[1][0], rows[1][1], rows[1][2]},
+			                  r2{rows[2][0], rows[2][1], rows[2][2]};
+			Vec3<float> const c0 = r1.cross(r2), c1 = r2.cross(r0), c2 = r0.cross(r1);
+			float const invDet = 1.f / r0.dot(c0);
+
+			AffineMatrix inverse{c0[0] * invDet, c1[0] * invDet, c2[0] * invDet, 0.f,
+			                     c0[1] * invDet, c1[1] * invDet, c2[1] * invDet, 0.f,
+			                     c0[2] * invDet, c1[2] * invDet, c2[2] * invDet, 0.f};
+			return inverse.setTranslation(-inverse.transformDirection(getTranslation()));
+		}
+
+		/**
+		 * @brief Like invert(), but assumes that the linear part is a pure
+		 * rotation, i.e. an orthonormal matrix.
+		 */
+		constexpr FORCE_INLINE AffineMatrix& invertRigid()
+		{
+			return *this = getInverseRigid();
+		}
+
+		/**
+		 * @brief Like operator!(), but assumes that the linear part is a pure
+		 * rotation, i.e. an orthonormal matrix. The inverse rotation is the
+		 * transposed rotation.
+		 */
+		constexpr AffineMatrix getInverseRigid() const
+		{
+			AffineMatrix inverse{rows[0][0], rows[1][0], rows[2][0], 0.f,
+			                     rows[0][1], rows[1][1], rows[2][1], 0.f,
+			                     rows[0][2], rows[1][2], rows[2][2], 0.f};
+			return inverse.setTranslation(-inverse.transformDirection(getTranslation()));
+		}
+	};
+
+
+	// ==========================
+	// AffineMatrix static values
+	// ==========================
+	inline constexpr AffineMatrix AffineMatrix::eye = {};
+} // namespace VaporWorldVR::Math
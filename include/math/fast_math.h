@@ -0,0 +1,288 @@
+#pragma once
+
+#include <bit>
+#include <limits>
+#include <type_traits>
+
+#include "core_types.h"
+
+
+/* Polynomial approximations of the transcendental functions, adapted from
+   the Cephes single-precision library. The functions are branch-free, all
+   paths are evaluated and the result is selected with bit masks, so that
+   loops that call them can be vectorized. They can also be evaluated in
+   constant expressions.
+
+   Error bounds are measured against the double-precision libm result over
+   the documented domain; outside of it, the result is undefined. */
+namespace VaporWorldVR::Math::Fast
+{
+	namespace Impl
+	{
+		/* Constants used for range reduction, pi/4 is split in three parts so
+		   that the reduction is exact for the first part. */
+		/// @{
+		constexpr float pi = 3.14159265358979f;
+		constexpr float halfPi = 1.57079632679490f;
+		constexpr float quarterPi = 0.785398163397448f;
+		constexpr float fourOverPi = 1.27323954473516f;
+		constexpr float quarterPi0 = 0.78515625f;
+		constexpr float quarterPi1 = 2.4187564849853515625e-4f;
+		constexpr float quarterPi2 = 3.77489497744594108e-8f;
+		/// @}
+
+		/* Sign bit of a single-precision float. */
+		constexpr uint32_t signBit = 0x80000000u;
+
+		/* Returns a mask with all bits set if the condition is true. */
+		constexpr FORCE_INLINE uint32_t toMask(bool cond)
+		{
+			return 0u - static_cast<uint32_t>(cond);
+		}
+
+		/* Returns the first value where the mask is set, the second
+		   otherwise. */
+		constexpr FORCE_INLINE float select(uint32_t mask, float a, float b)
+		{
+			return ::std::bit_cast<float>((::std::bit_cast<uint32_t>(a) & mask)
+			                            | (::std::bit_cast<uint32_t>(b) & ~mask));
+		}
+
+		/* Returns the sign bit of the value. */
+		constexpr FORCE_INLINE uint32_t getSign(float x)
+		{
+			return ::std::bit_cast<uint32_t>(x) & signBit;
+		}
+
+		/* Flips the sign of the value if the sign bit is set. */
+		constexpr FORCE_INLINE float flipSign(float x, uint32_t sign)
+		{
+			return ::std::bit_cast<float>(::std::bit_cast<uint32_t>(x) ^ sign);
+		}
+
+		constexpr FORCE_INLINE float abs(float x)
+		{
+			return ::std::bit_cast<float>(::std::bit_cast<uint32_t>(x) & ~signBit);
+		}
+
+		/* Minimax polynomials of sin(x) and cos(x) in [-pi/4, pi/4]. */
+		/// @{
+		constexpr FORCE_INLINE float sinPoly(float x, float x2)
+		{
+			return ((-1.9515295891e-4f * x2 + 8.3321608736e-3f) * x2 - 1.6666654611e-1f) * x2 * x + x;
+		}
+
+		constexpr FORCE_INLINE float cosPoly(float x2)
+		{
+			return ((2.443315711809948e-5f * x2 - 1.388731625493765e-3f) * x2 + 4.166664568298827e-2f) * x2 * x2
+			     - 0.5f * x2 + 1.f;
+		}
+		/// @}
+
+		/**
+		 * @brief Reduces the argument to [-pi/4, pi/4].
+		 *
+		 * @param x The absolute value of the angle
+		 * @param[out] octant The octant of the angle, always even
+		 * @return The reduced angle
+		 */
+		constexpr FORCE_INLINE float reduceAngle(float x, uint32_t& octant)
+		{
+			int32_t j = static_cast<int32_t>(x * fourOverPi);
+			j = (j + 1) & ~1;
+			float const y = static_cast<float>(j);
+			octant = static_cast<uint32_t>(j);
+			return ((x - y * quarterPi0) - y * quarterPi1) - y * quarterPi2;
+		}
+
+		/* Minimax polynomial of atan(x) in [-tan(pi/8), tan(pi/8)]. */
+		constexpr FORCE_INLINE float atanPoly(float x)
+		{
+			float const x2 = x * x;
+			return (((8.05374449538e-2f * x2 - 1.38776856032e-1f) * x2 + 1.99777106478e-1f) * x2
+			        - 3.33329491539e-1f) * x2 * x + x;
+		}
+
+		/* Minimax polynomial of asin(x) in [-0.5, 0.5]. */
+		constexpr FORCE_INLINE float asinPoly(float x)
+		{
+			float const x2 = x * x;
+			return ((((4.2163199048e-2f * x2 + 2.4181311049e-2f) * x2 + 4.5470025998e-2f) * x2
+			         + 7.4953002686e-2f) * x2 + 1.6666752422e-1f) * x2 * x + x;
+		}
+	} // namespace Impl
+
+
+	/**
+	 * @brief The largest absolute angle (in radians) that sin(), cos(),
+	 * sincos() and tan() can reduce.
+	 */
+	constexpr float maxTrigAngle = 8192.f;
+
+	/**
+	 * @brief Returns true if the angle can be passed to the trigonometric
+	 * functions, false if it is too large, infinite or NaN.
+	 */
+	constexpr FORCE_INLINE bool isTrigAngle(float x)
+	{
+		return Impl::abs(x) <= maxTrigAngle;
+	}
+
+	/**
+	 * @brief Computes the square root of the given value.
+	 *
+	 * Error: at most 0.5 ULP (correctly rounded). At runtime, this is the
+	 * hardware instruction; in constant expressions, a few Newton iterations
+	 * in double precision.
+	 */
+	constexpr FORCE_INLINE float sqrt(float x)
+	{
+		if (!::std::is_constant_evaluated())
+			return __builtin_sqrtf(x);
+
+		if (!(x > 0.f) || x == x * 2.f)
+			// Zero, negative, NaN or infinity
+			return x == 0.f || x > 0.f ? x : ::std::numeric_limits<float>::quiet_NaN();
+
+		// Halve the exponent for the first guess, then refine
+		double g = ::std::bit_cast<float>((::std::bit_cast<uint32_t>(x) >> 1) + 0x1fbd1df5u);
+		for (int i = 0; i < 4; ++i)
+		{
+			g = 0.5 * (g + x / g);
+		}
+		return static_cast<float>(g);
+	}
+
+	/**
+	 * @brief Computes the sine of the given value (in radians).
+	 *
+	 * Error: at most 2 ULP for |x| <= 64, absolute error below 1e-7 for
+	 * |x| <= 8192.
+	 */
+	constexpr FORCE_INLINE float sin(float x)
+	{
+		uint32_t octant = 0;
+		float const r = Impl::reduceAngle(Impl::abs(x), octant);
+		float const r2 = r * r;
+
+		// sin(x + k * pi/2) is either +-sin(x) or +-cos(x)
+		float const y = Impl::select(Impl::toMask(octant & 2), Impl::cosPoly(r2), Impl::sinPoly(r, r2));
+		return Impl::flipSign(y, ((octant & 4) << 29) ^ Impl::getSign(x));
+	}
+
+	/**
+	 * @brief Computes the cosine of the given value (in radians).
+	 *
+	 * Error: at most 2 ULP for |x| <= 64, absolute error below 1e-7 for
+	 * |x| <= 8192.
+	 */
+	constexpr FORCE_INLINE float cos(float x)
+	{
+		uint32_t octant = 0;
+		float const r = Impl::reduceAngle(Impl::abs(x), octant);
+		float const r2 = r * r;
+
+		float const y = Impl::select(Impl::toMask(octant & 2), Impl::sinPoly(r, r2), Impl::cosPoly(r2));
+		return Impl::flipSign(y, ((octant + 2) & 4) << 29);
+	}
+
+	/**
+	 * @brief Computes the sine and cosine of the given value (in radians),
+	 * sharing the range reduction.
+	 *
+	 * Error: same as sin() and cos().
+	 */
+	constexpr FORCE_INLINE void sincos(float x, float& outSin, float& outCos)
+	{
+		uint32_t octant = 0;
+		float const r = Impl::reduceAngle(Impl::abs(x), octant);
+		float const r2 = r * r;
+		float const s = Impl::sinPoly(r, r2), c = Impl::cosPoly(r2);
+
+		uint32_t const swap = Impl::toMask(octant & 2);
+		outSin = Impl::flipSign(Impl::select(swap, c, s), ((octant & 4) << 29) ^ Impl::getSign(x));
+		outCos = Impl::flipSign(Impl::select(swap, s, c), ((octant + 2) & 4) << 29);
+	}
+
+	/**
+	 * @brief Computes the tangent of the given value (in radians).
+	 *
+	 * Error: at most 3 ULP for |x| <= 1.5.
+	 */
+	constexpr FORCE_INLINE float tan(float x)
+	{
+		float s = 0.f, c = 0.f;
+		sincos(x, s, c);
+		return s / c;
+	}
+
+	/**
+	 * @brief Computes the arctangent of the given value.
+	 *
+	 * Error: at most 3 ULP for all finite values.
+	 */
+	constexpr FORCE_INLINE float atan(float x)
+	{
+		// Reduce to [-tan(pi/8), tan(pi/8)], the divisor is never zero
+		float const a = Impl::abs(x);
+		uint32_t const large = Impl::toMask(a > 2.414213562373095f);
+		uint32_t const medium = Impl::toMask(a > 0.4142135623730950f) & ~large;
+		float const num = Impl::select(large, -1.f, Impl::select(medium, a - 1.f, a));
+		float const den = Impl::select(large, a, Impl::select(medium, a + 1.f, 1.f));
+		float const offset = Impl::select(large, Impl::halfPi, Impl::select(medium, Impl::quarterPi, 0.f));
+
+		float const y = offset + Impl::atanPoly(num / den);
+		return Impl::flipSign(y, Impl::getSign(x));
+	}
+
+	/**
+	 * @brief Computes the arctangent of y / x, using the signs of the
+	 * arguments to determine the quadrant.
+	 *
+	 * Error: at most 3 ULP for all finite values.
+	 */
+	constexpr FORCE_INLINE float atan2(float y, float x)
+	{
+		// If x is zero, the angle is vertical. If y is zero too, it is
+		// either +-0 or +-pi depending on the sign of x, like libm
+		uint32_t const vertical = Impl::toMask(x == 0.f);
+		float const a = atan(y / Impl::select(vertical, 1.f, x));
+		float const offset = Impl::select(Impl::toMask(x < 0.f), Impl::flipSign(Impl::pi, Impl::getSign(y)), 0.f);
+		float const origin = Impl::select(Impl::toMask(Impl::getSign(x) != 0u), Impl::pi, 0.f);
+		float const up = Impl::flipSign(Impl::select(Impl::toMask(y == 0.f), origin, Impl::halfPi), Impl::getSign(y));
+		return Impl::select(vertical, up, a + offset);
+	}
+
+	/**
+	 * @brief Computes the arcsine of the given value.
+	 *
+	 * Error: at most 2 ULP in [-1, 1].
+	 */
+	constexpr FORCE_INLINE float asin(float x)
+	{
+		// For |x| > 0.5, asin(x) = pi/2 - 2 * asin(sqrt((1 - x) / 2))
+		float const a = Impl::abs(x);
+		uint32_t const large = Impl::toMask(a > 0.5f);
+		float const p = Impl::asinPoly(Impl::select(large, sqrt(0.5f * (1.f - a)), a));
+
+		float const y = Impl::select(large, Impl::halfPi - 2.f * p, p);
+		return Impl::flipSign(y, Impl::getSign(x));
+	}
+
+	/**
+	 * @brief Computes the arccosine of the given value.
+	 *
+	 * Error: at most 1 ULP in [-1, 1].
+	 */
+	constexpr FORCE_INLINE float acos(float x)
+	{
+		// For |x| > 0.5, acos(x) = 2 * asin(sqrt((1 - |x|) / 2)), mirrored for
+		// negative values
+		float const a = Impl::abs(x);
+		uint32_t const large = Impl::toMask(a > 0.5f);
+		float const p = Impl::asinPoly(Impl::select(large, sqrt(0.5f * (1.f - a)), x));
+
+		float const mirrored = Impl::select(Impl::toMask(x < 0.f), Impl::pi - 2.f * p, 2.f * p);
+		return Impl::select(large, mirrored, Impl::halfPi - p);
+	}
+} // namespace VaporWorldVR::Math::Fast
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <type_traits>
+
 #include "vec4.h"
+#include "simd.h"
 
 
 namespace VaporWorldVR::Math
@@ -337,12 +340,163 @@ namespace VaporWorldVR::Math
 	};
 
 
+	// =========================
+	// Mat4 SIMD specialization
+	// =========================
+#if VW_MATH_SIMD
+	// The constant-evaluated paths only access the plain data array, which is
+	// the union member initialized by the element-wise constructors.
+	template<>
+	constexpr FORCE_INLINE Mat4<float> Mat4<float>::getTransposed() const
+	{
+		if (::std::is_constant_evaluated())
+		{
+			return {data[0], data[4], data[8],  data[12],
+			        data[1], data[5], data[9],  data[13],
+			        data[2], data[6], data[10], data[14],
+			        data[3], data[7], data[11], data[15]};
+		}
+
+		using namespace Simd;
+		Float32x4 const r0 = load(rows[0].coords), r1 = load(rows[1].coords),
+		                r2 = load(rows[2].coords), r3 = load(rows[3].coords);
+		Float32x4 const t0 = shuffle<0, 1, 0, 1>(r0, r1), t1 = shuffle<2, 3, 2, 3>(r0, r1),
+		                t2 = shuffle<0, 1, 0, 1>(r2, r3), t3 = shuffle<2, 3, 2, 3>(r2, r3);
+
+		Mat4<float> transposed;
+		store(transposed.rows[0].coords, shuffle<0, 2, 0, 2>(t0, t2));
+		store(transposed.rows[1].coords, shuffle<1, 3, 1, 3>(t0, t2));
+		store(transposed.rows[2].coords, shuffle<0, 2, 0, 2>(t1, t3));
+		store(transposed.rows[3].coords, shuffle<1, 3, 1, 3>(t1, t3));
+		return transposed;
+	}
+
+	template<>
+	constexpr FORCE_INLINE Mat4<float> Mat4<float>::dot(Mat4 const& other) const
+	{
+		if (::std::is_constant_evaluated())
+		{
+			Mat4<float> result;
+			for (int i = 0; i < 4; ++i)
+			{
+				for (int j = 0; j < 4; ++j)
+				{
+					for (int k = 0; k < 4; ++k)
+					{
+						result.data[i * 4 + j] += data[i * 4 + k] * other.data[k * 4 + j];
+					}
+				}
+			}
+			return result;
+		}
+
+		// Each row of the result is a linear combination of the rows of the
+		// other matrix, no need to transpose it
+		using namespace Simd;
+		Float32x4 const o0 = load(other.rows[0].coords), o1 = load(other.rows[1].coords),
+		                o2 = load(other.rows[2].coords), o3 = load(other.rows[3].coords);
+
+		Mat4<float> result;
+		for (int i = 0; i < 4; ++i)
+		{
+			Float32x4 const r = load(rows[i].coords);
+			Float32x4 v = mul(broadcast<0>(r), o0);
+			v = madd(broadcast<1>(r), o1, v);
+			v = madd(broadcast<2>(r), o2, v);
+			v = madd(broadcast<3>(r), o3, v);
+			store(result.rows[i].coords, v);
+		}
+		return result;
+	}
+
+	template<>
+	constexpr FORCE_INLINE Vec4<float> Mat4<float>::dot(Vec4<float> const& v) const
+	{
+		if (::std::is_constant_evaluated())
+		{
+			Vec4<float> result;
+			for (int i = 0; i < 4; ++i)
+			{
+				for (int k = 0; k < 4; ++k)
+				{
+					result.coords[i] += data[i * 4 + k] * v.coords[k];
+				}
+			}
+			return result;
+		}
+
+		using namespace Simd;
+		Float32x4 const u = load(v.coords);
+
+		Vec4<float> result;
+		store(result.coords, hsum(mul(load(rows[0].coords), u), mul(load(rows[1].coords), u),
+		                          mul(load(rows[2].coords), u), mul(load(rows[3].coords), u)));
+		return result;
+	}
+#endif
+
+
 	// ==================================
 	// Floating-point Mat4 specialization
 	// ==================================
 	template<>
 	constexpr FORCE_INLINE Mat4<float> Mat4<float>::operator!() const
 	{
+#if VW_MATH_SIMD
+		if (!::std::is_constant_evaluated())
+		{
+			// Block-wise inversion, where the matrix is split in four 2x2
+			// matrices A, B, C and D, each stored in a single register.
+			// https://lxjk.github.io/2017/09/03/Fast-4x4-Matrix-Inverse-with-SSE-SIMD-Explained.html
+			using namespace Simd;
+
+			// 2x2 matrix product, adjugate product and product with adjugate
+			auto const mat2Mul = [](Float32x4 u, Float32x4 v) {
+
+				return add(mul(u, swizzle<0, 3, 0, 3>(v)), mul(swizzle<1, 0, 3, 2>(u), swizzle<2, 1, 2, 1>(v)));
+			};
+			auto const mat2AdjMul = [](Float32x4 u, Float32x4 v) {
+
+				return sub(mul(swizzle<3, 3, 0, 0>(u), v), mul(swizzle<1, 1, 2, 2>(u), swizzle<2, 3, 0, 1>(v)));
+			};
+			auto const mat2MulAdj = [](Float32x4 u, Float32x4 v) {
+
+				return sub(mul(u, swizzle<3, 0, 3, 0>(v)), mul(swizzle<1, 0, 3, 2>(u), swizzle<2, 1, 2, 1>(v)));
+			};
+
+			Float32x4 const r0 = load(rows[0].coords), r1 = load(rows[1].coords),
+			                r2 = load(rows[2].coords), r3 = load(rows[3].coords);
+			Float32x4 const a = shuffle<0, 1, 0, 1>(r0, r1), b = shuffle<2, 3, 2, 3>(r0, r1),
+			                c = shuffle<0, 1, 0, 1>(r2, r3), d = shuffle<2, 3, 2, 3>(r2, r3);
+
+			// Determinants of the sub-matrices as <|A|, |B|, |C|, |D|>
+			Float32x4 const detSub = sub(mul(shuffle<0, 2, 0, 2>(r0, r2), shuffle<1, 3, 1, 3>(r1, r3)),
+			                             mul(shuffle<1, 3, 1, 3>(r0, r2), shuffle<0, 2, 0, 2>(r1, r3)));
+			Float32x4 const detA = broadcast<0>(detSub), detB = broadcast<1>(detSub),
+			                detC = broadcast<2>(detSub), detD = broadcast<3>(detSub);
+
+			Float32x4 const dc = mat2AdjMul(d, c), ab = mat2AdjMul(a, b);
+			Float32x4 const x = sub(mul(detD, a), mat2Mul(b, dc));
+			Float32x4 const w = sub(mul(detA, d), mat2Mul(c, ab));
+			Float32x4 const y = sub(mul(detB, c), mat2MulAdj(d, ab));
+			Float32x4 const z = sub(mul(detC, b), mat2MulAdj(a, dc));
+
+			// |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+			Float32x4 const tr = hsum(mul(ab, swizzle<0, 2, 1, 3>(dc)));
+			Float32x4 const detM = sub(add(mul(detA, detD), mul(detB, detC)), tr);
+			Float32x4 const invDetM = div(set(1.f, -1.f, -1.f, 1.f), detM);
+
+			Float32x4 const xs = mul(x, invDetM), ys = mul(y, invDetM), zs = mul(z, invDetM), ws = mul(w, invDetM);
+
+			Mat4<float> inverse;
+			store(inverse.rows[0].coords, shuffle<3, 1, 3, 1>(xs, ys));
+			store(inverse.rows[1].coords, shuffle<2, 0, 2, 0>(xs, ys));
+			store(inverse.rows[2].coords, shuffle<3, 1, 3, 1>(zs, ws));
+			store(inverse.rows[3].coords, shuffle<2, 0, 2, 0>(zs, ws));
+			return inverse;
+		}
+#endif
+
 		Mat4<float> compMatrix = getComplementsMatrix();
 		float invDet = 1.f / compMatrix[0].dot(rows[0]);
 		return compMatrix.transpose() * invDet;
@@ -358,7 +512,7 @@ namespace VaporWorldVR::Math
 
 
 	// ==================
-	// Vec4 static values
+	// Mat4 static values
 	// ==================
 	template<typename T>
 	constexpr Mat4<T> Mat4<T>::zero = {};
@@ -7,4 +7,9 @@
 #include "quat.h"
 #include "mat4.h"
 #include "transform.h"
+#include "affine.h"
+#include "packet.h"
+#include "packet_math.h"
+#include "packed.h"
+#include "morton.h"
 #include "vector_math.h"
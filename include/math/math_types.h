@@ -10,6 +10,14 @@ namespace VaporWorldVR::Math
 	template<typename T> struct Vec4;
 	                     struct Quat;
 	template<typename T> struct Mat4;
+	                     struct AffineMatrix;
+	                     struct Transform;
+	                     struct Half;
+	                     struct Half3;
+	                     struct OctNormal;
+	                     struct Unorm8x4;
+	                     struct Snorm16x4;
+	                     struct RGB10A2;
 } // namespace VaporWorld::Math
 
 
@@ -22,6 +30,7 @@ namespace VaporWorldVR
 	using float3   = Math::Vec3<float>;
 	using float4   = Math::Vec4<float>;
 	using float4x4 = Math::Mat4<float>;
+	using float3x4 = Math::AffineMatrix;
 
 	using int2   = Math::Vec2<int>;
 	using int3   = Math::Vec3<int>;
@@ -34,6 +43,13 @@ namespace VaporWorldVR
 	using uint4x4 = Math::Mat4<uint32_t>;
 
 	using quat = Math::Quat;
+
+	using half      = Math::Half;
+	using half3     = Math::Half3;
+	using octnormal = Math::OctNormal;
+	using unorm8x4  = Math::Unorm8x4;
+	using snorm16x4 = Math::Snorm16x4;
+	using rgb10a2   = Math::RGB10A2;
 } // namespace VaporWorld
 
 
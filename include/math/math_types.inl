@@ -2,64 +2,160 @@
 # define VW_MATH_USE_GCEM 1
 #endif
 
+#ifndef VW_MATH_USE_FAST_MATH
+# define VW_MATH_USE_FAST_MATH 1
+#endif
+
+#include <math.h>
+#include <type_traits>
+
 #if VW_MATH_USE_GCEM
 # include "gcem.hpp"
+#endif
+#include "fast_math.h"
+
+/* Single-precision functions used in constant expressions, gcem is accurate
+   but slow, the polynomials in fast_math.h are used if gcem is disabled. */
+#if VW_MATH_USE_GCEM
+# define VW_MATH_CONSTEVAL_FN(gcemFn, fastFn) ::gcem::gcemFn
+#else
+# define VW_MATH_CONSTEVAL_FN(gcemFn, fastFn) Fast::fastFn
+#endif
+
+/* Single-precision functions used at runtime, the polynomials in fast_math.h
+   trade a couple of ULPs for speed and vectorization. */
+#if VW_MATH_USE_FAST_MATH
+# define VW_MATH_RUNTIME_FN(fastFn, libmFn) Fast::fastFn
+#else
+# define VW_MATH_RUNTIME_FN(fastFn, libmFn) ::libmFn
+#endif
+
+/* True if the angle is within the domain of the trigonometric polynomials,
+   larger angles, infinities and NaNs fall back to libm. */
+#if VW_MATH_USE_FAST_MATH
+# define VW_MATH_TRIG_ANGLE(x) Fast::isTrigAngle(x)
 #else
-# include <math.h>
+# define VW_MATH_TRIG_ANGLE(x) true
 #endif
 
 
 namespace VaporWorldVR::Math
 {
+	/* Double-precision functions always use libm at runtime. They can only be
+	   constant-evaluated if gcem is enabled. */
 #if VW_MATH_USE_GCEM
+# define VW_MATH_DOUBLE_FN(gcemFn, libmFn, ...) \
+	(::std::is_constant_evaluated() ? ::gcem::gcemFn(__VA_ARGS__) : ::libmFn(__VA_ARGS__))
+#else
+# define VW_MATH_DOUBLE_FN(gcemFn, libmFn, ...) ::libmFn(__VA_ARGS__)
+#endif
+
 	/* Computes the sine of the given value (in radians). */
 	/// @{
-	constexpr FORCE_INLINE float sin(float x)   { return ::gcem::sin(x); }
-	constexpr FORCE_INLINE double sin(double x) { return ::gcem::sin(x); }
+	constexpr FORCE_INLINE float sin(float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(sin, sin)(x);
+		if (!VW_MATH_TRIG_ANGLE(x)) [[unlikely]]
+			return ::sinf(x);
+		return VW_MATH_RUNTIME_FN(sin, sinf)(x);
+	}
+
+	constexpr FORCE_INLINE double sin(double x) { return VW_MATH_DOUBLE_FN(sin, sin, x); }
 	/// @}
 
 	/* Computes the cosine of the given value (in radians). */
 	/// @{
-	constexpr FORCE_INLINE float cos(float x)   { return ::gcem::cos(x); }
-	constexpr FORCE_INLINE double cos(double x) { return ::gcem::cos(x); }
+	constexpr FORCE_INLINE float cos(float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(cos, cos)(x);
+		if (!VW_MATH_TRIG_ANGLE(x)) [[unlikely]]
+			return ::cosf(x);
+		return VW_MATH_RUNTIME_FN(cos, cosf)(x);
+	}
+
+	constexpr FORCE_INLINE double cos(double x) { return VW_MATH_DOUBLE_FN(cos, cos, x); }
 	/// @}
 
 	/* Computes the tangent of the given value (in radians). */
 	/// @{
-	constexpr FORCE_INLINE float tan(float x)   { return ::gcem::tan(x); }
-	constexpr FORCE_INLINE double tan(double x) { return ::gcem::tan(x); }
+	constexpr FORCE_INLINE float tan(float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(tan, tan)(x);
+		if (!VW_MATH_TRIG_ANGLE(x)) [[unlikely]]
+			return ::tanf(x);
+		return VW_MATH_RUNTIME_FN(tan, tanf)(x);
+	}
+
+	constexpr FORCE_INLINE double tan(double x) { return VW_MATH_DOUBLE_FN(tan, tan, x); }
 	/// @}
 
 	/* Computes the arcsine of the given value. */
 	/// @{
-	constexpr FORCE_INLINE float asin(float x)   { return ::gcem::asin(x); }
-	constexpr FORCE_INLINE double asin(double x) { return ::gcem::asin(x); }
+	constexpr FORCE_INLINE float asin(float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(asin, asin)(x);
+		return VW_MATH_RUNTIME_FN(asin, asinf)(x);
+	}
+
+	constexpr FORCE_INLINE double asin(double x) { return VW_MATH_DOUBLE_FN(asin, asin, x); }
 	/// @}
 
 	/* Computes the arccosine of the given value. */
 	/// @{
-	constexpr FORCE_INLINE float acos(float x)   { return ::gcem::acos(x); }
-	constexpr FORCE_INLINE double acos(double x) { return ::gcem::acos(x); }
+	constexpr FORCE_INLINE float acos(float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(acos, acos)(x);
+		return VW_MATH_RUNTIME_FN(acos, acosf)(x);
+	}
+
+	constexpr FORCE_INLINE double acos(double x) { return VW_MATH_DOUBLE_FN(acos, acos, x); }
 	/// @}
 
 	/* Computes the arctangent of the given value. */
 	/// @{
-	constexpr FORCE_INLINE float atan(float x)   { return ::gcem::atan(x); }
-	constexpr FORCE_INLINE double atan(double x) { return ::gcem::atan(x); }
+	constexpr FORCE_INLINE float atan(float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(atan, atan)(x);
+		return VW_MATH_RUNTIME_FN(atan, atanf)(x);
+	}
+
+	constexpr FORCE_INLINE double atan(double x) { return VW_MATH_DOUBLE_FN(atan, atan, x); }
 	/// @}
 
 	/* Computes the arctangent from the sine and cosine of the angle. */
 	/// @{
-	constexpr FORCE_INLINE float atan(float y, float x)   { return ::gcem::atan2(y, x); }
-	constexpr FORCE_INLINE double atan(double y, double x) { return ::gcem::atan2(y, x); }
+	constexpr FORCE_INLINE float atan(float y, float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(atan2, atan2)(y, x);
+		return VW_MATH_RUNTIME_FN(atan2, atan2f)(y, x);
+	}
+
+	constexpr FORCE_INLINE double atan(double y, double x) { return VW_MATH_DOUBLE_FN(atan2, atan2, y, x); }
+
+	constexpr FORCE_INLINE float atan2(float y, float x)    { return atan(y, x); }
+	constexpr FORCE_INLINE double atan2(double y, double x) { return atan(y, x); }
 	/// @}
 
 	/* Computes the square root of the given value. */
 	/// @{
-	constexpr FORCE_INLINE float sqrt(float x)   { return ::gcem::sqrt(x); }
-	constexpr FORCE_INLINE double sqrt(double x) { return ::gcem::sqrt(x); }
+	constexpr FORCE_INLINE float sqrt(float x)
+	{
+		if (::std::is_constant_evaluated())
+			return VW_MATH_CONSTEVAL_FN(sqrt, sqrt)(x);
+		return Fast::sqrt(x);
+	}
+
+	constexpr FORCE_INLINE double sqrt(double x) { return VW_MATH_DOUBLE_FN(sqrt, sqrt, x); }
 	/// @}
-#endif
+
+#undef VW_MATH_DOUBLE_FN
 
 	/**
 	 * @brief Returns the inverse square root of the given value.
@@ -132,3 +228,7 @@ namespace VaporWorldVR::Math
 		return x + (y - x) * t;
 	}
 } // namespace VaporWorldVR::Math
+
+#undef VW_MATH_CONSTEVAL_FN
+#undef VW_MATH_RUNTIME_FN
+#undef VW_MATH_TRIG_ANGLE
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <type_traits>
+
+#include "vec3.h"
+
+
+#ifndef VW_MATH_USE_BMI2
+# if defined(__BMI2__)
+#  define VW_MATH_USE_BMI2 1
+# else
+#  define VW_MATH_USE_BMI2 0
+# endif
+#endif
+
+#if VW_MATH_USE_BMI2
+# include <immintrin.h>
+#endif
+
+
+/* Morton (Z-order) codes interleave the bits of the coordinates of a 3D
+   integer vector, so that vectors that are close in space are likely to be
+   close in the code order too. With 21 bits per coordinate, a code fits in
+   64 bits. */
+namespace VaporWorldVR::Math
+{
+	namespace Impl
+	{
+		/* Bits of the X coordinate in a Morton code, Y and Z are the same
+		   mask shifted by one and two bits. */
+		constexpr uint64_t mortonMaskX = 0x1249249249249249ull;
+
+		/* Number of bits and mask of each coordinate. */
+		/// @{
+		constexpr int mortonBits = 21;
+		constexpr uint32_t mortonCoordMask = (1u << mortonBits) - 1;
+		/// @}
+
+		/* Bias that maps the signed range to the unsigned range, preserving
+		   the order. */
+		constexpr int32_t mortonBias = 1 << (mortonBits - 1);
+
+		/* Spreads the lower 21 bits of the value, such that there are two
+		   zero bits between each bit. */
+		constexpr FORCE_INLINE uint64_t expandBits3(uint32_t v)
+		{
+#if VW_MATH_USE_BMI2
+			if (!::std::is_constant_evaluated())
+				return _pdep_u64(v, mortonMaskX);
+#endif
+
+			uint64_t x = v & mortonCoordMask;
+			x = (x | x << 32) & 0x001f00000000ffffull;
+			x = (x | x << 16) & 0x001f0000ff0000ffull;
+			x = (x | x << 8)  & 0x100f00f00f00f00full;
+			x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+			x = (x | x << 2)  & 0x1249249249249249ull;
+			return x;
+		}
+
+		/* Inverse of expandBits3(), gathers every third bit of the value. */
+		constexpr FORCE_INLINE uint32_t compactBits3(uint64_t v)
+		{
+#if VW_MATH_USE_BMI2
+			if (!::std::is_constant_evaluated())
+				return static_cast<uint32_t>(_pext_u64(v, mortonMaskX));
+#endif
+
+			uint64_t x = v & mortonMaskX;
+			x = (x | x >> 2)  & 0x10c30c30c30c30c3ull;
+			x = (x | x >> 4)  & 0x100f00f00f00f00full;
+			x = (x | x >> 8)  & 0x001f0000ff0000ffull;
+			x = (x | x >> 16) & 0x001f00000000ffffull;
+			x = (x | x >> 32) & mortonCoordMask;
+			return static_cast<uint32_t>(x);
+		}
+
+		/* The 64-bit finalizer of MurmurHash3, every input bit affects every
+		   output bit. */
+		constexpr FORCE_INLINE uint64_t mix64(uint64_t h)
+		{
+			h ^= h >> 33;
+			h *= 0xff51afd7ed558ccdull;
+			h ^= h >> 33;
+			h *= 0xc4ceb9fe1a85ec53ull;
+			h ^= h >> 33;
+			return h;
+		}
+	} // namespace Impl
+
+
+	/**
+	 * @brief Returns the Morton code of the given vector.
+	 *
+	 * Only the lower 21 bits of each coordinate are encoded. For signed
+	 * vectors, coordinates must be in [-2^20, 2^20); they are biased so that
+	 * the code order matches the unsigned order of the biased coordinates.
+	 *
+	 * @param v An integer vector
+	 * @return The Morton code
+	 * @{
+	 */
+	constexpr FORCE_INLINE uint64_t encodeMorton(Vec3<uint32_t> const& v)
+	{
+		return Impl::expandBits3(v[0]) | Impl::expandBits3(v[1]) << 1 | Impl::expandBits3(v[2]) << 2;
+	}
+
+	constexpr FORCE_INLINE uint64_t encodeMorton(Vec3<int> const& v)
+	{
+		return encodeMorton(Vec3<uint32_t>{static_cast<uint32_t>(v[0] + Impl::mortonBias),
+		                                   static_cast<uint32_t>(v[1] + Impl::mortonBias),
+		                                   static_cast<uint32_t>(v[2] + Impl::mortonBias)});
+	}
+	/// @}
+
+	/**
+	 * @brief Inverse of encodeMorton(), returns the unsigned vector encoded
+	 * in the given Morton code.
+	 *
+	 * @param code A Morton code
+	 * @return The encoded vector
+	 */
+	constexpr FORCE_INLINE Vec3<uint32_t> decodeMorton(uint64_t code)
+	{
+		return {Impl::compactBits3(code), Impl::compactBits3(code >> 1), Impl::compactBits3(code >> 2)};
+	}
+
+	/**
+	 * @brief Like decodeMorton(), but returns the signed vector, i.e. the
+	 * inverse of encodeMorton(Vec3<int>).
+	 *
+	 * @param code A Morton code
+	 * @return The encoded vector
+	 */
+	constexpr FORCE_INLINE Vec3<int> decodeMortonSigned(uint64_t code)
+	{
+		Vec3<uint32_t> const v = decodeMorton(code);
+		return {static_cast<int>(v[0]) - Impl::mortonBias, static_cast<int>(v[1]) - Impl::mortonBias,
+		        static_cast<int>(v[2]) - Impl::mortonBias};
+	}
+
+	/**
+	 * @brief Returns the Morton code of the vector offset by the given
+	 * delta, without decoding it. Each coordinate wraps around on overflow.
+	 *
+	 * Works for both unsigned and signed codes. If the delta is a constant,
+	 * the cost is a few bitwise operations, which makes neighbour lookups
+	 * cheap.
+	 *
+	 * @param code A Morton code
+	 * @param delta The offset, each coordinate in [-2^20, 2^20)
+	 * @return The Morton code of the offset vector
+	 */
+	constexpr FORCE_INLINE uint64_t offsetMorton(uint64_t code, Vec3<int> const& delta)
+	{
+		// The delta in two's complement, then add each coordinate in place:
+		// filling the gaps with ones carries across them
+		uint64_t const d = encodeMorton(Vec3<uint32_t>{static_cast<uint32_t>(delta[0]),
+		                                               static_cast<uint32_t>(delta[1]),
+		                                               static_cast<uint32_t>(delta[2])});
+		uint64_t result = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			uint64_t const mask = Impl::mortonMaskX << i;
+			result |= ((code | ~mask) + (d & mask)) & mask;
+		}
+		return result;
+	}
+
+	/**
+	 * @brief Returns a 64-bit hash of the given vector, suitable for open
+	 * addressing hash tables.
+	 *
+	 * All bits are well distributed, so the table size can be a power of two
+	 * and the index can be taken from the lowest bits.
+	 *
+	 * @param v An integer vector
+	 * @return The hash value
+	 * @{
+	 */
+	constexpr FORCE_INLINE uint64_t hash(Vec3<uint32_t> const& v)
+	{
+		// Odd multipliers are invertible, the finalizer spreads the bits
+		uint64_t const h = v[0] * 0x9e3779b97f4a7c15ull ^ v[1] * 0xc2b2ae3d27d4eb4full ^ v[2] * 0x165667b19e3779f9ull;
+		return Impl::mix64(h);
+	}
+
+	constexpr FORCE_INLINE uint64_t hash(Vec3<int> const& v)
+	{
+		return hash(Vec3<uint32_t>{static_cast<uint32_t>(v[0]), static_cast<uint32_t>(v[1]),
+		                           static_cast<uint32_t>(v[2])});
+	}
+	/// @}
+} // namespace VaporWorldVR::Math
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <bit>
+
+#include "fast_math.h"
+#include "vec3.h"
+#include "vec4.h"
+
+
+/* Compact encodings for vertex attributes. Each type matches a GLES 3 vertex
+   attribute format, noted in the type documentation, and converts to and
+   from the float vector types. Conversions are constexpr; batch converters
+   for large arrays are in pack_batch.h. */
+namespace VaporWorldVR::Math
+{
+	namespace Impl
+	{
+		/**
+		 * @brief Converts a float to the bits of the nearest half, rounding
+		 * ties to even. Values too large for a half become infinity,
+		 * NaN stays NaN.
+		 */
+		constexpr FORCE_INLINE uint16_t floatToHalf(float f)
+		{
+			// https://gist.github.com/rygorous/2156668
+			constexpr uint32_t f32Infinity = 255u << 23;
+			constexpr uint32_t f16Max = (127u + 16u) << 23;
+			constexpr uint32_t denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+			uint32_t bits = ::std::bit_cast<uint32_t>(f);
+			uint32_t const sign = bits & 0x80000000u;
+			bits ^= sign;
+
+			uint32_t out = 0;
+			if (bits >= f16Max)
+				// Infinity or NaN
+				out = bits > f32Infinity ? 0x7e00u : 0x7c00u;
+			else if (bits < (113u << 23))
+				// Subnormal half, let the float addition do the rounding
+				out = ::std::bit_cast<uint32_t>(::std::bit_cast<float>(bits) + ::std::bit_cast<float>(denormMagic))
+				    - denormMagic;
+			else
+			{
+				// Rebias the exponent and round the mantissa to nearest even
+				uint32_t const mantissaOdd = (bits >> 13) & 1u;
+				bits += ((15u - 127u) << 23) + 0xfffu + mantissaOdd;
+				out = bits >> 13;
+			}
+			return static_cast<uint16_t>(out | (sign >> 16));
+		}
+
+		/**
+		 * @brief Converts the bits of a half to a float, exactly.
+		 */
+		constexpr FORCE_INLINE float halfToFloat(uint16_t h)
+		{
+			// Rebias the exponent with a multiplication, which also
+			// normalizes subnormals
+			constexpr float magic = ::std::bit_cast<float>((254u - 15u) << 23);
+			constexpr float wasInfNaN = ::std::bit_cast<float>((127u + 16u) << 23);
+
+			float f = ::std::bit_cast<float>(static_cast<uint32_t>(h & 0x7fffu) << 13) * magic;
+			uint32_t bits = ::std::bit_cast<uint32_t>(f);
+			if (f >= wasInfNaN)
+				bits |= 255u << 23;
+			return ::std::bit_cast<float>(bits | (static_cast<uint32_t>(h & 0x8000u) << 16));
+		}
+
+		/**
+		 * @brief Clamps the value to [lo, hi], scales it and rounds it to the
+		 * nearest integer, ties away from zero.
+		 */
+		constexpr FORCE_INLINE int32_t quantize(float x, float lo, float hi, float scale)
+		{
+			x = x < lo ? lo : (x > hi ? hi : x);
+			return static_cast<int32_t>(x * scale + (x < 0.f ? -0.5f : 0.5f));
+		}
+
+		/* Returns 1 if the value is positive or zero, -1 otherwise. */
+		constexpr FORCE_INLINE float signNotZero(float x)
+		{
+			return x < 0.f ? -1.f : 1.f;
+		}
+	} // namespace Impl
+
+
+	/**
+	 * @brief IEEE 754 half-precision float, GL_HALF_FLOAT.
+	 *
+	 * Only storage and conversion are supported, convert to float for
+	 * arithmetic.
+	 */
+	struct Half
+	{
+		/* The encoded value. */
+		uint16_t bits;
+
+		/**
+		 * @brief Constructs a half equal to zero.
+		 */
+		constexpr FORCE_INLINE Half() : bits{0} {}
+
+		/**
+		 * @brief Constructs a half with the nearest value to the given float.
+		 *
+		 * @param f A float value
+		 */
+		constexpr FORCE_INLINE explicit Half(float f) : bits{Impl::floatToHalf(f)} {}
+
+		/**
+		 * @brief Returns a half with the given encoded value.
+		 *
+		 * @param bits The encoded value
+		 */
+		static constexpr FORCE_INLINE Half fromBits(uint16_t bits)
+		{
+			Half h;
+			h.bits = bits;
+			return h;
+		}
+
+		/**
+		 * @brief Returns the value of this half as a float, the conversion is
+		 * exact.
+		 */
+		constexpr FORCE_INLINE operator float() const
+		{
+			return Impl::halfToFloat(bits);
+		}
+	};
+
+
+	/**
+	 * @brief A vector of three halves, 3 x GL_HALF_FLOAT.
+	 */
+	struct Half3
+	{
+		/* Vector coordinates. */
+		Half x, y, z;
+
+		/**
+		 * @brief Constructs a zero vector.
+		 */
+		constexpr FORCE_INLINE Half3() = default;
+
+		/**
+		 * @brief Constructs a vector with the nearest values to the given
+		 * vector.
+		 *
+		 * @param v A Vec3
+		 */
+		constexpr FORCE_INLINE explicit Half3(Vec3<float> const& v) : x{v[0]}, y{v[1]}, z{v[2]} {}
+
+		/**
+		 * @brief Returns the vector as a Vec3, the conversion is exact.
+		 */
+		constexpr FORCE_INLINE operator Vec3<float>() const
+		{
+			return {x, y, z};
+		}
+	};
+
+
+	/**
+	 * @brief A unit vector encoded on the octahedron, 2 x GL_SHORT
+	 * normalized.
+	 *
+	 * The sphere is projected on the octahedron, whose lower half is folded
+	 * over the upper half, then flattened to the [-1, 1] square. The
+	 * maximum angular error is below 0.005 degrees.
+	 *
+	 * @see https://jcgt.org/published/0003/02/01/
+	 */
+	struct OctNormal
+	{
+		/* The coordinates on the square, as normalized integers. */
+		int16_t u, v;
+
+		/**
+		 * @brief Constructs the encoding of the up vector.
+		 */
+		constexpr FORCE_INLINE OctNormal() : u{0}, v{0} {}
+
+		/**
+		 * @brief Constructs the encoding of the given vector.
+		 *
+		 * @param n A unit vector
+		 */
+		constexpr explicit OctNormal(Vec3<float> const& n) : OctNormal{}
+		{
+			float const invL1 = 1.f / (Fast::Impl::abs(n[0]) + Fast::Impl::abs(n[1]) + Fast::Impl::abs(n[2]));
+			float x = n[0] * invL1, y = n[1] * invL1;
+			if (n[2] < 0.f)
+			{
+				// Fold the lower half
+				float const foldedX = (1.f - Fast::Impl::abs(y)) * Impl::signNotZero(x);
+				float const foldedY = (1.f - Fast::Impl::abs(x)) * Impl::signNotZero(y);
+				x = foldedX;
+				y = foldedY;
+			}
+			u = static_cast<int16_t>(Impl::quantize(x, -1.f, 1.f, 32767.f));
+			v = static_cast<int16_t>(Impl::quantize(y, -1.f, 1.f, 32767.f));
+		}
+
+		/**
+		 * @brief Returns the decoded unit vector.
+		 */
+		constexpr operator Vec3<float>() const
+		{
+			float x = Math::max(u / 32767.f, -1.f), y = Math::max(v / 32767.f, -1.f);
+			float const z = 1.f - Fast::Impl::abs(x) - Fast::Impl::abs(y);
+
+			// Unfold the lower half
+			float const t = Math::max(-z, 0.f);
+			x += x >= 0.f ? -t : t;
+			y += y >= 0.f ? -t : t;
+			return Vec3<float>{x, y, z}.getNormal();
+		}
+	};
+
+
+	/**
+	 * @brief Four values in [0, 1], 4 x GL_UNSIGNED_BYTE normalized. Used for
+	 * colors and occlusion.
+	 */
+	struct Unorm8x4
+	{
+		/* The coordinates, as normalized integers. */
+		uint8_t coords[4];
+
+		/**
+		 * @brief Constructs a zero vector.
+		 */
+		constexpr FORCE_INLINE Unorm8x4() : coords{} {}
+
+		/**
+		 * @brief Constructs the encoding of the given vector, coordinates are
+		 * clamped to [0, 1].
+		 *
+		 * @param v A Vec4
+		 */
+		constexpr FORCE_INLINE explicit Unorm8x4(Vec4<float> const& v)
+			: coords{static_cast<uint8_t>(Impl::quantize(v[0], 0.f, 1.f, 255.f)),
+			         static_cast<uint8_t>(Impl::quantize(v[1], 0.f, 1.f, 255.f)),
+			         static_cast<uint8_t>(Impl::quantize(v[2], 0.f, 1.f, 255.f)),
+			         static_cast<uint8_t>(Impl::quantize(v[3], 0.f, 1.f, 255.f))}
+		{}
+
+		/**
+		 * @brief Returns the decoded vector.
+		 */
+		constexpr FORCE_INLINE operator Vec4<float>() const
+		{
+			return {coords[0] / 255.f, coords[1] / 255.f, coords[2] / 255.f, coords[3] / 255.f};
+		}
+	};
+
+
+	/**
+	 * @brief Four values in [-1, 1], 4 x GL_SHORT normalized. Used for
+	 * tangents, with the handedness in W.
+	 */
+	struct Snorm16x4
+	{
+		/* The coordinates, as normalized integers. */
+		int16_t coords[4];
+
+		/**
+		 * @brief Constructs a zero vector.
+		 */
+		constexpr FORCE_INLINE Snorm16x4() : coords{} {}
+
+		/**
+		 * @brief Constructs the encoding of the given vector, coordinates are
+		 * clamped to [-1, 1].
+		 *
+		 * @param v A Vec4
+		 */
+		constexpr FORCE_INLINE explicit Snorm16x4(Vec4<float> const& v)
+			: coords{static_cast<int16_t>(Impl::quantize(v[0], -1.f, 1.f, 32767.f)),
+			         static_cast<int16_t>(Impl::quantize(v[1], -1.f, 1.f, 32767.f)),
+			         static_cast<int16_t>(Impl::quantize(v[2], -1.f, 1.f, 32767.f)),
+			         static_cast<int16_t>(Impl::quantize(v[3], -1.f, 1.f, 32767.f))}
+		{}
+
+		/**
+		 * @brief Returns the decoded vector. As in GLES 3, -32768 decodes to
+		 * -1 like -32767.
+		 */
+		constexpr FORCE_INLINE operator Vec4<float>() const
+		{
+			return {Math::max(coords[0] / 32767.f, -1.f), Math::max(coords[1] / 32767.f, -1.f),
+			        Math::max(coords[2] / 32767.f, -1.f), Math::max(coords[3] / 32767.f, -1.f)};
+		}
+	};
+
+
+	/**
+	 * @brief Three values in [0, 1] with 10 bits each and one with 2 bits,
+	 * GL_UNSIGNED_INT_2_10_10_10_REV normalized. R is stored in the least
+	 * significant bits.
+	 */
+	struct RGB10A2
+	{
+		/* The encoded value. */
+		uint32_t bits;
+
+		/**
+		 * @brief Constructs a zero vector.
+		 */
+		constexpr FORCE_INLINE RGB10A2() : bits{0} {}
+
+		/**
+		 * @brief Constructs the encoding of the given vector, coordinates are
+		 * clamped to [0, 1].
+		 *
+		 * @param v A Vec4
+		 */
+		constexpr FORCE_INLINE explicit RGB10A2(Vec4<float> const& v)
+			: bits{static_cast<uint32_t>(Impl::quantize(v[0], 0.f, 1.f, 1023.f))
+			     | static_cast<uint32_t>(Impl::quantize(v[1], 0.f, 1.f, 1023.f)) << 10
+			     | static_cast<uint32_t>(Impl::quantize(v[2], 0.f, 1.f, 1023.f)) << 20
+			     | static_cast<uint32_t>(Impl::quantize(v[3], 0.f, 1.f, 3.f)) << 30}
+		{}
+
+		/**
+		 * @brief Returns the decoded vector.
+		 */
+		constexpr FORCE_INLINE operator Vec4<float>() const
+		{
+			return {(bits & 0x3ffu) / 1023.f, ((bits >> 10) & 0x3ffu) / 1023.f, ((bits >> 20) & 0x3ffu) / 1023.f,
+			        (bits >> 30) / 3.f};
+		}
+	};
+
+
+	static_assert(sizeof(Half) == 2 && sizeof(Half3) == 6 && sizeof(OctNormal) == 4 && sizeof(Unorm8x4) == 4
+	           && sizeof(Snorm16x4) == 8 && sizeof(RGB10A2) == 4, "Packed types must not have padding");
+} // namespace VaporWorldVR::Math
@@ -0,0 +1,890 @@
+#pragma once
+
+#include "simd.h"
+#include "vec3.h"
+
+
+namespace VaporWorldVR::Math
+{
+	/**
+	 * @brief The result of a lane-wise comparison between two packets.
+	 *
+	 * @tparam N The number of lanes, a multiple of 4
+	 */
+	template<int N>
+	struct PacketMask
+	{
+		static_assert(N > 0 && N % 4 == 0, "Number of lanes must be a multiple of 4");
+
+		/* Number of SIMD registers. */
+		static constexpr int numRegs = N / 4;
+
+		/* The masks, each register holds 4 lanes. */
+		Simd::Mask32x4 regs[numRegs];
+
+		/**
+		 * @brief Returns an integer whose i-th bit is set if the i-th lane is
+		 * set.
+		 */
+		FORCE_INLINE uint32_t getBits() const
+		{
+			uint32_t bits = 0;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				bits |= Simd::moveMask(regs[i]) << (i * 4);
+			}
+			return bits;
+		}
+
+		/**
+		 * @brief Returns true if at least one lane is set.
+		 */
+		FORCE_INLINE bool any() const
+		{
+			return getBits() != 0;
+		}
+
+		/**
+		 * @brief Returns true if all lanes are set.
+		 */
+		FORCE_INLINE bool all() const
+		{
+			return getBits() == (N == 32 ? ~0u : (1u << N) - 1);
+		}
+
+		/**
+		 * @brief Returns true if no lane is set.
+		 */
+		FORCE_INLINE bool none() const
+		{
+			return getBits() == 0;
+		}
+
+		/**
+		 * @brief Returns the lane-wise negation of this mask.
+		 */
+		FORCE_INLINE PacketMask operator~() const
+		{
+			PacketMask out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::maskNot(regs[i]);
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Returns the lane-wise conjunction of two masks.
+		 */
+		FORCE_INLINE PacketMask operator&(PacketMask const& other) const
+		{
+			PacketMask out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::maskAnd(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Returns the lane-wise disjunction of two masks.
+		 */
+		FORCE_INLINE PacketMask operator|(PacketMask const& other) const
+		{
+			PacketMask out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::maskOr(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Returns the lane-wise exclusive disjunction of two masks.
+		 */
+		FORCE_INLINE PacketMask operator^(PacketMask const& other) const
+		{
+			PacketMask out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::maskXor(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+	};
+
+
+	/**
+	 * @brief A packet of N values of the given type, stored in structure of
+	 * arrays layout so that each SIMD lane holds a different value.
+	 *
+	 * Kernels written against packets process N values at once. Only float
+	 * and Vec3<float> packets are defined.
+	 *
+	 * @tparam T The type of the values
+	 * @tparam N The number of lanes, a multiple of 4
+	 */
+	template<typename T, int N>
+	struct Packet;
+
+
+	/**
+	 * @brief A packet of N floats.
+	 *
+	 * @tparam N The number of lanes, a multiple of 4
+	 */
+	template<int N>
+	struct Packet<float, N>
+	{
+		static_assert(N > 0 && N % 4 == 0, "Number of lanes must be a multiple of 4");
+
+		/* Number of lanes and of SIMD registers. */
+		/// @{
+		static constexpr int numLanes = N;
+		static constexpr int numRegs = N / 4;
+		/// @}
+
+		/* The values, each register holds 4 lanes. */
+		Simd::Float32x4 regs[numRegs];
+
+		/**
+		 * @brief Constructs a zero-initialized packet.
+		 */
+		FORCE_INLINE Packet() : Packet{0.f} {}
+
+		/**
+		 * @brief Constructs a new packet and sets all lanes equal to the given
+		 * scalar value.
+		 *
+		 * @param s A scalar value
+		 */
+		FORCE_INLINE Packet(float s)
+		{
+			for (int i = 0; i < numRegs; ++i)
+			{
+				regs[i] = Simd::splat(s);
+			}
+		}
+
+		/**
+		 * @brief Returns a new packet with the values loaded from memory.
+		 *
+		 * @param src Ptr to N floats
+		 */
+		static FORCE_INLINE Packet load(float const* src)
+		{
+			Packet out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::load(src + i * 4);
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Like load(), but the address must be 16 bytes aligned.
+		 */
+		static FORCE_INLINE Packet loadAligned(float const* src)
+		{
+			Packet out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::loadAligned(src + i * 4);
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Stores the values of this packet to memory.
+		 *
+		 * @param dst Ptr to N floats
+		 */
+		FORCE_INLINE void store(float* dst) const
+		{
+			for (int i = 0; i < numRegs; ++i)
+			{
+				Simd::store(dst + i * 4, regs[i]);
+			}
+		}
+
+		/**
+		 * @brief Like store(), but the address must be 16 bytes aligned.
+		 */
+		FORCE_INLINE void storeAligned(float* dst) const
+		{
+			for (int i = 0; i < numRegs; ++i)
+			{
+				Simd::storeAligned(dst + i * 4, regs[i]);
+			}
+		}
+
+		/**
+		 * @brief Returns the value of the i-th lane.
+		 *
+		 * Lane access goes through memory, avoid it in hot loops.
+		 */
+		FORCE_INLINE float getLane(int idx) const
+		{
+			VW_CHECK(idx >= 0 && idx < N);
+			float lanes[N];
+			store(lanes);
+			return lanes[idx];
+		}
+
+		/**
+		 * @brief Sets the value of the i-th lane.
+		 */
+		FORCE_INLINE void setLane(int idx, float s)
+		{
+			VW_CHECK(idx >= 0 && idx < N);
+			float lanes[N];
+			store(lanes);
+			lanes[idx] = s;
+			*this = load(lanes);
+		}
+
+		/**
+		 * @brief Returns a new packet with all lanes negated.
+		 */
+		FORCE_INLINE Packet operator-() const
+		{
+			Packet out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::neg(regs[i]);
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Lane-wise arithmetic operators.
+		 *
+		 * @param other Another packet, or a scalar value
+		 * @return Ref to self
+		 * @{
+		 */
+		FORCE_INLINE Packet& operator+=(Packet const& other)
+		{
+			for (int i = 0; i < numRegs; ++i)
+			{
+				regs[i] = Simd::add(regs[i], other.regs[i]);
+			}
+			return *this;
+		}
+
+		FORCE_INLINE Packet& operator-=(Packet const& other)
+		{
+			for (int i = 0; i < numRegs; ++i)
+			{
+				regs[i] = Simd::sub(regs[i], other.regs[i]);
+			}
+			return *this;
+		}
+
+		FORCE_INLINE Packet& operator*=(Packet const& other)
+		{
+			for (int i = 0; i < numRegs; ++i)
+			{
+				regs[i] = Simd::mul(regs[i], other.regs[i]);
+			}
+			return *this;
+		}
+
+		FORCE_INLINE Packet& operator/=(Packet const& other)
+		{
+			for (int i = 0; i < numRegs; ++i)
+			{
+				regs[i] = Simd::div(regs[i], other.regs[i]);
+			}
+			return *this;
+		}
+		/// @}
+
+		/**
+		 * @brief Lane-wise arithmetic operators.
+		 *
+		 * @param other Another packet, or a scalar value
+		 * @return A new packet
+		 * @{
+		 */
+		FORCE_INLINE Packet operator+(Packet const& other) const
+		{
+			return Packet{*this} += other;
+		}
+
+		FORCE_INLINE Packet operator-(Packet const& other) const
+		{
+			return Packet{*this} -= other;
+		}
+
+		FORCE_INLINE Packet operator*(Packet const& other) const
+		{
+			return Packet{*this} *= other;
+		}
+
+		FORCE_INLINE Packet operator/(Packet const& other) const
+		{
+			return Packet{*this} /= other;
+		}
+
+		friend FORCE_INLINE Packet operator+(float s, Packet const& p)
+		{
+			return Packet{s} += p;
+		}
+
+		friend FORCE_INLINE Packet operator-(float s, Packet const& p)
+		{
+			return Packet{s} -= p;
+		}
+
+		friend FORCE_INLINE Packet operator*(float s, Packet const& p)
+		{
+			return Packet{s} *= p;
+		}
+
+		friend FORCE_INLINE Packet operator/(float s, Packet const& p)
+		{
+			return Packet{s} /= p;
+		}
+		/// @}
+
+		/**
+		 * @brief Lane-wise comparison operators.
+		 *
+		 * @param other Another packet, or a scalar value
+		 * @return A mask with the result of the comparison for each lane
+		 * @{
+		 */
+		FORCE_INLINE PacketMask<N> operator==(Packet const& other) const
+		{
+			PacketMask<N> out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::cmpEq(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+
+		FORCE_INLINE PacketMask<N> operator!=(Packet const& other) const
+		{
+			return ~(*this == other);
+		}
+
+		FORCE_INLINE PacketMask<N> operator<(Packet const& other) const
+		{
+			PacketMask<N> out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::cmpLt(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+
+		FORCE_INLINE PacketMask<N> operator<=(Packet const& other) const
+		{
+			PacketMask<N> out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::cmpLe(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+
+		FORCE_INLINE PacketMask<N> operator>(Packet const& other) const
+		{
+			PacketMask<N> out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::cmpGt(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+
+		FORCE_INLINE PacketMask<N> operator>=(Packet const& other) const
+		{
+			PacketMask<N> out;
+			for (int i = 0; i < numRegs; ++i)
+			{
+				out.regs[i] = Simd::cmpGe(regs[i], other.regs[i]);
+			}
+			return out;
+		}
+		/// @}
+	};
+
+
+	/**
+	 * @brief A packet of N 3-component vectors. Each component is stored in
+	 * a separate float packet.
+	 *
+	 * @tparam N The number of lanes, a multiple of 4
+	 */
+	template<int N>
+	struct Packet<Vec3<float>, N>
+	{
+		/* The type of a packet of scalar values. */
+		using ScalarT = Packet<float, N>;
+
+		/* Number of lanes. */
+		static constexpr int numLanes = N;
+
+		/* Packets of vector coordinates. */
+		/// @{
+		ScalarT x;
+		ScalarT y;
+		ScalarT z;
+		/// @}
+
+		/**
+		 * @brief Constructs a packet of zero vectors.
+		 */
+		FORCE_INLINE Packet() = default;
+
+		/**
+		 * @brief Constructs a new packet and sets all lanes equal to the given
+		 * vector.
+		 *
+		 * @param v A Vec3
+		 */
+		FORCE_INLINE Packet(Vec3<float> const& v) : x{v.x}, y{v.y}, z{v.z} {}
+
+		/**
+		 * @brief Constructs a new packet with the given coordinates.
+		 *
+		 * @param inX,inY,inZ Packets of coordinates
+		 */
+		FORCE_INLINE Packet(ScalarT const& inX, ScalarT const& inY, ScalarT const& inZ)
+			: x{inX}
+			, y{inY}
+			, z{inZ}
+		{}
+
+		/**
+		 * @brief Returns a new packet with the vectors loaded from an array
+		 * of structures.
+		 *
+		 * @param src Ptr to N vectors
+		 */
+		static FORCE_INLINE Packet loadAoS(Vec3<float> const* src)
+		{
+			Packet out;
+			for (int i = 0; i < ScalarT::numRegs; ++i)
+			{
+				Vec3<float> const* block = src + i * 4;
+				if constexpr (sizeof(Vec3<float>) == 3 * sizeof(float))
+				{
+					// Vectors are tightly packed
+					Simd::load3(block->coords, out.x.regs[i], out.y.regs[i], out.z.regs[i]);
+				}
+				else
+				{
+					out.x.regs[i] = Simd::set(block[0].x, block[1].x, block[2].x, block[3].x);
+					out.y.regs[i] = Simd::set(block[0].y, block[1].y, block[2].y, block[3].y);
+					out.z.regs[i] = Simd::set(block[0].z, block[1].z, block[2].z, block[3].z);
+				}
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Inverse of loadAoS(), stores the vectors to an array of
+		 * structures.
+		 *
+		 * @param dst Ptr to N vectors
+		 */
+		FORCE_INLINE void storeAoS(Vec3<float>* dst) const
+		{
+			if constexpr (sizeof(Vec3<float>) == 3 * sizeof(float))
+			{
+				for (int i = 0; i < ScalarT::numRegs; ++i)
+				{
+					Simd::store3(dst[i * 4].coords, x.regs[i], y.regs[i], z.regs[i]);
+				}
+			}
+			else
+			{
+				float xs[N], ys[N], zs[N];
+				x.store(xs);
+				y.store(ys);
+				z.store(zs);
+				for (int i = 0; i < N; ++i)
+				{
+					dst[i] = {xs[i], ys[i], zs[i]};
+				}
+			}
+		}
+
+		/**
+		 * @brief Returns a new packet with the vectors loaded from a
+		 * structure of arrays.
+		 *
+		 * @param xs,ys,zs Ptrs to N coordinates each
+		 */
+		static FORCE_INLINE Packet load(float const* xs, float const* ys, float const* zs)
+		{
+			return {ScalarT::load(xs), ScalarT::load(ys), ScalarT::load(zs)};
+		}
+
+		/**
+		 * @brief Inverse of load(), stores the vectors to a structure of
+		 * arrays.
+		 *
+		 * @param xs,ys,zs Ptrs to N coordinates each
+		 */
+		FORCE_INLINE void store(float* xs, float* ys, float* zs) const
+		{
+			x.store(xs);
+			y.store(ys);
+			z.store(zs);
+		}
+
+		/**
+		 * @brief Returns the vector in the i-th lane.
+		 *
+		 * Lane access goes through memory, avoid it in hot loops.
+		 */
+		FORCE_INLINE Vec3<float> getLane(int idx) const
+		{
+			return {x.getLane(idx), y.getLane(idx), z.getLane(idx)};
+		}
+
+		/**
+		 * @brief Sets the vector in the i-th lane.
+		 */
+		FORCE_INLINE void setLane(int idx, Vec3<float> const& v)
+		{
+			x.setLane(idx, v.x);
+			y.setLane(idx, v.y);
+			z.setLane(idx, v.z);
+		}
+
+		/**
+		 * @brief Returns the squared size of the vectors.
+		 */
+		FORCE_INLINE ScalarT getSize2() const
+		{
+			return dot(*this);
+		}
+
+		/**
+		 * @brief Returns the size of the vectors.
+		 */
+		FORCE_INLINE ScalarT getSize() const
+		{
+			return sqrt(getSize2());
+		}
+
+		/**
+		 * @brief Divides all vectors by their size.
+		 */
+		FORCE_INLINE Packet& normalize()
+		{
+			return *this /= getSize();
+		}
+
+		/**
+		 * @brief Returns a new packet with the vectors divided by their size.
+		 */
+		FORCE_INLINE Packet getNormal() const
+		{
+			return *this / getSize();
+		}
+
+		/**
+		 * @brief Returns a new packet with the vectors negated.
+		 */
+		FORCE_INLINE Packet operator-() const
+		{
+			return {-x, -y, -z};
+		}
+
+		/**
+		 * @brief Coordinate-wise arithmetic operators.
+		 *
+		 * @param other Another packet of vectors
+		 * @return Ref to self
+		 * @{
+		 */
+		FORCE_INLINE Packet& operator+=(Packet const& other)
+		{
+			x += other.x;
+			y += other.y;
+			z += other.z;
+			return *this;
+		}
+
+		FORCE_INLINE Packet& operator-=(Packet const& other)
+		{
+			x -= other.x;
+			y -= other.y;
+			z -= other.z;
+			return *this;
+		}
+
+		FORCE_INLINE Packet& operator*=(Packet const& other)
+		{
+			x *= other.x;
+			y *= other.y;
+			z *= other.z;
+			return *this;
+		}
+
+		FORCE_INLINE Packet& operator/=(Packet const& other)
+		{
+			x /= other.x;
+			y /= other.y;
+			z /= other.z;
+			return *this;
+		}
+		/// @}
+
+		/**
+		 * @brief Multiplies or divides each vector by the value in the same
+		 * lane of a scalar packet.
+		 *
+		 * @param s A packet of scalar values
+		 * @return Ref to self
+		 * @{
+		 */
+		FORCE_INLINE Packet& operator*=(ScalarT const& s)
+		{
+			x *= s;
+			y *= s;
+			z *= s;
+			return *this;
+		}
+
+		FORCE_INLINE Packet& operator/=(ScalarT const& s)
+		{
+			// One division instead of three
+			return *this *= 1.f / s;
+		}
+		/// @}
+
+		/**
+		 * @brief Coordinate-wise arithmetic operators.
+		 *
+		 * @param other Another packet of vectors, or a packet of scalar values
+		 * @return A new packet
+		 * @{
+		 */
+		FORCE_INLINE Packet operator+(Packet const& other) const
+		{
+			return Packet{*this} += other;
+		}
+
+		FORCE_INLINE Packet operator-(Packet const& other) const
+		{
+			return Packet{*this} -= other;
+		}
+
+		FORCE_INLINE Packet operator*(Packet const& other) const
+		{
+			return Packet{*this} *= other;
+		}
+
+		FORCE_INLINE Packet operator/(Packet const& other) const
+		{
+			return Packet{*this} /= other;
+		}
+
+		FORCE_INLINE Packet operator*(ScalarT const& s) const
+		{
+			return Packet{*this} *= s;
+		}
+
+		FORCE_INLINE Packet operator/(ScalarT const& s) const
+		{
+			return Packet{*this} /= s;
+		}
+
+		friend FORCE_INLINE Packet operator*(ScalarT const& s, Packet const& p)
+		{
+			return p * s;
+		}
+		/// @}
+
+		/**
+		 * @brief Returns the dot product of the vectors in each lane.
+		 *
+		 * @param other Another packet of vectors
+		 * @return u dot v
+		 */
+		FORCE_INLINE ScalarT dot(Packet const& other) const
+		{
+			ScalarT out;
+			for (int i = 0; i < ScalarT::numRegs; ++i)
+			{
+				Simd::Float32x4 r = Simd::mul(x.regs[i], other.x.regs[i]);
+				r = Simd::madd(y.regs[i], other.y.regs[i], r);
+				out.regs[i] = Simd::madd(z.regs[i], other.z.regs[i], r);
+			}
+			return out;
+		}
+
+		/**
+		 * @brief Returns the cross product of the vectors in each lane.
+		 *
+		 * @param other Another packet of vectors
+		 * @return u cross v
+		 */
+		FORCE_INLINE Packet cross(Packet const& other) const
+		{
+			return {y * other.z - z * other.y,
+			        z * other.x - x * other.z,
+			        x * other.y - y * other.x};
+		}
+	};
+
+
+	// =================
+	// Packet operations
+	// =================
+	/**
+	 * @brief Returns a packet whose lanes are picked from the first packet
+	 * where the mask is set, from the second packet otherwise.
+	 *
+	 * @param m The selection mask
+	 * @param a,b The packets to pick the lanes from
+	 * @return m ? a : b
+	 * @{
+	 */
+	template<int N>
+	FORCE_INLINE Packet<float, N> select(PacketMask<N> const& m, Packet<float, N> const& a,
+	                                     Packet<float, N> const& b)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Simd::select(m.regs[i], a.regs[i], b.regs[i]);
+		}
+		return out;
+	}
+
+	template<int N>
+	FORCE_INLINE Packet<Vec3<float>, N> select(PacketMask<N> const& m, Packet<Vec3<float>, N> const& a,
+	                                           Packet<Vec3<float>, N> const& b)
+	{
+		return {select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z)};
+	}
+	/// @}
+
+	/**
+	 * @brief Returns the lane-wise least and greatest value of two packets.
+	 * If either lane is NaN, the result is undefined.
+	 *
+	 * @param x The first packet
+	 * @param y The second packet
+	 * @{
+	 */
+	template<int N>
+	FORCE_INLINE Packet<float, N> min(Packet<float, N> const& x, Packet<float, N> const& y)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Simd::min(x.regs[i], y.regs[i]);
+		}
+		return out;
+	}
+
+	template<int N>
+	FORCE_INLINE Packet<float, N> max(Packet<float, N> const& x, Packet<float, N> const& y)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Simd::max(x.regs[i], y.regs[i]);
+		}
+		return out;
+	}
+	/// @}
+
+	/**
+	 * @brief Like vmin() and vmax(), but for packets of vectors.
+	 *
+	 * @param u The first packet
+	 * @param v The second packet
+	 * @{
+	 */
+	template<int N>
+	FORCE_INLINE Packet<Vec3<float>, N> vmin(Packet<Vec3<float>, N> const& u, Packet<Vec3<float>, N> const& v)
+	{
+		return {min(u.x, v.x), min(u.y, v.y), min(u.z, v.z)};
+	}
+
+	template<int N>
+	FORCE_INLINE Packet<Vec3<float>, N> vmax(Packet<Vec3<float>, N> const& u, Packet<Vec3<float>, N> const& v)
+	{
+		return {max(u.x, v.x), max(u.y, v.y), max(u.z, v.z)};
+	}
+	/// @}
+
+	/**
+	 * @brief Returns the absolute value of each lane.
+	 */
+	template<int N>
+	FORCE_INLINE Packet<float, N> abs(Packet<float, N> const& x)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Simd::abs(x.regs[i]);
+		}
+		return out;
+	}
+
+	/**
+	 * @brief Returns the square root of each lane.
+	 */
+	template<int N>
+	FORCE_INLINE Packet<float, N> sqrt(Packet<float, N> const& x)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Simd::sqrt(x.regs[i]);
+		}
+		return out;
+	}
+
+	/**
+	 * @brief Computes the linear interpolation between two packets, with a
+	 * different interpolation value for each lane.
+	 *
+	 * @param x The first packet
+	 * @param y The second packet
+	 * @param t The interpolation values
+	 * @return x + (y - x) * t
+	 * @{
+	 */
+	template<int N>
+	FORCE_INLINE Packet<float, N> lerp(Packet<float, N> const& x, Packet<float, N> const& y,
+	                                   Packet<float, N> const& t)
+	{
+		return x + (y - x) * t;
+	}
+
+	template<int N>
+	FORCE_INLINE Packet<Vec3<float>, N> lerp(Packet<Vec3<float>, N> const& x, Packet<Vec3<float>, N> const& y,
+	                                         Packet<float, N> const& t)
+	{
+		return x + (y - x) * t;
+	}
+	/// @}
+} // namespace VaporWorldVR::Math
+
+
+namespace VaporWorldVR
+{
+	// ===================
+	// Packet type aliases
+	// ===================
+	using floatp4  = Math::Packet<float, 4>;
+	using floatp8  = Math::Packet<float, 8>;
+	using float3p4 = Math::Packet<Math::Vec3<float>, 4>;
+	using float3p8 = Math::Packet<Math::Vec3<float>, 8>;
+
+	using maskp4 = Math::PacketMask<4>;
+	using maskp8 = Math::PacketMask<8>;
+} // namespace VaporWorldVR
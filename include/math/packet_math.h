@@ -0,0 +1,362 @@
+#pragma once
+
+#include <limits>
+
+#include "fast_math.h"
+#include "packet.h"
+
+
+namespace VaporWorldVR::Math
+{
+	/**
+	 * @brief The accuracy tier of the packet math kernels.
+	 *
+	 * Lower tiers use lower-degree polynomials and fewer refinement steps.
+	 * The error bound of each tier is documented per kernel and measured
+	 * against the double-precision libm result.
+	 */
+	enum class Accuracy
+	{
+		/* At least 10 bits, for noise and other visual-only values. */
+		Low,
+
+		/* At least 15 bits, for geometry that does not feed back into the
+		   simulation. */
+		Medium,
+
+		/* Close to full single precision, within a few ULP. */
+		High
+	};
+
+
+	/* Per-register kernels, shared by all packet sizes. */
+	namespace Impl
+	{
+		/* Evaluates the polynomial with the given coefficients, from the
+		   lowest to the highest degree. */
+		/// @{
+		FORCE_INLINE Simd::Float32x4 horner(Simd::Float32x4, float c)
+		{
+			return Simd::splat(c);
+		}
+
+		template<typename... CoeffsT>
+		FORCE_INLINE Simd::Float32x4 horner(Simd::Float32x4 x, float c, CoeffsT... coeffs)
+		{
+			return Simd::madd(horner(x, coeffs...), x, Simd::splat(c));
+		}
+		/// @}
+
+		/* Returns a mask where the sign bit of the lane is set, including
+		   negative zero. */
+		FORCE_INLINE Simd::Mask32x4 signMask(Simd::Float32x4 v)
+		{
+			using namespace Simd;
+			return cmpEq(shiftRight<31>(castToInt(v)), splatInt(1));
+		}
+
+		/* Returns the lanes of the first register, negated where the mask is
+		   set. */
+		FORCE_INLINE Simd::Float32x4 negateIf(Simd::Mask32x4 m, Simd::Float32x4 v)
+		{
+			return Simd::select(m, Simd::neg(v), v);
+		}
+
+		template<Accuracy accuracy>
+		FORCE_INLINE void sincos(Simd::Float32x4 x, Simd::Float32x4& outSin, Simd::Float32x4& outCos)
+		{
+			using namespace Simd;
+			using namespace Fast::Impl;
+
+			// Reduce to [-pi/4, pi/4], the octant is always even
+			Float32x4 const a = abs(x);
+			Int32x4 const j = bitAnd(add(convertToInt(mul(a, splat(fourOverPi))), splatInt(1)), splatInt(~1));
+			Float32x4 const y = convertToFloat(j);
+			Float32x4 r = madd(y, splat(-quarterPi0), a);
+			r = madd(y, splat(-quarterPi1), r);
+			r = madd(y, splat(-quarterPi2), r);
+			Float32x4 const r2 = mul(r, r);
+
+			Float32x4 s, c;
+			if constexpr (accuracy == Accuracy::Low)
+			{
+				s = horner(r2, -1.6244069688e-1f);
+				c = horner(r2, 4.0896623581e-2f);
+			}
+			else if constexpr (accuracy == Accuracy::Medium)
+			{
+				s = horner(r2, -1.6663459172e-1f, 8.1645797895e-3f);
+				c = horner(r2, 4.1661032980e-2f, -1.3648047732e-3f);
+			}
+			else
+			{
+				s = horner(r2, -1.6666654611e-1f, 8.3321608736e-3f, -1.9515295891e-4f);
+				c = horner(r2, 4.166664568298827e-2f, -1.388731625493765e-3f, 2.443315711809948e-5f);
+			}
+			s = madd(mul(s, r2), r, r);
+			c = madd(mul(c, r2), r2, madd(splat(-0.5f), r2, splat(1.f)));
+
+			// sin(x + k * pi/2) is either +-sin(x) or +-cos(x)
+			Mask32x4 const swap = cmpEq(bitAnd(j, splatInt(2)), splatInt(2));
+			Mask32x4 const flipSin = maskXor(cmpEq(bitAnd(j, splatInt(4)), splatInt(4)), signMask(x));
+			Mask32x4 const flipCos = cmpEq(bitAnd(add(j, splatInt(2)), splatInt(4)), splatInt(4));
+			outSin = negateIf(flipSin, select(swap, c, s));
+			outCos = negateIf(flipCos, select(swap, s, c));
+		}
+
+		template<Accuracy accuracy>
+		FORCE_INLINE Simd::Float32x4 exp2(Simd::Float32x4 x)
+		{
+			using namespace Simd;
+
+			// Split in integer part and fraction in [-0.5, 0.5], rounding
+			// with the 1.5 * 2^23 trick
+			Float32x4 const clamped = min(max(x, splat(-126.f)), splat(128.f));
+			Float32x4 const n = sub(add(clamped, splat(12582912.f)), splat(12582912.f));
+			Float32x4 const f = sub(clamped, n);
+
+			Float32x4 p;
+			if constexpr (accuracy == Accuracy::Low)
+				p = horner(f, 6.9336860126e-1f, 2.4221783810e-1f, 5.4592824742e-2f);
+			else if constexpr (accuracy == Accuracy::Medium)
+				p = horner(f, 6.9312199484e-1f, 2.4023718463e-1f, 5.5916893825e-2f, 9.6003955170e-3f);
+			else
+				p = horner(f, 6.931472028550421e-1f, 2.402264791363012e-1f, 5.550332471162809e-2f,
+				           9.618437357674640e-3f, 1.339887440266574e-3f, 1.535336188319500e-4f);
+			p = madd(p, f, splat(1.f));
+
+			// Add the integer part to the exponent of 2^f, which is in
+			// [sqrt(1/2), sqrt(2)], so the exponent never overflows in range
+			Float32x4 const y = castToFloat(add(castToInt(p), shiftLeft<23>(convertToInt(n))));
+			Float32x4 const underflow = select(cmpLt(x, splat(-126.f)), splat(0.f), y);
+			return select(cmpGe(x, splat(128.f)), splat(::std::numeric_limits<float>::infinity()), underflow);
+		}
+
+		template<Accuracy accuracy>
+		FORCE_INLINE Simd::Float32x4 log2(Simd::Float32x4 x)
+		{
+			using namespace Simd;
+			constexpr float inf = ::std::numeric_limits<float>::infinity();
+
+			// Scale subnormals by 2^23, so that the mantissa is normalized
+			Mask32x4 const subnormal = cmpLt(x, splat(::std::numeric_limits<float>::min()));
+			Int32x4 const bits = castToInt(select(subnormal, mul(x, splat(8388608.f)), x));
+			Float32x4 e = convertToFloat(sub(shiftRight<23>(bits), splatInt(127)));
+			e = select(subnormal, sub(e, splat(23.f)), e);
+
+			// Split in exponent and mantissa in [sqrt(1/2), sqrt(2)]
+			Float32x4 m = castToFloat(bitOr(bitAnd(bits, splatInt(0x007fffff)), splatInt(0x3f800000)));
+			Mask32x4 const large = cmpGt(m, splat(1.41421356237f));
+			m = select(large, mul(m, splat(0.5f)), m);
+			e = select(large, add(e, splat(1.f)), e);
+			Float32x4 const t = sub(m, splat(1.f));
+
+			Float32x4 y;
+			if constexpr (accuracy == Accuracy::Low)
+			{
+				y = horner(t, 1.4423167519f, -7.2479947755e-1f, 5.0990002369e-1f, -3.2133024780e-1f);
+				y = madd(y, t, e);
+			}
+			else if constexpr (accuracy == Accuracy::Medium)
+			{
+				y = horner(t, 1.4427002399f, -7.2119401151e-1f, 4.7994483886e-1f, -3.6699780541e-1f,
+				           3.1667784521e-1f, -2.0163581553e-1f);
+				y = madd(y, t, e);
+			}
+			else
+			{
+				// Natural log polynomial, the result is scaled by log2(e) in
+				// two parts to limit the rounding error
+				constexpr float log2eMinusOne = 0.44269504088896340736f;
+				Float32x4 const t2 = mul(t, t);
+				Float32x4 l = horner(t, 3.3333331174e-1f, -2.4999993993e-1f, 2.0000714765e-1f, -1.6668057665e-1f,
+				                     1.4249322787e-1f, -1.2420140846e-1f, 1.1676998740e-1f, -1.1514610310e-1f,
+				                     7.0376836292e-2f);
+				l = madd(splat(-0.5f), t2, mul(mul(l, t2), t));
+				y = madd(l, splat(log2eMinusOne), mul(t, splat(log2eMinusOne)));
+				y = add(add(add(y, l), t), e);
+			}
+
+			// log2(inf) = inf, log2(0) = -inf, negative values and NaN are NaN
+			y = select(cmpEq(x, splat(inf)), x, y);
+			y = select(cmpEq(x, splat(0.f)), splat(-inf), y);
+			return select(cmpGe(x, splat(0.f)), y, splat(::std::numeric_limits<float>::quiet_NaN()));
+		}
+
+		template<Accuracy accuracy>
+		FORCE_INLINE Simd::Float32x4 rsqrt(Simd::Float32x4 x)
+		{
+			using namespace Simd;
+			if constexpr (accuracy == Accuracy::Low)
+				return rsqrtEstimate(x);
+			else if constexpr (accuracy == Accuracy::Medium)
+			{
+				// One Newton step: r' = r * (1.5 - 0.5 * x * r^2)
+				Float32x4 const r = rsqrtEstimate(x);
+				Float32x4 const hx = mul(x, splat(0.5f));
+				return mul(r, madd(mul(hx, r), neg(r), splat(1.5f)));
+			}
+			else
+				return div(splat(1.f), sqrt(x));
+		}
+
+		template<Accuracy accuracy>
+		FORCE_INLINE Simd::Float32x4 atan2(Simd::Float32x4 y, Simd::Float32x4 x)
+		{
+			using namespace Simd;
+			using namespace Fast::Impl;
+
+			// If x is zero, the angle is vertical, or zero if y is zero too
+			Mask32x4 const vertical = cmpEq(x, splat(0.f));
+			Float32x4 const q = div(y, select(vertical, splat(1.f), x));
+
+			// Reduce to [-tan(pi/8), tan(pi/8)], the divisor is never zero
+			Float32x4 const a = abs(q);
+			Mask32x4 const large = cmpGt(a, splat(2.414213562373095f));
+			Mask32x4 const medium = maskAnd(cmpGt(a, splat(0.4142135623730950f)), maskNot(large));
+			Float32x4 const num = select(large, splat(-1.f), select(medium, sub(a, splat(1.f)), a));
+			Float32x4 const den = select(large, a, select(medium, add(a, splat(1.f)), splat(1.f)));
+			Float32x4 const offset = select(large, splat(halfPi), select(medium, splat(quarterPi), splat(0.f)));
+			Float32x4 const z = div(num, den);
+			Float32x4 const z2 = mul(z, z);
+
+			Float32x4 p;
+			if constexpr (accuracy == Accuracy::Low)
+				p = horner(z2, -3.0761096086e-1f);
+			else if constexpr (accuracy == Accuracy::Medium)
+				p = horner(z2, -3.3184890113e-1f, 1.7044165824e-1f);
+			else
+				p = horner(z2, -3.33329491539e-1f, 1.99777106478e-1f, -1.38776856032e-1f, 8.05374449538e-2f);
+			Float32x4 const t = negateIf(signMask(q), add(offset, madd(mul(p, z2), z, z)));
+
+			// Move to the left half-plane if x is negative
+			Mask32x4 const negY = signMask(y);
+			Float32x4 const halfTurn = select(cmpLt(x, splat(0.f)), negateIf(negY, splat(pi)), splat(0.f));
+			Float32x4 const up = select(cmpEq(y, splat(0.f)), splat(0.f), negateIf(negY, splat(halfPi)));
+			return select(vertical, up, add(t, halfTurn));
+		}
+	} // namespace Impl
+
+
+	// ===================
+	// Packet math kernels
+	// ===================
+	/**
+	 * @brief Computes the sine and cosine of each lane (in radians), sharing
+	 * the range reduction.
+	 *
+	 * Absolute error for |x| <= 8192:
+	 * - Low: below 5e-4
+	 * - Medium: below 2e-6
+	 * - High: below 1e-7, and at most 2 ULP for |x| <= 64
+	 *
+	 * @tparam accuracy The accuracy tier
+	 * @param x The angles
+	 * @param[out] outSin,outCos The sines and cosines of the angles
+	 */
+	template<Accuracy accuracy = Accuracy::High, int N>
+	FORCE_INLINE void sincos(Packet<float, N> const& x, Packet<float, N>& outSin, Packet<float, N>& outCos)
+	{
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			Impl::sincos<accuracy>(x.regs[i], outSin.regs[i], outCos.regs[i]);
+		}
+	}
+
+	/**
+	 * @brief Computes two raised to the power of each lane.
+	 *
+	 * Results that would be subnormal are flushed to zero, results that
+	 * overflow are infinity. Relative error:
+	 * - Low: below 2e-4
+	 * - Medium: below 5e-6
+	 * - High: at most 2 ULP
+	 *
+	 * @tparam accuracy The accuracy tier
+	 * @param x The exponents
+	 * @return 2^x
+	 */
+	template<Accuracy accuracy = Accuracy::High, int N>
+	FORCE_INLINE Packet<float, N> exp2(Packet<float, N> const& x)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Impl::exp2<accuracy>(x.regs[i]);
+		}
+		return out;
+	}
+
+	/**
+	 * @brief Computes the base-2 logarithm of each lane.
+	 *
+	 * Subnormals are supported. Relative error over all positive values:
+	 * - Low: below 5e-4
+	 * - Medium: below 1e-5
+	 * - High: at most 2 ULP
+	 *
+	 * @tparam accuracy The accuracy tier
+	 * @param x The values
+	 * @return log2(x)
+	 */
+	template<Accuracy accuracy = Accuracy::High, int N>
+	FORCE_INLINE Packet<float, N> log2(Packet<float, N> const& x)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Impl::log2<accuracy>(x.regs[i]);
+		}
+		return out;
+	}
+
+	/**
+	 * @brief Computes the inverse square root of each lane.
+	 *
+	 * The Low tier is the hardware estimate, the Medium tier refines it
+	 * with one Newton step. Both are only defined for positive normal
+	 * values. Relative error:
+	 * - Low: below 4e-4
+	 * - Medium: below 5e-6
+	 * - High: at most 1 ULP
+	 *
+	 * @tparam accuracy The accuracy tier
+	 * @param x The values
+	 * @return 1 / sqrt(x)
+	 */
+	template<Accuracy accuracy = Accuracy::High, int N>
+	FORCE_INLINE Packet<float, N> rsqrt(Packet<float, N> const& x)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Impl::rsqrt<accuracy>(x.regs[i]);
+		}
+		return out;
+	}
+
+	/**
+	 * @brief Computes the arctangent of y / x for each lane, using the signs
+	 * of the arguments to determine the quadrant.
+	 *
+	 * Absolute error for all finite values:
+	 * - Low: below 5e-4
+	 * - Medium: below 1e-5
+	 * - High: at most 3 ULP
+	 *
+	 * @tparam accuracy The accuracy tier
+	 * @param y The numerators
+	 * @param x The denominators
+	 * @return atan(y / x)
+	 */
+	template<Accuracy accuracy = Accuracy::High, int N>
+	FORCE_INLINE Packet<float, N> atan2(Packet<float, N> const& y, Packet<float, N> const& x)
+	{
+		Packet<float, N> out;
+		for (int i = 0; i < Packet<float, N>::numRegs; ++i)
+		{
+			out.regs[i] = Impl::atan2<accuracy>(y.regs[i], x.regs[i]);
+		}
+		return out;
+	}
+} // namespace VaporWorldVR::Math
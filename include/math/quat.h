@@ -119,12 +119,64 @@ namespace VaporWorldVR::Math
 		constexpr FORCE_INLINE Vec3<float> rotateVector(Vec3<float> const& v) const
 		{
 			// http://people.csail.mit.edu/bkph/articles/Quaternions.pdf
-			const Vec3<float> q{*this};
-			const Vec3<float> t = (q.cross(v)) * 2.f;
-			return v + (t * w) + (q.cross(t));
+			// t = 2 * cross(q, v), v' = v + w * t + cross(q, t), expanded
+			// because the temporary Vec3 are not optimized away
+			float const tx = 2.f * (y * v[2] - z * v[1]),
+			            ty = 2.f * (z * v[0] - x * v[2]),
+			            tz = 2.f * (x * v[1] - y * v[0]);
+			return {v[0] + w * tx + (y * tz - z * ty),
+			        v[1] + w * ty + (z * tx - x * tz),
+			        v[2] + w * tz + (x * ty - y * tx)};
 		}
 
 	protected:
 		using Vec4::Vec4;
 	};
+
+
+	/**
+	 * @brief Returns the normalized linear interpolation between two
+	 * rotations, along the shortest path.
+	 *
+	 * The angular velocity is not constant, but the error is negligible for
+	 * close rotations, e.g. predicted poses of consecutive frames.
+	 *
+	 * @param a The first rotation
+	 * @param b The second rotation
+	 * @param t The interpolation value
+	 * @return The interpolated rotation
+	 */
+	constexpr Quat nlerp(Quat const& a, Quat const& b, float t)
+	{
+		// q and -q describe the same rotation, flip b to take the shortest
+		// path
+		float const wa = 1.f - t, wb = a.dot(b) < 0.f ? -t : t;
+		Vec4<float> const q = Vec4<float>{wa * a + wb * b}.normalize();
+		return {q[0], q[1], q[2], q[3]};
+	}
+
+	/**
+	 * @brief Returns the spherical linear interpolation between two
+	 * rotations, along the shortest path. The angular velocity is constant.
+	 *
+	 * @param a The first rotation
+	 * @param b The second rotation
+	 * @param t The interpolation value
+	 * @return The interpolated rotation
+	 */
+	constexpr Quat slerp(Quat const& a, Quat const& b, float t)
+	{
+		float const cosTheta = a.dot(b);
+		float const absCosTheta = cosTheta < 0.f ? -cosTheta : cosTheta;
+		if (absCosTheta > 0.9995f)
+			// Rotations are too close, sin(theta) would be unstable
+			return nlerp(a, b, t);
+
+		float const theta = acos(absCosTheta);
+		float const invSinTheta = 1.f / sin(theta);
+		float const wa = sin((1.f - t) * theta) * invSinTheta;
+		float const wb = sin(t * theta) * invSinTheta;
+		Vec4<float> const q = wa * a + (cosTheta < 0.f ? -wb : wb) * b;
+		return {q[0], q[1], q[2], q[3]};
+	}
 } // namespace VaporWorldVR::Math
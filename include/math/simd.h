@@ -0,0 +1,907 @@
+#pragma once
+
+#include <string.h>
+#include <math.h>
+
+#include "core_types.h"
+
+
+#ifndef VW_MATH_USE_SIMD
+# define VW_MATH_USE_SIMD 1
+#endif
+
+#if VW_MATH_USE_SIMD && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+# define VW_MATH_SIMD_NEON 1
+# define VW_MATH_SIMD_SSE 0
+# include <arm_neon.h>
+#elif VW_MATH_USE_SIMD && (defined(__SSE2__) || defined(_M_X64))
+# define VW_MATH_SIMD_NEON 0
+# define VW_MATH_SIMD_SSE 1
+# include <emmintrin.h>
+# if defined(__SSE3__)
+#  include <pmmintrin.h>
+# endif
+#else
+# define VW_MATH_SIMD_NEON 0
+# define VW_MATH_SIMD_SSE 0
+#endif
+
+#define VW_MATH_SIMD (VW_MATH_SIMD_NEON || VW_MATH_SIMD_SSE)
+
+
+/* The functions in this file are always available. If neither NEON nor SSE is
+   enabled, registers are emulated with generic compiler vectors, and code that
+   has a scalar alternative should test VW_MATH_SIMD instead. */
+namespace VaporWorldVR::Math::Simd
+{
+	// ==============
+	// Register types
+	// ==============
+#if VW_MATH_SIMD_NEON
+	/* A register with 4 single-precision floating-point lanes. */
+	using Float32x4 = float32x4_t;
+
+	/* The result of a lane-wise comparison, each lane is either all ones or
+	   all zeros. */
+	using Mask32x4 = uint32x4_t;
+
+	/* A register with 4 signed 32-bit integer lanes. */
+	using Int32x4 = int32x4_t;
+#elif VW_MATH_SIMD_SSE
+	/* A register with 4 single-precision floating-point lanes. */
+	using Float32x4 = __m128;
+
+	/* The result of a lane-wise comparison, each lane is either all ones or
+	   all zeros. */
+	using Mask32x4 = __m128;
+
+	/* A register with 4 signed 32-bit integer lanes. */
+	using Int32x4 = __m128i;
+#else
+	/* A register with 4 single-precision floating-point lanes. */
+	typedef float Float32x4 __attribute__((vector_size(16)));
+
+	/* The result of a lane-wise comparison, each lane is either all ones or
+	   all zeros. */
+	typedef int32_t Mask32x4 __attribute__((vector_size(16)));
+
+	/* A register with 4 signed 32-bit integer lanes. */
+	typedef int32_t Int32x4 __attribute__((vector_size(16)));
+#endif
+
+
+	/**
+	 * @brief Loads 4 floats from memory. The address does not need to be
+	 * aligned.
+	 */
+	FORCE_INLINE Float32x4 load(float const* src)
+	{
+#if VW_MATH_SIMD_NEON
+		return vld1q_f32(src);
+#elif VW_MATH_SIMD_SSE
+		return _mm_loadu_ps(src);
+#else
+		Float32x4 v;
+		memcpy(&v, src, sizeof(v));
+		return v;
+#endif
+	}
+
+	/**
+	 * @brief Stores 4 floats to memory. The address does not need to be
+	 * aligned.
+	 */
+	FORCE_INLINE void store(float* dst, Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		vst1q_f32(dst, v);
+#elif VW_MATH_SIMD_SSE
+		_mm_storeu_ps(dst, v);
+#else
+		memcpy(dst, &v, sizeof(v));
+#endif
+	}
+
+	/**
+	 * @brief Like load(), but the address must be 16 bytes aligned.
+	 */
+	FORCE_INLINE Float32x4 loadAligned(float const* src)
+	{
+#if VW_MATH_SIMD_NEON
+		return vld1q_f32(reinterpret_cast<float const*>(__builtin_assume_aligned(src, 16)));
+#elif VW_MATH_SIMD_SSE
+		return _mm_load_ps(src);
+#else
+		return *reinterpret_cast<Float32x4 const*>(src);
+#endif
+	}
+
+	/**
+	 * @brief Like store(), but the address must be 16 bytes aligned.
+	 */
+	FORCE_INLINE void storeAligned(float* dst, Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		vst1q_f32(reinterpret_cast<float*>(__builtin_assume_aligned(dst, 16)), v);
+#elif VW_MATH_SIMD_SSE
+		_mm_store_ps(dst, v);
+#else
+		*reinterpret_cast<Float32x4*>(dst) = v;
+#endif
+	}
+
+	/**
+	 * @brief Returns true if the address is 16 bytes aligned.
+	 */
+	FORCE_INLINE bool isAligned(void const* ptr)
+	{
+		return (reinterpret_cast<uintptr_t>(ptr) & 0xf) == 0;
+	}
+
+	/**
+	 * @brief Returns a register with all lanes equal to the given value.
+	 */
+	FORCE_INLINE Float32x4 splat(float s)
+	{
+#if VW_MATH_SIMD_NEON
+		return vdupq_n_f32(s);
+#elif VW_MATH_SIMD_SSE
+		return _mm_set1_ps(s);
+#else
+		return Float32x4{s, s, s, s};
+#endif
+	}
+
+	/**
+	 * @brief Returns a register with the given lanes.
+	 */
+	FORCE_INLINE Float32x4 set(float x, float y, float z, float w)
+	{
+#if VW_MATH_SIMD_NEON
+		float const lanes[4] = {x, y, z, w};
+		return vld1q_f32(lanes);
+#elif VW_MATH_SIMD_SSE
+		return _mm_setr_ps(x, y, z, w);
+#else
+		return Float32x4{x, y, z, w};
+#endif
+	}
+
+	/**
+	 * @brief Returns the value of the first lane.
+	 */
+	FORCE_INLINE float first(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		return vgetq_lane_f32(v, 0);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cvtss_f32(v);
+#else
+		return v[0];
+#endif
+	}
+
+	/* Lane-wise arithmetic. */
+	/// @{
+	FORCE_INLINE Float32x4 add(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vaddq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_add_ps(a, b);
+#else
+		return a + b;
+#endif
+	}
+
+	FORCE_INLINE Float32x4 sub(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vsubq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_sub_ps(a, b);
+#else
+		return a - b;
+#endif
+	}
+
+	FORCE_INLINE Float32x4 mul(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vmulq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_mul_ps(a, b);
+#else
+		return a * b;
+#endif
+	}
+
+	FORCE_INLINE Float32x4 div(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON && defined(__aarch64__)
+		return vdivq_f32(a, b);
+#elif VW_MATH_SIMD_NEON
+		// ARMv7 has no vector division, refine the reciprocal estimate twice
+		float32x4_t r = vrecpeq_f32(b);
+		r = vmulq_f32(vrecpsq_f32(b, r), r);
+		r = vmulq_f32(vrecpsq_f32(b, r), r);
+		return vmulq_f32(a, r);
+#elif VW_MATH_SIMD_SSE
+		return _mm_div_ps(a, b);
+#else
+		return a / b;
+#endif
+	}
+	/// @}
+
+	/**
+	 * @brief Returns a * b + c.
+	 *
+	 * The operation may or may not be fused, depending on the target.
+	 */
+	FORCE_INLINE Float32x4 madd(Float32x4 a, Float32x4 b, Float32x4 c)
+	{
+#if VW_MATH_SIMD_NEON && defined(__aarch64__)
+		return vfmaq_f32(c, a, b);
+#elif VW_MATH_SIMD_NEON
+		return vmlaq_f32(c, a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_add_ps(_mm_mul_ps(a, b), c);
+#else
+		return a * b + c;
+#endif
+	}
+
+	/**
+	 * @brief Returns a register whose lanes are picked from two registers.
+	 *
+	 * The first two lanes are picked from the first register, the last two
+	 * from the second register: {a[i0], a[i1], b[i2], b[i3]}.
+	 *
+	 * @tparam i0,i1,i2,i3 The index of the lanes to pick
+	 */
+	template<int i0, int i1, int i2, int i3>
+	FORCE_INLINE Float32x4 shuffle(Float32x4 a, Float32x4 b)
+	{
+		static_assert(i0 >= 0 && i0 < 4 && i1 >= 0 && i1 < 4 && i2 >= 0 && i2 < 4 && i3 >= 0 && i3 < 4,
+		              "Lane index out of range");
+#if VW_MATH_SIMD_NEON
+		return __builtin_shufflevector(a, b, i0, i1, i2 + 4, i3 + 4);
+#elif VW_MATH_SIMD_SSE
+		return _mm_shuffle_ps(a, b, _MM_SHUFFLE(i3, i2, i1, i0));
+#else
+		return Float32x4{a[i0], a[i1], b[i2], b[i3]};
+#endif
+	}
+
+	/**
+	 * @brief Like shuffle(), but picks all lanes from the same register.
+	 */
+	template<int i0, int i1, int i2, int i3>
+	FORCE_INLINE Float32x4 swizzle(Float32x4 v)
+	{
+		return shuffle<i0, i1, i2, i3>(v, v);
+	}
+
+	/**
+	 * @brief Returns a register with all lanes equal to the i-th lane of the
+	 * given register.
+	 */
+	template<int i>
+	FORCE_INLINE Float32x4 broadcast(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON && defined(__aarch64__)
+		return vdupq_laneq_f32(v, i);
+#else
+		return swizzle<i, i, i, i>(v);
+#endif
+	}
+
+	/**
+	 * @brief Returns the sum of all the lanes, broadcast to all lanes.
+	 */
+	FORCE_INLINE Float32x4 hsum(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON && defined(__aarch64__)
+		return vdupq_n_f32(vaddvq_f32(v));
+#else
+		v = add(v, swizzle<1, 0, 3, 2>(v));
+		return add(v, swizzle<2, 3, 0, 1>(v));
+#endif
+	}
+
+	/**
+	 * @brief Returns the sum of the lanes of each register, such that the
+	 * i-th lane of the result is the sum of all the lanes of the i-th
+	 * register.
+	 */
+	FORCE_INLINE Float32x4 hsum(Float32x4 a, Float32x4 b, Float32x4 c, Float32x4 d)
+	{
+#if VW_MATH_SIMD_NEON && defined(__aarch64__)
+		return vpaddq_f32(vpaddq_f32(a, b), vpaddq_f32(c, d));
+#elif VW_MATH_SIMD_SSE && defined(__SSE3__)
+		return _mm_hadd_ps(_mm_hadd_ps(a, b), _mm_hadd_ps(c, d));
+#else
+		// Transpose, then sum columns
+		Float32x4 const ab01 = shuffle<0, 1, 0, 1>(a, b), ab23 = shuffle<2, 3, 2, 3>(a, b);
+		Float32x4 const cd01 = shuffle<0, 1, 0, 1>(c, d), cd23 = shuffle<2, 3, 2, 3>(c, d);
+		Float32x4 const s = add(ab01, ab23), t = add(cd01, cd23);
+		return add(shuffle<0, 2, 0, 2>(s, t), shuffle<1, 3, 1, 3>(s, t));
+#endif
+	}
+
+	/**
+	 * @brief Loads 4 interleaved 3-component vectors and splits them in
+	 * three registers, one per component.
+	 *
+	 * @param src Ptr to 12 floats, <x0, y0, z0, x1, ...>
+	 * @param[out] x,y,z The components of the vectors
+	 */
+	FORCE_INLINE void load3(float const* src, Float32x4& x, Float32x4& y, Float32x4& z)
+	{
+#if VW_MATH_SIMD_NEON
+		float32x4x3_t const v = vld3q_f32(src);
+		x = v.val[0];
+		y = v.val[1];
+		z = v.val[2];
+#else
+		Float32x4 const a = load(src), b = load(src + 4), c = load(src + 8);
+		x = shuffle<0, 3, 1, 2>(a, shuffle<2, 2, 1, 1>(b, c));
+		y = shuffle<0, 2, 0, 2>(shuffle<1, 1, 0, 0>(a, b), shuffle<3, 3, 2, 2>(b, c));
+		z = shuffle<0, 2, 0, 1>(shuffle<2, 2, 1, 1>(a, b), swizzle<0, 3, 0, 3>(c));
+#endif
+	}
+
+	/**
+	 * @brief Inverse of load3(), interleaves the components of 4 vectors and
+	 * stores them to memory.
+	 *
+	 * @param dst Ptr to 12 floats
+	 * @param x,y,z The components of the vectors
+	 */
+	FORCE_INLINE void store3(float* dst, Float32x4 x, Float32x4 y, Float32x4 z)
+	{
+#if VW_MATH_SIMD_NEON
+		vst3q_f32(dst, float32x4x3_t{{x, y, z}});
+#else
+		store(dst, shuffle<0, 2, 0, 2>(shuffle<0, 0, 0, 0>(x, y), shuffle<0, 0, 1, 1>(z, x)));
+		store(dst + 4, shuffle<0, 2, 0, 2>(shuffle<1, 1, 1, 1>(y, z), shuffle<2, 2, 2, 2>(x, y)));
+		store(dst + 8, shuffle<0, 2, 0, 2>(shuffle<2, 2, 3, 3>(z, x), shuffle<3, 3, 3, 3>(y, z)));
+#endif
+	}
+
+	/**
+	 * @brief Transposes the 4x4 matrix whose rows are the given registers,
+	 * such that the i-th register holds the i-th lane of all registers.
+	 */
+	FORCE_INLINE void transpose(Float32x4& a, Float32x4& b, Float32x4& c, Float32x4& d)
+	{
+		Float32x4 const ab01 = shuffle<0, 1, 0, 1>(a, b), ab23 = shuffle<2, 3, 2, 3>(a, b);
+		Float32x4 const cd01 = shuffle<0, 1, 0, 1>(c, d), cd23 = shuffle<2, 3, 2, 3>(c, d);
+		a = shuffle<0, 2, 0, 2>(ab01, cd01);
+		b = shuffle<1, 3, 1, 3>(ab01, cd01);
+		c = shuffle<0, 2, 0, 2>(ab23, cd23);
+		d = shuffle<1, 3, 1, 3>(ab23, cd23);
+	}
+
+	/**
+	 * @brief Returns the dot product of two registers.
+	 */
+	FORCE_INLINE float dot(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON && defined(__aarch64__)
+		return vaddvq_f32(vmulq_f32(a, b));
+#else
+		return first(hsum(mul(a, b)));
+#endif
+	}
+
+	/**
+	 * @brief Returns the register with all lanes negated.
+	 */
+	FORCE_INLINE Float32x4 neg(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		return vnegq_f32(v);
+#elif VW_MATH_SIMD_SSE
+		return _mm_xor_ps(v, _mm_set1_ps(-0.f));
+#else
+		return -v;
+#endif
+	}
+
+	/**
+	 * @brief Returns the absolute value of all lanes.
+	 */
+	FORCE_INLINE Float32x4 abs(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		return vabsq_f32(v);
+#elif VW_MATH_SIMD_SSE
+		return _mm_andnot_ps(_mm_set1_ps(-0.f), v);
+#else
+		return (Float32x4)((Mask32x4)v & 0x7fffffff);
+#endif
+	}
+
+	/* Lane-wise minimum and maximum. If either lane is NaN, the result is
+	   undefined. */
+	/// @{
+	FORCE_INLINE Float32x4 min(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vminq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_min_ps(a, b);
+#else
+		return (Float32x4)(((a < b) & (Mask32x4)a) | (~(a < b) & (Mask32x4)b));
+#endif
+	}
+
+	FORCE_INLINE Float32x4 max(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vmaxq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_max_ps(a, b);
+#else
+		return (Float32x4)(((a > b) & (Mask32x4)a) | (~(a > b) & (Mask32x4)b));
+#endif
+	}
+	/// @}
+
+	/**
+	 * @brief Returns the square root of all lanes.
+	 */
+	FORCE_INLINE Float32x4 sqrt(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON && defined(__aarch64__)
+		return vsqrtq_f32(v);
+#elif VW_MATH_SIMD_NEON
+		// ARMv7 has no vector square root, refine the inverse root estimate
+		// twice, then fix the result for zero lanes
+		float32x4_t r = vrsqrteq_f32(v);
+		r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(v, r), r), r);
+		r = vmulq_f32(vrsqrtsq_f32(vmulq_f32(v, r), r), r);
+		return vbslq_f32(vceqq_f32(v, vdupq_n_f32(0.f)), v, vmulq_f32(v, r));
+#elif VW_MATH_SIMD_SSE
+		return _mm_sqrt_ps(v);
+#else
+		return Float32x4{::sqrtf(v[0]), ::sqrtf(v[1]), ::sqrtf(v[2]), ::sqrtf(v[3])};
+#endif
+	}
+
+	/**
+	 * @brief Returns an estimate of the inverse square root of all lanes,
+	 * with a relative error below 1.5 * 2^-12.
+	 */
+	FORCE_INLINE Float32x4 rsqrtEstimate(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		// The NEON estimate only has 8 bits, refine it once
+		float32x4_t const r = vrsqrteq_f32(v);
+		return vmulq_f32(vrsqrtsq_f32(vmulq_f32(v, r), r), r);
+#elif VW_MATH_SIMD_SSE
+		return _mm_rsqrt_ps(v);
+#else
+		return 1.f / sqrt(v);
+#endif
+	}
+
+
+	// ===================
+	// Comparisons & masks
+	// ===================
+	/* Lane-wise comparisons, each lane of the mask is all ones if the
+	   comparison is true, all zeros otherwise. */
+	/// @{
+	FORCE_INLINE Mask32x4 cmpEq(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vceqq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cmpeq_ps(a, b);
+#else
+		return a == b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 cmpLt(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vcltq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cmplt_ps(a, b);
+#else
+		return a < b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 cmpLe(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vcleq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cmple_ps(a, b);
+#else
+		return a <= b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 cmpGt(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vcgtq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cmpgt_ps(a, b);
+#else
+		return a > b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 cmpGe(Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vcgeq_f32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cmpge_ps(a, b);
+#else
+		return a >= b;
+#endif
+	}
+	/// @}
+
+	/* Lane-wise logical operations on masks. */
+	/// @{
+	FORCE_INLINE Mask32x4 maskAnd(Mask32x4 a, Mask32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vandq_u32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_and_ps(a, b);
+#else
+		return a & b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 maskOr(Mask32x4 a, Mask32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vorrq_u32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_or_ps(a, b);
+#else
+		return a | b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 maskXor(Mask32x4 a, Mask32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return veorq_u32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_xor_ps(a, b);
+#else
+		return a ^ b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 maskNot(Mask32x4 m)
+	{
+#if VW_MATH_SIMD_NEON
+		return vmvnq_u32(m);
+#elif VW_MATH_SIMD_SSE
+		return _mm_xor_ps(m, _mm_castsi128_ps(_mm_set1_epi32(-1)));
+#else
+		return ~m;
+#endif
+	}
+	/// @}
+
+	/**
+	 * @brief Returns a register whose lanes are picked from the first
+	 * register where the mask is set, from the second register otherwise.
+	 *
+	 * @param m The selection mask
+	 * @param a,b The registers to pick the lanes from
+	 * @return m ? a : b
+	 */
+	FORCE_INLINE Float32x4 select(Mask32x4 m, Float32x4 a, Float32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vbslq_f32(m, a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+#else
+		return (Float32x4)((m & (Mask32x4)a) | (~m & (Mask32x4)b));
+#endif
+	}
+
+	/**
+	 * @brief Returns an integer whose i-th bit is set if the i-th lane of
+	 * the mask is set.
+	 */
+	FORCE_INLINE uint32_t moveMask(Mask32x4 m)
+	{
+#if VW_MATH_SIMD_NEON
+		uint32x4_t const bits = {1, 2, 4, 8};
+		uint32x4_t const t = vandq_u32(m, bits);
+		uint32x2_t const s = vorr_u32(vget_low_u32(t), vget_high_u32(t));
+		return vget_lane_u32(s, 0) | vget_lane_u32(s, 1);
+#elif VW_MATH_SIMD_SSE
+		return _mm_movemask_ps(m);
+#else
+		return (m[0] & 1) | (m[1] & 2) | (m[2] & 4) | (m[3] & 8);
+#endif
+	}
+
+
+	// =============
+	// Integer lanes
+	// =============
+	/**
+	 * @brief Returns a register with all lanes equal to the given integer.
+	 */
+	FORCE_INLINE Int32x4 splatInt(int32_t s)
+	{
+#if VW_MATH_SIMD_NEON
+		return vdupq_n_s32(s);
+#elif VW_MATH_SIMD_SSE
+		return _mm_set1_epi32(s);
+#else
+		return Int32x4{s, s, s, s};
+#endif
+	}
+
+	/* Reinterprets the bits of a register, no conversion is performed. */
+	/// @{
+	FORCE_INLINE Int32x4 castToInt(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		return vreinterpretq_s32_f32(v);
+#elif VW_MATH_SIMD_SSE
+		return _mm_castps_si128(v);
+#else
+		return (Int32x4)v;
+#endif
+	}
+
+	FORCE_INLINE Float32x4 castToFloat(Int32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		return vreinterpretq_f32_s32(v);
+#elif VW_MATH_SIMD_SSE
+		return _mm_castsi128_ps(v);
+#else
+		return (Float32x4)v;
+#endif
+	}
+	/// @}
+
+	/**
+	 * @brief Converts all lanes to integers, rounding towards zero. If the
+	 * value does not fit in 32 bits, the result is undefined.
+	 */
+	FORCE_INLINE Int32x4 convertToInt(Float32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		return vcvtq_s32_f32(v);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cvttps_epi32(v);
+#else
+		return __builtin_convertvector(v, Int32x4);
+#endif
+	}
+
+	/**
+	 * @brief Converts all lanes to floats.
+	 */
+	FORCE_INLINE Float32x4 convertToFloat(Int32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		return vcvtq_f32_s32(v);
+#elif VW_MATH_SIMD_SSE
+		return _mm_cvtepi32_ps(v);
+#else
+		return __builtin_convertvector(v, Float32x4);
+#endif
+	}
+
+	/* Lane-wise integer arithmetic, overflow wraps around. */
+	/// @{
+	FORCE_INLINE Int32x4 add(Int32x4 a, Int32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vaddq_s32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_add_epi32(a, b);
+#else
+		return a + b;
+#endif
+	}
+
+	FORCE_INLINE Int32x4 sub(Int32x4 a, Int32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vsubq_s32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_sub_epi32(a, b);
+#else
+		return a - b;
+#endif
+	}
+	/// @}
+
+	/* Lane-wise bitwise operations. */
+	/// @{
+	FORCE_INLINE Int32x4 bitAnd(Int32x4 a, Int32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vandq_s32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_and_si128(a, b);
+#else
+		return a & b;
+#endif
+	}
+
+	FORCE_INLINE Int32x4 bitOr(Int32x4 a, Int32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vorrq_s32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_or_si128(a, b);
+#else
+		return a | b;
+#endif
+	}
+
+	FORCE_INLINE Int32x4 bitXor(Int32x4 a, Int32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return veorq_s32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_xor_si128(a, b);
+#else
+		return a ^ b;
+#endif
+	}
+	/// @}
+
+	/**
+	 * @brief Shifts all lanes left by the given number of bits.
+	 */
+	template<int n>
+	FORCE_INLINE Int32x4 shiftLeft(Int32x4 v)
+	{
+		static_assert(n > 0 && n < 32, "Shift out of range");
+#if VW_MATH_SIMD_NEON
+		return vshlq_n_s32(v, n);
+#elif VW_MATH_SIMD_SSE
+		return _mm_slli_epi32(v, n);
+#else
+		return v << n;
+#endif
+	}
+
+	/**
+	 * @brief Shifts all lanes right by the given number of bits, shifting in
+	 * zeros.
+	 */
+	template<int n>
+	FORCE_INLINE Int32x4 shiftRight(Int32x4 v)
+	{
+		static_assert(n > 0 && n < 32, "Shift out of range");
+#if VW_MATH_SIMD_NEON
+		return vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(v), n));
+#elif VW_MATH_SIMD_SSE
+		return _mm_srli_epi32(v, n);
+#else
+		typedef uint32_t UInt32x4 __attribute__((vector_size(16)));
+		return (Int32x4)((UInt32x4)v >> n);
+#endif
+	}
+
+	/* Lane-wise signed integer comparisons, each lane of the mask is all
+	   ones if the comparison is true, all zeros otherwise. */
+	/// @{
+	FORCE_INLINE Mask32x4 cmpEq(Int32x4 a, Int32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vceqq_s32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b));
+#else
+		return a == b;
+#endif
+	}
+
+	FORCE_INLINE Mask32x4 cmpGt(Int32x4 a, Int32x4 b)
+	{
+#if VW_MATH_SIMD_NEON
+		return vcgtq_s32(a, b);
+#elif VW_MATH_SIMD_SSE
+		return _mm_castsi128_ps(_mm_cmpgt_epi32(a, b));
+#else
+		return a > b;
+#endif
+	}
+	/// @}
+
+	/**
+	 * @brief Returns a register whose lanes are picked from the first
+	 * register where the mask is set, from the second register otherwise.
+	 */
+	FORCE_INLINE Int32x4 select(Mask32x4 m, Int32x4 a, Int32x4 b)
+	{
+		return castToInt(select(m, castToFloat(a), castToFloat(b)));
+	}
+
+	/**
+	 * @brief Loads 4 integers from memory. The address does not need to be
+	 * aligned.
+	 */
+	FORCE_INLINE Int32x4 load(int32_t const* src)
+	{
+#if VW_MATH_SIMD_NEON
+		return vld1q_s32(src);
+#elif VW_MATH_SIMD_SSE
+		return _mm_loadu_si128(reinterpret_cast<__m128i const*>(src));
+#else
+		Int32x4 v;
+		memcpy(&v, src, sizeof(v));
+		return v;
+#endif
+	}
+
+	/**
+	 * @brief Stores 4 integers to memory. The address does not need to be
+	 * aligned.
+	 */
+	FORCE_INLINE void store(int32_t* dst, Int32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		vst1q_s32(dst, v);
+#elif VW_MATH_SIMD_SSE
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), v);
+#else
+		memcpy(dst, &v, sizeof(v));
+#endif
+	}
+
+	/**
+	 * @brief Loads 4 16-bit integers from memory and zero-extends them to
+	 * 32 bits. The address does not need to be aligned.
+	 */
+	FORCE_INLINE Int32x4 load16(uint16_t const* src)
+	{
+#if VW_MATH_SIMD_NEON
+		return vreinterpretq_s32_u32(vmovl_u16(vld1_u16(src)));
+#elif VW_MATH_SIMD_SSE
+		return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(src)), _mm_setzero_si128());
+#else
+		return Int32x4{src[0], src[1], src[2], src[3]};
+#endif
+	}
+
+	/**
+	 * @brief Inverse of load16(), stores the low 16 bits of each lane to
+	 * memory. The address does not need to be aligned.
+	 */
+	FORCE_INLINE void store16(uint16_t* dst, Int32x4 v)
+	{
+#if VW_MATH_SIMD_NEON
+		vst1_u16(dst, vmovn_u32(vreinterpretq_u32_s32(v)));
+#elif VW_MATH_SIMD_SSE
+		// Move the low half of each lane to the first 8 bytes
+		v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 2, 0));
+		v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 3, 2, 0));
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 2, 0)));
+#else
+		for (int i = 0; i < 4; ++i)
+		{
+			dst[i] = static_cast<uint16_t>(v[i]);
+		}
+#endif
+	}
+} // namespace VaporWorldVR::Math::Simd
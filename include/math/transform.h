@@ -1,6 +1,8 @@
 #pragma once
 
 #include "mat4.h"
+#include "quat.h"
+#include "affine.h"
 
 
 namespace VaporWorldVR::Math
@@ -16,7 +18,12 @@ namespace VaporWorldVR::Math
 		 * @brief Construct a new TransformationMatrix with zero translation,
 		 * zero rotation and uniform scale.
 		 */
-		constexpr FORCE_INLINE TransformationMatrix() : Mat4{Mat4::eye} {}
+		constexpr FORCE_INLINE TransformationMatrix()
+			: Mat4{1.f, 0.f, 0.f, 0.f,
+			       0.f, 1.f, 0.f, 0.f,
+			       0.f, 0.f, 1.f, 0.f,
+			       0.f, 0.f, 0.f, 1.f}
+		{}
 
 		/**
 		 * @brief Construct a new TransformationMatrix with the given
@@ -240,4 +247,163 @@ namespace VaporWorldVR::Math
 	protected:
 		using Mat4::Mat4;
 	};
+
+
+	/**
+	 * @brief A transformation described by its scale, rotation and
+	 * translation, applied in this order.
+	 *
+	 * Takes 40 bytes instead of the 64 bytes of a Mat4, and composition,
+	 * inversion and interpolation are cheaper than with matrices. Use it for
+	 * scene nodes and poses, and bake it to a matrix only when it must be
+	 * uploaded to the GPU, see bakeTransforms() for large batches.
+	 *
+	 * Composition and inversion are exact only if the scale is uniform.
+	 * With non-uniform scale, the exact result may have shear, which cannot
+	 * be described by this type.
+	 */
+	struct Transform
+	{
+		/* Transform static values. */
+		/// @{
+		static const Transform identity;
+		/// @}
+
+		/* The rotation component. */
+		Quat rotation;
+
+		/* The translation component. */
+		Vec3<float> translation;
+
+		/* The scale component. */
+		Vec3<float> scale;
+
+		/**
+		 * @brief Constructs a new Transform that describes the identity
+		 * transformation.
+		 */
+		constexpr FORCE_INLINE Transform() : rotation{}, translation{}, scale{1.f, 1.f, 1.f} {}
+
+		/**
+		 * @brief Constructs a new Transform with the given translation,
+		 * rotation and scale.
+		 *
+		 * @param translation The given translation
+		 * @param rotation The given rotation
+		 * @param scale The given scale
+		 */
+		constexpr FORCE_INLINE explicit Transform(Vec3<float> const& translation, Quat const& rotation = Quat{},
+		                                          Vec3<float> const& scale = Vec3<float>::one)
+			: rotation{rotation}
+			, translation{translation}
+			, scale{scale}
+		{}
+
+		/**
+		 * @brief Returns an AffineMatrix that describes the same
+		 * transformation.
+		 */
+		constexpr FORCE_INLINE explicit operator AffineMatrix() const
+		{
+			return {translation, rotation, scale};
+		}
+
+		/**
+		 * @brief Returns a Mat4 that describes the same transformation.
+		 */
+		constexpr FORCE_INLINE explicit operator Mat4<float>() const
+		{
+			return static_cast<Mat4<float>>(static_cast<AffineMatrix>(*this));
+		}
+
+		/**
+		 * @brief Applies this transformation to a position vector.
+		 *
+		 * @param v The Vec3 to transform
+		 * @return T(v)
+		 */
+		constexpr FORCE_INLINE Vec3<float> transformPoint(Vec3<float> const& v) const
+		{
+			return rotation.rotateVector(v * scale) + translation;
+		}
+
+		/**
+		 * @brief Applies this transformation to a direction vector, which is
+		 * not affected by the translation.
+		 *
+		 * @param v The Vec3 to transform
+		 * @return T(v)
+		 */
+		constexpr FORCE_INLINE Vec3<float> transformDirection(Vec3<float> const& v) const
+		{
+			return rotation.rotateVector(v * scale);
+		}
+
+		/**
+		 * @brief Returns the composition of this transformation with another
+		 * transformation. The other transformation is applied first.
+		 *
+		 * @param other Another Transform
+		 * @return t dot u
+		 */
+		constexpr FORCE_INLINE Transform dot(Transform const& other) const
+		{
+			return Transform{transformPoint(other.translation), rotation * other.rotation, scale * other.scale};
+		}
+
+		/**
+		 * @brief Invert this transformation in place.
+		 */
+		constexpr FORCE_INLINE Transform& invert()
+		{
+			return *this = !(*this);
+		}
+
+		/**
+		 * @brief Returns the inverse of this transformation.
+		 */
+		constexpr FORCE_INLINE Transform operator!() const
+		{
+			Quat const invRotation = !rotation;
+			Vec3<float> const invScale = 1.f / scale;
+			return Transform{invRotation.rotateVector(-translation) * invScale, invRotation, invScale};
+		}
+	};
+
+
+	/**
+	 * @brief Interpolates the components of two transformations. The
+	 * rotation is interpolated with nlerp(), which is cheaper and close
+	 * enough for nearby poses.
+	 *
+	 * @param a The first transformation
+	 * @param b The second transformation
+	 * @param t The interpolation value
+	 * @return The interpolated transformation
+	 */
+	constexpr FORCE_INLINE Transform lerp(Transform const& a, Transform const& b, float t)
+	{
+		return Transform{lerp(a.translation, b.translation, t), nlerp(a.rotation, b.rotation, t),
+		                 lerp(a.scale, b.scale, t)};
+	}
+
+	/**
+	 * @brief Like lerp(), but the rotation is interpolated with slerp().
+	 *
+	 * @param a The first transformation
+	 * @param b The second transformation
+	 * @param t The interpolation value
+	 * @return The interpolated transformation
+	 */
+	constexpr FORCE_INLINE Transform slerp(Transform const& a, Transform const& b, float t)
+	{
+		return Transform{lerp(a.translation, b.translation, t), slerp(a.rotation, b.rotation, t),
+		                 lerp(a.scale, b.scale, t)};
+	}
+
+
+	// =======================
+	// Transform static values
+	// =======================
+	inline constexpr Transform Transform::identity = {};
 } // namespace VaporWorldVR::Math
@@ -1,6 +1,9 @@
 #pragma once
 
+#include <type_traits>
+
 #include "vec3.h"
+#include "simd.h"
 
 
 namespace VaporWorldVR::Math
@@ -335,6 +338,93 @@ namespace VaporWorldVR::Math
 	};
 
 
+	// =========================
+	// Vec4 SIMD specialization
+	// =========================
+#if VW_MATH_SIMD
+	// The constant-evaluated paths only access the coordinates array, which
+	// is the union member initialized by the constructors.
+	template<>
+	constexpr FORCE_INLINE Vec4<float>& Vec4<float>::operator+=(Vec4 const& other)
+	{
+		if (::std::is_constant_evaluated())
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				coords[i] += other.coords[i];
+			}
+		}
+		else
+		{
+			Simd::store(coords, Simd::add(Simd::load(coords), Simd::load(other.coords)));
+		}
+		return *this;
+	}
+
+	template<>
+	constexpr FORCE_INLINE Vec4<float>& Vec4<float>::operator-=(Vec4 const& other)
+	{
+		if (::std::is_constant_evaluated())
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				coords[i] -= other.coords[i];
+			}
+		}
+		else
+		{
+			Simd::store(coords, Simd::sub(Simd::load(coords), Simd::load(other.coords)));
+		}
+		return *this;
+	}
+
+	template<>
+	constexpr FORCE_INLINE Vec4<float>& Vec4<float>::operator*=(Vec4 const& other)
+	{
+		if (::std::is_constant_evaluated())
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				coords[i] *= other.coords[i];
+			}
+		}
+		else
+		{
+			Simd::store(coords, Simd::mul(Simd::load(coords), Simd::load(other.coords)));
+		}
+		return *this;
+	}
+
+	template<>
+	constexpr FORCE_INLINE Vec4<float>& Vec4<float>::operator/=(Vec4 const& other)
+	{
+		if (::std::is_constant_evaluated())
+		{
+			for (int i = 0; i < 4; ++i)
+			{
+				coords[i] /= other.coords[i];
+			}
+		}
+		else
+		{
+			Simd::store(coords, Simd::div(Simd::load(coords), Simd::load(other.coords)));
+		}
+		return *this;
+	}
+
+	template<>
+	constexpr FORCE_INLINE float Vec4<float>::dot(Vec4 const& other) const
+	{
+		if (::std::is_constant_evaluated())
+		{
+			return coords[0] * other.coords[0] + coords[1] * other.coords[1] + coords[2] * other.coords[2]
+			     + coords[3] * other.coords[3];
+		}
+		return Simd::dot(Simd::load(coords), Simd::load(other.coords));
+	}
+#endif
+
+
 	// ==================================
 	// Vec4 floating-point specialization
 	// ==================================
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <thread>
 #include <variant>
 
 #include "utility.h"
-#include "mutex.h"
-#include "event.h"
+#include "futex.h"
+#include "block_pool.h"
+#include "logging.h"
 
 
 namespace VaporWorldVR
@@ -21,6 +26,260 @@ namespace VaporWorldVR
 	struct Message {};
 
 
+	/* The number of messages a target can hold before its pool allocates
+	   more memory, unless specified. */
+	constexpr size_t defaultMessagePoolCapacity = 16;
+
+
+	/* Type of the continuation of a message, see MessageHandle::then(). */
+	using MessageCallback = void (*)(void* payload);
+
+
+	/**
+	 * @brief The state of a posted message, shared between the target that
+	 * processes it and the producers that wait for it. Also used as the node
+	 * of the message queue.
+	 */
+	struct MessageState
+	{
+		enum AckFlag
+		{
+			AckFlag_Received = 1 << 0,
+			AckFlag_Processed = 1 << 1,
+			AckFlag_Waiting = 1 << 2,
+			AckFlag_Callback = 1 << 3
+		};
+
+		/* Pointer to next message in queue. */
+		::std::atomic<MessageState*> next = nullptr;
+
+		/* Ack flags (used for both received and processed), whether a
+		   thread is sleeping on them and whether a continuation is set. */
+		::std::atomic<uint32_t> ackFlags = 0;
+
+		/* Number of live references, one is owned by the queue. */
+		::std::atomic<uint32_t> refCount = 0;
+
+		/* Wether should block until received/processed. */
+		int reqFlags = 0;
+
+		/* The continuation, and its payload. */
+		/// @{
+		MessageCallback callback = nullptr;
+		void* callbackPayload = nullptr;
+		/// @}
+
+		/* Destroys the message when the last reference is released. */
+		void (*destroy)(MessageState* state) = nullptr;
+
+		FORCE_INLINE void acquireRef()
+		{
+			refCount.fetch_add(1, ::std::memory_order_relaxed);
+		}
+
+		FORCE_INLINE void releaseRef()
+		{
+			if (refCount.fetch_sub(1, ::std::memory_order_acq_rel) == 1)
+				destroy(this);
+		}
+
+		/* Returns true if the given ack flag is set. */
+		FORCE_INLINE bool hasAck(uint32_t ackFlag) const
+		{
+			return (ackFlags.load(::std::memory_order_acquire) & ackFlag) != 0;
+		}
+
+		/* Sets the given ack flag, and wakes up the producers if waiting.
+		   Runs the continuation if the message was processed. */
+		FORCE_INLINE void signalAck(uint32_t ackFlag)
+		{
+			uint32_t const prevFlags = ackFlags.fetch_or(ackFlag, ::std::memory_order_acq_rel);
+			if (prevFlags & AckFlag_Waiting)
+				futexWake(ackFlags);
+
+			// Either this thread sees the continuation, or the thread that
+			// sets it sees the ack
+			if ((ackFlag & AckFlag_Processed) && (prevFlags & AckFlag_Callback))
+				callback(callbackPayload);
+		}
+
+		/* Sets the continuation, or runs it if the message was already
+		   processed. */
+		void setCallback(MessageCallback inCallback, void* inPayload)
+		{
+			VW_CHECKF(!hasAck(AckFlag_Callback), "Message @ %p already has a continuation", this);
+			callback = inCallback;
+			callbackPayload = inPayload;
+			if (ackFlags.fetch_or(AckFlag_Callback, ::std::memory_order_acq_rel) & AckFlag_Processed)
+				callback(callbackPayload);
+		}
+
+		/* Blocks until the given ack flag is set, or the timeout expires.
+		   Returns true if the flag is set. */
+		bool waitAck(uint32_t ackFlag, int64_t timeoutNs = -1)
+		{
+			using Clock = ::std::chrono::steady_clock;
+			Clock::time_point const deadline = Clock::now() + ::std::chrono::nanoseconds{timeoutNs};
+
+			uint32_t flags = ackFlags.load(::std::memory_order_acquire);
+			while ((flags & ackFlag) == 0)
+			{
+				int64_t remainingNs = -1;
+				if (timeoutNs >= 0)
+				{
+					remainingNs = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(deadline - Clock::now())
+					            .count();
+					if (remainingNs <= 0)
+						return false;
+				}
+
+				// Announce the sleep with the same atomic, so the consumer
+				// either sees the waiting flag or we see its ack
+				flags = ackFlags.fetch_or(AckFlag_Waiting, ::std::memory_order_acq_rel) | AckFlag_Waiting;
+				if ((flags & ackFlag) == 0)
+				{
+					futexWait(ackFlags, flags, remainingNs);
+					flags = ackFlags.load(::std::memory_order_acquire);
+				}
+			}
+			return true;
+		}
+	};
+
+
+	/**
+	 * @brief A handle to a message posted with
+	 * MessageTarget::postMessageAsync(), used to learn when the message has
+	 * been processed.
+	 *
+	 * The handle holds a reference to the message, so it can be queried
+	 * after the message has been processed. It must be reset or destroyed
+	 * before the target is destroyed.
+	 */
+	class MessageHandle
+	{
+		template<typename, typename...>
+		friend class MessageTarget;
+
+	public:
+		MessageHandle()
+			: state{nullptr}
+		{}
+
+		MessageHandle(MessageHandle const& other)
+			: state{other.state}
+		{
+			if (state)
+				state->acquireRef();
+		}
+
+		MessageHandle(MessageHandle&& other)
+			: state{other.state}
+		{
+			other.state = nullptr;
+		}
+
+		MessageHandle& operator=(MessageHandle const& other)
+		{
+			if (other.state)
+				other.state->acquireRef();
+			reset();
+			state = other.state;
+			return *this;
+		}
+
+		MessageHandle& operator=(MessageHandle&& other)
+		{
+			if (this != &other)
+			{
+				reset();
+				state = other.state;
+				other.state = nullptr;
+			}
+			return *this;
+		}
+
+		~MessageHandle()
+		{
+			reset();
+		}
+
+		/**
+		 * @brief Returns true if the handle refers to a message.
+		 */
+		FORCE_INLINE bool isValid() const
+		{
+			return state != nullptr;
+		}
+
+		/**
+		 * @brief Returns true if the message has been processed. The effects
+		 * of the target on the message are visible after this returns true.
+		 */
+		FORCE_INLINE bool isDone() const
+		{
+			return state->hasAck(MessageState::AckFlag_Processed);
+		}
+
+		/**
+		 * @brief Blocks until the message has been processed.
+		 */
+		FORCE_INLINE void wait() const
+		{
+			state->waitAck(MessageState::AckFlag_Processed);
+		}
+
+		/**
+		 * @brief Blocks until the message has been processed, or the timeout
+		 * expires.
+		 *
+		 * @param timeoutNs The maximum time to wait, in nanoseconds
+		 * @return true if the message has been processed
+		 */
+		FORCE_INLINE bool waitFor(int64_t timeoutNs) const
+		{
+			return state->waitAck(MessageState::AckFlag_Processed, timeoutNs);
+		}
+
+		/**
+		 * @brief Sets a function called once the message has been processed.
+		 *
+		 * The function is called by the target thread, right after
+		 * processing the message, or by this thread before returning if the
+		 * message has already been processed. Only one continuation can be
+		 * set for each message.
+		 *
+		 * @param callback The function to call
+		 * @param payload The value passed to the function
+		 */
+		FORCE_INLINE void then(MessageCallback callback, void* payload)
+		{
+			state->setCallback(callback, payload);
+		}
+
+		/**
+		 * @brief Releases the message, the handle becomes invalid.
+		 */
+		FORCE_INLINE void reset()
+		{
+			if (state)
+			{
+				state->releaseRef();
+				state = nullptr;
+			}
+		}
+
+	protected:
+		/* The state of the message. */
+		MessageState* state;
+
+		/* Adopts a reference to the given message. */
+		explicit MessageHandle(MessageState* inState)
+			: state{inState}
+		{}
+	};
+
+
 	/**
 	 * @brief This class provides an API to exchange messages between separate
 	 * modules (e.g. application -> render thread).
@@ -29,6 +288,21 @@ namespace VaporWorldVR
 	 * processed in the same order they were sent. There's no such guarantee
 	 * between messages sent by different recipients.
 	 *
+	 * Messages are stored in an intrusive lock-free queue, with many
+	 * producers and a single consumer, the thread that calls flushMessages().
+	 * Posting a message never blocks, unless an ack is requested, not even
+	 * while the target is processing messages, and the consumer is only
+	 * woken up with a futex if it is sleeping in flushMessages(). Each message
+	 * has its own ack flags, so a producer that waits for an ack only wakes
+	 * up when its own message is handled. postMessageAsync() returns a handle
+	 * to the message instead of waiting. A MessageBatch records many messages
+	 * and pushes them all at once, waking up the target once.
+	 *
+	 * Messages are allocated from a pool owned by the target. Once the pool
+	 * has grown to the largest number of messages in flight, posting a
+	 * message does not allocate from the heap anymore, see
+	 * getMessagePoolStats().
+	 *
 	 * @tparam TargetT The target class (should be the class that implements
 	 *                 the API)
 	 * @tparam MessagesT The list of Messages this target accepts
@@ -41,20 +315,18 @@ namespace VaporWorldVR
 	public:
 		/**
 		 * @brief Construct a new MessageTarget object.
+		 *
+		 * @param poolCapacity The number of messages allocated upfront,
+		 *                     should be at least the number of messages in
+		 *                     flight in a frame
 		 */
-		MessageTarget()
-			: beforeFirst_NoInit{}
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wuninitialized"
-			, tail{&beforeFirst}
-#pragma clang diagnostic pop
-			, mutex{createMutex()}
-			, eventSent{createEvent()}
-			, eventRcvd{createEvent()}
-			, eventProc{createEvent()}
-		{
-			beforeFirst.next = nullptr;
-		}
+		explicit MessageTarget(size_t poolCapacity = defaultMessagePoolCapacity)
+			: stub{}
+			, head{&stub}
+			, tail{&stub}
+			, consumerParked{0}
+			, pool{sizeof(MessageWrapper), alignof(MessageWrapper), poolCapacity}
+		{}
 
 		/**
 		 * @brief Destroy the MessageTarget object.
@@ -63,30 +335,38 @@ namespace VaporWorldVR
 		{
 			VW_CHECKF(isEmpty(), "Some messages still in queue, but target is being destroyed");
 
-			for (auto* it = &beforeFirst; it->next;)
+			while (MessageWrapper* wrapper = popMessage())
 			{
 				// Destroy all messages in queue
-				auto* wrapper = it->next;
-				VW_CHECKF(wrapper->refCount == 0, "Destroying message @ %p with %u live refs", wrapper,
-				          wrapper->refCount);
-
-				it->next = wrapper->next;
-				delete wrapper;
+				VW_CHECKF(wrapper->refCount.load(::std::memory_order_relaxed) == 1,
+				          "Destroying message @ %p with %u live refs", wrapper,
+				          wrapper->refCount.load(::std::memory_order_relaxed) - 1);
+				wrapper->releaseRef();
 			}
-
-			// Destroy mutex and events
-			destroyEvent(eventProc);
-			destroyEvent(eventRcvd);
-			destroyEvent(eventSent);
-			destroyMutex(mutex);
 		}
 
 		/**
-		 * @brief Returns true if the message queue is empty.
+		 * @brief Returns true if the message queue is empty. May be called by
+		 * any thread, but the result is only a snapshot.
 		 */
 		FORCE_INLINE bool isEmpty() const
 		{
-			return tail == &beforeFirst;
+			// The consumer is at the stub, and no producer pushed after it.
+			// The stub may also be the last node while messages are still
+			// queued before it, if it was pushed back concurrently with a
+			// producer, so the head alone is not enough
+			return tail.load(::std::memory_order_relaxed) == &stub
+			    && head.load(::std::memory_order_seq_cst) == &stub;
+		}
+
+		/**
+		 * @brief Returns the usage statistics of the message pool. If the
+		 * number of slabs keeps growing after the first frames, the initial
+		 * capacity is too small.
+		 */
+		FORCE_INLINE BlockPoolStats getMessagePoolStats() const
+		{
+			return pool.getStats();
 		}
 
 		/**
@@ -114,158 +394,413 @@ namespace VaporWorldVR
 		/// @}
 
 		/**
-		 * @brief Process the message queue.
+		 * @brief Posts a message to the target object, and returns a handle
+		 * to learn when it has been processed without blocking.
 		 *
-		 * @param blocking If true and the queue empty, it will block execution
-		 *                 and wait for new messages
+		 * @tparam MessageT The type of the message to send
+		 * @param msg The message to post
+		 * @return The handle of the message
+		 * @{
 		 */
-		void flushMessages(bool blocking = false)
+		template<typename MessageT>
+		MessageHandle postMessageAsync(MessageT const& msg)
+		{
+			return MessageHandle{pushMessage(msg, MessageWait_Processed)};
+		}
+
+		template<typename MessageT>
+		MessageHandle postMessageAsync(MessageT&& msg)
+		{
+			return MessageHandle{pushMessage(::std::move(msg), MessageWait_Processed)};
+		}
+		/// @}
+
+		/**
+		 * @brief Records messages for a target on the producer thread, and
+		 * submits them at once.
+		 *
+		 * Messages are linked in a private chain while recorded, so recording
+		 * needs no synchronization besides allocating the messages from the
+		 * pool of the target. submit() appends the whole chain to the queue
+		 * with a single atomic exchange, and wakes up the target once. The
+		 * messages of a batch are processed in the order they were recorded,
+		 * and after the messages posted by the same thread before the batch
+		 * was submitted.
+		 *
+		 * A batch must only be used by one thread. Messages still recorded
+		 * when the batch is destroyed are submitted.
+		 */
+		class MessageBatch
 		{
-			mutex->lock();
+		public:
+			/**
+			 * @brief Constructs an empty batch for the given target.
+			 */
+			explicit MessageBatch(MessageTarget& inTarget)
+				: target{&inTarget}
+				, first{nullptr}
+				, last{nullptr}
+				, numMessages{0}
+				, waitState{nullptr}
+				, waitAckFlag{0}
+			{}
+
+			MessageBatch(MessageBatch const&) = delete;
+			MessageBatch& operator=(MessageBatch const&) = delete;
+
+			~MessageBatch()
+			{
+				submit();
+			}
+
+			/**
+			 * @brief Returns the number of messages recorded since the last
+			 * submit.
+			 */
+			FORCE_INLINE size_t getNumMessages() const
+			{
+				return numMessages;
+			}
+
+			/**
+			 * @brief Records a message, see MessageTarget::postMessage().
+			 *
+			 * If acks are requested, submit() blocks until they are received.
+			 * Since messages are processed in order, only the acks of the last
+			 * message that requested them are waited for.
+			 *
+			 * @tparam MessageT The type of the message to record
+			 * @param msg The message to record
+			 * @param flags Used to request acks from the target
+			 * @{
+			 */
+			template<typename MessageT>
+			void postMessage(MessageT const& msg, int sendFlags = MessageWait_None)
+			{
+				postMessage_Impl(msg, sendFlags);
+			}
+
+			template<typename MessageT>
+			void postMessage(MessageT&& msg, int sendFlags = MessageWait_None)
+			{
+				postMessage_Impl(::std::move(msg), sendFlags);
+			}
+			/// @}
+
+			/**
+			 * @brief Records a message, see MessageTarget::postMessageAsync().
+			 * The message is not processed before the batch is submitted.
+			 *
+			 * @tparam MessageT The type of the message to record
+			 * @param msg The message to record
+			 * @return The handle of the message
+			 * @{
+			 */
+			template<typename MessageT>
+			MessageHandle postMessageAsync(MessageT const& msg)
 			{
-				while (blocking && isEmpty())
+				return MessageHandle{recordMessage(msg, MessageWait_Processed, 2)};
+			}
+
+			template<typename MessageT>
+			MessageHandle postMessageAsync(MessageT&& msg)
+			{
+				return MessageHandle{recordMessage(::std::move(msg), MessageWait_Processed, 2)};
+			}
+			/// @}
+
+			/**
+			 * @brief Pushes all recorded messages to the target, and waits for
+			 * the requested acks. The batch is empty afterwards, and can be
+			 * reused.
+			 */
+			void submit()
+			{
+				if (!first)
+					return;
+
+				// Push the whole chain and notify target
+				target->pushNodes(first, last);
+				target->wakeConsumer();
+				first = last = nullptr;
+				numMessages = 0;
+
+				if (waitState)
 				{
-					// Block on waiting for new messages
-					eventSent->wait(mutex);
+					waitState->waitAck(waitAckFlag);
+					waitState->releaseRef();
+					waitState = nullptr;
 				}
+			}
 
-				// Process queue
-				auto* it = &beforeFirst;
-				while (it->next)
-				{
-					acquireRef(it->next);
+		protected:
+			/* The target of the messages. */
+			MessageTarget* target;
 
-					// Pop message
-					auto* wrapper = it->next;
-					it->next = wrapper->next;
+			/* The first and last recorded messages. */
+			/// @{
+			MessageState* first;
+			MessageState* last;
+			/// @}
 
-					if (wrapper->reqFlags & MessageWait_Received)
-					{
-						// Signal received event
-						wrapper->ackFlags |= AckFlag_Received;
-						eventRcvd->notifyOne();
-					}
+			/* The number of recorded messages. */
+			size_t numMessages;
 
-					// Process message
-					::std::visit([this](auto&& msg) -> void {
+			/* The message whose ack submit() waits for, and the ack. */
+			/// @{
+			MessageState* waitState;
+			uint32_t waitAckFlag;
+			/// @}
 
-						static_cast<TargetT*>(this)->processMessage(FORWARD(msg));
-					}, wrapper->msg);
+			FORCE_INLINE void postMessage_Impl(auto&& msg, int sendFlags)
+			{
+				if (sendFlags & (MessageWait_Received | MessageWait_Processed))
+				{
+					// Acks of earlier messages are implied by the acks of this
+					// one, only keep a reference to the last message
+					MessageState* state = recordMessage(FORWARD(msg), sendFlags, 2);
+					if (waitState)
+						waitState->releaseRef();
+					waitState = state;
+					waitAckFlag = (sendFlags & MessageWait_Processed) ? MessageState::AckFlag_Processed
+					                                                  : MessageState::AckFlag_Received;
+				}
+				else
+					recordMessage(FORWARD(msg), MessageWait_None, 1);
+			}
 
-					if (wrapper->reqFlags & MessageWait_Processed)
-					{
-						// Signal processed event
-						wrapper->ackFlags |= AckFlag_Processed;
-						eventProc->notifyOne();
-					}
+			/* Allocates a message and appends it to the chain. */
+			FORCE_INLINE MessageState* recordMessage(auto&& msg, int sendFlags, uint32_t numRefs)
+			{
+				MessageWrapper* wrapper = target->createMessage(FORWARD(msg), sendFlags, numRefs);
+				if (last)
+					last->next.store(wrapper, ::std::memory_order_relaxed);
+				else
+					first = wrapper;
+				last = wrapper;
+				++numMessages;
+				return wrapper;
+			}
+		};
 
-					releaseRef(wrapper);
+		/**
+		 * @brief Process the message queue. Must only be called by the thread
+		 * that owns the target.
+		 *
+		 * Only the messages posted before the call are processed, messages
+		 * posted by the handlers or by other threads in the meantime are left
+		 * for the next call. Producers can thus never keep the target inside
+		 * this function.
+		 *
+		 * @param blocking If true and the queue empty, it will block execution
+		 *                 and wait for new messages
+		 */
+		void flushMessages(bool blocking = false)
+		{
+			for (;;)
+			{
+				// Detach the messages posted so far, the queue stays open to
+				// the producers. If the last node is the stub, messages may
+				// still be queued before it, and the snapshot ends when the
+				// consumer reaches it
+				MessageState* const last = head.load(::std::memory_order_acquire);
+				bool processed = false;
+				while (last != &stub || tail.load(::std::memory_order_relaxed) != &stub)
+				{
+					MessageWrapper* wrapper = popMessage();
+					if (!wrapper)
+						break;
+
+					bool const isLast = wrapper == last;
+					dispatchMessage(wrapper);
+					processed = true;
+					if (isLast)
+						break;
 				}
-				tail = it;
+
+				if (processed || !blocking)
+					return;
+
+				waitMessages();
 			}
-			mutex->unlock();
 		}
 
 	protected:
-		enum AckFlag
-		{
-			AckFlag_Received = 1 << 0,
-			AckFlag_Processed = 1 << 1
-		};
-
-		/* Wraps a message with a pointer to the next message in the queue. */
-		struct MessageWrapper
+		/* Wraps a message with its state. */
+		struct MessageWrapper : MessageState
 		{
 			/* This message. */
 			MessageVarT msg;
 
-			/* Wether should block until received/processed. */
-			int reqFlags = 0;
+			/* The pool the message was allocated from. */
+			BlockPool* pool;
 
-			/* Ack flags (used for both received and processed). */
-			int ackFlags = 0;
+			template<typename MessageT>
+			MessageWrapper(MessageT&& inMsg, BlockPool* inPool)
+				: MessageState{}
+				, msg{FORWARD(inMsg)}
+				, pool{inPool}
+			{}
+		};
 
-			// TODO: maybe use an atomic, though we only write this in critical sections
-			/* Number of live references. */
-			uint32_t refCount = 0;
+		/* Placeholder node, that is in the queue when there are no messages,
+		   so that producers never see an empty list. */
+		MessageState stub;
 
-			/* Pointer to next message in queue. */
-			MessageWrapper* next = nullptr;
-		};
+		/* Last node of the queue, where producers push new messages. */
+		alignas(64) ::std::atomic<MessageState*> head;
 
-		union
+		/* First node of the queue, only written by the consumer. Atomic so
+		   that isEmpty() can be called by any thread. */
+		alignas(64) ::std::atomic<MessageState*> tail;
+
+		/* Non zero while the consumer is sleeping, or about to, waiting for
+		   new messages. */
+		::std::atomic<uint32_t> consumerParked;
+
+		/* The pool of message wrappers. */
+		BlockPool pool;
+
+		FORCE_INLINE void postMessage_Impl(auto&& msg, int sendFlags)
 		{
-			/* Used to prevent initialization of member. */
-			int beforeFirst_NoInit;
+			if (sendFlags & (MessageWait_Received | MessageWait_Processed))
+			{
+				// The producer keeps a reference while it waits for the acks.
+				// The processed ack is always signaled after the received one
+				MessageHandle handle{pushMessage(FORWARD(msg), sendFlags)};
+				handle.state->waitAck((sendFlags & MessageWait_Processed) ? MessageState::AckFlag_Processed
+				                                                          : MessageState::AckFlag_Received);
+			}
+			else
+				pushMessage(FORWARD(msg), MessageWait_None);
+		}
 
-			/* Head of the queue, msg should never be accessed. */
-			MessageWrapper beforeFirst;
-		};
+		/* Allocates a message and pushes it to the queue. If acks are
+		   requested, returns a reference to the message owned by the
+		   caller. */
+		FORCE_INLINE MessageState* pushMessage(auto&& msg, int sendFlags)
+		{
+			bool const tracked = sendFlags != MessageWait_None;
+			MessageWrapper* wrapper = createMessage(FORWARD(msg), sendFlags, tracked ? 2 : 1);
 
-		/* Tail of the queue. */
-		MessageWrapper* tail;
+			// Push to queue and notify target
+			pushNodes(wrapper, wrapper);
+			wakeConsumer();
+			return tracked ? wrapper : nullptr;
+		}
 
-		/* Mutex that provides protected access to the queue. */
-		Mutex* mutex;
+		/* Allocates a message from the pool. */
+		FORCE_INLINE MessageWrapper* createMessage(auto&& msg, int sendFlags, uint32_t numRefs)
+		{
+			void* block = pool.allocate();
+			VW_ASSERTF(block != nullptr, "Failed to allocate message");
+			auto* wrapper = new (block) MessageWrapper{FORWARD(msg), &pool};
+			wrapper->reqFlags = sendFlags;
+			wrapper->refCount.store(numRefs, ::std::memory_order_relaxed);
+			wrapper->destroy = &destroyMessage;
+			return wrapper;
+		}
 
-		/* Event fired whenever a new message is posted. */
-		Event* eventSent;
+		/* Destroys a message and returns it to its pool. */
+		static void destroyMessage(MessageState* state)
+		{
+			auto* wrapper = static_cast<MessageWrapper*>(state);
+			BlockPool* wrapperPool = wrapper->pool;
+			wrapper->~MessageWrapper();
+			wrapperPool->free(wrapper);
+		}
 
-		/* Event fired when a message that requires a ack is received. */
-		Event* eventRcvd;
+		/* Appends a linked chain of nodes to the queue. */
+		FORCE_INLINE void pushNodes(MessageState* first, MessageState* last)
+		{
+			last->next.store(nullptr, ::std::memory_order_relaxed);
 
-		/* Event fired after a message that requires a ack is processed. */
-		Event* eventProc;
+			// Between the exchange and the store the chain is not reachable
+			// yet, the consumer waits for the link in this case
+			MessageState* prev = head.exchange(last, ::std::memory_order_seq_cst);
+			prev->next.store(first, ::std::memory_order_release);
+		}
 
-		FORCE_INLINE void postMessage_Impl(auto&& msg, int sendFlags)
+		/* Pops the first message of the queue. Returns null if the queue is
+		   empty, or the first message is still being linked. */
+		MessageWrapper* popMessage()
 		{
-			mutex->lock();
+			MessageState* first = tail.load(::std::memory_order_relaxed);
+			MessageState* next = first->next.load(::std::memory_order_acquire);
+			if (first == &stub)
 			{
-				// Push to queue
-				auto* wrapper = new MessageWrapper{FORWARD(msg), sendFlags};
-				tail = tail->next = wrapper;
-
-				// Notify target
-				eventSent->notifyOne();
+				// Skip the stub
+				if (!next)
+					return nullptr;
 
-				if ((sendFlags & MessageWait_Received) == MessageWait_Received)
-				{
-					acquireRef(wrapper);
-					while ((wrapper->ackFlags & AckFlag_Received) != AckFlag_Received)
-					{
-						// Wait for the received event to trigger and check again
-						eventRcvd->wait(mutex);
-					}
-					releaseRef(wrapper);
-				}
+				first = next;
+				tail.store(first, ::std::memory_order_relaxed);
+				next = next->next.load(::std::memory_order_acquire);
+			}
 
-				if ((sendFlags & MessageWait_Processed) == MessageWait_Processed)
-				{
-					acquireRef(wrapper);
-					while ((wrapper->ackFlags & AckFlag_Processed) != AckFlag_Processed)
-					{
-						// Wait for the processed event to trigger and check again
-						eventProc->wait(mutex);
-					}
-					releaseRef(wrapper);
-				}
+			if (!next)
+			{
+				if (first != head.load(::std::memory_order_acquire))
+					// A producer is linking the next message
+					return nullptr;
+
+				// This is the last message, push back the stub so that the
+				// message can be detached from the queue
+				pushNodes(&stub, &stub);
+
+				// If a producer pushed right before the stub, the stub is
+				// linked after its message, and the producer is about to link
+				// it to this one. The message cannot be popped before, and
+				// giving up would leave the queue looking empty with messages
+				// in it, so wait for the link
+				while (!(next = first->next.load(::std::memory_order_acquire)))
+					::std::this_thread::yield();
 			}
-			mutex->unlock();
+
+			tail.store(next, ::std::memory_order_relaxed);
+			return static_cast<MessageWrapper*>(first);
 		}
 
-		FORCE_INLINE void acquireRef(MessageWrapper* wrapper)
+		/* Sends the message to the target, and signals the requested acks. */
+		FORCE_INLINE void dispatchMessage(MessageWrapper* wrapper)
 		{
-			wrapper->refCount++;
+			if (wrapper->reqFlags & MessageWait_Received)
+				wrapper->signalAck(MessageState::AckFlag_Received);
+
+			// Process message
+			::std::visit([this](auto&& msg) -> void {
+
+				static_cast<TargetT*>(this)->processMessage(FORWARD(msg));
+			}, wrapper->msg);
+
+			if (wrapper->reqFlags & MessageWait_Processed)
+				wrapper->signalAck(MessageState::AckFlag_Processed);
+
+			wrapper->releaseRef();
 		}
 
-		FORCE_INLINE void releaseRef(MessageWrapper* wrapper)
+		/* Puts the consumer to sleep until a message is posted. */
+		void waitMessages()
 		{
-			wrapper->refCount--;
-			if (wrapper->refCount == 0)
-			{
-				// Delete message
-				delete wrapper;
-			}
+			// Producers check the flag after pushing, and the consumer checks
+			// the head after raising it, so either the producer sees the flag
+			// or the consumer sees the message
+			consumerParked.store(1, ::std::memory_order_seq_cst);
+			if (isEmpty())
+				futexWait(consumerParked, 1);
+			else
+				// Messages are queued, or being linked, let the producer
+				// finish
+				::std::this_thread::yield();
+			consumerParked.store(0, ::std::memory_order_relaxed);
+		}
+
+		/* Wakes up the consumer if it is sleeping. */
+		FORCE_INLINE void wakeConsumer()
+		{
+			if (consumerParked.load(::std::memory_order_seq_cst) != 0
+			 && consumerParked.exchange(0, ::std::memory_order_seq_cst) != 0)
+				futexWake(consumerParked, false);
 		}
 	};
 } // namespace VaporWorldVR
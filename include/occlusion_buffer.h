@@ -0,0 +1,175 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "math/vec3.h"
+#include "math/vec4.h"
+#include "math/mat4.h"
+
+
+namespace VaporWorldVR
+{
+	class DensityField;
+
+
+	/* The number of cells along each side of a chunk, in which the occluder
+	   of the chunk is built. */
+	constexpr uint32_t occluderCellsPerChunk = 8;
+
+	/* The number of density samples along each side of a cell of an
+	   occluder. */
+	constexpr uint32_t occluderSamplesPerCell = 4;
+
+
+	/**
+	 * @brief Builds the occluder of a chunk, a simplified hull of the solid
+	 * part of the terrain in the chunk.
+	 *
+	 * The chunk is split in occluderCellsPerChunk cells along each side. A
+	 * cell is solid if the density at its samples is greater than the bound
+	 * of the gradient times the largest distance of a point of the cell from
+	 * the closest sample, so the whole cell is certainly inside the terrain.
+	 * Cells below the surface height range are solid and cells above are
+	 * empty without sampling. The faces between solid and empty cells are
+	 * merged in rectangles and emitted as triangles, counter-clockwise when
+	 * seen from outside. The occluder is thus entirely inside the terrain,
+	 * and at most about a cell below the surface.
+	 *
+	 * The cells that are neither certainly solid nor certainly empty contain
+	 * the surface, and the mesh of the chunk, whose vertices are on the edges
+	 * of the voxels crossed by the surface. Their bounds are much tighter
+	 * than the bounds of the chunk, and are used to test the chunk against
+	 * the occluders.
+	 *
+	 * @param field The density field of the terrain
+	 * @param chunkIdx The index of the chunk
+	 * @param[out] outVertices The vector to which the triangles are
+	 *                         appended, three vertices per triangle
+	 * @param[out] outSurfaceMin If not null, the minimum corner of the bounds
+	 *                           of the surface in the chunk
+	 * @param[out] outSurfaceMax If not null, the maximum corner of the bounds
+	 *                           of the surface in the chunk. Less than the
+	 *                           minimum corner if the surface does not cross
+	 *                           the chunk
+	 * @return The number of triangles appended
+	 */
+	size_t buildChunkOccluder(DensityField const& field, int3 const& chunkIdx, ::std::vector<float3>& outVertices,
+	                          float3* outSurfaceMin = nullptr, float3* outSurfaceMax = nullptr);
+
+
+	/**
+	 * @brief A low resolution depth buffer in which occluders are rendered
+	 * on the CPU, to cull objects hidden behind them.
+	 *
+	 * Triangles are rasterized eight pixels of a row at a time: the edge
+	 * functions give the coverage mask of the pixels, and the depth is only
+	 * written to the covered ones. The buffer stores the inverse of the view
+	 * depth, which is linear in screen space, so larger values are closer.
+	 * The depth written by a triangle is moved back by its change across
+	 * half a pixel, so it is never closer than the triangle anywhere in the
+	 * pixel. After rendering, the farthest depth of each tile is stored in a
+	 * coarser level, such that most boxes are tested against a few tiles
+	 * only.
+	 *
+	 * Coverage is sampled at the pixel centers, hence an object that is only
+	 * visible through a gap thinner than a pixel may be culled.
+	 */
+	class OcclusionBuffer
+	{
+	public:
+		/* The size of the tiles of the coarse level, in pixels. */
+		/// @{
+		static constexpr uint32_t tileWidth = 8;
+		static constexpr uint32_t tileHeight = 8;
+		/// @}
+
+		/**
+		 * @brief Constructs a new buffer with the given resolution.
+		 *
+		 * @param inWidth The width, must be a multiple of tileWidth
+		 * @param inHeight The height, must be a multiple of tileHeight
+		 */
+		OcclusionBuffer(uint32_t inWidth, uint32_t inHeight);
+
+		/**
+		 * @brief Returns the width of the buffer.
+		 */
+		FORCE_INLINE uint32_t getWidth() const
+		{
+			return width;
+		}
+
+		/**
+		 * @brief Returns the height of the buffer.
+		 */
+		FORCE_INLINE uint32_t getHeight() const
+		{
+			return height;
+		}
+
+		/**
+		 * @brief Returns the inverse depths of the pixels, row by row from
+		 * the bottom one. Zero where nothing was rendered.
+		 */
+		FORCE_INLINE ::std::span<float const> getDepths() const
+		{
+			return depths;
+		}
+
+		/**
+		 * @brief Clears the buffer, and sets the camera used to render the
+		 * occluders and test the objects.
+		 *
+		 * @param inViewProj The view-projection matrix of the camera, with
+		 *                   the OpenGL clip space conventions
+		 */
+		void begin(float4x4 const& inViewProj);
+
+		/**
+		 * @brief Renders a sequence of occluder triangles. Triangles are
+		 * clipped against the near plane, and back faces are culled.
+		 *
+		 * @param vertices The vertices of the triangles, three per triangle,
+		 *                 counter-clockwise when seen from the front
+		 */
+		void renderTriangles(::std::span<float3 const> vertices);
+
+		/**
+		 * @brief Updates the coarse level of the buffer. Must be called after
+		 * all occluders have been rendered, and before testing objects.
+		 */
+		void end();
+
+		/**
+		 * @brief Returns false if the given AABB is hidden behind the
+		 * occluders, or outside of the screen.
+		 *
+		 * The box is tested with its screen rectangle and its closest depth.
+		 * Boxes that cross the near plane are always visible.
+		 *
+		 * @param min The minimum corner of the AABB
+		 * @param max The maximum corner of the AABB
+		 */
+		bool testAABB(float3 const& min, float3 const& max) const;
+
+	protected:
+		/* The resolution of the buffer. */
+		/// @{
+		uint32_t width;
+		uint32_t height;
+		/// @}
+
+		/* The view-projection matrix of the camera. */
+		float4x4 viewProj;
+
+		/* The inverse depth of each pixel. */
+		::std::vector<float> depths;
+
+		/* The farthest inverse depth of each tile. */
+		::std::vector<float> tileDepths;
+
+		/* Rasterizes a triangle in front of the near plane. */
+		void rasterizeTriangle(float4 const& a, float4 const& b, float4 const& c);
+	};
+} // namespace VaporWorldVR
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <span>
+
+#include "math/vec3.h"
+#include "math/vec4.h"
+#include "math/packed.h"
+
+
+namespace VaporWorldVR
+{
+	/**
+	 * @brief Converts a sequence of floats to halves, rounding to nearest
+	 * even. The result is the same as converting each value with Half(float).
+	 *
+	 * The source and destination sequences must have the same size. Use the
+	 * Vec3 overload to convert positions to Half3.
+	 *
+	 * @param src The values to convert
+	 * @param dst The converted values
+	 * @{
+	 */
+	void packHalf(::std::span<float const> src, ::std::span<half> dst);
+
+	void packHalf(::std::span<float3 const> src, ::std::span<half3> dst);
+	/// @}
+
+	/**
+	 * @brief Inverse of packHalf(), converts a sequence of halves to floats.
+	 *
+	 * @param src The values to convert
+	 * @param dst The converted values
+	 */
+	void unpackHalf(::std::span<half const> src, ::std::span<float> dst);
+
+	/**
+	 * @brief Encodes a sequence of unit vectors on the octahedron. The result
+	 * is the same as encoding each vector with OctNormal(Vec3<float>).
+	 *
+	 * @param src The unit vectors to encode
+	 * @param dst The encoded vectors
+	 */
+	void packOctNormals(::std::span<float3 const> src, ::std::span<octnormal> dst);
+
+	/**
+	 * @brief Encodes a sequence of Vec4 as normalized integers. The result is
+	 * the same as encoding each vector with the constructor of the packed
+	 * type.
+	 *
+	 * @param src The vectors to encode
+	 * @param dst The encoded vectors
+	 * @{
+	 */
+	void packUnorm8x4(::std::span<float4 const> src, ::std::span<unorm8x4> dst);
+
+	void packSnorm16x4(::std::span<float4 const> src, ::std::span<snorm16x4> dst);
+
+	void packRGB10A2(::std::span<float4 const> src, ::std::span<rgb10a2> dst);
+	/// @}
+} // namespace VaporWorldVR
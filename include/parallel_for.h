@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <type_traits>
+
+#include "core_types.h"
+
+
+namespace VaporWorldVR
+{
+	/* Type of the function called by parallelFor_Impl() to process a range. */
+	using ParallelForRangeFn = void (*)(void* payload, size_t begin, size_t end);
+
+
+	/**
+	 * @brief Returns the number of worker threads used by parallelFor(), not
+	 * counting the calling thread.
+	 *
+	 * Workers are created the first time this function or parallelFor() are
+	 * called.
+	 */
+	uint32_t getNumParallelForWorkers();
+
+	/**
+	 * @brief Internal implementation of parallelFor(), see parallelFor().
+	 */
+	void parallelFor_Impl(size_t count, size_t minBatchSize, ParallelForRangeFn fn, void* payload);
+
+	/**
+	 * @brief Splits the range [0, count) in batches and processes them in
+	 * parallel on the worker threads and the calling thread.
+	 *
+	 * The function returns after all batches have been processed. If the
+	 * count is not greater than the minimum batch size, or if another
+	 * parallelFor() is already in progress, the whole range is processed on
+	 * the calling thread.
+	 *
+	 * @param count The number of items to process
+	 * @param minBatchSize The minimum number of items processed by a single
+	 *                     call to the function
+	 * @param fn A callable with signature void(size_t begin, size_t end)
+	 */
+	template<typename FnT>
+	FORCE_INLINE void parallelFor(size_t count, size_t minBatchSize, FnT&& fn)
+	{
+		using CallableT = ::std::remove_reference_t<FnT>;
+		parallelFor_Impl(count, minBatchSize, [](void* payload, size_t begin, size_t end) -> void {
+
+			(*reinterpret_cast<CallableT*>(payload))(begin, end);
+		}, const_cast<void*>(reinterpret_cast<void const*>(&fn)));
+	}
+} // namespace VaporWorldVR
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <span>
+
+#include "math/vec3.h"
+#include "collision_utils.h"
+#include "transform_batch.h"
+
+
+namespace VaporWorldVR
+{
+	class DensityField;
+	class DensityGridCache;
+
+
+	/* Batches with more bodies than this are split between the
+	   parallelFor() workers. */
+	constexpr size_t terrainQueryParallelThreshold = 16;
+
+
+	/**
+	 * @brief Computes the contact between a sphere and the terrain.
+	 *
+	 * The bound of the gradient of the density rejects spheres far from the
+	 * surface. Otherwise, the surface is searched along the gradient at the
+	 * center of the sphere, sampling eight points at once, and refined with
+	 * a few steps of regula falsi. The penetration is measured along the
+	 * gradient, so it is exact for locally flat terrain.
+	 *
+	 * @param field The density field of the terrain
+	 * @param center The center of the sphere
+	 * @param radius The radius of the sphere
+	 * @param cache If not null, a cache of the field used to reject spheres
+	 *              far from the surface
+	 * @return The contact, or no contact
+	 */
+	ContactResult overlapSphereTerrain(DensityField const& field, float3 const& center, float radius,
+	                                   DensityGridCache const* cache = nullptr);
+
+	/**
+	 * @brief Like overlapSphereTerrain(), but for a capsule.
+	 *
+	 * The density is sampled at eight points along the segment at once, and
+	 * the point closest to the surface, according to the gradient, is
+	 * tested like a sphere.
+	 *
+	 * @param field The density field of the terrain
+	 * @param segmentStart The start of the segment of the capsule
+	 * @param segmentEnd The end of the segment of the capsule
+	 * @param radius The radius of the capsule
+	 * @param cache If not null, a cache of the field used to reject capsules
+	 *              far from the surface
+	 * @return The contact, or no contact
+	 */
+	ContactResult overlapCapsuleTerrain(DensityField const& field, float3 const& segmentStart,
+	                                    float3 const& segmentEnd, float radius,
+	                                    DensityGridCache const* cache = nullptr);
+
+	/**
+	 * @brief Moves a sphere along a direction and finds the first contact
+	 * with the terrain.
+	 *
+	 * The sphere advances by half the distance from the surface estimated
+	 * from the density and its gradient, or by the lower bound given by the
+	 * bound of the gradient if greater, and by at least half a voxel. The
+	 * first contact is refined with bisection. Like raycastTerrain(),
+	 * features smaller than a voxel may be missed.
+	 *
+	 * @param field The density field of the terrain
+	 * @param center The starting center of the sphere
+	 * @param radius The radius of the sphere
+	 * @param dir The direction of the movement (does not need to be
+	 *            normalized)
+	 * @param maxDist The maximum distance of the movement
+	 * @param[out] outDist If not null and a contact occured, the distance of
+	 *                     the movement at the first contact
+	 * @param cache If not null, a cache of the field used to step faster far
+	 *              from the surface
+	 * @return The first contact, or no contact. If the sphere overlaps the
+	 *         terrain at the start, the contact at the start
+	 */
+	ContactResult sweepSphereTerrain(DensityField const& field, float3 const& center, float radius,
+	                                 float3 const& dir, float maxDist, float* outDist = nullptr,
+	                                 DensityGridCache const* cache = nullptr);
+
+	/**
+	 * @brief Like sweepSphereTerrain(), but for a capsule.
+	 *
+	 * @param field The density field of the terrain
+	 * @param segmentStart The starting start of the segment of the capsule
+	 * @param segmentEnd The starting end of the segment of the capsule
+	 * @param radius The radius of the capsule
+	 * @param dir The direction of the movement (does not need to be
+	 *            normalized)
+	 * @param maxDist The maximum distance of the movement
+	 * @param[out] outDist If not null and a contact occured, the distance of
+	 *                     the movement at the first contact
+	 * @param cache If not null, a cache of the field used to step faster far
+	 *              from the surface
+	 * @return The first contact, or no contact
+	 */
+	ContactResult sweepCapsuleTerrain(DensityField const& field, float3 const& segmentStart,
+	                                  float3 const& segmentEnd, float radius, float3 const& dir, float maxDist,
+	                                  float* outDist = nullptr, DensityGridCache const* cache = nullptr);
+
+	/**
+	 * @brief Computes the contacts between a sequence of spheres and the
+	 * terrain, see overlapSphereTerrain(). Large batches are processed in
+	 * parallel.
+	 *
+	 * @param field The density field of the terrain
+	 * @param centers The centers of the spheres
+	 * @param radii The radii of the spheres, same size as the centers
+	 * @param[out] outContacts The contact of each sphere, same size as the
+	 *                         centers
+	 * @param cache If not null, a cache of the field, see prepare()
+	 */
+	void overlapSpheresTerrain(DensityField const& field, Vec3SoA<float const> const& centers,
+	                           ::std::span<float const> radii, ::std::span<ContactResult> outContacts,
+	                           DensityGridCache const* cache = nullptr);
+
+	/**
+	 * @brief Moves a sequence of spheres and finds their first contacts with
+	 * the terrain, see sweepSphereTerrain(). Large batches are processed in
+	 * parallel.
+	 *
+	 * @param field The density field of the terrain
+	 * @param centers The starting centers of the spheres
+	 * @param radii The radii of the spheres, same size as the centers
+	 * @param motions The movement of each sphere, same size as the centers
+	 * @param[out] outContacts The first contact of each sphere, same size as
+	 *                         the centers
+	 * @param[out] outFractions The fraction of the movement of each sphere
+	 *                          before the first contact, 1 if no contact
+	 *                          occured. Same size as the centers
+	 * @param cache If not null, a cache of the field, see prepare()
+	 */
+	void sweepSpheresTerrain(DensityField const& field, Vec3SoA<float const> const& centers,
+	                         ::std::span<float const> radii, Vec3SoA<float const> const& motions,
+	                         ::std::span<ContactResult> outContacts, ::std::span<float> outFractions,
+	                         DensityGridCache const* cache = nullptr);
+} // namespace VaporWorldVR
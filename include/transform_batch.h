@@ -0,0 +1,105 @@
+#pragma once
+
+#include <span>
+
+#include "math/vec3.h"
+#include "math/vec4.h"
+#include "math/mat4.h"
+#include "math/transform.h"
+
+
+namespace VaporWorldVR
+{
+	/**
+	 * @brief A structure of arrays view of a sequence of 3-component vectors.
+	 *
+	 * All arrays must have the same size.
+	 *
+	 * @tparam T The type of the coordinates, possibly const-qualified
+	 */
+	template<typename T>
+	struct Vec3SoA
+	{
+		/* The arrays of coordinates. */
+		/// @{
+		::std::span<T> x;
+		::std::span<T> y;
+		::std::span<T> z;
+		/// @}
+
+		/**
+		 * @brief Returns the number of vectors.
+		 */
+		constexpr FORCE_INLINE size_t size() const
+		{
+			return x.size();
+		}
+
+		/**
+		 * @brief Converts a mutable view to a const view.
+		 */
+		constexpr FORCE_INLINE operator Vec3SoA<T const>() const
+		{
+			return {x, y, z};
+		}
+	};
+
+
+	/* Batches larger than this are split between the parallelFor() workers. */
+	constexpr size_t transformBatchParallelThreshold = 0x4000;
+
+
+	/**
+	 * @brief Applies the transformation described by the given matrix to a
+	 * sequence of position vectors (i.e. with W = 1).
+	 *
+	 * The source and destination sequences must have the same size, and may
+	 * be the same sequence. Any other overlap is not allowed.
+	 *
+	 * @param m The transformation matrix
+	 * @param src The vectors to transform
+	 * @param dst The transformed vectors
+	 * @{
+	 */
+	void transformPoints(float4x4 const& m, ::std::span<float3 const> src, ::std::span<float3> dst);
+
+	void transformPoints(float4x4 const& m, Vec3SoA<float const> const& src, Vec3SoA<float> const& dst);
+	/// @}
+
+	/**
+	 * @brief Like transformPoints(), but transforms direction vectors (i.e.
+	 * with W = 0). Translation does not affect directions.
+	 *
+	 * @param m The transformation matrix
+	 * @param src The vectors to transform
+	 * @param dst The transformed vectors
+	 * @{
+	 */
+	void transformDirections(float4x4 const& m, ::std::span<float3 const> src, ::std::span<float3> dst);
+
+	void transformDirections(float4x4 const& m, Vec3SoA<float const> const& src, Vec3SoA<float> const& dst);
+	/// @}
+
+	/**
+	 * @brief Computes the dot product between the given matrix and a
+	 * sequence of Vec4.
+	 *
+	 * If both sequences are 16 bytes aligned, aligned loads and stores are
+	 * used.
+	 *
+	 * @param m The transformation matrix
+	 * @param src The vectors to transform
+	 * @param dst The transformed vectors
+	 */
+	void transformVectors(float4x4 const& m, ::std::span<float4 const> src, ::std::span<float4> dst);
+
+	/**
+	 * @brief Bakes a sequence of transformations to matrices, e.g. before
+	 * uploading them to the GPU. The result is the same as converting each
+	 * transformation to a Mat4.
+	 *
+	 * @param src The transformations to bake
+	 * @param dst The baked matrices
+	 */
+	void bakeTransforms(::std::span<Math::Transform const> src, ::std::span<float4x4> dst);
+} // namespace VaporWorldVR
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "math/vec3.h"
+#include "math/vec4.h"
+#include "math/packet.h"
+#include "collision_utils.h"
+
+
+namespace VaporWorldVR
+{
+	/**
+	 * @brief A node of a TriangleBVH.
+	 *
+	 * The children of an internal node are adjacent, the left child is at
+	 * leftOrFirst and the right child right after it.
+	 */
+	struct TriangleBVHNode
+	{
+		/* The minimum corner of the bounds of the node. */
+		float3 min;
+
+		/* The index of the left child for internal nodes, or the index of
+		   the block of triangles for leaves. */
+		uint32_t leftOrFirst;
+
+		/* The maximum corner of the bounds of the node. */
+		float3 max;
+
+		/* The number of triangles of leaves, 0 for internal nodes. */
+		uint32_t numTriangles;
+
+		/**
+		 * @brief Returns true if the node is a leaf.
+		 */
+		constexpr FORCE_INLINE bool isLeaf() const
+		{
+			return numTriangles > 0;
+		}
+	};
+
+	static_assert(sizeof(TriangleBVHNode) == 32, "TriangleBVHNode should fit in half a cache line");
+
+
+	/**
+	 * @brief A bounding volume hierarchy of triangles, used for precise ray
+	 * hits against the meshes of the chunks.
+	 *
+	 * The tree is built with the surface area heuristic, evaluated on a
+	 * fixed number of bins. Each leaf holds up to four triangles, stored in
+	 * structure of arrays layout, so that a ray is tested against all of
+	 * them at once. Packets of coherent rays, e.g. the rays of a controller
+	 * laser or a gaze cone, traverse the tree together and are tested against
+	 * each node and triangle at once.
+	 *
+	 * A tree is independent from the GL context and from other trees, so it
+	 * can be built on a worker thread after meshing.
+	 */
+	class TriangleBVH
+	{
+	public:
+		/* The maximum number of triangles in a leaf. */
+		static constexpr uint32_t maxLeafSize = 4;
+
+		/* The number of bins in which the centroids are split along each
+		   axis when building the tree. */
+		static constexpr uint32_t numBins = 8;
+
+		/**
+		 * @brief Rebuilds the tree from the given triangle soup.
+		 *
+		 * @param vertices The vertices of the triangles, three per triangle.
+		 *                 XYZ is the position, W is ignored, like in
+		 *                 ChunkVertexPositionOnly
+		 */
+		void build(::std::span<float4 const> vertices);
+
+		/**
+		 * @brief Returns the nodes of the tree, the root is the first one.
+		 */
+		FORCE_INLINE ::std::span<TriangleBVHNode const> getNodes() const
+		{
+			return nodes;
+		}
+
+		/**
+		 * @brief Returns the number of triangles in the tree.
+		 */
+		FORCE_INLINE size_t getNumTriangles() const
+		{
+			return numTriangles;
+		}
+
+		/**
+		 * @brief Computes the closest intersection between a ray and the
+		 * triangles.
+		 *
+		 * Both sides of the triangles are hit, the normal faces the ray.
+		 *
+		 * @param rayStart The starting point of the ray
+		 * @param rayDir The direction of the ray (does not need to be
+		 *               normalized, distances are in units of its length)
+		 * @param maxDist The maximum distance along the ray
+		 * @param[out] outTriangle If not null and a hit occured, the index of
+		 *                         the triangle in the soup
+		 * @return The closest hit, or no hit
+		 */
+		HitResult raycast(float3 const& rayStart, float3 const& rayDir, float maxDist,
+		                  uint32_t* outTriangle = nullptr) const;
+
+		/**
+		 * @brief Like raycast(), but traces a packet of rays at once. Works
+		 * best with coherent rays, i.e. with similar origins and directions.
+		 *
+		 * @tparam N The number of rays, 4 or 8
+		 * @param rayStarts The starting points of the rays
+		 * @param rayDirs The directions of the rays
+		 * @param maxDists The maximum distances along the rays
+		 * @param[out] outHits The closest hit of each ray
+		 */
+		template<int N>
+		void raycast_Packet(Math::Packet<float3, N> const& rayStarts, Math::Packet<float3, N> const& rayDirs,
+		                    Math::Packet<float, N> const& maxDists, HitResult (&outHits)[N]) const;
+
+	protected:
+		/* A block of triangles, in structure of arrays layout. Triangles are
+		   stored as a vertex and two edges. Unused triangles are degenerate,
+		   and never hit. */
+		struct TriangleBlock
+		{
+			/* The first vertex and the edges, indexed by coordinate and
+			   triangle. */
+			/// @{
+			float v0[3][maxLeafSize];
+			float e1[3][maxLeafSize];
+			float e2[3][maxLeafSize];
+			/// @}
+
+			/* The indices of the triangles in the soup. */
+			uint32_t indices[maxLeafSize];
+		};
+
+		/* The nodes of the tree. */
+		::std::vector<TriangleBVHNode> nodes;
+
+		/* The triangles of the leaves, one block per leaf. */
+		::std::vector<TriangleBlock> blocks;
+
+		/* The number of triangles. */
+		size_t numTriangles = 0;
+	};
+} // namespace VaporWorldVR
@@ -0,0 +1,423 @@
+#include "aabb_tree.h"
+
+#include "math/math.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* Returns half the surface area of the given box, which is
+		   proportional to the probability that a random ray hits it. */
+		static FORCE_INLINE float getHalfArea(float3 const& min, float3 const& max)
+		{
+			float3 const size = max - min;
+			return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+		}
+
+		/* Returns true if the first box contains the second box. */
+		static FORCE_INLINE bool containsAABB(float3 const& outerMin, float3 const& outerMax, float3 const& min,
+		                                      float3 const& max)
+		{
+			return outerMin[0] <= min[0] && outerMin[1] <= min[1] && outerMin[2] <= min[2]
+			    && max[0] <= outerMax[0] && max[1] <= outerMax[1] && max[2] <= outerMax[2];
+		}
+
+		/* Returns true if the two boxes overlap. */
+		static FORCE_INLINE bool overlapAABB(float3 const& minA, float3 const& maxA, float3 const& minB,
+		                                     float3 const& maxB)
+		{
+			return minA[0] <= maxB[0] && minA[1] <= maxB[1] && minA[2] <= maxB[2]
+			    && minB[0] <= maxA[0] && minB[1] <= maxA[1] && minB[2] <= maxA[2];
+		}
+
+		/* Returns true if the sphere overlaps the box. */
+		static FORCE_INLINE bool overlapSphere(float3 const& min, float3 const& max, float3 const& center,
+		                                       float radius2)
+		{
+			float3 const closest = Math::vmin(Math::vmax(center, min), max);
+			return (closest - center).getSize2() <= radius2;
+		}
+
+		/* Writes the user data to the output, if there's room left. */
+		static FORCE_INLINE void appendResult(::std::span<uint32_t> out, size_t& count, uint32_t userData)
+		{
+			if (count < out.size())
+				out[count] = userData;
+			++count;
+		}
+
+		/* Mask with a bit for each plane of the frustum. */
+		constexpr uint32_t allPlanesMask = (1u << 6) - 1;
+	} // namespace
+
+
+	AABBTree::AABBTree(float inMargin)
+		: root{nullNode}
+		, freeList{nullNode}
+		, numProxies{0}
+		, margin{inMargin}
+	{}
+
+	uint32_t AABBTree::insert(float3 const& min, float3 const& max, uint32_t userData)
+	{
+		uint32_t const leaf = allocateNode();
+		Node& node = nodes[leaf];
+		node.min = min - margin;
+		node.max = max + margin;
+		node.userData = userData;
+		node.height = 0;
+		insertLeaf(leaf);
+		++numProxies;
+		return leaf;
+	}
+
+	void AABBTree::remove(uint32_t proxy)
+	{
+		VW_CHECKF(proxy < nodes.size() && nodes[proxy].isLeaf() && nodes[proxy].height == 0, "Invalid proxy %u",
+		          proxy);
+		removeLeaf(proxy);
+		freeNode(proxy);
+		--numProxies;
+	}
+
+	bool AABBTree::refit(uint32_t proxy, float3 const& min, float3 const& max)
+	{
+		VW_CHECKF(proxy < nodes.size() && nodes[proxy].isLeaf() && nodes[proxy].height == 0, "Invalid proxy %u",
+		          proxy);
+		Node& node = nodes[proxy];
+		if (containsAABB(node.min, node.max, min, max))
+			// Still in the fat box
+			return false;
+
+		removeLeaf(proxy);
+		node.min = min - margin;
+		node.max = max + margin;
+		insertLeaf(proxy);
+		return true;
+	}
+
+	size_t AABBTree::cullFrustum(Frustum const& frustum, ::std::span<uint32_t> outUserData) const
+	{
+		if (root == nullNode)
+			return 0;
+
+		// Each entry holds a node and the planes that may still cull it
+		uint32_t stack[maxStackSize];
+		uint32_t stackMasks[maxStackSize];
+		int stackSize = 0;
+		stack[stackSize] = root;
+		stackMasks[stackSize++] = allPlanesMask;
+
+		size_t count = 0;
+		while (stackSize > 0)
+		{
+			--stackSize;
+			Node const& node = nodes[stack[stackSize]];
+			uint32_t mask = stackMasks[stackSize];
+
+			bool outside = false;
+			for (int i = 0; i < 6 && !outside; ++i)
+			{
+				if (!(mask & (1u << i)))
+					continue;
+
+				// Test the p-vertex and the n-vertex of the node
+				float4 const& plane = frustum.planes[i];
+				float3 const p{plane[0] >= 0.f ? node.max[0] : node.min[0],
+				               plane[1] >= 0.f ? node.max[1] : node.min[1],
+				               plane[2] >= 0.f ? node.max[2] : node.min[2]};
+				float3 const n{plane[0] >= 0.f ? node.min[0] : node.max[0],
+				               plane[1] >= 0.f ? node.min[1] : node.max[1],
+				               plane[2] >= 0.f ? node.min[2] : node.max[2]};
+				if (plane.xyz.dot(p) + plane.w < 0.f)
+					outside = true;
+				else if (plane.xyz.dot(n) + plane.w >= 0.f)
+					// Fully inside, skip this plane for the children
+					mask &= ~(1u << i);
+			}
+
+			if (outside)
+				continue;
+
+			if (node.isLeaf())
+			{
+				appendResult(outUserData, count, node.userData);
+				continue;
+			}
+
+			if (mask == 0)
+			{
+				// Fully inside the frustum, collect all leaves. The stack
+				// holds the rest of this subtree too
+				int const base = stackSize;
+				stack[stackSize++] = node.children[0];
+				stack[stackSize++] = node.children[1];
+				while (stackSize > base)
+				{
+					Node const& child = nodes[stack[--stackSize]];
+					if (child.isLeaf())
+						appendResult(outUserData, count, child.userData);
+					else
+					{
+						VW_CHECKF(stackSize + 2 <= maxStackSize, "AABB tree traversal stack overflow");
+						stack[stackSize++] = child.children[0];
+						stack[stackSize++] = child.children[1];
+					}
+				}
+				continue;
+			}
+
+			VW_CHECKF(stackSize + 2 <= maxStackSize, "AABB tree traversal stack overflow");
+			stack[stackSize] = node.children[0];
+			stackMasks[stackSize++] = mask;
+			stack[stackSize] = node.children[1];
+			stackMasks[stackSize++] = mask;
+		}
+
+		return count;
+	}
+
+	size_t AABBTree::querySphere(float3 const& center, float radius, ::std::span<uint32_t> outUserData) const
+	{
+		if (root == nullNode)
+			return 0;
+
+		uint32_t stack[maxStackSize];
+		int stackSize = 0;
+		stack[stackSize++] = root;
+
+		size_t count = 0;
+		float const radius2 = radius * radius;
+		while (stackSize > 0)
+		{
+			Node const& node = nodes[stack[--stackSize]];
+			if (!overlapSphere(node.min, node.max, center, radius2))
+				continue;
+
+			if (node.isLeaf())
+				appendResult(outUserData, count, node.userData);
+			else
+			{
+				VW_CHECKF(stackSize + 2 <= maxStackSize, "AABB tree traversal stack overflow");
+				stack[stackSize++] = node.children[0];
+				stack[stackSize++] = node.children[1];
+			}
+		}
+
+		return count;
+	}
+
+	size_t AABBTree::queryAABB(float3 const& min, float3 const& max, ::std::span<uint32_t> outUserData) const
+	{
+		if (root == nullNode)
+			return 0;
+
+		uint32_t stack[maxStackSize];
+		int stackSize = 0;
+		stack[stackSize++] = root;
+
+		size_t count = 0;
+		while (stackSize > 0)
+		{
+			Node const& node = nodes[stack[--stackSize]];
+			if (!overlapAABB(node.min, node.max, min, max))
+				continue;
+
+			if (node.isLeaf())
+				appendResult(outUserData, count, node.userData);
+			else
+			{
+				VW_CHECKF(stackSize + 2 <= maxStackSize, "AABB tree traversal stack overflow");
+				stack[stackSize++] = node.children[0];
+				stack[stackSize++] = node.children[1];
+			}
+		}
+
+		return count;
+	}
+
+	uint32_t AABBTree::allocateNode()
+	{
+		uint32_t nodeIdx = freeList;
+		if (nodeIdx == nullNode)
+		{
+			// No free nodes, grow the pool
+			nodeIdx = static_cast<uint32_t>(nodes.size());
+			nodes.emplace_back();
+		}
+		else
+			freeList = nodes[nodeIdx].parent;
+
+		Node& node = nodes[nodeIdx];
+		node.parent = nullNode;
+		node.children[0] = node.children[1] = nullNode;
+		node.height = 0;
+		node.userData = 0;
+		return nodeIdx;
+	}
+
+	void AABBTree::freeNode(uint32_t nodeIdx)
+	{
+		nodes[nodeIdx].parent = freeList;
+		nodes[nodeIdx].height = -1;
+		freeList = nodeIdx;
+	}
+
+	void AABBTree::insertLeaf(uint32_t leaf)
+	{
+		if (root == nullNode)
+		{
+			root = leaf;
+			nodes[root].parent = nullNode;
+			return;
+		}
+
+		// Find the best sibling, descending towards the child with the
+		// lowest cost. The cost of a sibling is the area of the new parent,
+		// plus the area added to the ancestors
+		float3 const leafMin = nodes[leaf].min, leafMax = nodes[leaf].max;
+		uint32_t sibling = root;
+		while (!nodes[sibling].isLeaf())
+		{
+			Node const& node = nodes[sibling];
+			float const area = getHalfArea(node.min, node.max);
+			float const combinedArea = getHalfArea(Math::vmin(node.min, leafMin), Math::vmax(node.max, leafMax));
+
+			// Cost of making a new parent for this node and the leaf, and
+			// minimum cost of pushing the leaf further down
+			float const cost = 2.f * combinedArea;
+			float const inheritanceCost = 2.f * (combinedArea - area);
+
+			float childCosts[2];
+			for (int i = 0; i < 2; ++i)
+			{
+				Node const& child = nodes[node.children[i]];
+				float const childArea = getHalfArea(Math::vmin(child.min, leafMin), Math::vmax(child.max, leafMax));
+				childCosts[i] = (child.isLeaf() ? childArea : childArea - getHalfArea(child.min, child.max))
+				              + inheritanceCost;
+			}
+
+			if (cost < childCosts[0] && cost < childCosts[1])
+				break;
+
+			sibling = node.children[childCosts[1] < childCosts[0]];
+		}
+
+		// Make a new parent for the sibling and the leaf
+		uint32_t const oldParent = nodes[sibling].parent;
+		uint32_t const newParent = allocateNode();
+		Node& parentNode = nodes[newParent];
+		parentNode.parent = oldParent;
+		parentNode.min = Math::vmin(nodes[sibling].min, leafMin);
+		parentNode.max = Math::vmax(nodes[sibling].max, leafMax);
+		parentNode.height = nodes[sibling].height + 1;
+		parentNode.children[0] = sibling;
+		parentNode.children[1] = leaf;
+		nodes[sibling].parent = newParent;
+		nodes[leaf].parent = newParent;
+
+		if (oldParent == nullNode)
+			root = newParent;
+		else
+		{
+			Node& oldParentNode = nodes[oldParent];
+			oldParentNode.children[oldParentNode.children[1] == sibling] = newParent;
+		}
+
+		refitAncestors(oldParent);
+	}
+
+	void AABBTree::removeLeaf(uint32_t leaf)
+	{
+		if (leaf == root)
+		{
+			root = nullNode;
+			return;
+		}
+
+		// Replace the parent with the sibling
+		uint32_t const parent = nodes[leaf].parent;
+		uint32_t const grandParent = nodes[parent].parent;
+		uint32_t const sibling = nodes[parent].children[nodes[parent].children[0] == leaf];
+		nodes[sibling].parent = grandParent;
+		freeNode(parent);
+
+		if (grandParent == nullNode)
+			root = sibling;
+		else
+		{
+			Node& grandParentNode = nodes[grandParent];
+			grandParentNode.children[grandParentNode.children[1] == parent] = sibling;
+			refitAncestors(grandParent);
+		}
+	}
+
+	void AABBTree::refitAncestors(uint32_t nodeIdx)
+	{
+		while (nodeIdx != nullNode)
+		{
+			nodeIdx = balance(nodeIdx);
+
+			Node& node = nodes[nodeIdx];
+			Node const& child0 = nodes[node.children[0]];
+			Node const& child1 = nodes[node.children[1]];
+			node.min = Math::vmin(child0.min, child1.min);
+			node.max = Math::vmax(child0.max, child1.max);
+			node.height = 1 + Math::max(child0.height, child1.height);
+
+			nodeIdx = node.parent;
+		}
+	}
+
+	uint32_t AABBTree::balance(uint32_t nodeIdx)
+	{
+		Node& node = nodes[nodeIdx];
+		if (node.isLeaf())
+			return nodeIdx;
+
+		// Rotate the higher child up, if the heights differ by more than one
+		int32_t const heightDiff = nodes[node.children[1]].height - nodes[node.children[0]].height;
+		if (heightDiff >= -1 && heightDiff <= 1)
+			return nodeIdx;
+
+		int const upSide = heightDiff > 0;
+		uint32_t const upIdx = node.children[upSide];
+		Node& up = nodes[upIdx];
+
+		// The up node takes the place of the node
+		up.parent = node.parent;
+		node.parent = upIdx;
+		if (up.parent == nullNode)
+			root = upIdx;
+		else
+		{
+			Node& parentNode = nodes[up.parent];
+			parentNode.children[parentNode.children[1] == nodeIdx] = upIdx;
+		}
+
+		// The higher grandchild stays under the up node, the other one
+		// replaces the up node under the node
+		Node const& grandChild0 = nodes[up.children[0]];
+		Node const& grandChild1 = nodes[up.children[1]];
+		int const keepSide = grandChild1.height > grandChild0.height;
+		uint32_t const keepIdx = up.children[keepSide];
+		uint32_t const moveIdx = up.children[!keepSide];
+		up.children[0] = nodeIdx;
+		up.children[1] = keepIdx;
+		node.children[upSide] = moveIdx;
+		nodes[moveIdx].parent = nodeIdx;
+
+		Node const& sibling = nodes[node.children[!upSide]];
+		Node const& moved = nodes[moveIdx];
+		node.min = Math::vmin(sibling.min, moved.min);
+		node.max = Math::vmax(sibling.max, moved.max);
+		node.height = 1 + Math::max(sibling.height, moved.height);
+
+		Node const& kept = nodes[keepIdx];
+		up.min = Math::vmin(node.min, kept.min);
+		up.max = Math::vmax(node.max, kept.max);
+		up.height = 1 + Math::max(node.height, kept.height);
+		return upIdx;
+	}
+} // namespace VaporWorldVR
@@ -0,0 +1,159 @@
+#include "block_pool.h"
+
+#include <bit>
+#include <new>
+
+#include "mutex.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	BlockPool::BlockPool(size_t inBlockSize, size_t inBlockAlign, size_t initialCapacity)
+		: blockStride{0}
+		, headerSize{0}
+		, firstSlabSize{initialCapacity > 0 ? initialCapacity : 1}
+		, slabs{}
+		, numSlabs{0}
+		, freeList{nullIndex}
+		, numUsed{0}
+		, highWaterMark{0}
+		, growMutex{createMutex()}
+	{
+		VW_CHECKF(::std::has_single_bit(inBlockAlign) && inBlockAlign <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+		          "Invalid block alignment %zu", inBlockAlign);
+
+		// The block follows its header, and the next header follows the
+		// block, so both must be aligned
+		size_t const align = inBlockAlign > alignof(BlockHeader) ? inBlockAlign : alignof(BlockHeader);
+		headerSize = (sizeof(BlockHeader) + align - 1) & ~(align - 1);
+		blockStride = headerSize + ((inBlockSize + align - 1) & ~(align - 1));
+
+		grow();
+	}
+
+	BlockPool::~BlockPool()
+	{
+		VW_CHECKF(numUsed.load(::std::memory_order_relaxed) == 0, "Destroying pool with %zu blocks in use",
+		          numUsed.load(::std::memory_order_relaxed));
+
+		for (uint32_t i = 0, n = numSlabs.load(::std::memory_order_relaxed); i < n; ++i)
+		{
+			::operator delete(slabs[i].load(::std::memory_order_relaxed));
+		}
+		destroyMutex(growMutex);
+	}
+
+	void* BlockPool::allocate()
+	{
+		uint64_t head = freeList.load(::std::memory_order_acquire);
+		for (;;)
+		{
+			uint32_t const index = static_cast<uint32_t>(head);
+			if (index == nullIndex)
+			{
+				if (!grow())
+					return nullptr;
+
+				head = freeList.load(::std::memory_order_acquire);
+				continue;
+			}
+
+			// If the block is popped and pushed back by other threads in the
+			// meantime, the next index may be stale, but the counter changed
+			// and the exchange fails. Slabs are never freed, so reading the
+			// header of a block in use is safe
+			BlockHeader* header = getHeader(index);
+			uint32_t const next = header->nextFree.load(::std::memory_order_relaxed);
+			uint64_t const newHead = ((head >> 32) + 1) << 32 | next;
+			if (freeList.compare_exchange_weak(head, newHead, ::std::memory_order_acquire,
+			                                   ::std::memory_order_acquire))
+			{
+				// Update the high water mark
+				size_t const used = numUsed.fetch_add(1, ::std::memory_order_relaxed) + 1;
+				size_t mark = highWaterMark.load(::std::memory_order_relaxed);
+				while (used > mark && !highWaterMark.compare_exchange_weak(mark, used, ::std::memory_order_relaxed))
+				{}
+
+				return reinterpret_cast<uint8_t*>(header) + headerSize;
+			}
+		}
+	}
+
+	void BlockPool::free(void* block)
+	{
+		if (!block)
+			return;
+
+		BlockHeader* header = reinterpret_cast<BlockHeader*>(static_cast<uint8_t*>(block) - headerSize);
+		VW_CHECKF(getHeader(header->index) == header, "Block @ %p does not belong to pool @ %p", block, this);
+		numUsed.fetch_sub(1, ::std::memory_order_relaxed);
+		pushFree(header->index, header);
+	}
+
+	BlockPoolStats BlockPool::getStats() const
+	{
+		uint32_t const n = numSlabs.load(::std::memory_order_acquire);
+		return {firstSlabSize * ((size_t{1} << n) - 1), numUsed.load(::std::memory_order_relaxed),
+		        highWaterMark.load(::std::memory_order_relaxed), n};
+	}
+
+	BlockPool::BlockHeader* BlockPool::getHeader(uint32_t index) const
+	{
+		// Slab i starts at block firstSlabSize * (2^i - 1)
+		uint32_t const slab = static_cast<uint32_t>(::std::bit_width(index / firstSlabSize + 1)) - 1;
+		size_t const offset = index - firstSlabSize * ((size_t{1} << slab) - 1);
+		return reinterpret_cast<BlockHeader*>(slabs[slab].load(::std::memory_order_acquire) + offset * blockStride);
+	}
+
+	void BlockPool::pushFree(uint32_t first, BlockHeader* last)
+	{
+		uint64_t head = freeList.load(::std::memory_order_relaxed);
+		uint64_t newHead;
+		do
+		{
+			last->nextFree.store(static_cast<uint32_t>(head), ::std::memory_order_relaxed);
+			newHead = ((head >> 32) + 1) << 32 | first;
+		} while (!freeList.compare_exchange_weak(head, newHead, ::std::memory_order_release,
+		                                         ::std::memory_order_relaxed));
+	}
+
+	bool BlockPool::grow()
+	{
+		bool grown = true;
+		growMutex->lock();
+		{
+			uint32_t const slab = numSlabs.load(::std::memory_order_relaxed);
+			size_t const slabSize = firstSlabSize << slab;
+			size_t const firstIndex = firstSlabSize * ((size_t{1} << slab) - 1);
+			if (static_cast<uint32_t>(freeList.load(::std::memory_order_acquire)) != nullIndex)
+			{
+				// Another thread already added blocks
+			}
+			else if (slab == maxSlabs || firstIndex + slabSize > nullIndex)
+			{
+				VW_LOG_ERROR("Block pool @ %p is full", this);
+				grown = false;
+			}
+			else
+			{
+				// Link the blocks of the new slab in a chain
+				uint8_t* blocks = static_cast<uint8_t*>(::operator new(slabSize * blockStride));
+				for (size_t i = 0; i < slabSize; ++i)
+				{
+					BlockHeader* header = new (blocks + i * blockStride) BlockHeader;
+					header->index = static_cast<uint32_t>(firstIndex + i);
+					header->nextFree.store(static_cast<uint32_t>(firstIndex + i + 1), ::std::memory_order_relaxed);
+				}
+
+				// Publish the slab before its blocks are reachable
+				slabs[slab].store(blocks, ::std::memory_order_release);
+				numSlabs.store(slab + 1, ::std::memory_order_release);
+				pushFree(static_cast<uint32_t>(firstIndex),
+				         reinterpret_cast<BlockHeader*>(blocks + (slabSize - 1) * blockStride));
+			}
+		}
+		growMutex->unlock();
+		return grown;
+	}
+} // namespace VaporWorldVR
@@ -0,0 +1,305 @@
+#include "broadphase.h"
+
+#include <math.h>
+
+#include "math/math.h"
+#include "parallel_for.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* The offset added to the coordinates of the cells, so they are
+		   stored unsigned. */
+		constexpr int coordBias = 1 << (SpatialHash::coordBits - 1);
+
+		/* The mask of a coordinate in a key. */
+		constexpr uint64_t coordMask = (1ull << SpatialHash::coordBits) - 1;
+
+		/* The initial size of the hash table. */
+		constexpr size_t minNumSlots = 64;
+
+		/* The offsets of the 13 neighbour cells that follow a cell, such
+		   that each pair of neighbours is visited once. */
+		constexpr int forwardNeighbours[13][3] = {
+			{1, 0, 0},
+			{-1, 1, 0}, {0, 1, 0}, {1, 1, 0},
+			{-1, -1, 1}, {0, -1, 1}, {1, -1, 1},
+			{-1, 0, 1}, {0, 0, 1}, {1, 0, 1},
+			{-1, 1, 1}, {0, 1, 1}, {1, 1, 1}
+		};
+
+		/* Returns the key of a cell. Coordinates out of range wrap, which
+		   may only alias distant cells. */
+		static FORCE_INLINE uint64_t makeCellKey(int x, int y, int z, int level)
+		{
+			return static_cast<uint64_t>(level) << (3 * SpatialHash::coordBits)
+			     | (static_cast<uint64_t>(x + coordBias) & coordMask) << (2 * SpatialHash::coordBits)
+			     | (static_cast<uint64_t>(y + coordBias) & coordMask) << SpatialHash::coordBits
+			     | (static_cast<uint64_t>(z + coordBias) & coordMask);
+		}
+
+		/* Returns the coordinates and the level of a cell. */
+		static FORCE_INLINE void decodeCellKey(uint64_t key, int& x, int& y, int& z, int& level)
+		{
+			x = static_cast<int>((key >> (2 * SpatialHash::coordBits)) & coordMask) - coordBias;
+			y = static_cast<int>((key >> SpatialHash::coordBits) & coordMask) - coordBias;
+			z = static_cast<int>(key & coordMask) - coordBias;
+			level = static_cast<int>(key >> (3 * SpatialHash::coordBits));
+		}
+	} // namespace
+
+
+	SpatialHash::SpatialHash(float inCellSize)
+		: cells(minNumSlots, Cell{emptyKey, nullProxy, 0})
+		, freeList{nullProxy}
+		, numProxies{0}
+		, numCells{0}
+		, levelCounts{}
+		, cellSize{inCellSize}
+		, invCellSize{1.f / inCellSize}
+	{
+		VW_CHECKF(inCellSize > 0.f, "Invalid cell size %f", inCellSize);
+	}
+
+	uint32_t SpatialHash::insert(float3 const& center, float radius, uint32_t userData)
+	{
+		uint32_t proxy = freeList;
+		if (proxy == nullProxy)
+		{
+			// No free proxies, grow the pool
+			proxy = static_cast<uint32_t>(proxies.size());
+			proxies.emplace_back();
+		}
+		else
+			freeList = proxies[proxy].next;
+
+		Proxy& node = proxies[proxy];
+		node.center = center;
+		node.radius = radius;
+		node.userData = userData;
+		node.cellKey = getCellKey(center, radius);
+		linkProxy(proxy);
+		++numProxies;
+		return proxy;
+	}
+
+	void SpatialHash::remove(uint32_t proxy)
+	{
+		VW_CHECKF(proxy < proxies.size() && proxies[proxy].cellKey != emptyKey, "Invalid proxy %u", proxy);
+		unlinkProxy(proxy);
+		proxies[proxy].cellKey = emptyKey;
+		proxies[proxy].next = freeList;
+		freeList = proxy;
+		--numProxies;
+	}
+
+	bool SpatialHash::move(uint32_t proxy, float3 const& center, float radius)
+	{
+		VW_CHECKF(proxy < proxies.size() && proxies[proxy].cellKey != emptyKey, "Invalid proxy %u", proxy);
+		Proxy& node = proxies[proxy];
+		node.center = center;
+		node.radius = radius;
+		uint64_t const cellKey = getCellKey(center, radius);
+		if (cellKey == node.cellKey)
+			// Still in the same cell
+			return false;
+
+		unlinkProxy(proxy);
+		node.cellKey = cellKey;
+		linkProxy(proxy);
+		return true;
+	}
+
+	size_t SpatialHash::findPairs(::std::vector<BroadphasePair>& outPairs) const
+	{
+		outPairs.clear();
+
+		// Tests all pairs between the proxies of two cells, or within a
+		// cell if they are the same
+		auto const testCells = [&](Cell const& cellA, Cell const& cellB) {
+
+			for (uint32_t a = cellA.firstProxy; a != nullProxy; a = proxies[a].next)
+			{
+				Proxy const& proxyA = proxies[a];
+				for (uint32_t b = &cellA == &cellB ? proxyA.next : cellB.firstProxy; b != nullProxy;
+				     b = proxies[b].next)
+				{
+					Proxy const& proxyB = proxies[b];
+					float const radiusSum = proxyA.radius + proxyB.radius;
+					if ((proxyA.center - proxyB.center).getSize2() <= radiusSum * radiusSum)
+						outPairs.push_back({proxyA.userData, proxyB.userData});
+				}
+			}
+		};
+
+		int coarseLevels[numLevels];
+		int numCoarseLevels = 0;
+		for (int level = 0; level < numLevels; ++level)
+		{
+			if (levelCounts[level] > 0)
+				coarseLevels[numCoarseLevels++] = level;
+		}
+
+		for (Cell const& cell : cells)
+		{
+			if (cell.key == emptyKey)
+				continue;
+
+			int x, y, z, level;
+			decodeCellKey(cell.key, x, y, z, level);
+			testCells(cell, cell);
+
+			// Same level neighbours
+			for (auto const& offset : forwardNeighbours)
+			{
+				size_t const slot = findSlot(makeCellKey(x + offset[0], y + offset[1], z + offset[2], level));
+				if (cells[slot].key != emptyKey)
+					testCells(cell, cells[slot]);
+			}
+
+			// Neighbours of the ancestors in the coarser levels
+			for (int i = 0; i < numCoarseLevels; ++i)
+			{
+				int const coarseLevel = coarseLevels[i];
+				if (coarseLevel <= level)
+					continue;
+
+				int const shift = coarseLevel - level;
+				int const px = x >> shift, py = y >> shift, pz = z >> shift;
+				for (int dz = -1; dz <= 1; ++dz)
+				{
+					for (int dy = -1; dy <= 1; ++dy)
+					{
+						for (int dx = -1; dx <= 1; ++dx)
+						{
+							size_t const slot = findSlot(makeCellKey(px + dx, py + dy, pz + dz, coarseLevel));
+							if (cells[slot].key != emptyKey)
+								testCells(cell, cells[slot]);
+						}
+					}
+				}
+			}
+		}
+
+		return outPairs.size();
+	}
+
+	uint64_t SpatialHash::getCellKey(float3 const& center, float radius) const
+	{
+		int level = 0;
+		for (float size = cellSize; size < 2.f * radius && level < numLevels - 1; size *= 2.f)
+		{
+			++level;
+		}
+		VW_CHECKF(cellSize * (1 << level) >= 2.f * radius, "Sphere radius %f too large for the spatial hash",
+		          radius);
+
+		// The coordinates of all levels are derived from the finest ones,
+		// so that the cells of coarser levels contain exactly their
+		// children
+		int coords[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			float const coord = Math::min(Math::max(floorf(center[i] * invCellSize), static_cast<float>(-coordBias)),
+			                              static_cast<float>(coordBias - 1));
+			coords[i] = static_cast<int>(coord) >> level;
+		}
+		return makeCellKey(coords[0], coords[1], coords[2], level);
+	}
+
+	void SpatialHash::linkProxy(uint32_t proxy)
+	{
+		// Keep the load factor below one quarter. Most lookups are for
+		// empty neighbours, and they are much faster when the home slot
+		// is empty too
+		if (4 * (numCells + 1) > cells.size())
+			growCells();
+
+		Proxy& node = proxies[proxy];
+		Cell& cell = cells[findSlot(node.cellKey)];
+		if (cell.key == emptyKey)
+		{
+			cell.key = node.cellKey;
+			cell.firstProxy = nullProxy;
+			cell.numProxies = 0;
+			++numCells;
+		}
+
+		node.prev = nullProxy;
+		node.next = cell.firstProxy;
+		if (cell.firstProxy != nullProxy)
+			proxies[cell.firstProxy].prev = proxy;
+		cell.firstProxy = proxy;
+		++cell.numProxies;
+		++levelCounts[node.cellKey >> (3 * coordBits)];
+	}
+
+	void SpatialHash::unlinkProxy(uint32_t proxy)
+	{
+		Proxy const& node = proxies[proxy];
+		size_t slot = findSlot(node.cellKey);
+		Cell& cell = cells[slot];
+		VW_CHECKF(cell.key == node.cellKey, "Proxy %u not found in its cell", proxy);
+
+		if (node.prev != nullProxy)
+			proxies[node.prev].next = node.next;
+		else
+			cell.firstProxy = node.next;
+		if (node.next != nullProxy)
+			proxies[node.next].prev = node.prev;
+		--levelCounts[node.cellKey >> (3 * coordBits)];
+		if (--cell.numProxies > 0)
+			return;
+
+		// Remove the empty cell, and shift back the following cells of the
+		// cluster that would not be found anymore
+		size_t const mask = cells.size() - 1;
+		cells[slot].key = emptyKey;
+		--numCells;
+		for (size_t next = (slot + 1) & mask; cells[next].key != emptyKey; next = (next + 1) & mask)
+		{
+			size_t const home = getKeyHash(cells[next].key) & mask;
+			// Move the cell if its home is not between the hole and it
+			if (((next - home) & mask) >= ((next - slot) & mask))
+			{
+				cells[slot] = cells[next];
+				cells[next].key = emptyKey;
+				slot = next;
+			}
+		}
+	}
+
+	void SpatialHash::growCells()
+	{
+		::std::vector<Cell> oldCells(cells.size() * 2, Cell{emptyKey, nullProxy, 0});
+		oldCells.swap(cells);
+		for (Cell const& cell : oldCells)
+		{
+			if (cell.key != emptyKey)
+				cells[findSlot(cell.key)] = cell;
+		}
+	}
+
+
+	void overlapSpherePairs(::std::span<BroadphasePair const> pairs, Vec3SoA<float const> const& centers,
+	                        ::std::span<float const> radii, ::std::span<ContactResult> outContacts)
+	{
+		VW_CHECKF(centers.size() == radii.size() && pairs.size() == outContacts.size(),
+		          "Centers (%zu), radii (%zu), pairs (%zu) and contacts (%zu) size mismatch", centers.size(),
+		          radii.size(), pairs.size(), outContacts.size());
+		size_t const count = Math::min(pairs.size(), outContacts.size());
+
+		// Pairs are independent
+		parallelFor(count, pairQueryParallelThreshold, [&](size_t begin, size_t end) {
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				uint32_t const a = pairs[i].a, b = pairs[i].b;
+				outContacts[i] = overlapSphereSphere({centers.x[a], centers.y[a], centers.z[a]}, radii[a],
+				                                     {centers.x[b], centers.y[b], centers.z[b]}, radii[b]);
+			}
+		});
+	}
+} // namespace VaporWorldVR
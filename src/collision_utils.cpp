@@ -1,138 +1,976 @@
 #include "collision_utils.h"
 
-#include <arm_neon.h>
+#include <math.h>
+
+#include <bit>
+
+#include "math/simd.h"
+#include "density_field.h"
+#include "logging.h"
 
 
 namespace VaporWorldVR
 {
 	namespace
 	{
-		/* Returns the planes of the frustum given the transposed frustum
-		   matrix. */
-		static void getFrustumTPlanes(float4 planes[], float4x4 const& frustumT)
+		/* Number of objects processed by each iteration of the SIMD kernels. */
+		constexpr size_t blockSize = 4;
+
+		/* Number of objects in each word of a visibility mask. */
+		constexpr size_t maskWordSize = 32;
+
+		/* Returns the given plane, normalized. A degenerate plane, like the
+		   far plane of an infinite projection, is replaced with a plane that
+		   contains everything. */
+		static float4 normalizePlane(float4 const& plane)
+		{
+			float const size = plane.xyz.getSize();
+			return size > 1e-6f ? plane / size : float4{0.f, 0.f, 0.f, 1.f};
+		}
+
+		/* Returns the directions of the edges between the side planes of the
+		   frustum, normalized and pointing away from the eye. */
+		static void getFrustumEdges(float3 edges[], Frustum const& frustum)
+		{
+			float3 const& left = frustum.planes[0].xyz;
+			float3 const& right = frustum.planes[1].xyz;
+			float3 const& bottom = frustum.planes[2].xyz;
+			float3 const& top = frustum.planes[3].xyz;
+			float3 const& forward = frustum.planes[4].xyz;
+			edges[0] = left.cross(bottom).normalize();
+			edges[1] = bottom.cross(right).normalize();
+			edges[2] = right.cross(top).normalize();
+			edges[3] = top.cross(left).normalize();
+			for (int i = 0; i < 4; ++i)
+			{
+				edges[i] = edges[i].dot(forward) < 0.f ? -edges[i] : edges[i];
+			}
+		}
+
+		/* Returns a side plane of the frustum that contains both eye frusta,
+		   see StereoFrustum(). */
+		static float4 getStereoSidePlane(int side, Frustum const eyes[], float3 const eyePositions[],
+		                                 float3 const (*edges)[4])
+		{
+			// The edges on each side, see getFrustumEdges()
+			constexpr int sideEdges[4][2] = {{3, 0}, {1, 2}, {0, 1}, {2, 3}};
+			int const a = sideEdges[side][0], b = sideEdges[side][1];
+
+			// Try the planes of the eyes first, then the planes through the
+			// outermost edges of both eyes, which work for canted eyes
+			float3 const average = eyes[0].planes[side].xyz + eyes[1].planes[side].xyz;
+			float3 const candidates[] = {eyes[0].planes[side].xyz, eyes[1].planes[side].xyz,
+			                             edges[0][a].cross(edges[1][b]), edges[1][a].cross(edges[0][b])};
+
+			// Choose the plane closest to the edges, then the one closest to
+			// both eyes
+			float4 bestPlane{0.f, 0.f, 0.f, 1.f};
+			float bestScore = INFINITY, bestSlack = INFINITY;
+			for (float3 normal : candidates)
+			{
+				if (normal.getSize2() < 1e-12f)
+					// Parallel edges
+					continue;
+
+				normal.normalize();
+				normal = normal.dot(average) < 0.f ? -normal : normal;
+
+				bool contained = true;
+				float score = 0.f;
+				for (int eyeIdx = 0; eyeIdx < 2; ++eyeIdx)
+				{
+					for (int i = 0; i < 4; ++i)
+					{
+						float const d = normal.dot(edges[eyeIdx][i]);
+						contained &= d >= -1e-5f;
+						score += i == a || i == b ? d : 0.f;
+					}
+				}
+
+				float const dist0 = normal.dot(eyePositions[0]), dist1 = normal.dot(eyePositions[1]);
+				float const slack = Math::max(dist0, dist1) - Math::min(dist0, dist1);
+				if (contained && (score < bestScore - 1e-5f || (score < bestScore + 1e-5f && slack < bestSlack)))
+				{
+					bestPlane = {normal, -Math::min(dist0, dist1)};
+					bestScore = score;
+					bestSlack = slack;
+				}
+			}
+
+			return bestPlane;
+		}
+
+#if VW_MATH_SIMD
+		/* Frustum planes, each coordinate broadcast to all lanes of a
+		   register. */
+		struct SplatFrustum
+		{
+			Math::Simd::Float32x4 planes[6][4];
+
+			/* The absolute values of the plane normals. */
+			Math::Simd::Float32x4 absNormals[6][3];
+
+			FORCE_INLINE explicit SplatFrustum(Frustum const& frustum)
+			{
+				using namespace Math::Simd;
+				for (int i = 0; i < 6; ++i)
+				{
+					for (int j = 0; j < 4; ++j)
+					{
+						planes[i][j] = splat(frustum.planes[i][j]);
+					}
+
+					for (int j = 0; j < 3; ++j)
+					{
+						absNormals[i][j] = abs(planes[i][j]);
+					}
+				}
+			}
+
+			/* Returns the signed distances of the points from the i-th
+			   plane. */
+			FORCE_INLINE Math::Simd::Float32x4 getDistance(int i, Math::Simd::Float32x4 x, Math::Simd::Float32x4 y,
+			                                               Math::Simd::Float32x4 z) const
+			{
+				using namespace Math::Simd;
+				return madd(planes[i][0], x, madd(planes[i][1], y, madd(planes[i][2], z, planes[i][3])));
+			}
+
+			/* Returns a 4-bit mask of the visible spheres. */
+			FORCE_INLINE uint32_t testSpheres(Math::Simd::Float32x4 x, Math::Simd::Float32x4 y,
+			                                  Math::Simd::Float32x4 z, Math::Simd::Float32x4 r) const
+			{
+				// Visible if the distance from all planes is greater than
+				// -radius, i.e. if the least distance is
+				using namespace Math::Simd;
+				Float32x4 minDist = getDistance(0, x, y, z);
+				for (int i = 1; i < 6; ++i)
+				{
+					minDist = min(minDist, getDistance(i, x, y, z));
+				}
+				return moveMask(cmpGe(add(minDist, r), splat(0.f)));
+			}
+
+			/* Returns a 4-bit mask of the visible boxes, given their centers
+			   and half extents. */
+			FORCE_INLINE uint32_t testAABBs(Math::Simd::Float32x4 x, Math::Simd::Float32x4 y,
+			                                Math::Simd::Float32x4 z, Math::Simd::Float32x4 ex,
+			                                Math::Simd::Float32x4 ey, Math::Simd::Float32x4 ez) const
+			{
+				// The distance of the p-vertex is the distance of the center
+				// plus the projection of the half extent on the normal
+				using namespace Math::Simd;
+				Float32x4 minDist = splat(0.f);
+				for (int i = 0; i < 6; ++i)
+				{
+					Float32x4 const dist = madd(absNormals[i][0], ex, madd(absNormals[i][1], ey,
+					                            madd(absNormals[i][2], ez, getDistance(i, x, y, z))));
+					minDist = i == 0 ? dist : min(minDist, dist);
+				}
+				return moveMask(cmpGe(minDist, splat(0.f)));
+			}
+		};
+#endif
+
+		/* Returns the visibility mask of the objects in the range [begin,
+		   end), at most one word. The block test returns the mask of 4
+		   objects, the test the visibility of one object. */
+		template<typename BlockTestT, typename TestT>
+		FORCE_INLINE uint32_t getVisibilityWord(size_t begin, size_t end,
+		                                        [[maybe_unused]] BlockTestT const& blockTest, TestT const& test)
+		{
+			uint32_t word = 0;
+			size_t idx = begin;
+
+#if VW_MATH_SIMD
+			for (; idx + blockSize <= end; idx += blockSize)
+			{
+				word |= blockTest(idx) << (idx - begin);
+			}
+#endif
+
+			for (; idx < end; ++idx)
+			{
+				// Remainder
+				word |= static_cast<uint32_t>(test(idx)) << (idx - begin);
+			}
+
+			return word;
+		}
+
+		/* Writes the visibility mask of all objects, one word at a time. */
+		template<typename WordFnT>
+		size_t writeVisibleMask(size_t count, ::std::span<uint32_t> outVisibleMask, WordFnT const& getWord)
+		{
+			VW_CHECKF(outVisibleMask.size() >= getVisibilityMaskSize(count), "Mask too small (%zu) for %zu objects",
+			          outVisibleMask.size(), count);
+			count = Math::min(count, outVisibleMask.size() * maskWordSize);
+
+			size_t numVisible = 0;
+			for (size_t begin = 0; begin < count; begin += maskWordSize)
+			{
+				uint32_t const word = getWord(begin, Math::min(begin + maskWordSize, count));
+				outVisibleMask[begin / maskWordSize] = word;
+				numVisible += ::std::popcount(word);
+			}
+			return numVisible;
+		}
+
+		/* Writes the indices of the visible objects, one word at a time. */
+		template<typename WordFnT>
+		size_t writeVisibleIndices(size_t count, ::std::span<uint32_t> outVisibleIndices, WordFnT const& getWord)
+		{
+			VW_CHECKF(outVisibleIndices.size() >= count, "Index list too small (%zu) for %zu objects",
+			          outVisibleIndices.size(), count);
+			count = Math::min(count, outVisibleIndices.size());
+
+			size_t numVisible = 0;
+			for (size_t begin = 0; begin < count; begin += maskWordSize)
+			{
+				for (uint32_t word = getWord(begin, Math::min(begin + maskWordSize, count)); word; word &= word - 1)
+				{
+					outVisibleIndices[numVisible++] = static_cast<uint32_t>(begin + ::std::countr_zero(word));
+				}
+			}
+			return numVisible;
+		}
+
+		/* Returns a function that computes the visibility mask of a range of
+		   spheres. */
+		FORCE_INLINE auto makeSpheresWordFn(Frustum const& frustum, Vec3SoA<float const> const& centers,
+		                                    ::std::span<float const> radii)
 		{
-			planes[0] = frustumT[3] + frustumT[0];
-			planes[1] = frustumT[3] - frustumT[0];
-			planes[2] = frustumT[3] + frustumT[1];
-			planes[3] = frustumT[3] - frustumT[1];
-			planes[4] = frustumT[3];
-			planes[5] = frustumT[3] - frustumT[2];
+#if VW_MATH_SIMD
+			SplatFrustum const splatFrustum{frustum};
+#endif
+			return [=, &frustum](size_t begin, size_t end) {
+
+				return getVisibilityWord(begin, end, [&]([[maybe_unused]] size_t idx) {
+
+#if VW_MATH_SIMD
+					using namespace Math::Simd;
+					return splatFrustum.testSpheres(load(&centers.x[idx]), load(&centers.y[idx]),
+					                                load(&centers.z[idx]), load(&radii[idx]));
+#else
+					return 0u;
+#endif
+				}, [&](size_t idx) {
+
+					return frustum.testSphere({centers.x[idx], centers.y[idx], centers.z[idx]}, radii[idx]);
+				});
+			};
 		}
 
-		/* Returns the vertices of the given AABB. */
-		static void getAAABVertices(float3 vertices[], float3 const& min, float3 const& max)
+		/* Returns a function that computes the visibility mask of a range of
+		   AABBs. */
+		FORCE_INLINE auto makeAABBsWordFn(Frustum const& frustum, Vec3SoA<float const> const& mins,
+		                                  Vec3SoA<float const> const& maxs)
 		{
-			float3 extent = max - min;
-			vertices[0] = min;
-			vertices[1] = min + float3{extent.x, 0.f, 0.f};
-			vertices[2] = min + float3{0.f, extent.y, 0.f};
-			vertices[3] = min + float3{extent.x, extent.y, 0.f};
-			vertices[4] = max - float3{extent.x, extent.y, 0.f};
-			vertices[5] = max - float3{0.f, extent.y, 0.f};
-			vertices[6] = max - float3{extent.x, 0.f, 0.f};
-			vertices[7] = max;
+#if VW_MATH_SIMD
+			SplatFrustum const splatFrustum{frustum};
+#endif
+			return [=, &frustum](size_t begin, size_t end) {
+
+				return getVisibilityWord(begin, end, [&]([[maybe_unused]] size_t idx) {
+
+#if VW_MATH_SIMD
+					// Test the center and the half extent of the boxes
+					using namespace Math::Simd;
+					Float32x4 const half = splat(0.5f);
+					Float32x4 const minX = load(&mins.x[idx]), minY = load(&mins.y[idx]), minZ = load(&mins.z[idx]);
+					Float32x4 const maxX = load(&maxs.x[idx]), maxY = load(&maxs.y[idx]), maxZ = load(&maxs.z[idx]);
+					return splatFrustum.testAABBs(mul(add(minX, maxX), half), mul(add(minY, maxY), half),
+					                              mul(add(minZ, maxZ), half), mul(sub(maxX, minX), half),
+					                              mul(sub(maxY, minY), half), mul(sub(maxZ, minZ), half));
+#else
+					return 0u;
+#endif
+				}, [&](size_t idx) {
+
+					return frustum.testAABB({mins.x[idx], mins.y[idx], mins.z[idx]},
+					                        {maxs.x[idx], maxs.y[idx], maxs.z[idx]});
+				});
+			};
 		}
 
-		/* Returns true if the given point is within the frustum defined by the
-		   given planes. The order of the planes does not matter. */
-		static bool frustumTest_Impl(float4 const planes[], float3 const& pos, float radius)
+		/* Visits the cells of a uniform grid crossed by the ray between the
+		   given distances, in order (3D-DDA). The function is called with
+		   the cell, and the distances at which the ray enters and exits it,
+		   and returns false to stop. Returns false if stopped. */
+		template<typename FnT>
+		static bool traverseGrid(float3 const& gridOrigin, float cellSize, float3 const& rayStart,
+		                         float3 const& rayDir, float tMin, float tMax, FnT&& fn)
 		{
-			for (int i = 0; i < 6; ++i)
+			float3 const pos = (rayStart + rayDir * tMin - gridOrigin) / cellSize;
+			int3 cell, step;
+			float3 tNext, tDelta;
+			for (int i = 0; i < 3; ++i)
 			{
-				if (pos.dot(planes[i].xyz) + planes[i].w + radius < 0.f)
-					// Point is outside of frustum
+				float const cellPos = floorf(pos[i]);
+				cell[i] = static_cast<int>(cellPos);
+				if (rayDir[i] > 0.f)
+				{
+					step[i] = 1;
+					tDelta[i] = cellSize / rayDir[i];
+					tNext[i] = tMin + (cellPos + 1.f - pos[i]) * tDelta[i];
+				}
+				else if (rayDir[i] < 0.f)
+				{
+					step[i] = -1;
+					tDelta[i] = -cellSize / rayDir[i];
+					tNext[i] = tMin + (pos[i] - cellPos) * tDelta[i];
+				}
+				else
+				{
+					step[i] = 0;
+					tDelta[i] = tNext[i] = __builtin_inff();
+				}
+			}
+
+			for (float t = tMin; t < tMax;)
+			{
+				// Step along the axis of the closest boundary
+				int const axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+				float const tExit = Math::min(tNext[axis], tMax);
+				if (!fn(cell, t, tExit))
 					return false;
+
+				t = tExit;
+				cell[axis] += step[axis];
+				tNext[axis] += tDelta[axis];
 			}
 
 			return true;
 		}
+
+		/* Computes the distances at which the ray enters and exits the
+		   sphere. Returns false if the line of the ray misses the sphere. */
+		static FORCE_INLINE bool getRaySphereDists(float3 const& rayStart, float3 const& rayDir,
+		                                           float3 const& sphereOrigin, float sphereRadius, float& outDist0,
+		                                           float& outDist1)
+		{
+			// Solve the quadratic equation dist(rayStart + rayDir * x, sphereOrigin) = sphereRadius
+			float3 const sphereToRay = sphereOrigin - rayStart;
+			float const a = rayDir.dot(rayDir);
+			float const b2 = rayDir.dot(sphereToRay);
+			float const c = sphereToRay.dot(sphereToRay) - (sphereRadius * sphereRadius);
+			float const d = b2 * b2 - a * c;
+			if (d < 0.f)
+				// No real solution, no intersection
+				return false;
+
+			float const sqrtD = Math::sqrt(d);
+			outDist0 = (b2 - sqrtD) / a;
+			outDist1 = (b2 + sqrtD) / a;
+			return true;
+		}
+
+		/* Returns the distance of the first hit of the ray with the sphere
+		   within the maximum distance, or infinity. */
+		static FORCE_INLINE float getRaySphereFirstDist(float3 const& rayStart, float3 const& rayDir,
+		                                                float3 const& sphereOrigin, float sphereRadius, float maxDist)
+		{
+			float dist0, dist1;
+			if (!getRaySphereDists(rayStart, rayDir, sphereOrigin, sphereRadius, dist0, dist1))
+				return __builtin_inff();
+
+			// The ray may start inside the sphere
+			float const dist = dist0 >= 0.f ? dist0 : dist1;
+			return dist >= 0.f && dist < maxDist ? dist : __builtin_inff();
+		}
+
+		/* Returns the inverse of the ray direction. Zero coordinates are
+		   replaced with a large value, to avoid NaN in the slab tests. */
+		static FORCE_INLINE float3 getInvDir(float3 const& rayDir)
+		{
+			return {rayDir[0] != 0.f ? 1.f / rayDir[0] : 1e30f, rayDir[1] != 0.f ? 1.f / rayDir[1] : 1e30f,
+			        rayDir[2] != 0.f ? 1.f / rayDir[2] : 1e30f};
+		}
+
+		/* Returns the distance at which the ray enters the AABB within the
+		   maximum distance, or infinity. */
+		static FORCE_INLINE float getRayAABBFirstDist(float3 const& rayStart, float3 const& invDir, float3 const& min,
+		                                              float3 const& max, float maxDist)
+		{
+			float tMin = 0.f, tMax = __builtin_inff();
+			for (int i = 0; i < 3; ++i)
+			{
+				float const t0 = (min[i] - rayStart[i]) * invDir[i];
+				float const t1 = (max[i] - rayStart[i]) * invDir[i];
+				tMin = Math::max(tMin, Math::min(t0, t1));
+				tMax = Math::min(tMax, Math::max(t0, t1));
+			}
+			return tMin <= tMax && tMin < maxDist ? tMin : __builtin_inff();
+		}
+
+#if VW_MATH_SIMD
+		/* Returns the distances of the first hits of 4 rays with 4 spheres,
+		   lane by lane, or infinity. Either the rays or the spheres may be
+		   the same in all lanes. */
+		static FORCE_INLINE Math::Simd::Float32x4 getRaySphereFirstDists(
+			Math::Simd::Float32x4 startX, Math::Simd::Float32x4 startY, Math::Simd::Float32x4 startZ,
+			Math::Simd::Float32x4 dirX, Math::Simd::Float32x4 dirY, Math::Simd::Float32x4 dirZ,
+			Math::Simd::Float32x4 dirSize2, Math::Simd::Float32x4 invDirSize2, Math::Simd::Float32x4 originX,
+			Math::Simd::Float32x4 originY, Math::Simd::Float32x4 originZ, Math::Simd::Float32x4 radius,
+			Math::Simd::Float32x4 maxDist)
+		{
+			// Same as getRaySphereDists(), a zero direction gives NaN which
+			// fails all tests. The squared size of the directions is passed
+			// along with its inverse, to hoist the division out of the loops
+			// with a single ray
+			using namespace Math::Simd;
+			Float32x4 const zero = splat(0.f);
+			Float32x4 const x = sub(originX, startX), y = sub(originY, startY), z = sub(originZ, startZ);
+			Float32x4 const a = dirSize2;
+			Float32x4 const b2 = madd(dirX, x, madd(dirY, y, mul(dirZ, z)));
+			Float32x4 const c = sub(madd(x, x, madd(y, y, mul(z, z))), mul(radius, radius));
+			Float32x4 const d = sub(mul(b2, b2), mul(a, c));
+			Mask32x4 const lineHit = cmpGe(d, zero);
+			if (!moveMask(lineHit))
+				// Most objects are missed when picking, skip the roots
+				return splat(__builtin_inff());
+
+			Float32x4 const sqrtD = sqrt(max(d, zero));
+			Float32x4 const dist0 = mul(sub(b2, sqrtD), invDirSize2);
+			Float32x4 const dist1 = mul(add(b2, sqrtD), invDirSize2);
+			Float32x4 const dist = select(cmpGe(dist0, zero), dist0, dist1);
+			Mask32x4 const hit = maskAnd(maskAnd(lineHit, cmpGe(dist, zero)), cmpLt(dist, maxDist));
+			return select(hit, dist, splat(__builtin_inff()));
+		}
+
+		/* Like getRaySphereFirstDists(), but for AABBs. */
+		static FORCE_INLINE Math::Simd::Float32x4 getRayAABBFirstDists(
+			Math::Simd::Float32x4 startX, Math::Simd::Float32x4 startY, Math::Simd::Float32x4 startZ,
+			Math::Simd::Float32x4 invDirX, Math::Simd::Float32x4 invDirY, Math::Simd::Float32x4 invDirZ,
+			Math::Simd::Float32x4 minX, Math::Simd::Float32x4 minY, Math::Simd::Float32x4 minZ,
+			Math::Simd::Float32x4 maxX, Math::Simd::Float32x4 maxY, Math::Simd::Float32x4 maxZ,
+			Math::Simd::Float32x4 maxDist)
+		{
+			using namespace Math::Simd;
+			Float32x4 const tx0 = mul(sub(minX, startX), invDirX), tx1 = mul(sub(maxX, startX), invDirX);
+			Float32x4 const ty0 = mul(sub(minY, startY), invDirY), ty1 = mul(sub(maxY, startY), invDirY);
+			Float32x4 const tz0 = mul(sub(minZ, startZ), invDirZ), tz1 = mul(sub(maxZ, startZ), invDirZ);
+			Float32x4 const tMin = max(max(min(tx0, tx1), min(ty0, ty1)), max(min(tz0, tz1), splat(0.f)));
+			Float32x4 const tMax = min(min(max(tx0, tx1), max(ty0, ty1)), max(tz0, tz1));
+			Mask32x4 const hit = maskAnd(cmpLe(tMin, tMax), cmpLt(tMin, maxDist));
+			return select(hit, tMin, splat(__builtin_inff()));
+		}
+
+		/* Like getInvDir(), for 4 directions. */
+		static FORCE_INLINE Math::Simd::Float32x4 getInvDirs(Math::Simd::Float32x4 dir)
+		{
+			using namespace Math::Simd;
+			return select(cmpEq(dir, splat(0.f)), splat(1e30f), div(splat(1.f), dir));
+		}
+#endif
+
+		/* Finds the closest of a batch of hits. The block function returns
+		   the distances of 4 hits, the function the distance of one hit,
+		   infinity if no hit occured. If not empty, the distances are also
+		   written to the output. */
+		template<typename BlockDistFnT, typename DistFnT>
+		FORCE_INLINE BatchHitResult findClosestHit(size_t count, ::std::span<float> outDists,
+		                                           [[maybe_unused]] BlockDistFnT const& getBlockDists,
+		                                           DistFnT const& getDist)
+		{
+			BatchHitResult hit;
+			size_t idx = 0;
+
+#if VW_MATH_SIMD
+			using namespace Math::Simd;
+			Float32x4 closestDist = splat(hit.dist);
+			for (; idx + blockSize <= count; idx += blockSize)
+			{
+				Float32x4 const dists = getBlockDists(idx);
+				if (!outDists.empty())
+					store(&outDists[idx], dists);
+
+				if (uint32_t closer = moveMask(cmpLt(dists, closestDist)))
+				{
+					// Rare, find the closest lane
+					float lanes[blockSize];
+					store(lanes, dists);
+					for (; closer; closer &= closer - 1)
+					{
+						uint32_t const lane = ::std::countr_zero(closer);
+						if (lanes[lane] < hit.dist)
+						{
+							hit.index = static_cast<uint32_t>(idx + lane);
+							hit.dist = lanes[lane];
+						}
+					}
+					closestDist = splat(hit.dist);
+				}
+			}
+#endif
+
+			for (; idx < count; ++idx)
+			{
+				// Remainder
+				float const dist = getDist(idx);
+				if (!outDists.empty())
+					outDists[idx] = dist;
+
+				if (dist < hit.dist)
+				{
+					hit.index = static_cast<uint32_t>(idx);
+					hit.dist = dist;
+				}
+			}
+
+			return hit;
+		}
 	} // namespace
 
 
 	bool raySphereIntersect(float3 const& rayStart, float3 const& rayDir, float3 const& sphereOrigin,
 	                        float sphereRadius, HitResult& closestHit, HitResult& furthestHit)
 	{
-		// Solve the quadratic equation dist(rayStart + rayDir * x, spherOrigin) = spherRadius
-		float3 sphereToRay = sphereOrigin - rayStart;
-		float a = rayDir.dot(rayDir);
-		float b2 = rayDir.dot(sphereToRay);
-		float c = sphereToRay.dot(sphereToRay) - (sphereRadius * sphereRadius);
-		float d = b2 * b2 - a * c;
+		float dist0, dist1;
+		if (!getRaySphereDists(rayStart, rayDir, sphereOrigin, sphereRadius, dist0, dist1))
+			return false;
+
+		closestHit = getRaySphereHit(rayStart, rayDir, dist0, sphereOrigin, sphereRadius);
+		closestHit.hitOccured = dist0 >= 0.f;
+		furthestHit = getRaySphereHit(rayStart, rayDir, dist1, sphereOrigin, sphereRadius);
+		furthestHit.hitOccured = dist1 >= 0.f;
+		return true;
+	}
+
+	HitResult raySphereIntersect(float3 const& rayStart, float3 const& rayDir, float3 const& sphereOrigin,
+	                             float sphereRadius)
+	{
+		// Only compute the normal of the first actual hit
+		float const dist = getRaySphereFirstDist(rayStart, rayDir, sphereOrigin, sphereRadius, __builtin_inff());
+		return dist < __builtin_inff() ? getRaySphereHit(rayStart, rayDir, dist, sphereOrigin, sphereRadius)
+		                               : HitResult{};
+	}
 
-		if (d < 0.f)
+	bool raySphereIntersectTest(float3 const& rayStart, float3 const& rayDir, float3 const& sphereOrigin,
+	                            float sphereRadius)
+	{
+		if ((rayStart - sphereOrigin).getSize2() <= sphereRadius * sphereRadius)
 		{
-			// No real solution, no intersection
-			return false;
+			// If ray starts inside, then ray and sphere intersect
+			return true;
 		}
 
-		// Get first intersection point
-		float x0 = (b2 - Math::sqrt(d)) / a;
-		closestHit.hitOccured = x0 >= 0.f;
-		closestHit.hitPosition = rayStart + rayDir * x0;
-		closestHit.hitNormal = (closestHit.hitPosition - sphereOrigin).normalize();
+		// Test intersection, the sphere may be behind the ray
+		float dist0, dist1;
+		return getRaySphereDists(rayStart, rayDir, sphereOrigin, sphereRadius, dist0, dist1) && dist1 >= 0.f;
+	}
 
-		// Get second intersection point
-		float x1 = (b2 + Math::sqrt(d)) / a;
-		furthestHit.hitOccured = x1 >= 0.f;
-		furthestHit.hitPosition = rayStart + rayDir * x0;
-		furthestHit.hitNormal = (furthestHit.hitPosition - sphereOrigin).normalize();
+	BatchHitResult raySpheresIntersect(float3 const& rayStart, float3 const& rayDir,
+	                                   Vec3SoA<float const> const& centers, ::std::span<float const> radii,
+	                                   float maxDist)
+	{
+		VW_CHECKF(centers.size() == radii.size(), "Centers (%zu) and radii (%zu) size mismatch", centers.size(),
+		          radii.size());
+		size_t const count = Math::min(centers.size(), radii.size());
 
-		return true;
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		Float32x4 const startX = splat(rayStart.x), startY = splat(rayStart.y), startZ = splat(rayStart.z);
+		Float32x4 const dirX = splat(rayDir.x), dirY = splat(rayDir.y), dirZ = splat(rayDir.z);
+		Float32x4 const dirSize2 = splat(rayDir.getSize2()), invDirSize2 = splat(1.f / rayDir.getSize2());
+		Float32x4 const maxDists = splat(maxDist);
+#endif
+		return findClosestHit(count, {}, [&]([[maybe_unused]] size_t idx) {
+
+#if VW_MATH_SIMD
+			return getRaySphereFirstDists(startX, startY, startZ, dirX, dirY, dirZ, dirSize2, invDirSize2,
+			                              load(&centers.x[idx]), load(&centers.y[idx]), load(&centers.z[idx]),
+			                              load(&radii[idx]), maxDists);
+#else
+			return 0.f;
+#endif
+		}, [&](size_t idx) {
+
+			return getRaySphereFirstDist(rayStart, rayDir, {centers.x[idx], centers.y[idx], centers.z[idx]},
+			                             radii[idx], maxDist);
+		});
+	}
+
+	BatchHitResult raysSphereIntersect(Vec3SoA<float const> const& rayStarts, Vec3SoA<float const> const& rayDirs,
+	                                   float3 const& sphereOrigin, float sphereRadius, float maxDist,
+	                                   ::std::span<float> outDists)
+	{
+		VW_CHECKF(rayStarts.size() == rayDirs.size() && rayStarts.size() == outDists.size(),
+		          "Ray starts (%zu), directions (%zu) and distances (%zu) size mismatch", rayStarts.size(),
+		          rayDirs.size(), outDists.size());
+		size_t const count = Math::min(Math::min(rayStarts.size(), rayDirs.size()), outDists.size());
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		Float32x4 const originX = splat(sphereOrigin.x), originY = splat(sphereOrigin.y);
+		Float32x4 const originZ = splat(sphereOrigin.z), radius = splat(sphereRadius), maxDists = splat(maxDist);
+#endif
+		return findClosestHit(count, outDists, [&]([[maybe_unused]] size_t idx) {
+
+#if VW_MATH_SIMD
+			Float32x4 const dirX = load(&rayDirs.x[idx]), dirY = load(&rayDirs.y[idx]), dirZ = load(&rayDirs.z[idx]);
+			Float32x4 const dirSize2 = madd(dirX, dirX, madd(dirY, dirY, mul(dirZ, dirZ)));
+			return getRaySphereFirstDists(load(&rayStarts.x[idx]), load(&rayStarts.y[idx]), load(&rayStarts.z[idx]),
+			                              dirX, dirY, dirZ, dirSize2, div(splat(1.f), dirSize2), originX, originY,
+			                              originZ, radius, maxDists);
+#else
+			return 0.f;
+#endif
+		}, [&](size_t idx) {
+
+			return getRaySphereFirstDist({rayStarts.x[idx], rayStarts.y[idx], rayStarts.z[idx]},
+			                             {rayDirs.x[idx], rayDirs.y[idx], rayDirs.z[idx]}, sphereOrigin, sphereRadius,
+			                             maxDist);
+		});
 	}
 
-	inline HitResult raySphereIntersect(float3 const& rayStart, float3 const& rayDir, float3 const& sphereOrigin,
-	                                    float sphereRadius)
+	BatchHitResult rayAABBsIntersect(float3 const& rayStart, float3 const& rayDir, Vec3SoA<float const> const& mins,
+	                                 Vec3SoA<float const> const& maxs, float maxDist)
 	{
-		if (HitResult hitResults[2]; raySphereIntersect(rayStart, rayDir, sphereOrigin, sphereRadius, hitResults[0],
-		                                                hitResults[1]))
+		VW_CHECKF(mins.size() == maxs.size(), "Min (%zu) and max (%zu) size mismatch", mins.size(), maxs.size());
+		size_t const count = Math::min(mins.size(), maxs.size());
+		float3 const invDir = getInvDir(rayDir);
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		Float32x4 const startX = splat(rayStart.x), startY = splat(rayStart.y), startZ = splat(rayStart.z);
+		Float32x4 const invDirX = splat(invDir.x), invDirY = splat(invDir.y), invDirZ = splat(invDir.z);
+		Float32x4 const maxDists = splat(maxDist);
+#endif
+		return findClosestHit(count, {}, [&]([[maybe_unused]] size_t idx) {
+
+#if VW_MATH_SIMD
+			return getRayAABBFirstDists(startX, startY, startZ, invDirX, invDirY, invDirZ, load(&mins.x[idx]),
+			                            load(&mins.y[idx]), load(&mins.z[idx]), load(&maxs.x[idx]),
+			                            load(&maxs.y[idx]), load(&maxs.z[idx]), maxDists);
+#else
+			return 0.f;
+#endif
+		}, [&](size_t idx) {
+
+			return getRayAABBFirstDist(rayStart, invDir, {mins.x[idx], mins.y[idx], mins.z[idx]},
+			                           {maxs.x[idx], maxs.y[idx], maxs.z[idx]}, maxDist);
+		});
+	}
+
+	BatchHitResult raysAABBIntersect(Vec3SoA<float const> const& rayStarts, Vec3SoA<float const> const& rayDirs,
+	                                 float3 const& min, float3 const& max, float maxDist, ::std::span<float> outDists)
+	{
+		VW_CHECKF(rayStarts.size() == rayDirs.size() && rayStarts.size() == outDists.size(),
+		          "Ray starts (%zu), directions (%zu) and distances (%zu) size mismatch", rayStarts.size(),
+		          rayDirs.size(), outDists.size());
+		size_t const count = Math::min(Math::min(rayStarts.size(), rayDirs.size()), outDists.size());
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		Float32x4 const minX = splat(min.x), minY = splat(min.y), minZ = splat(min.z);
+		Float32x4 const maxX = splat(max.x), maxY = splat(max.y), maxZ = splat(max.z);
+		Float32x4 const maxDists = splat(maxDist);
+#endif
+		return findClosestHit(count, outDists, [&]([[maybe_unused]] size_t idx) {
+
+#if VW_MATH_SIMD
+			return getRayAABBFirstDists(load(&rayStarts.x[idx]), load(&rayStarts.y[idx]), load(&rayStarts.z[idx]),
+			                            getInvDirs(load(&rayDirs.x[idx])), getInvDirs(load(&rayDirs.y[idx])),
+			                            getInvDirs(load(&rayDirs.z[idx])), minX, minY, minZ, maxX, maxY, maxZ,
+			                            maxDists);
+#else
+			return 0.f;
+#endif
+		}, [&](size_t idx) {
+
+			return getRayAABBFirstDist({rayStarts.x[idx], rayStarts.y[idx], rayStarts.z[idx]},
+			                           getInvDir({rayDirs.x[idx], rayDirs.y[idx], rayDirs.z[idx]}), min, max,
+			                           maxDist);
+		});
+	}
+
+	HitResult getRaySphereHit(float3 const& rayStart, float3 const& rayDir, float dist, float3 const& sphereOrigin,
+	                          float sphereRadius)
+	{
+		HitResult hit;
+		hit.hitOccured = true;
+		hit.hitPosition = rayStart + rayDir * dist;
+		// The hit is on the sphere, no need to normalize
+		hit.hitNormal = (hit.hitPosition - sphereOrigin) * (1.f / sphereRadius);
+		return hit;
+	}
+
+	HitResult getRayAABBHit(float3 const& rayStart, float3 const& rayDir, float dist, float3 const& min,
+	                        float3 const& max)
+	{
+		HitResult hit;
+		hit.hitOccured = true;
+		hit.hitPosition = rayStart + rayDir * dist;
+		if (dist <= 0.f)
 		{
-			// Closest hit may actually be a false hit
-			return hitResults[0] ? hitResults[0] : hitResults[1];
+			// The ray starts inside the box
+			hit.hitNormal = -float3{rayDir}.normalize();
+			return hit;
 		}
 
-		// No hit occured
-		return {};
+		// Find the face closest to the hit
+		int bestAxis = 0;
+		float bestSign = 1.f, bestFaceDist = __builtin_inff();
+		for (int i = 0; i < 3; ++i)
+		{
+			float const minDist = fabsf(hit.hitPosition[i] - min[i]), maxDist = fabsf(hit.hitPosition[i] - max[i]);
+			if (minDist < bestFaceDist)
+			{
+				bestAxis = i;
+				bestSign = -1.f;
+				bestFaceDist = minDist;
+			}
+			if (maxDist < bestFaceDist)
+			{
+				bestAxis = i;
+				bestSign = 1.f;
+				bestFaceDist = maxDist;
+			}
+		}
+		hit.hitNormal[bestAxis] = bestSign;
+		return hit;
 	}
 
-	inline bool raySphereIntersectTest(float3 const& rayStart, float3 const& rayDir, float3 const& sphereOrigin,
-	                                   float sphereRadius)
+	HitResult raycastTerrain(DensityField const& field, float3 const& rayStart, float3 const& rayDir, float maxDist)
 	{
-		if ((rayStart - sphereOrigin).getSize2() <= sphereRadius * sphereRadius)
+		constexpr int numBisectionSteps = 12;
+
+		HitResult hit;
+		float3 const dir = rayDir.getNormal();
+		auto const makeHit = [&](float t) -> HitResult {
+
+			HitResult result;
+			float3 gradient;
+			result.hitOccured = true;
+			result.hitPosition = rayStart + dir * t;
+			field.sample(result.hitPosition, &gradient);
+			result.hitNormal = (-gradient).normalize();
+			return result;
+		};
+
+		float prevDensity = field.sample(rayStart);
+		if (prevDensity > 0.f)
+			// Starts inside the terrain
+			return makeHit(0.f);
+
+		// Clip the ray to the heights in which the surface may be. The
+		// terrain is solid below, so the surface is crossed before leaving
+		// the range, extended so that the last sample is inside
+		float minHeight, maxHeight;
+		field.getSurfaceHeightRange(minHeight, maxHeight);
+		minHeight -= field.getVoxelSize();
+		float tMin = 0.f, tMax = maxDist;
+		if (dir.y != 0.f)
 		{
-			// If ray starts inside, then ray and sphere intersect
-			return true;
+			float const t0 = (minHeight - rayStart.y) / dir.y, t1 = (maxHeight - rayStart.y) / dir.y;
+			tMin = Math::max(tMin, Math::min(t0, t1));
+			tMax = Math::min(tMax, Math::max(t0, t1));
 		}
+		else if (rayStart.y > maxHeight)
+			return hit;
+
+		if (tMin >= tMax)
+			return hit;
+
+		// The density changes by at most maxGradient per unit of distance,
+		// so the surface is not crossed before safeDist
+		float const maxGradient = field.getMaxGradient();
+		float prevDist = tMin;
+		prevDensity = tMin > 0.f ? field.sample(rayStart + dir * tMin) : prevDensity;
+		float safeDist = prevDist - prevDensity / maxGradient;
+
+		float hitDist = -1.f;
+		traverseGrid(field.getGridOrigin(), field.getChunkSize(), rayStart, dir, tMin, tMax,
+		             [&](int3 const&, float chunkEnter, float chunkExit) -> bool {
+
+			if (chunkExit <= safeDist)
+				// The whole chunk is skipped
+				return true;
 
-		// Test intersection
-		HitResult _[2];
-		return raySphereIntersect(rayStart, rayDir, sphereOrigin, sphereRadius, _[0], _[1]);
+			return traverseGrid(field.getGridOrigin(), field.getVoxelSize(), rayStart, dir, chunkEnter, chunkExit,
+			                    [&](int3 const&, float, float voxelExit) -> bool {
+
+				if (voxelExit <= safeDist)
+					return true;
+
+				float const density = field.sample(rayStart + dir * voxelExit);
+				if (density <= 0.f)
+				{
+					prevDist = voxelExit;
+					prevDensity = density;
+					safeDist = prevDist - prevDensity / maxGradient;
+					return true;
+				}
+
+				// The surface is crossed in this voxel, refine the hit
+				float lo = prevDist, hi = voxelExit, loDensity = prevDensity, hiDensity = density;
+				for (int i = 0; i < numBisectionSteps; ++i)
+				{
+					float const mid = (lo + hi) * 0.5f;
+					float const midDensity = field.sample(rayStart + dir * mid);
+					if (midDensity > 0.f)
+					{
+						hi = mid;
+						hiDensity = midDensity;
+					}
+					else
+					{
+						lo = mid;
+						loDensity = midDensity;
+					}
+				}
+
+				// Interpolate linearly between the last two samples
+				hitDist = lo + (hi - lo) * loDensity / (loDensity - hiDensity);
+				return false;
+			});
+		});
+
+		return hitDist >= 0.f ? makeHit(hitDist) : hit;
 	}
 
-	bool frustumSphereOverlapTest(float4x4 const& frustum, float3 const& origin, float radius)
+	Frustum::Frustum(float4x4 const& viewProj)
 	{
-		// Get frustum planes
-		float4 planes[6];
-		getFrustumTPlanes(planes, frustum.getTransposed());
-		return frustumTest_Impl(planes, origin, radius);
+		// https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+		planes[0] = normalizePlane(viewProj[3] + viewProj[0]);
+		planes[1] = normalizePlane(viewProj[3] - viewProj[0]);
+		planes[2] = normalizePlane(viewProj[3] + viewProj[1]);
+		planes[3] = normalizePlane(viewProj[3] - viewProj[1]);
+		planes[4] = normalizePlane(viewProj[3] + viewProj[2]);
+		planes[5] = normalizePlane(viewProj[3] - viewProj[2]);
 	}
 
-	bool frustumAABBOverlapTest(float4x4 const& frustum, float3 const& min, float3 const& max)
+	StereoFrustum::StereoFrustum(float4x4 const (&views)[2], float4x4 const (&projections)[2])
 	{
-		// Get AABB vertices
-		float3 vertices[8];
-		getAAABVertices(vertices, min, max);
+		float3 eyePositions[2];
+		float3 edges[2][4];
+		for (int eyeIdx = 0; eyeIdx < 2; ++eyeIdx)
+		{
+			eyes[eyeIdx] = Frustum{projections[eyeIdx].dot(views[eyeIdx])};
+			eyePositions[eyeIdx] = (!views[eyeIdx]).dot(float4{0.f, 0.f, 0.f, 1.f}).xyz;
+			getFrustumEdges(edges[eyeIdx], eyes[eyeIdx]);
+		}
 
-		// Get frustum planes
-		float4 planes[6];
-		getFrustumTPlanes(planes, frustum.getTransposed());
+		for (int i = 0; i < 4; ++i)
+		{
+			combined.planes[i] = getStereoSidePlane(i, eyes, eyePositions, edges);
+		}
 
-		for (int i = 0; i < 8; ++i)
+		for (int i = 4; i < 6; ++i)
 		{
-			if (frustumTest_Impl(planes, vertices[0], 0.f))
-				// At least one vertex overlaps
-				return true;
+			// Move the near and far planes back to contain the other eye,
+			// degenerate planes already contain everything
+			combined.planes[i] = {0.f, 0.f, 0.f, 1.f};
+			float bestOffset = INFINITY;
+			for (int eyeIdx = 0; eyeIdx < 2; ++eyeIdx)
+			{
+				float4 const& plane = eyes[eyeIdx].planes[i];
+				float3 const& otherEye = eyePositions[1 - eyeIdx];
+				bool contained = plane.xyz.getSize2() > 0.f;
+				for (int j = 0; j < 4; ++j)
+				{
+					contained &= plane.xyz.dot(edges[1 - eyeIdx][j]) >= -1e-5f;
+				}
+
+				float const offset = Math::max(-(plane.xyz.dot(otherEye) + plane.w), 0.f);
+				if (contained && offset < bestOffset)
+				{
+					combined.planes[i] = plane + float4{0.f, 0.f, 0.f, offset};
+					bestOffset = offset;
+				}
+			}
 		}
+	}
+
+	size_t cullSpheres(Frustum const& frustum, Vec3SoA<float const> const& centers, ::std::span<float const> radii,
+	                   ::std::span<uint32_t> outVisibleMask)
+	{
+		VW_CHECKF(centers.size() == radii.size(), "Centers (%zu) and radii (%zu) size mismatch", centers.size(),
+		          radii.size());
+		size_t const count = Math::min(centers.size(), radii.size());
+		return writeVisibleMask(count, outVisibleMask, makeSpheresWordFn(frustum, centers, radii));
+	}
+
+	size_t cullSpheres_Compact(Frustum const& frustum, Vec3SoA<float const> const& centers,
+	                           ::std::span<float const> radii, ::std::span<uint32_t> outVisibleIndices)
+	{
+		VW_CHECKF(centers.size() == radii.size(), "Centers (%zu) and radii (%zu) size mismatch", centers.size(),
+		          radii.size());
+		size_t const count = Math::min(centers.size(), radii.size());
+		return writeVisibleIndices(count, outVisibleIndices, makeSpheresWordFn(frustum, centers, radii));
+	}
+
+	size_t cullAABBs(Frustum const& frustum, Vec3SoA<float const> const& mins, Vec3SoA<float const> const& maxs,
+	                 ::std::span<uint32_t> outVisibleMask)
+	{
+		VW_CHECKF(mins.size() == maxs.size(), "Min (%zu) and max (%zu) size mismatch", mins.size(), maxs.size());
+		size_t const count = Math::min(mins.size(), maxs.size());
+		return writeVisibleMask(count, outVisibleMask, makeAABBsWordFn(frustum, mins, maxs));
+	}
+
+	size_t cullAABBs_Compact(Frustum const& frustum, Vec3SoA<float const> const& mins,
+	                         Vec3SoA<float const> const& maxs, ::std::span<uint32_t> outVisibleIndices)
+	{
+		VW_CHECKF(mins.size() == maxs.size(), "Min (%zu) and max (%zu) size mismatch", mins.size(), maxs.size());
+		size_t const count = Math::min(mins.size(), maxs.size());
+		return writeVisibleIndices(count, outVisibleIndices, makeAABBsWordFn(frustum, mins, maxs));
+	}
+
+	size_t cullAABBs_Stereo(StereoFrustum const& frustum, Vec3SoA<float const> const& mins,
+	                        Vec3SoA<float const> const& maxs, ::std::span<uint32_t> outVisibleIndices,
+	                        ::std::span<uint8_t> outEyeMasks)
+	{
+		VW_CHECKF(outVisibleIndices.size() == outEyeMasks.size(), "Indices (%zu) and eye masks (%zu) size mismatch",
+		          outVisibleIndices.size(), outEyeMasks.size());
+		size_t const numCandidates = cullAABBs_Compact(frustum.combined, mins, maxs,
+		                                               outVisibleIndices.first(Math::min(outVisibleIndices.size(),
+		                                                                                 outEyeMasks.size())));
+
+		// Test the boxes visible in the combined frustum against each eye,
+		// and drop those that are visible in neither
+		size_t numVisible = 0;
+		for (size_t i = 0; i < numCandidates; ++i)
+		{
+			uint32_t const idx = outVisibleIndices[i];
+			float3 const min{mins.x[idx], mins.y[idx], mins.z[idx]}, max{maxs.x[idx], maxs.y[idx], maxs.z[idx]};
+			uint8_t const eyeMask = static_cast<uint8_t>(frustum.eyes[0].testAABB(min, max))
+			                      | static_cast<uint8_t>(frustum.eyes[1].testAABB(min, max)) << 1;
+			if (eyeMask)
+			{
+				outVisibleIndices[numVisible] = idx;
+				outEyeMasks[numVisible] = eyeMask;
+				numVisible++;
+			}
+		}
+		return numVisible;
+	}
+
+	bool frustumSphereOverlapTest(float4x4 const& frustum, float3 const& origin, float radius)
+	{
+		return Frustum{frustum}.testSphere(origin, radius);
+	}
+
+	bool frustumAABBOverlapTest(float4x4 const& frustum, float3 const& min, float3 const& max)
+	{
+		return Frustum{frustum}.testAABB(min, max);
+	}
+
+	ContactResult overlapSphereSphere(float3 const& centerA, float radiusA, float3 const& centerB, float radiusB)
+	{
+		float3 const delta = centerA - centerB;
+		float const dist2 = delta.getSize2();
+		float const radiusSum = radiusA + radiusB;
+		if (dist2 > radiusSum * radiusSum)
+			return {};
 
-		return false;
+		// Push the spheres apart vertically if their centers coincide
+		float const dist = sqrtf(dist2);
+		ContactResult contact;
+		contact.contactOccured = true;
+		contact.contactNormal = dist > 1e-6f ? delta / dist : float3{0.f, 1.f, 0.f};
+		contact.contactPoint = centerB + contact.contactNormal * radiusB;
+		contact.penetrationDepth = radiusSum - dist;
+		return contact;
 	}
 } // namespace VaporWorldVR
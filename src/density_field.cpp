@@ -0,0 +1,450 @@
+#include "density_field.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <utility>
+
+#include "math/math.h"
+#include "parallel_for.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		struct PerlinNoise
+		{
+			float3 grads[512];
+			uint32_t perms[512];
+		};
+
+
+		static void initPerlinNoiseGenerator(PerlinNoise& noiseGen)
+		{
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				noiseGen.perms[i] = i;
+			}
+
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				uint32_t j = rand() & 0xff;
+				::std::swap(noiseGen.perms[i], noiseGen.perms[j]);
+			}
+
+			for (uint32_t i = 0; i < 256; ++i)
+			{
+				constexpr float deltaAngle = (M_PI * 2.f) / 256;
+				noiseGen.grads[i] = {Math::cos(noiseGen.perms[i] * deltaAngle),
+				                     Math::cos(noiseGen.perms[noiseGen.perms[i]] * deltaAngle),
+				                     Math::sin(noiseGen.perms[i] * deltaAngle)};
+			}
+		}
+
+
+		static float perlinGradientValue(PerlinNoise const& noise, float3 p, int3 i, int3 period)
+		{
+			float3 grad = noise.grads[noise.perms[(noise.perms[(noise.perms[i.x % period.x] + i.y) % period.y] + i.z) % period.z]];
+			return p.dot(grad);
+		}
+
+
+		static float perlinNoiseSample3D(PerlinNoise const& noise, float3 pos, int3 period)
+		{
+			static constexpr int3 voxelVertices[] = {{0, 0, 0},
+			                                         {1, 0, 0},
+			                                         {0, 1, 0},
+			                                         {1, 1, 0},
+			                                         {0, 0, 1},
+			                                         {1, 0, 1},
+			                                         {0, 1, 1},
+			                                         {1, 1, 1}};
+
+			int3 i = (int3)pos;
+			float3 t = pos - (float3)i;
+			float3 w = t * t * (3.f - t * 2.f);
+
+			return Math::lerp(
+				Math::lerp(
+					Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[0], i + voxelVertices[0], period),
+					           perlinGradientValue(noise, t - (float3)voxelVertices[1], i + voxelVertices[1], period), w.x),
+					Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[2], i + voxelVertices[2], period),
+					           perlinGradientValue(noise, t - (float3)voxelVertices[3], i + voxelVertices[3], period), w.x),
+					w.y
+				),
+				Math::lerp(
+					Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[4], i + voxelVertices[4], period),
+					           perlinGradientValue(noise, t - (float3)voxelVertices[5], i + voxelVertices[5], period), w.x),
+					Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[6], i + voxelVertices[6], period),
+					           perlinGradientValue(noise, t - (float3)voxelVertices[7], i + voxelVertices[7], period), w.x),
+					w.y
+				),
+				w.z
+			);
+		}
+
+
+		static float perlinNoiseSampleOctaves3D(PerlinNoise const& noise, float3 const& pos, int3 period, uint32_t numOctaves)
+		{
+			float value = 0.f;
+			float freq = 1.f;
+			float ampl = 0.5f;
+
+			for (uint32_t octave = 0; octave < numOctaves; octave++)
+			{
+				value += perlinNoiseSample3D(noise, pos * freq, period) * ampl;
+				freq *= 2.f;
+				period *= 2;
+				ampl *= 0.5f;
+			}
+
+			return value;
+		}
+
+		/* Returns the texel coordinate and the interpolation weight of the
+		   given texture coordinate, with repeat wrapping. */
+		static FORCE_INLINE void getTexelCoords(float u, uint32_t res, uint32_t& outI0, uint32_t& outI1, float& outT)
+		{
+			// Texel centers are at (i + 0.5) / res
+			float const x = u * res - 0.5f;
+			float const x0 = floorf(x);
+			outT = x - x0;
+			int32_t i0 = static_cast<int32_t>(x0) % static_cast<int32_t>(res);
+			i0 += i0 < 0 ? res : 0;
+			outI0 = static_cast<uint32_t>(i0);
+			outI1 = outI0 + 1 == res ? 0 : outI0 + 1;
+		}
+	} // namespace
+
+
+	float NoiseTexture::sample(float3 const& uvw, float3* outGradient) const
+	{
+		if (texels.empty())
+		{
+			if (outGradient)
+				*outGradient = {};
+			return 0.f;
+		}
+
+		uint32_t x0, x1, y0, y1, z0, z1;
+		float tx, ty, tz;
+		getTexelCoords(uvw[0], resolution[0], x0, x1, tx);
+		getTexelCoords(uvw[1], resolution[1], y0, y1, ty);
+		getTexelCoords(uvw[2], resolution[2], z0, z1, tz);
+
+		size_t const rowSize = resolution[0], sliceSize = resolution[0] * resolution[1];
+		float const c000 = texels[z0 * sliceSize + y0 * rowSize + x0];
+		float const c100 = texels[z0 * sliceSize + y0 * rowSize + x1];
+		float const c010 = texels[z0 * sliceSize + y1 * rowSize + x0];
+		float const c110 = texels[z0 * sliceSize + y1 * rowSize + x1];
+		float const c001 = texels[z1 * sliceSize + y0 * rowSize + x0];
+		float const c101 = texels[z1 * sliceSize + y0 * rowSize + x1];
+		float const c011 = texels[z1 * sliceSize + y1 * rowSize + x0];
+		float const c111 = texels[z1 * sliceSize + y1 * rowSize + x1];
+
+		// Interpolate along X, then Y, then Z
+		float const c00 = Math::lerp(c000, c100, tx), c10 = Math::lerp(c010, c110, tx);
+		float const c01 = Math::lerp(c001, c101, tx), c11 = Math::lerp(c011, c111, tx);
+		float const c0 = Math::lerp(c00, c10, ty), c1 = Math::lerp(c01, c11, ty);
+
+		if (outGradient)
+		{
+			// Derivative of the trilinear interpolation, scaled from texels
+			// to texture coordinates
+			float const dx0 = Math::lerp(c100 - c000, c110 - c010, ty), dx1 = Math::lerp(c101 - c001, c111 - c011, ty);
+			*outGradient = {Math::lerp(dx0, dx1, tz) * resolution[0],
+			                Math::lerp(c10 - c00, c11 - c01, tz) * resolution[1],
+			                (c1 - c0) * resolution[2]};
+		}
+
+		return Math::lerp(c0, c1, tz);
+	}
+
+	template<int N>
+	Math::Packet<float, N> NoiseTexture::sample_Packet(Math::Packet<float3, N> const& uvw,
+	                                                   Math::Packet<float3, N>* outGradient) const
+	{
+		using FloatP = Math::Packet<float, N>;
+		if (texels.empty())
+		{
+			if (outGradient)
+				*outGradient = {};
+			return 0.f;
+		}
+
+		// Gather the corners of each lane, in the same order as sample()
+		float corners[8][N], weights[3][N];
+		size_t const rowSize = resolution[0], sliceSize = resolution[0] * resolution[1];
+		for (int lane = 0; lane < N; ++lane)
+		{
+			float3 const coords = uvw.getLane(lane);
+			uint32_t x0, x1, y0, y1, z0, z1;
+			getTexelCoords(coords[0], resolution[0], x0, x1, weights[0][lane]);
+			getTexelCoords(coords[1], resolution[1], y0, y1, weights[1][lane]);
+			getTexelCoords(coords[2], resolution[2], z0, z1, weights[2][lane]);
+
+			size_t const row00 = z0 * sliceSize + y0 * rowSize, row10 = z0 * sliceSize + y1 * rowSize;
+			size_t const row01 = z1 * sliceSize + y0 * rowSize, row11 = z1 * sliceSize + y1 * rowSize;
+			corners[0][lane] = texels[row00 + x0];
+			corners[1][lane] = texels[row00 + x1];
+			corners[2][lane] = texels[row10 + x0];
+			corners[3][lane] = texels[row10 + x1];
+			corners[4][lane] = texels[row01 + x0];
+			corners[5][lane] = texels[row01 + x1];
+			corners[6][lane] = texels[row11 + x0];
+			corners[7][lane] = texels[row11 + x1];
+		}
+
+		// Filter all lanes at once
+		FloatP const tx = FloatP::load(weights[0]), ty = FloatP::load(weights[1]), tz = FloatP::load(weights[2]);
+		FloatP const c000 = FloatP::load(corners[0]), c100 = FloatP::load(corners[1]);
+		FloatP const c010 = FloatP::load(corners[2]), c110 = FloatP::load(corners[3]);
+		FloatP const c001 = FloatP::load(corners[4]), c101 = FloatP::load(corners[5]);
+		FloatP const c011 = FloatP::load(corners[6]), c111 = FloatP::load(corners[7]);
+		FloatP const c00 = Math::lerp(c000, c100, tx), c10 = Math::lerp(c010, c110, tx);
+		FloatP const c01 = Math::lerp(c001, c101, tx), c11 = Math::lerp(c011, c111, tx);
+		FloatP const c0 = Math::lerp(c00, c10, ty), c1 = Math::lerp(c01, c11, ty);
+
+		if (outGradient)
+		{
+			FloatP const dx0 = Math::lerp(c100 - c000, c110 - c010, ty), dx1 = Math::lerp(c101 - c001, c111 - c011, ty);
+			*outGradient = {Math::lerp(dx0, dx1, tz) * static_cast<float>(resolution[0]),
+			                Math::lerp(c10 - c00, c11 - c01, tz) * static_cast<float>(resolution[1]),
+			                (c1 - c0) * static_cast<float>(resolution[2])};
+		}
+
+		return Math::lerp(c0, c1, tz);
+	}
+
+
+	DensityField::DensityField(float3 const& inGridOrigin, float inChunkSize, uint32_t inChunkResolution)
+		: noiseTextures{}
+		, gridOrigin{inGridOrigin}
+		, chunkSize{inChunkSize}
+		, chunkResolution{inChunkResolution}
+		, minSurfaceHeight{0.f}
+		, maxSurfaceHeight{0.f}
+		, maxGradient{1.f}
+	{}
+
+	void DensityField::initNoiseTextures(uint3 const& textureRes)
+	{
+		float3 const textureDensity = (float3)(textureRes / 4);
+		float minNoise = 0.f, maxNoise = 0.f;
+		float3 maxNoiseGradient;
+
+		for (uint32_t idx = 0; idx < numOctaves; ++idx)
+		{
+			NoiseTexture& texture = noiseTextures[idx];
+			texture.resolution = textureRes;
+			texture.texels.resize(textureRes.x * textureRes.y * textureRes.z);
+
+			// Noise generator
+			PerlinNoise noiseGen;
+			initPerlinNoiseGenerator(noiseGen);
+
+			for (uint32_t i = 0; i < textureRes.x; ++i)
+			{
+				for (uint32_t j = 0; j < textureRes.y; ++j)
+				{
+					for (uint32_t k = 0; k < textureRes.z; ++k)
+					{
+						size_t const pixelIdx = ((i * textureRes.y) + j) * textureRes.z + k;
+						float3 pos{i / textureDensity.x, j / textureDensity.y, k / textureDensity.z};
+						texture.texels[pixelIdx] = perlinNoiseSampleOctaves3D(noiseGen, pos, 4, 5);
+					}
+				}
+			}
+
+			// Find the range of the values and the greatest difference
+			// between neighbour texels, which bound the density and its
+			// gradient
+			float minTexel = texture.texels[0], maxTexel = texture.texels[0];
+			float3 maxDiff;
+			for (uint32_t z = 0; z < textureRes.z; ++z)
+			{
+				for (uint32_t y = 0; y < textureRes.y; ++y)
+				{
+					for (uint32_t x = 0; x < textureRes.x; ++x)
+					{
+						auto const getTexel = [&](uint32_t i, uint32_t j, uint32_t k) -> float {
+
+							return texture.texels[((k % textureRes.z) * textureRes.y + j % textureRes.y) * textureRes.x
+							                      + i % textureRes.x];
+						};
+						float const texel = getTexel(x, y, z);
+						minTexel = Math::min(minTexel, texel);
+						maxTexel = Math::max(maxTexel, texel);
+						maxDiff = Math::vmax(maxDiff, float3{fabsf(getTexel(x + 1, y, z) - texel),
+						                                     fabsf(getTexel(x, y + 1, z) - texel),
+						                                     fabsf(getTexel(x, y, z + 1) - texel)});
+					}
+				}
+			}
+
+			float const weight = 2.f * octaveWeights[idx];
+			minNoise += weight * minTexel;
+			maxNoise += weight * maxTexel;
+			maxNoiseGradient += weight * octaveScales[idx] * maxDiff * (float3)textureRes;
+		}
+
+		// The surface is where the noise is equal to the height
+		minSurfaceHeight = minNoise;
+		maxSurfaceHeight = maxNoise;
+		maxGradient = float3{maxNoiseGradient.x, maxNoiseGradient.y + 1.f, maxNoiseGradient.z}.getSize();
+	}
+
+	float DensityField::sample(float3 const& pos, float3* outGradient) const
+	{
+		float density = 0.f;
+		if (outGradient)
+			*outGradient = {};
+
+		for (uint32_t idx = 0; idx < numOctaves; ++idx)
+		{
+			float3 octaveGradient;
+			density += noiseTextures[idx].sample(pos * octaveScales[idx], outGradient ? &octaveGradient : nullptr)
+			         * octaveWeights[idx];
+			if (outGradient)
+				*outGradient += octaveGradient * (octaveWeights[idx] * octaveScales[idx] * 2.f);
+		}
+
+		if (outGradient)
+			(*outGradient)[1] -= 1.f;
+		return density * 2.f - pos.y;
+	}
+
+	template<int N>
+	Math::Packet<float, N> DensityField::sample_Packet(Math::Packet<float3, N> const& pos,
+	                                                   Math::Packet<float3, N>* outGradient) const
+	{
+		Math::Packet<float, N> density{0.f};
+		if (outGradient)
+			*outGradient = {};
+
+		for (uint32_t idx = 0; idx < numOctaves; ++idx)
+		{
+			Math::Packet<float3, N> octaveGradient;
+			density += noiseTextures[idx].sample_Packet<N>(pos * octaveScales[idx],
+			                                               outGradient ? &octaveGradient : nullptr)
+			         * octaveWeights[idx];
+			if (outGradient)
+				*outGradient += octaveGradient * (octaveWeights[idx] * octaveScales[idx] * 2.f);
+		}
+
+		if (outGradient)
+			outGradient->y -= 1.f;
+		return density * 2.f - pos.y;
+	}
+
+	template Math::Packet<float, 4> NoiseTexture::sample_Packet<4>(float3p4 const&, float3p4*) const;
+	template Math::Packet<float, 8> NoiseTexture::sample_Packet<8>(float3p8 const&, float3p8*) const;
+	template Math::Packet<float, 4> DensityField::sample_Packet<4>(float3p4 const&, float3p4*) const;
+	template Math::Packet<float, 8> DensityField::sample_Packet<8>(float3p8 const&, float3p8*) const;
+
+
+	DensityGridCache::DensityGridCache(DensityField const& inField)
+		: field{inField}
+		, chunks{}
+	{}
+
+	void DensityGridCache::prepare(float3 const& min, float3 const& max)
+	{
+		int3 const minChunk = field.getChunkIndex(min), maxChunk = field.getChunkIndex(max);
+		::std::vector<int3> missingChunks;
+		for (int z = minChunk.z; z <= maxChunk.z; ++z)
+		{
+			for (int y = minChunk.y; y <= maxChunk.y; ++y)
+			{
+				for (int x = minChunk.x; x <= maxChunk.x; ++x)
+				{
+					if (!chunks.contains(getChunkKey({x, y, z})))
+						missingChunks.push_back({x, y, z});
+				}
+			}
+		}
+
+		// Sample the missing chunks in parallel, then insert them
+		constexpr uint32_t gridSize = cellsPerChunk + 1;
+		constexpr uint32_t numPoints = gridSize * gridSize * gridSize;
+		float const cellSize = field.getChunkSize() / cellsPerChunk;
+		::std::vector<::std::vector<float>> grids(missingChunks.size());
+		parallelFor(missingChunks.size(), 1, [&](size_t begin, size_t end) {
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				float3 const chunkOrigin = field.getGridOrigin() + (float3)missingChunks[i] * field.getChunkSize();
+				auto const getPoint = [&](uint32_t pointIdx) -> float3 {
+
+					float3 const gridPos{static_cast<float>(pointIdx % gridSize),
+					                     static_cast<float>(pointIdx / gridSize % gridSize),
+					                     static_cast<float>(pointIdx / (gridSize * gridSize))};
+					return chunkOrigin + gridPos * cellSize;
+				};
+
+				::std::vector<float>& grid = grids[i];
+				grid.resize(numPoints);
+				uint32_t pointIdx = 0;
+				for (; pointIdx + 8 <= numPoints; pointIdx += 8)
+				{
+					float3p8 points;
+					for (int lane = 0; lane < 8; ++lane)
+					{
+						points.setLane(lane, getPoint(pointIdx + lane));
+					}
+					field.sample_Packet<8>(points).store(&grid[pointIdx]);
+				}
+
+				for (; pointIdx < numPoints; ++pointIdx)
+				{
+					// Remainder
+					grid[pointIdx] = field.sample(getPoint(pointIdx));
+				}
+			}
+		});
+
+		for (size_t i = 0; i < missingChunks.size(); ++i)
+		{
+			chunks.emplace(getChunkKey(missingChunks[i]), ::std::move(grids[i]));
+		}
+	}
+
+	void DensityGridCache::clear()
+	{
+		chunks.clear();
+	}
+
+	bool DensityGridCache::getDistanceLowerBound(float3 const& pos, float& outDist) const
+	{
+		int3 const chunkIdx = field.getChunkIndex(pos);
+		auto const it = chunks.find(getChunkKey(chunkIdx));
+		if (it == chunks.end())
+			return false;
+
+		// Find the cell, the position may be on the far side of the chunk
+		constexpr uint32_t gridSize = cellsPerChunk + 1;
+		float const cellSize = field.getChunkSize() / cellsPerChunk;
+		float3 const cellPos = (pos - field.getGridOrigin() - (float3)chunkIdx * field.getChunkSize()) / cellSize;
+		uint32_t cell[3];
+		float t[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			cell[i] = Math::min(static_cast<uint32_t>(Math::max(cellPos[i], 0.f)), cellsPerChunk - 1);
+			t[i] = Math::min(Math::max(cellPos[i] - cell[i], 0.f), 1.f);
+		}
+
+		float const* const grid = it->second.data() + (cell[2] * gridSize + cell[1]) * gridSize + cell[0];
+		constexpr uint32_t rowSize = gridSize, sliceSize = gridSize * gridSize;
+		float const c00 = Math::lerp(grid[0], grid[1], t[0]);
+		float const c10 = Math::lerp(grid[rowSize], grid[rowSize + 1], t[0]);
+		float const c01 = Math::lerp(grid[sliceSize], grid[sliceSize + 1], t[0]);
+		float const c11 = Math::lerp(grid[sliceSize + rowSize], grid[sliceSize + rowSize + 1], t[0]);
+		float const density = Math::lerp(Math::lerp(c00, c10, t[1]), Math::lerp(c01, c11, t[1]), t[2]);
+
+		// The interpolation error is bounded by the change of the density
+		// within a cell
+		outDist = -density / field.getMaxGradient() - cellSize * 1.7320508f;
+		return true;
+	}
+} // namespace VaporWorldVR
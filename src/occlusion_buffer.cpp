@@ -0,0 +1,461 @@
+#include "occlusion_buffer.h"
+
+#include <math.h>
+
+#include <algorithm>
+#include <array>
+
+#include "math/math.h"
+#include "math/packet.h"
+#include "density_field.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* The offsets of the centers of the pixels of a row of a tile. */
+		alignas(32) constexpr float tilePixelOffsets[OcclusionBuffer::tileWidth] = {0.5f, 1.5f, 2.5f, 3.5f,
+		                                                                             4.5f, 5.5f, 6.5f, 7.5f};
+
+		static_assert(OcclusionBuffer::tileWidth == 8, "A row of a tile should fit in a packet");
+
+		/* Transforms a point to clip space. Faster than Mat4::dot() for a
+		   single vector, which needs horizontal additions. */
+		static FORCE_INLINE float4 transformPoint(float4x4 const& m, float3 const& p)
+		{
+			return {m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+			        m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+			        m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3],
+			        m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3]};
+		}
+	} // namespace
+
+
+	size_t buildChunkOccluder(DensityField const& field, int3 const& chunkIdx, ::std::vector<float3>& outVertices,
+	                          float3* outSurfaceMin, float3* outSurfaceMax)
+	{
+		constexpr int numCells = occluderCellsPerChunk;
+		constexpr int gridSize = numCells + 2;
+		constexpr uint32_t latticeSize = numCells * occluderSamplesPerCell + 1;
+		constexpr uint32_t numSamples = latticeSize * latticeSize * latticeSize;
+
+		float const chunkSize = field.getChunkSize();
+		float const cellSize = chunkSize / numCells;
+		float const sampleSpacing = cellSize / occluderSamplesPerCell;
+		float3 const chunkOrigin = field.getGridOrigin() + (float3)chunkIdx * chunkSize;
+		float minHeight, maxHeight;
+		field.getSurfaceHeightRange(minHeight, maxHeight);
+
+		float3 surfaceMin{__builtin_inff()}, surfaceMax{-__builtin_inff()};
+		if (outSurfaceMin)
+			*outSurfaceMin = surfaceMin;
+
+		if (outSurfaceMax)
+			*outSurfaceMax = surfaceMax;
+
+		if (chunkOrigin.y >= maxHeight)
+			// The chunk is empty
+			return 0;
+
+		::std::vector<float> samples;
+		if (chunkOrigin.y + chunkSize > minHeight)
+		{
+			// The surface may cross the chunk, sample the density eight
+			// points at a time
+			auto const getSample = [&](uint32_t sampleIdx) -> float3 {
+
+				float3 const latticePos{static_cast<float>(sampleIdx % latticeSize),
+				                        static_cast<float>(sampleIdx / latticeSize % latticeSize),
+				                        static_cast<float>(sampleIdx / (latticeSize * latticeSize))};
+				return chunkOrigin + latticePos * sampleSpacing;
+			};
+
+			samples.resize(numSamples);
+			uint32_t sampleIdx = 0;
+			for (; sampleIdx + 8 <= numSamples; sampleIdx += 8)
+			{
+				float3p8 points;
+				for (int lane = 0; lane < 8; ++lane)
+				{
+					points.setLane(lane, getSample(sampleIdx + lane));
+				}
+				field.sample_Packet<8>(points).store(&samples[sampleIdx]);
+			}
+
+			for (; sampleIdx < numSamples; ++sampleIdx)
+			{
+				// Remainder
+				samples[sampleIdx] = field.sample(getSample(sampleIdx));
+			}
+		}
+
+		// Classify the cells, with a border of cells of the neighbour chunks.
+		// The border cells that may be crossed by the surface are not sampled,
+		// and assumed empty
+		float const minDensity = field.getMaxGradient() * sampleSpacing * 0.5f * sqrtf(3.f);
+		::std::array<bool, gridSize * gridSize * gridSize> solidCells;
+		for (int z = -1; z <= numCells; ++z)
+		{
+			for (int y = -1; y <= numCells; ++y)
+			{
+				for (int x = -1; x <= numCells; ++x)
+				{
+					float const cellMinHeight = chunkOrigin.y + y * cellSize;
+					bool solid = cellMinHeight + cellSize <= minHeight;
+					if (!solid && cellMinHeight < maxHeight && !samples.empty()
+					    && Math::min(Math::min(x, y), z) >= 0 && Math::max(Math::max(x, y), z) < numCells)
+					{
+						float minSample = __builtin_inff(), maxSample = -__builtin_inff();
+						for (uint32_t k = 0; k <= occluderSamplesPerCell; ++k)
+						{
+							for (uint32_t j = 0; j <= occluderSamplesPerCell; ++j)
+							{
+								uint32_t const rowIdx = ((z * occluderSamplesPerCell + k) * latticeSize
+								                      + y * occluderSamplesPerCell + j) * latticeSize
+								                      + x * occluderSamplesPerCell;
+								for (uint32_t i = 0; i <= occluderSamplesPerCell; ++i)
+								{
+									minSample = Math::min(minSample, samples[rowIdx + i]);
+									maxSample = Math::max(maxSample, samples[rowIdx + i]);
+								}
+							}
+						}
+
+						solid = minSample >= minDensity;
+						if (!solid && maxSample > -minDensity)
+						{
+							// Not certainly empty, the surface may cross the
+							// cell
+							float3 const cellMin = chunkOrigin + (float3)int3{x, y, z} * cellSize;
+							surfaceMin = Math::vmin(surfaceMin, cellMin);
+							surfaceMax = Math::vmax(surfaceMax, cellMin + cellSize);
+						}
+					}
+					solidCells[((z + 1) * gridSize + y + 1) * gridSize + x + 1] = solid;
+				}
+			}
+		}
+
+		if (outSurfaceMin)
+			*outSurfaceMin = surfaceMin;
+
+		if (outSurfaceMax)
+			*outSurfaceMax = surfaceMax;
+
+		auto const isSolid = [&](int3 const& cell) -> bool {
+
+			return solidCells[((cell.z + 1) * gridSize + cell.y + 1) * gridSize + cell.x + 1];
+		};
+
+		// For each side of each slice of cells, merge the faces between solid
+		// and empty cells in rectangles, greedily
+		size_t numTriangles = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			int const uAxis = (axis + 1) % 3, vAxis = (axis + 2) % 3;
+			for (int side = -1; side <= 1; side += 2)
+			{
+				for (int slice = 0; slice < numCells; ++slice)
+				{
+					bool faces[numCells][numCells];
+					for (int v = 0; v < numCells; ++v)
+					{
+						for (int u = 0; u < numCells; ++u)
+						{
+							int3 cell;
+							cell[axis] = slice;
+							cell[uAxis] = u;
+							cell[vAxis] = v;
+							int3 neighbour = cell;
+							neighbour[axis] += side;
+							faces[v][u] = isSolid(cell) && !isSolid(neighbour);
+						}
+					}
+
+					auto const getCorner = [&](int u, int v) -> float3 {
+
+						float3 cornerPos;
+						cornerPos[axis] = static_cast<float>(slice + (side > 0));
+						cornerPos[uAxis] = static_cast<float>(u);
+						cornerPos[vAxis] = static_cast<float>(v);
+						return chunkOrigin + cornerPos * cellSize;
+					};
+
+					for (int v = 0; v < numCells; ++v)
+					{
+						for (int u = 0; u < numCells; ++u)
+						{
+							if (!faces[v][u])
+								continue;
+
+							// Grow the rectangle along U, then along V while
+							// all faces of the next row are set
+							int rectWidth = 1, rectHeight = 1;
+							while (u + rectWidth < numCells && faces[v][u + rectWidth])
+								++rectWidth;
+
+							for (bool canGrow = true; canGrow && v + rectHeight < numCells; rectHeight += canGrow)
+							{
+								for (int i = 0; i < rectWidth; ++i)
+								{
+									canGrow &= faces[v + rectHeight][u + i];
+								}
+							}
+
+							for (int j = 0; j < rectHeight; ++j)
+							{
+								for (int i = 0; i < rectWidth; ++i)
+								{
+									faces[v + j][u + i] = false;
+								}
+							}
+
+							// U cross V is the axis, so the winding is flipped
+							// for faces on the negative side
+							float3 const corners[] = {getCorner(u, v), getCorner(u + rectWidth, v),
+							                          getCorner(u + rectWidth, v + rectHeight),
+							                          getCorner(u, v + rectHeight)};
+							if (side > 0)
+								outVertices.insert(outVertices.end(), {corners[0], corners[1], corners[2],
+								                                       corners[0], corners[2], corners[3]});
+							else
+								outVertices.insert(outVertices.end(), {corners[0], corners[2], corners[1],
+								                                       corners[0], corners[3], corners[2]});
+							numTriangles += 2;
+						}
+					}
+				}
+			}
+		}
+
+		return numTriangles;
+	}
+
+	OcclusionBuffer::OcclusionBuffer(uint32_t inWidth, uint32_t inHeight)
+		: width{inWidth}
+		, height{inHeight}
+		, viewProj{}
+		, depths(inWidth * inHeight, 0.f)
+		, tileDepths((inWidth / tileWidth) * (inHeight / tileHeight), 0.f)
+	{
+		VW_CHECKF(width % tileWidth == 0 && height % tileHeight == 0,
+		          "Occlusion buffer resolution must be a multiple of the tile size, got %ux%u", width, height);
+	}
+
+	void OcclusionBuffer::begin(float4x4 const& inViewProj)
+	{
+		viewProj = inViewProj;
+		::std::fill(depths.begin(), depths.end(), 0.f);
+	}
+
+	void OcclusionBuffer::renderTriangles(::std::span<float3 const> vertices)
+	{
+		for (size_t vertexIdx = 0; vertexIdx + 3 <= vertices.size(); vertexIdx += 3)
+		{
+			float4 const clipPos[] = {transformPoint(viewProj, vertices[vertexIdx]),
+			                          transformPoint(viewProj, vertices[vertexIdx + 1]),
+			                          transformPoint(viewProj, vertices[vertexIdx + 2])};
+
+			bool outside = false;
+			for (int i = 0; i < 3 && !outside; ++i)
+			{
+				// Skip triangles outside of one of the planes of the frustum
+				outside = (clipPos[0][i] > clipPos[0].w && clipPos[1][i] > clipPos[1].w && clipPos[2][i] > clipPos[2].w)
+				       || (clipPos[0][i] < -clipPos[0].w && clipPos[1][i] < -clipPos[1].w
+				           && clipPos[2][i] < -clipPos[2].w);
+			}
+
+			if (outside)
+				continue;
+
+			float const nearDists[] = {clipPos[0].z + clipPos[0].w, clipPos[1].z + clipPos[1].w,
+			                           clipPos[2].z + clipPos[2].w};
+			if (nearDists[0] >= 0.f && nearDists[1] >= 0.f && nearDists[2] >= 0.f)
+			{
+				rasterizeTriangle(clipPos[0], clipPos[1], clipPos[2]);
+				continue;
+			}
+
+			// Clip against the near plane, the clipped polygon has at most
+			// four vertices
+			float4 polygon[4];
+			int numPolygonVertices = 0;
+			for (int i = 0; i < 3; ++i)
+			{
+				int const j = (i + 1) % 3;
+				if (nearDists[i] >= 0.f)
+					polygon[numPolygonVertices++] = clipPos[i];
+
+				if ((nearDists[i] >= 0.f) != (nearDists[j] >= 0.f))
+					polygon[numPolygonVertices++] = clipPos[i] + (clipPos[j] - clipPos[i])
+					                                           * (nearDists[i] / (nearDists[i] - nearDists[j]));
+			}
+
+			for (int i = 2; i < numPolygonVertices; ++i)
+			{
+				rasterizeTriangle(polygon[0], polygon[i - 1], polygon[i]);
+			}
+		}
+	}
+
+	void OcclusionBuffer::end()
+	{
+		uint32_t const numTilesX = width / tileWidth;
+		for (uint32_t tileY = 0; tileY < height / tileHeight; ++tileY)
+		{
+			for (uint32_t tileX = 0; tileX < numTilesX; ++tileX)
+			{
+				float const* const tile = &depths[tileY * tileHeight * width + tileX * tileWidth];
+				floatp8 tileDepth = floatp8::load(tile);
+				for (uint32_t y = 1; y < tileHeight; ++y)
+				{
+					tileDepth = Math::min(tileDepth, floatp8::load(tile + y * width));
+				}
+
+				float minDepth = tileDepth.getLane(0);
+				for (int lane = 1; lane < 8; ++lane)
+				{
+					minDepth = Math::min(minDepth, tileDepth.getLane(lane));
+				}
+				tileDepths[tileY * numTilesX + tileX] = minDepth;
+			}
+		}
+	}
+
+	bool OcclusionBuffer::testAABB(float3 const& min, float3 const& max) const
+	{
+		float3 screenMin{__builtin_inff()}, screenMax{-__builtin_inff()};
+		for (int i = 0; i < 8; ++i)
+		{
+			float3 const corner{i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z};
+			float4 const clipPos = transformPoint(viewProj, corner);
+			if (clipPos.z < -clipPos.w || clipPos.w <= 0.f)
+				// The box crosses the near plane
+				return true;
+
+			float const invW = 1.f / clipPos.w;
+			float3 const screenPos{(clipPos.x * invW * 0.5f + 0.5f) * width, (clipPos.y * invW * 0.5f + 0.5f) * height,
+			                       invW};
+			screenMin = Math::vmin(screenMin, screenPos);
+			screenMax = Math::vmax(screenMax, screenPos);
+		}
+		float const boxDepth = screenMax.z;
+
+		// The pixels that overlap the screen rectangle of the box
+		int const xBegin = static_cast<int>(floorf(Math::max(screenMin.x, 0.f)));
+		int const xEnd = static_cast<int>(ceilf(Math::min(screenMax.x, static_cast<float>(width))));
+		int const yBegin = static_cast<int>(floorf(Math::max(screenMin.y, 0.f)));
+		int const yEnd = static_cast<int>(ceilf(Math::min(screenMax.y, static_cast<float>(height))));
+		if (xBegin >= xEnd || yBegin >= yEnd)
+			// Outside of the screen
+			return false;
+
+		uint32_t const numTilesX = width / tileWidth;
+		floatp8 const pixelOffsets = floatp8::load(tilePixelOffsets);
+		for (int tileY = yBegin / tileHeight; tileY <= (yEnd - 1) / static_cast<int>(tileHeight); ++tileY)
+		{
+			for (int tileX = xBegin / tileWidth; tileX <= (xEnd - 1) / static_cast<int>(tileWidth); ++tileX)
+			{
+				if (tileDepths[tileY * numTilesX + tileX] > boxDepth)
+					// The whole tile is closer than the box
+					continue;
+
+				// Test the pixels of the tile in the rectangle
+				floatp8 const pixelX = pixelOffsets + static_cast<float>(tileX * tileWidth);
+				maskp8 const inRect = (pixelX > static_cast<float>(xBegin)) & (pixelX < static_cast<float>(xEnd));
+				int const rowBegin = Math::max(tileY * static_cast<int>(tileHeight), yBegin);
+				int const rowEnd = Math::min((tileY + 1) * static_cast<int>(tileHeight), yEnd);
+				for (int y = rowBegin; y < rowEnd; ++y)
+				{
+					floatp8 const depth = floatp8::load(&depths[y * width + tileX * tileWidth]);
+					if ((inRect & (depth <= boxDepth)).any())
+						return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+	void OcclusionBuffer::rasterizeTriangle(float4 const& a, float4 const& b, float4 const& c)
+	{
+		if (a.w <= 0.f || b.w <= 0.f || c.w <= 0.f)
+			return;
+
+		// Project to pixel coordinates, Z is the inverse depth
+		float4 const* const clipPos[] = {&a, &b, &c};
+		float3 screenPos[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			float const invW = 1.f / clipPos[i]->w;
+			screenPos[i] = {(clipPos[i]->x * invW * 0.5f + 0.5f) * width,
+			                (clipPos[i]->y * invW * 0.5f + 0.5f) * height, invW};
+		}
+
+		// Twice the signed area, positive if counter-clockwise
+		float const area = (screenPos[1].x - screenPos[0].x) * (screenPos[2].y - screenPos[0].y)
+		                 - (screenPos[2].x - screenPos[0].x) * (screenPos[1].y - screenPos[0].y);
+		if (area <= 0.f)
+			// Back facing or degenerate
+			return;
+
+		// The pixels whose centers are inside the bounds of the triangle
+		float3 const boundsMin = Math::vmin(Math::vmin(screenPos[0], screenPos[1]), screenPos[2]);
+		float3 const boundsMax = Math::vmax(Math::vmax(screenPos[0], screenPos[1]), screenPos[2]);
+		int const xBegin = static_cast<int>(ceilf(Math::max(boundsMin.x, 0.f) - 0.5f));
+		int const xEnd = static_cast<int>(floorf(Math::min(boundsMax.x, static_cast<float>(width)) - 0.5f)) + 1;
+		int const yBegin = static_cast<int>(ceilf(Math::max(boundsMin.y, 0.f) - 0.5f));
+		int const yEnd = static_cast<int>(floorf(Math::min(boundsMax.y, static_cast<float>(height)) - 0.5f)) + 1;
+		if (xBegin >= xEnd || yBegin >= yEnd)
+			return;
+
+		// Edge functions E(x, y) = A * x + B * y + C, non-negative inside.
+		// The edge opposite to a vertex gives its barycentric coordinate
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			float3 const& p0 = screenPos[i];
+			float3 const& p1 = screenPos[(i + 1) % 3];
+			edgeA[i] = p0.y - p1.y;
+			edgeB[i] = p1.x - p0.x;
+			edgeC[i] = -(edgeA[i] * p0.x + edgeB[i] * p0.y);
+		}
+
+		// Plane of the inverse depth, moved back by its change across half a
+		// pixel
+		float const invArea = 1.f / area;
+		float const depthA = (edgeA[1] * screenPos[0].z + edgeA[2] * screenPos[1].z + edgeA[0] * screenPos[2].z)
+		                   * invArea;
+		float const depthB = (edgeB[1] * screenPos[0].z + edgeB[2] * screenPos[1].z + edgeB[0] * screenPos[2].z)
+		                   * invArea;
+		float const depthC = (edgeC[1] * screenPos[0].z + edgeC[2] * screenPos[1].z + edgeC[0] * screenPos[2].z)
+		                   * invArea - 0.5f * (fabsf(depthA) + fabsf(depthB));
+
+		floatp8 const pixelOffsets = floatp8::load(tilePixelOffsets);
+		int const xAlignedBegin = xBegin & ~static_cast<int>(tileWidth - 1);
+		for (int y = yBegin; y < yEnd; ++y)
+		{
+			float const pixelY = static_cast<float>(y) + 0.5f;
+			float const rowEdges[] = {edgeB[0] * pixelY + edgeC[0], edgeB[1] * pixelY + edgeC[1],
+			                          edgeB[2] * pixelY + edgeC[2]};
+			float const rowDepth = depthB * pixelY + depthC;
+			float* const row = &depths[y * width];
+			for (int x = xAlignedBegin; x < xEnd; x += tileWidth)
+			{
+				floatp8 const pixelX = pixelOffsets + static_cast<float>(x);
+				maskp8 const covered = (pixelX > static_cast<float>(xBegin)) & (pixelX < static_cast<float>(xEnd))
+				                     & (edgeA[0] * pixelX + rowEdges[0] >= 0.f)
+				                     & (edgeA[1] * pixelX + rowEdges[1] >= 0.f)
+				                     & (edgeA[2] * pixelX + rowEdges[2] >= 0.f);
+				if (covered.none())
+					continue;
+
+				// Only write the covered pixels
+				floatp8 const depth = floatp8::load(row + x);
+				Math::select(covered, Math::max(depth, depthA * pixelX + rowDepth), depth).store(row + x);
+			}
+		}
+	}
+} // namespace VaporWorldVR
@@ -0,0 +1,267 @@
+#include "pack_batch.h"
+
+#include "math/simd.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* Number of values processed by each iteration of the SIMD kernels. */
+		constexpr size_t blockSize = 4;
+
+		/* Returns the number of values to convert, the sizes should match. */
+		template<typename SrcT, typename DstT>
+		FORCE_INLINE size_t getBatchSize(::std::span<SrcT> src, ::std::span<DstT> dst)
+		{
+			VW_CHECKF(src.size() == dst.size(), "Source (%zu) and destination (%zu) size mismatch", src.size(),
+			          dst.size());
+			return src.size() < dst.size() ? src.size() : dst.size();
+		}
+
+#if VW_MATH_SIMD
+		/* Vector version of Impl::quantize(). */
+		FORCE_INLINE Math::Simd::Int32x4 quantize(Math::Simd::Float32x4 x, float lo, float hi, float scale)
+		{
+			using namespace Math::Simd;
+			x = min(max(x, splat(lo)), splat(hi));
+			Float32x4 const half = select(cmpLt(x, splat(0.f)), splat(-0.5f), splat(0.5f));
+			return convertToInt(add(mul(x, splat(scale)), half));
+		}
+
+		/* Vector version of Impl::floatToHalf(). */
+		FORCE_INLINE Math::Simd::Int32x4 floatToHalf(Math::Simd::Float32x4 f)
+		{
+			using namespace Math::Simd;
+			constexpr int32_t f32Infinity = 255 << 23;
+			constexpr int32_t f16Max = (127 + 16) << 23;
+			constexpr int32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+			Int32x4 bits = castToInt(f);
+			Int32x4 const sign = bitAnd(bits, splatInt(INT32_MIN));
+			bits = bitXor(bits, sign);
+
+			// Compute all cases, then select
+			Int32x4 const infNaN = select(cmpGt(bits, splatInt(f32Infinity)), splatInt(0x7e00), splatInt(0x7c00));
+			Int32x4 const subnormal = sub(castToInt(add(castToFloat(bits), castToFloat(splatInt(denormMagic)))),
+			                              splatInt(denormMagic));
+			Int32x4 const mantissaOdd = bitAnd(shiftRight<13>(bits), splatInt(1));
+			Int32x4 const normal = shiftRight<13>(add(add(bits, splatInt((15 - 127) * (1 << 23) + 0xfff)), mantissaOdd));
+
+			Int32x4 const out = select(cmpGt(bits, splatInt(f16Max - 1)), infNaN,
+			                           select(cmpGt(splatInt(113 << 23), bits), subnormal, normal));
+			return bitOr(out, shiftRight<16>(sign));
+		}
+
+		/* Vector version of Impl::halfToFloat(). */
+		FORCE_INLINE Math::Simd::Float32x4 halfToFloat(Math::Simd::Int32x4 h)
+		{
+			using namespace Math::Simd;
+			Float32x4 const f = mul(castToFloat(shiftLeft<13>(bitAnd(h, splatInt(0x7fff)))),
+			                        castToFloat(splatInt((254 - 15) << 23)));
+			Int32x4 bits = castToInt(f);
+			bits = select(cmpGe(f, castToFloat(splatInt((127 + 16) << 23))), bitOr(bits, splatInt(255 << 23)), bits);
+			return castToFloat(bitOr(bits, shiftLeft<16>(bitAnd(h, splatInt(0x8000)))));
+		}
+
+		/* Loads 4 Vec4 and transposes them, such that each register holds
+		   one coordinate of all vectors. */
+		FORCE_INLINE void loadTransposed(float4 const* src, Math::Simd::Float32x4& x, Math::Simd::Float32x4& y,
+		                                 Math::Simd::Float32x4& z, Math::Simd::Float32x4& w)
+		{
+			using namespace Math::Simd;
+			x = load(src[0].coords);
+			y = load(src[1].coords);
+			z = load(src[2].coords);
+			w = load(src[3].coords);
+			transpose(x, y, z, w);
+		}
+#endif
+	} // namespace
+
+
+	void packHalf(::std::span<float const> src, ::std::span<half> dst)
+	{
+		size_t const count = getBatchSize(src, dst);
+		size_t idx = 0;
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		for (; idx + blockSize <= count; idx += blockSize)
+		{
+			store16(&dst[idx].bits, floatToHalf(load(&src[idx])));
+		}
+#endif
+
+		for (; idx < count; ++idx)
+		{
+			// Remainder
+			dst[idx] = half{src[idx]};
+		}
+	}
+
+	void packHalf(::std::span<float3 const> src, ::std::span<half3> dst)
+	{
+		if constexpr (sizeof(float3) == 3 * sizeof(float))
+		{
+			// Both sequences are tightly packed, convert the coordinates
+			size_t const count = getBatchSize(src, dst);
+			packHalf({reinterpret_cast<float const*>(src.data()), count * 3},
+			         {reinterpret_cast<half*>(dst.data()), count * 3});
+		}
+		else
+		{
+			size_t const count = getBatchSize(src, dst);
+			for (size_t idx = 0; idx < count; ++idx)
+			{
+				dst[idx] = half3{src[idx]};
+			}
+		}
+	}
+
+	void unpackHalf(::std::span<half const> src, ::std::span<float> dst)
+	{
+		size_t const count = getBatchSize(src, dst);
+		size_t idx = 0;
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		for (; idx + blockSize <= count; idx += blockSize)
+		{
+			store(&dst[idx], halfToFloat(load16(&src[idx].bits)));
+		}
+#endif
+
+		for (; idx < count; ++idx)
+		{
+			// Remainder
+			dst[idx] = src[idx];
+		}
+	}
+
+	void packOctNormals(::std::span<float3 const> src, ::std::span<octnormal> dst)
+	{
+		size_t const count = getBatchSize(src, dst);
+		size_t idx = 0;
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		for (; idx + blockSize <= count; idx += blockSize)
+		{
+			Float32x4 x, y, z;
+			if constexpr (sizeof(float3) == 3 * sizeof(float))
+				load3(src[idx].coords, x, y, z);
+			else
+			{
+				x = set(src[idx].x, src[idx + 1].x, src[idx + 2].x, src[idx + 3].x);
+				y = set(src[idx].y, src[idx + 1].y, src[idx + 2].y, src[idx + 3].y);
+				z = set(src[idx].z, src[idx + 1].z, src[idx + 2].z, src[idx + 3].z);
+			}
+
+			// Project on the octahedron, then fold the lower half
+			Float32x4 const invL1 = div(splat(1.f), add(add(abs(x), abs(y)), abs(z)));
+			x = mul(x, invL1);
+			y = mul(y, invL1);
+			Float32x4 const signX = select(cmpLt(x, splat(0.f)), splat(-1.f), splat(1.f));
+			Float32x4 const signY = select(cmpLt(y, splat(0.f)), splat(-1.f), splat(1.f));
+			Mask32x4 const lower = cmpLt(z, splat(0.f));
+			Float32x4 const foldedX = mul(sub(splat(1.f), abs(y)), signX);
+			Float32x4 const foldedY = mul(sub(splat(1.f), abs(x)), signY);
+			x = select(lower, foldedX, x);
+			y = select(lower, foldedY, y);
+
+			Int32x4 const u = quantize(x, -1.f, 1.f, 32767.f), v = quantize(y, -1.f, 1.f, 32767.f);
+			store(reinterpret_cast<int32_t*>(&dst[idx]), bitOr(bitAnd(u, splatInt(0xffff)), shiftLeft<16>(v)));
+		}
+#endif
+
+		for (; idx < count; ++idx)
+		{
+			// Remainder
+			dst[idx] = octnormal{src[idx]};
+		}
+	}
+
+	void packUnorm8x4(::std::span<float4 const> src, ::std::span<unorm8x4> dst)
+	{
+		size_t const count = getBatchSize(src, dst);
+		size_t idx = 0;
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		for (; idx + blockSize <= count; idx += blockSize)
+		{
+			Float32x4 x, y, z, w;
+			loadTransposed(&src[idx], x, y, z, w);
+			Int32x4 const xy = bitOr(quantize(x, 0.f, 1.f, 255.f), shiftLeft<8>(quantize(y, 0.f, 1.f, 255.f)));
+			Int32x4 const zw = bitOr(shiftLeft<16>(quantize(z, 0.f, 1.f, 255.f)),
+			                         shiftLeft<24>(quantize(w, 0.f, 1.f, 255.f)));
+			store(reinterpret_cast<int32_t*>(&dst[idx]), bitOr(xy, zw));
+		}
+#endif
+
+		for (; idx < count; ++idx)
+		{
+			// Remainder
+			dst[idx] = unorm8x4{src[idx]};
+		}
+	}
+
+	void packSnorm16x4(::std::span<float4 const> src, ::std::span<snorm16x4> dst)
+	{
+		size_t const count = getBatchSize(src, dst);
+		size_t idx = 0;
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		for (; idx + blockSize <= count; idx += blockSize)
+		{
+			Float32x4 x, y, z, w;
+			loadTransposed(&src[idx], x, y, z, w);
+			Int32x4 const xy = bitOr(bitAnd(quantize(x, -1.f, 1.f, 32767.f), splatInt(0xffff)),
+			                         shiftLeft<16>(quantize(y, -1.f, 1.f, 32767.f)));
+			Int32x4 const zw = bitOr(bitAnd(quantize(z, -1.f, 1.f, 32767.f), splatInt(0xffff)),
+			                         shiftLeft<16>(quantize(w, -1.f, 1.f, 32767.f)));
+
+			// Interleave the halves of each vector
+			Float32x4 const lo = shuffle<0, 1, 0, 1>(castToFloat(xy), castToFloat(zw));
+			Float32x4 const hi = shuffle<2, 3, 2, 3>(castToFloat(xy), castToFloat(zw));
+			int32_t* const out = reinterpret_cast<int32_t*>(&dst[idx]);
+			store(out, castToInt(swizzle<0, 2, 1, 3>(lo)));
+			store(out + 4, castToInt(swizzle<0, 2, 1, 3>(hi)));
+		}
+#endif
+
+		for (; idx < count; ++idx)
+		{
+			// Remainder
+			dst[idx] = snorm16x4{src[idx]};
+		}
+	}
+
+	void packRGB10A2(::std::span<float4 const> src, ::std::span<rgb10a2> dst)
+	{
+		size_t const count = getBatchSize(src, dst);
+		size_t idx = 0;
+
+#if VW_MATH_SIMD
+		using namespace Math::Simd;
+		for (; idx + blockSize <= count; idx += blockSize)
+		{
+			Float32x4 x, y, z, w;
+			loadTransposed(&src[idx], x, y, z, w);
+			Int32x4 const rg = bitOr(quantize(x, 0.f, 1.f, 1023.f), shiftLeft<10>(quantize(y, 0.f, 1.f, 1023.f)));
+			Int32x4 const ba = bitOr(shiftLeft<20>(quantize(z, 0.f, 1.f, 1023.f)),
+			                         shiftLeft<30>(quantize(w, 0.f, 1.f, 3.f)));
+			store(reinterpret_cast<int32_t*>(&dst[idx]), bitOr(rg, ba));
+		}
+#endif
+
+		for (; idx < count; ++idx)
+		{
+			// Remainder
+			dst[idx] = rgb10a2{src[idx]};
+		}
+	}
+} // namespace VaporWorldVR
@@ -0,0 +1,293 @@
+#include "parallel_for.h"
+
+#include <unistd.h>
+
+#include <atomic>
+
+#include "runnable_thread.h"
+#include "mutex.h"
+#include "event.h"
+#include "logging.h"
+
+#define VW_PARALLEL_FOR_MAX_WORKERS 7
+#define VW_PARALLEL_FOR_BATCHES_PER_THREAD 4
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* Describes a parallelFor() in progress. */
+		struct ParallelForJob
+		{
+			/* The function that processes a range of items. */
+			ParallelForRangeFn fn;
+
+			/* User payload passed to the function. */
+			void* payload;
+
+			/* Total number of items. */
+			size_t count;
+
+			/* Number of items processed by a single call. */
+			size_t batchSize;
+
+			/* Index of the first item of the next batch. */
+			::std::atomic<size_t> next;
+
+			/* Number of workers executing this job, protected by the pool
+			   mutex. */
+			uint32_t numActiveWorkers;
+
+			/* Processes batches until all items have been taken. */
+			void execute()
+			{
+				for (;;)
+				{
+					size_t const begin = next.fetch_add(batchSize, ::std::memory_order_relaxed);
+					if (begin >= count)
+						// All batches taken
+						break;
+
+					size_t const end = begin + batchSize < count ? begin + batchSize : count;
+					fn(payload, begin, end);
+				}
+			}
+		};
+
+
+		/**
+		 * @brief A fixed set of worker threads that execute one
+		 * ParallelForJob at a time.
+		 */
+		class ParallelForPool
+		{
+		public:
+			ParallelForPool();
+			~ParallelForPool();
+
+			/**
+			 * @brief Returns the number of worker threads.
+			 */
+			FORCE_INLINE uint32_t getNumWorkers() const
+			{
+				return numWorkers;
+			}
+
+			/**
+			 * @brief Executes the job on the calling thread and on all
+			 * workers. Returns false if another job is already in progress.
+			 */
+			bool execute(ParallelForJob& job);
+
+			/**
+			 * @brief Loop executed by each worker thread.
+			 */
+			void workerLoop();
+
+		protected:
+			/* A runnable that runs the worker loop. */
+			class Worker final : public Runnable
+			{
+			public:
+				Worker(ParallelForPool* inPool) : pool{inPool} {}
+
+				virtual void run() override
+				{
+					pool->workerLoop();
+				}
+
+			private:
+				ParallelForPool* pool;
+			};
+
+			/* Workers and their threads. */
+			Worker* workers[VW_PARALLEL_FOR_MAX_WORKERS];
+			RunnableThread* threads[VW_PARALLEL_FOR_MAX_WORKERS];
+			uint32_t numWorkers;
+
+			/* Mutex that protects the state of the pool. */
+			Mutex* mutex;
+
+			/* Event fired when a new job is available. */
+			Event* eventJob;
+
+			/* Event fired when a worker is done with a job. */
+			Event* eventDone;
+
+			/* The job in progress, or null. */
+			ParallelForJob* currentJob;
+
+			/* Incremented every time a new job is submitted. */
+			uint64_t jobGeneration;
+
+			/* Set to true to terminate the workers. */
+			bool requestExit;
+		};
+
+
+		ParallelForPool::ParallelForPool()
+			: workers{}
+			, threads{}
+			, numWorkers{0}
+			, mutex{createMutex()}
+			, eventJob{createEvent()}
+			, eventDone{createEvent()}
+			, currentJob{nullptr}
+			, jobGeneration{0}
+			, requestExit{false}
+		{
+			// Leave one core to the calling thread
+			long const numCores = sysconf(_SC_NPROCESSORS_ONLN);
+			numWorkers = numCores > 1 ? numCores - 1 : 0;
+			numWorkers = numWorkers < VW_PARALLEL_FOR_MAX_WORKERS ? numWorkers : VW_PARALLEL_FOR_MAX_WORKERS;
+
+			for (uint32_t idx = 0; idx < numWorkers; ++idx)
+			{
+				workers[idx] = new Worker{this};
+				threads[idx] = createRunnableThread(workers[idx]);
+				threads[idx]->setName("VW_ParallelFor" + ::std::to_string(idx));
+				threads[idx]->start();
+			}
+
+			VW_LOG_DEBUG("Created %u parallel for workers", numWorkers);
+		}
+
+		ParallelForPool::~ParallelForPool()
+		{
+			mutex->lock();
+			{
+				requestExit = true;
+				eventJob->notifyAll();
+			}
+			mutex->unlock();
+
+			for (uint32_t idx = 0; idx < numWorkers; ++idx)
+			{
+				destroyRunnableThread(threads[idx]);
+				delete workers[idx];
+			}
+
+			destroyEvent(eventDone);
+			destroyEvent(eventJob);
+			destroyMutex(mutex);
+		}
+
+		bool ParallelForPool::execute(ParallelForJob& job)
+		{
+			mutex->lock();
+			{
+				if (currentJob)
+				{
+					// Only one job at a time
+					mutex->unlock();
+					return false;
+				}
+
+				// Publish job
+				currentJob = &job;
+				jobGeneration++;
+				eventJob->notifyAll();
+			}
+			mutex->unlock();
+
+			// Help workers
+			job.execute();
+
+			mutex->lock();
+			{
+				while (job.numActiveWorkers > 0)
+				{
+					// Wait for workers that joined the job to finish
+					eventDone->wait(mutex);
+				}
+
+				// Workers that wake up from now on will skip the job
+				currentJob = nullptr;
+			}
+			mutex->unlock();
+
+			return true;
+		}
+
+		void ParallelForPool::workerLoop()
+		{
+			uint64_t lastJobGeneration = 0;
+
+			mutex->lock();
+			for (;;)
+			{
+				while (!requestExit && jobGeneration == lastJobGeneration)
+				{
+					// Wait for next job
+					eventJob->wait(mutex);
+				}
+
+				if (requestExit)
+					break;
+
+				lastJobGeneration = jobGeneration;
+				ParallelForJob* job = currentJob;
+				if (!job)
+					// Job already completed
+					continue;
+
+				job->numActiveWorkers++;
+				mutex->unlock();
+				{
+					job->execute();
+				}
+				mutex->lock();
+
+				job->numActiveWorkers--;
+				if (job->numActiveWorkers == 0)
+				{
+					// Wake up the thread that submitted the job
+					eventDone->notifyAll();
+				}
+			}
+			mutex->unlock();
+		}
+
+
+		/* Returns the pool instance, the pool is created on first use. */
+		ParallelForPool& getParallelForPool()
+		{
+			static ParallelForPool pool;
+			return pool;
+		}
+	} // namespace
+
+
+	uint32_t getNumParallelForWorkers()
+	{
+		return getParallelForPool().getNumWorkers();
+	}
+
+	void parallelFor_Impl(size_t count, size_t minBatchSize, ParallelForRangeFn fn, void* payload)
+	{
+		if (count == 0)
+			return;
+
+		minBatchSize = minBatchSize > 0 ? minBatchSize : 1;
+		uint32_t const numWorkers = count > minBatchSize ? getNumParallelForWorkers() : 0;
+		if (numWorkers == 0)
+		{
+			// Not worth it, process all items on this thread
+			fn(payload, 0, count);
+			return;
+		}
+
+		// Split the range in a few batches per thread, to balance load
+		size_t const numBatches = (numWorkers + 1) * VW_PARALLEL_FOR_BATCHES_PER_THREAD;
+		size_t batchSize = (count + numBatches - 1) / numBatches;
+		batchSize = batchSize > minBatchSize ? batchSize : minBatchSize;
+
+		ParallelForJob job{fn, payload, count, batchSize, {0}, 0};
+		if (!getParallelForPool().execute(job))
+		{
+			// Pool is busy, nested or concurrent calls run on this thread
+			fn(payload, 0, count);
+		}
+	}
+} // namespace VaporWorldVR
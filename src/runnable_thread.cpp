@@ -41,14 +41,20 @@ namespace VaporWorldVR
 		 */
 		static FORCE_INLINE RunnableThreadImpl* findThreadById(int tid)
 		{
+			pthread_mutex_lock(&threadsMutex);
 			auto it = threads.find(tid);
-			return it != threads.end() ? it->second : nullptr;
+			RunnableThreadImpl* thread = it != threads.end() ? it->second : nullptr;
+			pthread_mutex_unlock(&threadsMutex);
+			return thread;
 		}
 
 	protected:
 		/* Map of threads, indexed by tid. */
 		static ThreadsMap threads;
 
+		/* Protects the map of threads, threads register concurrently. */
+		static pthread_mutex_t threadsMutex;
+
 		/* The pthread thread. */
 		pthread_t thread;
 
@@ -66,6 +72,7 @@ namespace VaporWorldVR
 	// RunnableThreadImpl static values
 	// ================================
 	ThreadsMap RunnableThreadImpl::threads;
+	pthread_mutex_t RunnableThreadImpl::threadsMutex = PTHREAD_MUTEX_INITIALIZER;
 
 
 	// =============================
@@ -133,7 +140,9 @@ namespace VaporWorldVR
 
 		// Read the thread id and register runnable thread
 		self->tid = gettid();
+		pthread_mutex_lock(&threadsMutex);
 		RunnableThreadImpl::threads.insert({self->tid, self});
+		pthread_mutex_unlock(&threadsMutex);
 
 		// Run the runnable task
 		self->state = State_Resumed;
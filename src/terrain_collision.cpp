@@ -0,0 +1,370 @@
+#include "terrain_collision.h"
+
+#include "math/math.h"
+#include "density_field.h"
+#include "parallel_for.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* Number of points sampled at once along lines and segments. */
+		constexpr int numLinePoints = 8;
+
+		/* Maximum number of segments searched for the surface, if the
+		   center of a sphere is inside the terrain. */
+		constexpr int maxSearchSegments = 4;
+
+		/* Number of regula falsi steps used to refine the surface. */
+		constexpr int numRefineSteps = 4;
+
+		/* Fraction of the first order estimate of the distance from the
+		   surface by which sweeps advance. The bound of the gradient is
+		   much larger than the gradient on most of the terrain, so the
+		   lower bound alone would advance in tiny steps near the
+		   surface. */
+		constexpr float stepRelaxation = 0.5f;
+
+		/* Number of bisection steps used to refine the first contact of a
+		   sweep. */
+		constexpr int numBisectionSteps = 10;
+
+		/* Returns the distance by which a point can safely move, i.e. the
+		   greatest between the lower bound of its distance from the surface
+		   and a fraction of the first order estimate of the distance. The
+		   cached bound is used if it is greater than the threshold,
+		   otherwise the density is evaluated. */
+		static FORCE_INLINE float getStepDistance(DensityField const& field, DensityGridCache const* cache,
+		                                          float3 const& pos, float threshold)
+		{
+			float dist;
+			if (cache && cache->getDistanceLowerBound(pos, dist) && dist > threshold)
+				return dist;
+
+			float3 gradient;
+			float const density = field.sample(pos, &gradient);
+			return Math::max(-density / field.getMaxGradient(),
+			                 -density / Math::max(gradient.getSize(), 1e-6f) * stepRelaxation);
+		}
+
+		/* Returns the contact of a sphere, given the density and the
+		   gradient at its center. The surface is searched along the
+		   gradient. */
+		static ContactResult findSphereContact(DensityField const& field, float3 const& center, float radius,
+		                                       float centerDensity, float3 const& centerGradient)
+		{
+			float const gradientSize = centerGradient.getSize();
+			float3 const normal = gradientSize > 1e-6f ? -centerGradient / gradientSize : float3{0.f, 1.f, 0.f};
+
+			// Sample the line along the normal, towards the terrain if the
+			// center is outside. If the center is inside, sample away from
+			// the terrain, in segments of increasing length
+			bool const inside = centerDensity > 0.f;
+			float a = 0.f, densityA = centerDensity, b = 0.f, densityB = 0.f;
+			bool found = false;
+			for (int segment = 0; segment < (inside ? maxSearchSegments : 1) && !found; ++segment)
+			{
+				float const start = a, length = inside ? 2.f * radius * (1 << segment) : -radius;
+				float offsets[numLinePoints], densities[numLinePoints];
+				float3p8 points;
+				for (int i = 0; i < numLinePoints; ++i)
+				{
+					offsets[i] = start + length * (i + 1) / numLinePoints;
+					points.setLane(i, center + normal * offsets[i]);
+				}
+				field.sample_Packet<numLinePoints>(points).store(densities);
+
+				// Find the first sign change
+				for (int i = 0; i < numLinePoints && !found; ++i)
+				{
+					found = (densities[i] > 0.f) != inside;
+					(found ? b : a) = offsets[i];
+					(found ? densityB : densityA) = densities[i];
+				}
+			}
+
+			float surfaceOffset = a;
+			if (found)
+			{
+				for (int step = 0; step < numRefineSteps; ++step)
+				{
+					float const mid = a + (b - a) * densityA / (densityA - densityB);
+					float const densityMid = field.sample(center + normal * mid);
+					if ((densityMid > 0.f) == (densityA > 0.f))
+					{
+						a = mid;
+						densityA = densityMid;
+					}
+					else
+					{
+						b = mid;
+						densityB = densityMid;
+					}
+				}
+				surfaceOffset = a + (b - a) * densityA / (densityA - densityB);
+			}
+			else if (!inside)
+				// No surface within the sphere
+				return {};
+
+			// The surface is at the offset along the normal
+			float const penetrationDepth = radius + surfaceOffset;
+			if (penetrationDepth <= 0.f)
+				return {};
+
+			ContactResult contact;
+			contact.contactOccured = true;
+			contact.contactPoint = center + normal * surfaceOffset;
+			contact.penetrationDepth = penetrationDepth;
+			float3 gradient;
+			field.sample(contact.contactPoint, &gradient);
+			contact.contactNormal = gradient.getSize2() > 1e-12f ? -gradient.normalize() : normal;
+			return contact;
+		}
+
+		/* Samples the segment of a capsule. Returns the lower bound of the
+		   distance of the samples from the surface, the distance by which
+		   all samples can move (see getStepDistance()), and the position
+		   along the segment closest to the surface. */
+		static FORCE_INLINE void sampleSegment(DensityField const& field, float3 const& segmentStart,
+		                                       float3 const& segmentEnd, float& outLowerBound, float& outStepDist,
+		                                       float& outClosestPos)
+		{
+			float3p8 points;
+			for (int i = 0; i < numLinePoints; ++i)
+			{
+				points.setLane(i, Math::lerp(segmentStart, segmentEnd, static_cast<float>(i) / (numLinePoints - 1)));
+			}
+
+			float3p8 gradients;
+			floatp8 const densities = field.sample_Packet<numLinePoints>(points, &gradients);
+			floatp8 const lowerBounds = -densities / field.getMaxGradient();
+			floatp8 const estimates = -densities / Math::max(gradients.getSize(), floatp8{1e-6f});
+			float lanes[3][numLinePoints];
+			lowerBounds.store(lanes[0]);
+			Math::max(lowerBounds, estimates * stepRelaxation).store(lanes[1]);
+			estimates.store(lanes[2]);
+
+			// The closest sample is refined with a parabola through the
+			// neighbour samples
+			outLowerBound = lanes[0][0];
+			outStepDist = lanes[1][0];
+			int closest = 0;
+			for (int i = 1; i < numLinePoints; ++i)
+			{
+				outLowerBound = Math::min(outLowerBound, lanes[0][i]);
+				outStepDist = Math::min(outStepDist, lanes[1][i]);
+				closest = lanes[2][i] < lanes[2][closest] ? i : closest;
+			}
+
+			float pos = static_cast<float>(closest);
+			if (closest > 0 && closest < numLinePoints - 1)
+			{
+				float const d0 = lanes[2][closest - 1], d1 = lanes[2][closest], d2 = lanes[2][closest + 1];
+				float const curvature = d0 - 2.f * d1 + d2;
+				pos += curvature > 1e-6f ? Math::min(Math::max((d0 - d2) / (2.f * curvature), -1.f), 1.f) : 0.f;
+			}
+			outClosestPos = pos / (numLinePoints - 1);
+		}
+
+		/* Moves a shape by sphere tracing, see sweepSphereTerrain(). The
+		   step function returns the distance by which the moved shape can
+		   advance, zero or negative if it may touch the surface, and the
+		   overlap function the contact of the moved shape. */
+		template<typename StepFnT, typename OverlapFnT>
+		static ContactResult sweepShape(float3 const& dir, float maxDist, float minStep, float* outDist,
+		                                StepFnT const& getStepDist, OverlapFnT const& overlap)
+		{
+			float safeDist = 0.f;
+			for (float dist = 0.f;;)
+			{
+				float3 const offset = dir * dist;
+				float const stepDist = getStepDist(offset, minStep);
+				if (stepDist <= 0.f)
+				{
+					if (ContactResult contact = overlap(offset))
+					{
+						// Bisect between the last position without contact
+						// and this one
+						float lo = safeDist, hi = dist;
+						for (int step = 0; step < numBisectionSteps && dist > 0.f; ++step)
+						{
+							float const mid = (lo + hi) * 0.5f;
+							if (ContactResult const midContact = overlap(dir * mid))
+							{
+								hi = mid;
+								contact = midContact;
+							}
+							else
+								lo = mid;
+						}
+
+						if (outDist)
+							*outDist = hi;
+						return contact;
+					}
+				}
+
+				safeDist = dist;
+				if (dist >= maxDist)
+					return {};
+
+				dist = Math::min(dist + Math::max(stepDist, minStep), maxDist);
+			}
+		}
+	} // namespace
+
+
+	ContactResult overlapSphereTerrain(DensityField const& field, float3 const& center, float radius,
+	                                   DensityGridCache const* cache)
+	{
+		if (float dist; cache && cache->getDistanceLowerBound(center, dist) && dist > radius)
+			// Far from the surface
+			return {};
+
+		float3 gradient;
+		float const density = field.sample(center, &gradient);
+		if (-density / field.getMaxGradient() > radius)
+			return {};
+
+		return findSphereContact(field, center, radius, density, gradient);
+	}
+
+	ContactResult overlapCapsuleTerrain(DensityField const& field, float3 const& segmentStart,
+	                                    float3 const& segmentEnd, float radius, DensityGridCache const* cache)
+	{
+		// Points of the segment are at most this far from a sample
+		float const halfSpacing = (segmentEnd - segmentStart).getSize() / (2.f * (numLinePoints - 1));
+		if (cache)
+		{
+			bool farFromSurface = true;
+			for (int i = 0; i < numLinePoints && farFromSurface; ++i)
+			{
+				float3 const pos = Math::lerp(segmentStart, segmentEnd, static_cast<float>(i) / (numLinePoints - 1));
+				float dist;
+				farFromSurface = cache->getDistanceLowerBound(pos, dist) && dist > radius + halfSpacing;
+			}
+			if (farFromSurface)
+				return {};
+		}
+
+		float lowerBound, stepDist, closestPos;
+		sampleSegment(field, segmentStart, segmentEnd, lowerBound, stepDist, closestPos);
+		if (lowerBound - halfSpacing > radius)
+			return {};
+
+		float3 const center = Math::lerp(segmentStart, segmentEnd, closestPos);
+		float3 gradient;
+		float const density = field.sample(center, &gradient);
+		return findSphereContact(field, center, radius, density, gradient);
+	}
+
+	ContactResult sweepSphereTerrain(DensityField const& field, float3 const& center, float radius,
+	                                 float3 const& dir, float maxDist, float* outDist, DensityGridCache const* cache)
+	{
+		float const dirSize = dir.getSize();
+		if (dirSize == 0.f)
+		{
+			if (outDist)
+				*outDist = 0.f;
+			return overlapSphereTerrain(field, center, radius, cache);
+		}
+
+		return sweepShape(dir / dirSize, maxDist, field.getVoxelSize() * 0.5f, outDist,
+		                  [&](float3 const& offset, float minStep) {
+
+			return getStepDistance(field, cache, center + offset, radius + minStep) - radius;
+		}, [&](float3 const& offset) {
+
+			return overlapSphereTerrain(field, center + offset, radius);
+		});
+	}
+
+	ContactResult sweepCapsuleTerrain(DensityField const& field, float3 const& segmentStart,
+	                                  float3 const& segmentEnd, float radius, float3 const& dir, float maxDist,
+	                                  float* outDist, DensityGridCache const* cache)
+	{
+		float const dirSize = dir.getSize();
+		if (dirSize == 0.f)
+		{
+			if (outDist)
+				*outDist = 0.f;
+			return overlapCapsuleTerrain(field, segmentStart, segmentEnd, radius, cache);
+		}
+
+		float const halfSpacing = (segmentEnd - segmentStart).getSize() / (2.f * (numLinePoints - 1));
+		return sweepShape(dir / dirSize, maxDist, field.getVoxelSize() * 0.5f, outDist,
+		                  [&](float3 const& offset, float minStep) {
+
+			if (cache)
+			{
+				// Use the cached bounds if all of them are far enough
+				float lowerBound = __builtin_inff();
+				for (int i = 0; i < numLinePoints && lowerBound > radius + halfSpacing + minStep; ++i)
+				{
+					float const t = static_cast<float>(i) / (numLinePoints - 1);
+					float dist;
+					lowerBound = cache->getDistanceLowerBound(Math::lerp(segmentStart, segmentEnd, t) + offset, dist)
+					           ? Math::min(lowerBound, dist) : -__builtin_inff();
+				}
+				if (lowerBound > radius + halfSpacing + minStep)
+					return lowerBound - halfSpacing - radius;
+			}
+
+			float lowerBound, stepDist, closestPos;
+			sampleSegment(field, segmentStart + offset, segmentEnd + offset, lowerBound, stepDist, closestPos);
+			return stepDist - halfSpacing - radius;
+		}, [&](float3 const& offset) {
+
+			return overlapCapsuleTerrain(field, segmentStart + offset, segmentEnd + offset, radius);
+		});
+	}
+
+	void overlapSpheresTerrain(DensityField const& field, Vec3SoA<float const> const& centers,
+	                           ::std::span<float const> radii, ::std::span<ContactResult> outContacts,
+	                           DensityGridCache const* cache)
+	{
+		VW_CHECKF(centers.size() == radii.size() && centers.size() == outContacts.size(),
+		          "Centers (%zu), radii (%zu) and contacts (%zu) size mismatch", centers.size(), radii.size(),
+		          outContacts.size());
+		size_t const count = Math::min(Math::min(centers.size(), radii.size()), outContacts.size());
+
+		// Bodies are independent, and the cache is read-only
+		parallelFor(count, terrainQueryParallelThreshold, [&](size_t begin, size_t end) {
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				outContacts[i] = overlapSphereTerrain(field, {centers.x[i], centers.y[i], centers.z[i]}, radii[i],
+				                                      cache);
+			}
+		});
+	}
+
+	void sweepSpheresTerrain(DensityField const& field, Vec3SoA<float const> const& centers,
+	                         ::std::span<float const> radii, Vec3SoA<float const> const& motions,
+	                         ::std::span<ContactResult> outContacts, ::std::span<float> outFractions,
+	                         DensityGridCache const* cache)
+	{
+		VW_CHECKF(centers.size() == radii.size() && centers.size() == motions.size()
+		              && centers.size() == outContacts.size() && centers.size() == outFractions.size(),
+		          "Centers (%zu), radii (%zu), motions (%zu), contacts (%zu) and fractions (%zu) size mismatch",
+		          centers.size(), radii.size(), motions.size(), outContacts.size(), outFractions.size());
+		size_t const count = Math::min(Math::min(Math::min(centers.size(), radii.size()), motions.size()),
+		                               Math::min(outContacts.size(), outFractions.size()));
+
+		parallelFor(count, terrainQueryParallelThreshold, [&](size_t begin, size_t end) {
+
+			for (size_t i = begin; i < end; ++i)
+			{
+				float3 const motion{motions.x[i], motions.y[i], motions.z[i]};
+				float const motionSize = motion.getSize();
+				float dist = motionSize;
+				outContacts[i] = sweepSphereTerrain(field, {centers.x[i], centers.y[i], centers.z[i]}, radii[i],
+				                                    motion, motionSize, &dist, cache);
+				outFractions[i] = !outContacts[i] ? 1.f : motionSize > 0.f ? dist / motionSize : 0.f;
+			}
+		});
+	}
+} // namespace VaporWorldVR
@@ -1,8 +1,13 @@
 #include "mutex.h"
 #include "event.h"
+#include "futex.h"
 
 #include <errno.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
 
 #include "logging.h"
 
@@ -235,4 +240,35 @@ namespace VaporWorldVR
 	{
 		delete event;
 	}
+
+
+	// ====================
+	// Futex implementation
+	// ====================
+	static_assert(sizeof(::std::atomic<uint32_t>) == sizeof(uint32_t) && ::std::atomic<uint32_t>::is_always_lock_free,
+	              "Futexes require a lock-free 32 bits atomic");
+
+	bool futexWait(::std::atomic<uint32_t>& value, uint32_t expected, int64_t timeoutNs)
+	{
+		timespec timeout;
+		if (timeoutNs >= 0)
+		{
+			timeout.tv_sec = static_cast<time_t>(timeoutNs / 1000000000);
+			timeout.tv_nsec = static_cast<long>(timeoutNs % 1000000000);
+		}
+
+		// Private futexes are only shared between threads of this process
+		long err = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&value), FUTEX_WAIT_PRIVATE, expected,
+		                   timeoutNs >= 0 ? &timeout : nullptr, nullptr, 0);
+		VW_CHECKF(err == 0 || errno == EAGAIN || errno == EINTR || errno == ETIMEDOUT,
+		          "Failed to wait on futex @ %p with error (%d)", &value, errno);
+		return err == 0 || errno != ETIMEDOUT;
+	}
+
+	void futexWake(::std::atomic<uint32_t>& value, bool wakeAll)
+	{
+		[[maybe_unused]] long err = syscall(SYS_futex, reinterpret_cast<uint32_t*>(&value), FUTEX_WAKE_PRIVATE,
+		                                    wakeAll ? INT32_MAX : 1, nullptr, nullptr, 0);
+		VW_CHECKF(err >= 0, "Failed to wake futex @ %p with error (%d)", &value, errno);
+	}
 } // namespace VaporWorldVR
@@ -0,0 +1,327 @@
+#include "transform_batch.h"
+
+#include "math/simd.h"
+#include "parallel_for.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* Number of vectors processed by each iteration of the SIMD kernels. */
+		constexpr size_t blockSize = 4;
+
+		/* Returns the transformed vector, W is 1 for points and 0 for
+		   directions. */
+		template<bool isPoint>
+		FORCE_INLINE float3 transformVec3_Scalar(float4x4 const& m, float3 const& v)
+		{
+			return m.dot(float4{v, isPoint ? 1.f : 0.f}).xyz;
+		}
+
+#if VW_MATH_SIMD
+		/* Matrix elements, each broadcast to all lanes of a register. */
+		struct SplatMatrix
+		{
+			Math::Simd::Float32x4 m[4][4];
+
+			FORCE_INLINE SplatMatrix(float4x4 const& mat)
+			{
+				for (int i = 0; i < 4; ++i)
+				{
+					for (int j = 0; j < 4; ++j)
+					{
+						m[i][j] = Math::Simd::splat(mat[i][j]);
+					}
+				}
+			}
+
+			/* Transforms 4 vectors in SoA layout, only the first three rows
+			   are used. */
+			template<bool isPoint>
+			FORCE_INLINE void transform(Math::Simd::Float32x4& x, Math::Simd::Float32x4& y,
+			                            Math::Simd::Float32x4& z) const
+			{
+				using namespace Math::Simd;
+				Float32x4 rx = isPoint ? m[0][3] : splat(0.f);
+				Float32x4 ry = isPoint ? m[1][3] : splat(0.f);
+				Float32x4 rz = isPoint ? m[2][3] : splat(0.f);
+				rx = madd(m[0][0], x, madd(m[0][1], y, madd(m[0][2], z, rx)));
+				ry = madd(m[1][0], x, madd(m[1][1], y, madd(m[1][2], z, ry)));
+				rz = madd(m[2][0], x, madd(m[2][1], y, madd(m[2][2], z, rz)));
+				x = rx;
+				y = ry;
+				z = rz;
+			}
+		};
+#endif
+
+		/* Transforms the vectors in the range [begin, end). */
+		template<bool isPoint>
+		void transformVec3_AoS(float4x4 const& m, float3 const* src, float3* dst, size_t begin, size_t end)
+		{
+			size_t idx = begin;
+
+#if VW_MATH_SIMD
+			if constexpr (sizeof(float3) == 3 * sizeof(float))
+			{
+				// Vectors are tightly packed, deinterleave 4 vectors at a time
+				using namespace Math::Simd;
+				SplatMatrix const splatM{m};
+				for (; idx + blockSize <= end; idx += blockSize)
+				{
+					Float32x4 x, y, z;
+					load3(src[idx].coords, x, y, z);
+					splatM.transform<isPoint>(x, y, z);
+					store3(dst[idx].coords, x, y, z);
+				}
+			}
+#endif
+
+			for (; idx < end; ++idx)
+			{
+				// Remainder
+				dst[idx] = transformVec3_Scalar<isPoint>(m, src[idx]);
+			}
+		}
+
+		/* Transforms the vectors in the range [begin, end). */
+		template<bool isPoint, bool aligned>
+		void transformVec3_SoA(float4x4 const& m, Vec3SoA<float const> const& src, Vec3SoA<float> const& dst,
+		                       size_t begin, size_t end)
+		{
+			size_t idx = begin;
+
+#if VW_MATH_SIMD
+			using namespace Math::Simd;
+			SplatMatrix const splatM{m};
+			for (; idx + blockSize <= end; idx += blockSize)
+			{
+				Float32x4 x, y, z;
+				if constexpr (aligned)
+				{
+					x = loadAligned(&src.x[idx]);
+					y = loadAligned(&src.y[idx]);
+					z = loadAligned(&src.z[idx]);
+				}
+				else
+				{
+					x = load(&src.x[idx]);
+					y = load(&src.y[idx]);
+					z = load(&src.z[idx]);
+				}
+
+				splatM.transform<isPoint>(x, y, z);
+
+				if constexpr (aligned)
+				{
+					storeAligned(&dst.x[idx], x);
+					storeAligned(&dst.y[idx], y);
+					storeAligned(&dst.z[idx], z);
+				}
+				else
+				{
+					store(&dst.x[idx], x);
+					store(&dst.y[idx], y);
+					store(&dst.z[idx], z);
+				}
+			}
+#endif
+
+			for (; idx < end; ++idx)
+			{
+				// Remainder
+				float3 const v = transformVec3_Scalar<isPoint>(m, {src.x[idx], src.y[idx], src.z[idx]});
+				dst.x[idx] = v.x;
+				dst.y[idx] = v.y;
+				dst.z[idx] = v.z;
+			}
+		}
+
+		/* Transforms the vectors in the range [begin, end). */
+		template<bool aligned>
+		void transformVec4(float4x4 const& m, float4 const* src, float4* dst, size_t begin, size_t end)
+		{
+#if VW_MATH_SIMD
+			// Each result is a linear combination of the matrix columns
+			using namespace Math::Simd;
+			float4x4 const mT = m.getTransposed();
+			Float32x4 const c0 = load(mT[0].coords), c1 = load(mT[1].coords),
+			                c2 = load(mT[2].coords), c3 = load(mT[3].coords);
+			for (size_t idx = begin; idx < end; ++idx)
+			{
+				Float32x4 const v = aligned ? loadAligned(src[idx].coords) : load(src[idx].coords);
+				Float32x4 r = mul(broadcast<0>(v), c0);
+				r = madd(broadcast<1>(v), c1, r);
+				r = madd(broadcast<2>(v), c2, r);
+				r = madd(broadcast<3>(v), c3, r);
+				aligned ? storeAligned(dst[idx].coords, r) : store(dst[idx].coords, r);
+			}
+#else
+			for (size_t idx = begin; idx < end; ++idx)
+			{
+				dst[idx] = m.dot(src[idx]);
+			}
+#endif
+		}
+
+		/* Bakes the transformations in the range [begin, end). */
+		void bakeTransforms_Kernel(Math::Transform const* src, float4x4* dst, size_t begin, size_t end)
+		{
+			size_t idx = begin;
+
+#if VW_MATH_SIMD
+			if constexpr (sizeof(Math::Transform) == 10 * sizeof(float))
+			{
+				// Transforms are tightly packed as <rotation, translation,
+				// scale>, deinterleave 4 transforms at a time
+				using namespace Math::Simd;
+				for (; idx + blockSize <= end; idx += blockSize)
+				{
+					float const* const data = reinterpret_cast<float const*>(&src[idx]);
+					Float32x4 qx = load(data), qy = load(data + 10), qz = load(data + 20), qw = load(data + 30);
+					Float32x4 tx = load(data + 4), ty = load(data + 14), tz = load(data + 24), sx = load(data + 34);
+					Float32x4 unused0 = load(data + 6), unused1 = load(data + 16), sy = load(data + 26),
+					          sz = load(data + 36);
+					transpose(qx, qy, qz, qw);
+					transpose(tx, ty, tz, sx);
+					transpose(unused0, unused1, sy, sz);
+
+					// Same as the AffineMatrix constructor
+					Float32x4 const one = splat(1.f), two = splat(2.f);
+					Float32x4 const x2 = mul(qx, two), y2 = mul(qy, two), z2 = mul(qz, two);
+					Float32x4 const xx = mul(qx, x2), xy = mul(qx, y2), xz = mul(qx, z2), xw = mul(qw, x2),
+					                yy = mul(qy, y2), yz = mul(qy, z2), yw = mul(qw, y2),
+					                zz = mul(qz, z2), zw = mul(qw, z2);
+
+					Float32x4 r0[4] = {mul(sub(one, add(yy, zz)), sx), mul(sub(xy, zw), sy), mul(add(xz, yw), sz),
+					                   tx};
+					Float32x4 r1[4] = {mul(add(xy, zw), sx), mul(sub(one, add(xx, zz)), sy), mul(sub(yz, xw), sz),
+					                   ty};
+					Float32x4 r2[4] = {mul(sub(xz, yw), sx), mul(add(yz, xw), sy), mul(sub(one, add(xx, yy)), sz),
+					                   tz};
+					transpose(r0[0], r0[1], r0[2], r0[3]);
+					transpose(r1[0], r1[1], r1[2], r1[3]);
+					transpose(r2[0], r2[1], r2[2], r2[3]);
+
+					Float32x4 const r3 = set(0.f, 0.f, 0.f, 1.f);
+					for (size_t i = 0; i < blockSize; ++i)
+					{
+						float* const out = dst[idx + i].data;
+						store(out, r0[i]);
+						store(out + 4, r1[i]);
+						store(out + 8, r2[i]);
+						store(out + 12, r3);
+					}
+				}
+			}
+#endif
+
+			for (; idx < end; ++idx)
+			{
+				// Remainder
+				dst[idx] = static_cast<float4x4>(src[idx]);
+			}
+		}
+
+		/* Runs the kernel over whole blocks, in parallel if the batch is
+		   large enough. Ranges passed to the kernel always start at a
+		   multiple of the block size, so that alignment is preserved. */
+		template<typename KernelT>
+		FORCE_INLINE void dispatchKernel(size_t count, KernelT&& kernel)
+		{
+			size_t const numBlocks = (count + blockSize - 1) / blockSize;
+			parallelFor(numBlocks, transformBatchParallelThreshold / blockSize, [&](size_t first, size_t last) {
+
+				size_t const end = last * blockSize < count ? last * blockSize : count;
+				kernel(first * blockSize, end);
+			});
+		}
+
+		template<bool isPoint>
+		FORCE_INLINE void transformVec3_Dispatch(float4x4 const& m, ::std::span<float3 const> src,
+		                                         ::std::span<float3> dst)
+		{
+			VW_CHECKF(src.size() == dst.size(), "Source (%zu) and destination (%zu) size mismatch", src.size(),
+			          dst.size());
+			size_t const count = src.size() < dst.size() ? src.size() : dst.size();
+			dispatchKernel(count, [&](size_t begin, size_t end) {
+
+				transformVec3_AoS<isPoint>(m, src.data(), dst.data(), begin, end);
+			});
+		}
+
+		template<bool isPoint>
+		FORCE_INLINE void transformVec3_Dispatch(float4x4 const& m, Vec3SoA<float const> const& src,
+		                                         Vec3SoA<float> const& dst)
+		{
+			VW_CHECKF(src.size() == dst.size(), "Source (%zu) and destination (%zu) size mismatch", src.size(),
+			          dst.size());
+			size_t const count = src.size() < dst.size() ? src.size() : dst.size();
+
+#if VW_MATH_SIMD
+			bool const aligned = Math::Simd::isAligned(src.x.data()) && Math::Simd::isAligned(src.y.data())
+			                  && Math::Simd::isAligned(src.z.data()) && Math::Simd::isAligned(dst.x.data())
+			                  && Math::Simd::isAligned(dst.y.data()) && Math::Simd::isAligned(dst.z.data());
+#else
+			bool const aligned = false;
+#endif
+			dispatchKernel(count, [&](size_t begin, size_t end) {
+
+				aligned ? transformVec3_SoA<isPoint, true>(m, src, dst, begin, end)
+				        : transformVec3_SoA<isPoint, false>(m, src, dst, begin, end);
+			});
+		}
+	} // namespace
+
+
+	void transformPoints(float4x4 const& m, ::std::span<float3 const> src, ::std::span<float3> dst)
+	{
+		transformVec3_Dispatch<true>(m, src, dst);
+	}
+
+	void transformPoints(float4x4 const& m, Vec3SoA<float const> const& src, Vec3SoA<float> const& dst)
+	{
+		transformVec3_Dispatch<true>(m, src, dst);
+	}
+
+	void transformDirections(float4x4 const& m, ::std::span<float3 const> src, ::std::span<float3> dst)
+	{
+		transformVec3_Dispatch<false>(m, src, dst);
+	}
+
+	void transformDirections(float4x4 const& m, Vec3SoA<float const> const& src, Vec3SoA<float> const& dst)
+	{
+		transformVec3_Dispatch<false>(m, src, dst);
+	}
+
+	void transformVectors(float4x4 const& m, ::std::span<float4 const> src, ::std::span<float4> dst)
+	{
+		VW_CHECKF(src.size() == dst.size(), "Source (%zu) and destination (%zu) size mismatch", src.size(),
+		          dst.size());
+		size_t const count = src.size() < dst.size() ? src.size() : dst.size();
+
+#if VW_MATH_SIMD
+		bool const aligned = Math::Simd::isAligned(src.data()) && Math::Simd::isAligned(dst.data());
+#else
+		bool const aligned = false;
+#endif
+		dispatchKernel(count, [&](size_t begin, size_t end) {
+
+			aligned ? transformVec4<true>(m, src.data(), dst.data(), begin, end)
+			        : transformVec4<false>(m, src.data(), dst.data(), begin, end);
+		});
+	}
+
+	void bakeTransforms(::std::span<Math::Transform const> src, ::std::span<float4x4> dst)
+	{
+		VW_CHECKF(src.size() == dst.size(), "Source (%zu) and destination (%zu) size mismatch", src.size(),
+		          dst.size());
+		size_t const count = src.size() < dst.size() ? src.size() : dst.size();
+		dispatchKernel(count, [&](size_t begin, size_t end) {
+
+			bakeTransforms_Kernel(src.data(), dst.data(), begin, end);
+		});
+	}
+} // namespace VaporWorldVR
@@ -0,0 +1,470 @@
+#include "triangle_bvh.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "math/math.h"
+#include "logging.h"
+
+
+namespace VaporWorldVR
+{
+	namespace
+	{
+		/* Maximum depth of the tree, and of the traversal stack. Past
+		   maxSAHDepth, nodes are split in two halves, which bounds the depth
+		   for up to 2^20 triangles. */
+		/// @{
+		constexpr int maxDepth = 64;
+		constexpr int maxSAHDepth = maxDepth - 20;
+		/// @}
+
+		/* Returns half the surface area of the given box. */
+		static FORCE_INLINE float getHalfArea(float3 const& min, float3 const& max)
+		{
+			float3 const size = max - min;
+			return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+		}
+
+		/* Returns the inverse of the ray direction. Zero coordinates are
+		   replaced with a large value, to avoid NaN in the slab tests. */
+		static FORCE_INLINE float3 getInvDir(float3 const& rayDir)
+		{
+			return {rayDir[0] != 0.f ? 1.f / rayDir[0] : 1e30f, rayDir[1] != 0.f ? 1.f / rayDir[1] : 1e30f,
+			        rayDir[2] != 0.f ? 1.f / rayDir[2] : 1e30f};
+		}
+
+		/* Returns the distance at which the ray enters the node, or infinity
+		   if the ray misses the node within the maximum distance. */
+		static FORCE_INLINE float getRayEntryDist(TriangleBVHNode const& node, float3 const& rayStart,
+		                                          float3 const& invDir, float maxDist)
+		{
+			float tMin = 0.f, tMax = maxDist;
+			for (int i = 0; i < 3; ++i)
+			{
+				float const t0 = (node.min[i] - rayStart[i]) * invDir[i];
+				float const t1 = (node.max[i] - rayStart[i]) * invDir[i];
+				tMin = Math::max(tMin, Math::min(t0, t1));
+				tMax = Math::min(tMax, Math::max(t0, t1));
+			}
+			return tMin <= tMax ? tMin : __builtin_inff();
+		}
+
+		/* Like getRayEntryDist(), but for a packet of rays. Returns the mask
+		   of the rays that hit the node. */
+		template<int N>
+		FORCE_INLINE Math::PacketMask<N> intersectNode(TriangleBVHNode const& node,
+		                                               Math::Packet<float3, N> const& rayStarts,
+		                                               Math::Packet<float3, N> const& invDirs,
+		                                               Math::Packet<float, N> const& maxDists)
+		{
+			using FloatP = Math::Packet<float, N>;
+			FloatP const tx0 = (FloatP{node.min.x} - rayStarts.x) * invDirs.x;
+			FloatP const tx1 = (FloatP{node.max.x} - rayStarts.x) * invDirs.x;
+			FloatP const ty0 = (FloatP{node.min.y} - rayStarts.y) * invDirs.y;
+			FloatP const ty1 = (FloatP{node.max.y} - rayStarts.y) * invDirs.y;
+			FloatP const tz0 = (FloatP{node.min.z} - rayStarts.z) * invDirs.z;
+			FloatP const tz1 = (FloatP{node.max.z} - rayStarts.z) * invDirs.z;
+			FloatP const tMin = Math::max(Math::max(Math::min(tx0, tx1), Math::min(ty0, ty1)),
+			                              Math::max(Math::min(tz0, tz1), FloatP{0.f}));
+			FloatP const tMax = Math::min(Math::min(Math::max(tx0, tx1), Math::max(ty0, ty1)),
+			                              Math::min(Math::max(tz0, tz1), maxDists));
+			return tMin <= tMax;
+		}
+
+		/* Intersects rays with triangles (Moller-Trumbore), lane by lane.
+		   Either the rays or the triangles may be the same in all lanes.
+		   Returns the mask of the lanes that hit within the maximum
+		   distance. */
+		template<int N>
+		FORCE_INLINE Math::PacketMask<N> intersectTriangles(Math::Packet<float3, N> const& rayStarts,
+		                                                    Math::Packet<float3, N> const& rayDirs,
+		                                                    Math::Packet<float3, N> const& v0,
+		                                                    Math::Packet<float3, N> const& e1,
+		                                                    Math::Packet<float3, N> const& e2,
+		                                                    Math::Packet<float, N> const& maxDists,
+		                                                    Math::Packet<float, N>& outDists)
+		{
+			using FloatP = Math::Packet<float, N>;
+
+			// Degenerate triangles have a zero determinant, which gives NaN
+			// or infinite barycentrics that fail the tests
+			Math::Packet<float3, N> const p = rayDirs.cross(e2);
+			FloatP const invDet = 1.f / e1.dot(p);
+			Math::Packet<float3, N> const s = rayStarts - v0;
+			FloatP const u = s.dot(p) * invDet;
+			Math::Packet<float3, N> const q = s.cross(e1);
+			FloatP const v = rayDirs.dot(q) * invDet;
+			outDists = e2.dot(q) * invDet;
+			return (u >= FloatP{0.f}) & (v >= FloatP{0.f}) & (u + v <= FloatP{1.f}) & (outDists >= FloatP{0.f})
+			     & (outDists < maxDists);
+		}
+
+		/* Returns the triangle in the given slot of the block, broadcast to
+		   all lanes. */
+		template<int N, typename BlockT>
+		FORCE_INLINE void loadTriangle(BlockT const& block, uint32_t slot, Math::Packet<float3, N>& outV0,
+		                               Math::Packet<float3, N>& outE1, Math::Packet<float3, N>& outE2)
+		{
+			outV0 = float3{block.v0[0][slot], block.v0[1][slot], block.v0[2][slot]};
+			outE1 = float3{block.e1[0][slot], block.e1[1][slot], block.e1[2][slot]};
+			outE2 = float3{block.e2[0][slot], block.e2[1][slot], block.e2[2][slot]};
+		}
+
+		/* Returns the hit with the given triangle, the normal faces the
+		   ray. */
+		template<typename BlockT>
+		FORCE_INLINE HitResult makeHit(BlockT const& block, uint32_t slot, float3 const& rayStart,
+		                               float3 const& rayDir, float dist)
+		{
+			float3 const e1{block.e1[0][slot], block.e1[1][slot], block.e1[2][slot]};
+			float3 const e2{block.e2[0][slot], block.e2[1][slot], block.e2[2][slot]};
+			float3 const normal = e1.cross(e2).normalize();
+
+			HitResult hit;
+			hit.hitOccured = true;
+			hit.hitPosition = rayStart + rayDir * dist;
+			hit.hitNormal = normal.dot(rayDir) > 0.f ? -normal : normal;
+			return hit;
+		}
+	} // namespace
+
+
+	void TriangleBVH::build(::std::span<float4 const> vertices)
+	{
+		VW_CHECKF(vertices.size() % 3 == 0, "Number of vertices (%zu) is not a multiple of 3", vertices.size());
+		numTriangles = vertices.size() / 3;
+		nodes.clear();
+		blocks.clear();
+		if (numTriangles == 0)
+			return;
+
+		// Bounds and centroids of the triangles
+		::std::vector<float3> triMins(numTriangles), triMaxs(numTriangles), centroids(numTriangles);
+		::std::vector<uint32_t> triIndices(numTriangles);
+		for (size_t i = 0; i < numTriangles; ++i)
+		{
+			float3 const& a = vertices[i * 3].xyz;
+			float3 const& b = vertices[i * 3 + 1].xyz;
+			float3 const& c = vertices[i * 3 + 2].xyz;
+			triMins[i] = Math::vmin(Math::vmin(a, b), c);
+			triMaxs[i] = Math::vmax(Math::vmax(a, b), c);
+			centroids[i] = (triMins[i] + triMaxs[i]) * 0.5f;
+			triIndices[i] = static_cast<uint32_t>(i);
+		}
+
+		// Each leaf has at most maxLeafSize triangles, a binary tree with n
+		// leaves has 2n - 1 nodes
+		size_t const maxNumLeaves = numTriangles;
+		nodes.reserve(2 * maxNumLeaves - 1);
+		nodes.emplace_back();
+
+		struct BuildTask
+		{
+			uint32_t nodeIdx;
+			uint32_t begin;
+			uint32_t end;
+			int depth;
+		};
+		BuildTask stack[maxDepth];
+		int stackSize = 0;
+		stack[stackSize++] = {0, 0, static_cast<uint32_t>(numTriangles), 0};
+
+		while (stackSize > 0)
+		{
+			BuildTask const task = stack[--stackSize];
+			uint32_t const count = task.end - task.begin;
+
+			// Compute the bounds of the node and of the centroids
+			float3 nodeMin{__builtin_inff()}, nodeMax{-__builtin_inff()};
+			float3 centroidMin{__builtin_inff()}, centroidMax{-__builtin_inff()};
+			for (uint32_t i = task.begin; i < task.end; ++i)
+			{
+				uint32_t const triIdx = triIndices[i];
+				nodeMin = Math::vmin(nodeMin, triMins[triIdx]);
+				nodeMax = Math::vmax(nodeMax, triMaxs[triIdx]);
+				centroidMin = Math::vmin(centroidMin, centroids[triIdx]);
+				centroidMax = Math::vmax(centroidMax, centroids[triIdx]);
+			}
+			nodes[task.nodeIdx].min = nodeMin;
+			nodes[task.nodeIdx].max = nodeMax;
+
+			if (count <= maxLeafSize)
+			{
+				// Make a leaf, and fill the unused slots with degenerate
+				// triangles
+				TriangleBlock block{};
+				for (uint32_t slot = 0; slot < count; ++slot)
+				{
+					uint32_t const triIdx = triIndices[task.begin + slot];
+					float3 const& a = vertices[triIdx * 3].xyz;
+					float3 const e1 = vertices[triIdx * 3 + 1].xyz - a;
+					float3 const e2 = vertices[triIdx * 3 + 2].xyz - a;
+					for (int i = 0; i < 3; ++i)
+					{
+						block.v0[i][slot] = a[i];
+						block.e1[i][slot] = e1[i];
+						block.e2[i][slot] = e2[i];
+					}
+					block.indices[slot] = triIdx;
+				}
+				nodes[task.nodeIdx].leftOrFirst = static_cast<uint32_t>(blocks.size());
+				nodes[task.nodeIdx].numTriangles = count;
+				blocks.push_back(block);
+				continue;
+			}
+
+			// Find the split with the lowest cost, i.e. the sum of the
+			// areas of the children weighted by their number of triangles
+			int bestAxis = -1;
+			uint32_t bestSplit = 0;
+			float bestCost = __builtin_inff();
+			for (int axis = 0; axis < 3 && task.depth < maxSAHDepth; ++axis)
+			{
+				float const extent = centroidMax[axis] - centroidMin[axis];
+				if (extent <= 0.f)
+					continue;
+
+				struct Bin
+				{
+					float3 min{__builtin_inff()};
+					float3 max{-__builtin_inff()};
+					uint32_t count = 0;
+				} bins[numBins];
+				float const binScale = numBins / extent;
+				for (uint32_t i = task.begin; i < task.end; ++i)
+				{
+					uint32_t const triIdx = triIndices[i];
+					uint32_t const binIdx = Math::min(static_cast<uint32_t>((centroids[triIdx][axis] - centroidMin[axis])
+					                                                        * binScale),
+					                                  numBins - 1);
+					bins[binIdx].min = Math::vmin(bins[binIdx].min, triMins[triIdx]);
+					bins[binIdx].max = Math::vmax(bins[binIdx].max, triMaxs[triIdx]);
+					bins[binIdx].count++;
+				}
+
+				// Sweep from the left, then from the right and evaluate the
+				// split after each bin
+				float leftCosts[numBins - 1];
+				float3 sweepMin{__builtin_inff()}, sweepMax{-__builtin_inff()};
+				uint32_t sweepCount = 0;
+				for (uint32_t i = 0; i < numBins - 1; ++i)
+				{
+					sweepMin = Math::vmin(sweepMin, bins[i].min);
+					sweepMax = Math::vmax(sweepMax, bins[i].max);
+					sweepCount += bins[i].count;
+					leftCosts[i] = sweepCount ? getHalfArea(sweepMin, sweepMax) * sweepCount : 0.f;
+				}
+				sweepMin = float3{__builtin_inff()};
+				sweepMax = float3{-__builtin_inff()};
+				sweepCount = 0;
+				for (uint32_t i = numBins - 1; i > 0; --i)
+				{
+					sweepMin = Math::vmin(sweepMin, bins[i].min);
+					sweepMax = Math::vmax(sweepMax, bins[i].max);
+					sweepCount += bins[i].count;
+					float const cost = leftCosts[i - 1] + (sweepCount ? getHalfArea(sweepMin, sweepMax) * sweepCount : 0.f);
+					if (sweepCount > 0 && sweepCount < count && cost < bestCost)
+					{
+						bestAxis = axis;
+						bestSplit = i;
+						bestCost = cost;
+					}
+				}
+			}
+
+			uint32_t mid;
+			if (bestAxis >= 0)
+			{
+				float const binScale = numBins / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+				uint32_t* const split = ::std::partition(&triIndices[task.begin], &triIndices[0] + task.end,
+				                                         [&](uint32_t triIdx) {
+
+					uint32_t const binIdx = Math::min(static_cast<uint32_t>((centroids[triIdx][bestAxis]
+					                                                         - centroidMin[bestAxis]) * binScale),
+					                                  numBins - 1);
+					return binIdx < bestSplit;
+				});
+				mid = static_cast<uint32_t>(split - &triIndices[0]);
+			}
+			else
+				// All centroids are the same, or the tree is too deep
+				mid = task.begin + count / 2;
+
+			uint32_t const leftIdx = static_cast<uint32_t>(nodes.size());
+			nodes[task.nodeIdx].leftOrFirst = leftIdx;
+			nodes[task.nodeIdx].numTriangles = 0;
+			nodes.emplace_back();
+			nodes.emplace_back();
+
+			VW_CHECKF(stackSize + 2 <= maxDepth, "Triangle BVH build stack overflow");
+			stack[stackSize++] = {leftIdx + 1, mid, task.end, task.depth + 1};
+			stack[stackSize++] = {leftIdx, task.begin, mid, task.depth + 1};
+		}
+	}
+
+	HitResult TriangleBVH::raycast(float3 const& rayStart, float3 const& rayDir, float maxDist,
+	                               uint32_t* outTriangle) const
+	{
+		if (nodes.empty() || getRayEntryDist(nodes[0], rayStart, getInvDir(rayDir), maxDist) > maxDist)
+			return {};
+
+		float3 const invDir = getInvDir(rayDir);
+		float3p4 const rayStarts{rayStart}, rayDirs{rayDir};
+		float hitDist = maxDist;
+		uint32_t hitBlock = 0, hitSlot = maxLeafSize;
+
+		uint32_t stack[maxDepth];
+		float stackDists[maxDepth];
+		int stackSize = 0;
+		stack[stackSize] = 0;
+		stackDists[stackSize++] = 0.f;
+
+		while (stackSize > 0)
+		{
+			--stackSize;
+			if (stackDists[stackSize] > hitDist)
+				// Behind the closest hit
+				continue;
+
+			TriangleBVHNode const& node = nodes[stack[stackSize]];
+			if (node.isLeaf())
+			{
+				// Test all triangles of the leaf at once
+				TriangleBlock const& block = blocks[node.leftOrFirst];
+				floatp4 dists;
+				maskp4 const hits = intersectTriangles<4>(rayStarts, rayDirs, float3p4::load(block.v0[0], block.v0[1],
+				                                                                                block.v0[2]),
+				                                          float3p4::load(block.e1[0], block.e1[1], block.e1[2]),
+				                                          float3p4::load(block.e2[0], block.e2[1], block.e2[2]),
+				                                          floatp4{hitDist}, dists);
+				for (uint32_t bits = hits.getBits(); bits; bits &= bits - 1)
+				{
+					uint32_t const slot = ::std::countr_zero(bits);
+					if (float const dist = dists.getLane(slot); dist < hitDist)
+					{
+						hitDist = dist;
+						hitBlock = node.leftOrFirst;
+						hitSlot = slot;
+					}
+				}
+				continue;
+			}
+
+			// Visit the closest child first
+			uint32_t near = node.leftOrFirst, far = node.leftOrFirst + 1;
+			float nearDist = getRayEntryDist(nodes[near], rayStart, invDir, hitDist);
+			float farDist = getRayEntryDist(nodes[far], rayStart, invDir, hitDist);
+			if (farDist < nearDist)
+			{
+				::std::swap(near, far);
+				::std::swap(nearDist, farDist);
+			}
+
+			if (farDist <= hitDist)
+			{
+				stack[stackSize] = far;
+				stackDists[stackSize++] = farDist;
+			}
+			if (nearDist <= hitDist)
+			{
+				stack[stackSize] = near;
+				stackDists[stackSize++] = nearDist;
+			}
+		}
+
+		if (hitSlot == maxLeafSize)
+			// No hit occured
+			return {};
+
+		if (outTriangle)
+			*outTriangle = blocks[hitBlock].indices[hitSlot];
+		return makeHit(blocks[hitBlock], hitSlot, rayStart, rayDir, hitDist);
+	}
+
+	template<int N>
+	void TriangleBVH::raycast_Packet(Math::Packet<float3, N> const& rayStarts, Math::Packet<float3, N> const& rayDirs,
+	                                 Math::Packet<float, N> const& maxDists, HitResult (&outHits)[N]) const
+	{
+		using FloatP = Math::Packet<float, N>;
+
+		for (int lane = 0; lane < N; ++lane)
+		{
+			outHits[lane] = {};
+		}
+		if (nodes.empty())
+			return;
+
+		Math::Packet<float3, N> invDirs;
+		for (int lane = 0; lane < N; ++lane)
+		{
+			invDirs.setLane(lane, getInvDir(rayDirs.getLane(lane)));
+		}
+
+		// The children are sorted along the direction of the first ray, the
+		// rays should be coherent
+		float3 const sortDir = rayDirs.getLane(0);
+		FloatP hitDists = maxDists;
+		uint32_t hitBlocks[N], hitSlots[N];
+		uint32_t hitBits = 0;
+
+		uint32_t stack[maxDepth];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			TriangleBVHNode const& node = nodes[stack[--stackSize]];
+			if (intersectNode<N>(node, rayStarts, invDirs, hitDists).none())
+				// Missed by all rays, or behind their closest hits
+				continue;
+
+			if (node.isLeaf())
+			{
+				// Test each triangle against all rays at once
+				TriangleBlock const& block = blocks[node.leftOrFirst];
+				for (uint32_t slot = 0; slot < node.numTriangles; ++slot)
+				{
+					Math::Packet<float3, N> v0, e1, e2;
+					loadTriangle<N>(block, slot, v0, e1, e2);
+					FloatP dists;
+					Math::PacketMask<N> const hits = intersectTriangles<N>(rayStarts, rayDirs, v0, e1, e2, hitDists,
+					                                                       dists);
+					uint32_t const bits = hits.getBits();
+					if (!bits)
+						continue;
+
+					hitDists = Math::select(hits, dists, hitDists);
+					hitBits |= bits;
+					for (uint32_t laneBits = bits; laneBits; laneBits &= laneBits - 1)
+					{
+						uint32_t const lane = ::std::countr_zero(laneBits);
+						hitBlocks[lane] = node.leftOrFirst;
+						hitSlots[lane] = slot;
+					}
+				}
+				continue;
+			}
+
+			// Push the furthest child first
+			uint32_t const left = node.leftOrFirst, right = node.leftOrFirst + 1;
+			float3 const centerDelta = (nodes[right].min + nodes[right].max) - (nodes[left].min + nodes[left].max);
+			bool const rightFirst = centerDelta.dot(sortDir) < 0.f;
+			VW_CHECKF(stackSize + 2 <= maxDepth, "Triangle BVH traversal stack overflow");
+			stack[stackSize++] = rightFirst ? left : right;
+			stack[stackSize++] = rightFirst ? right : left;
+		}
+
+		for (uint32_t bits = hitBits; bits; bits &= bits - 1)
+		{
+			uint32_t const lane = ::std::countr_zero(bits);
+			outHits[lane] = makeHit(blocks[hitBlocks[lane]], hitSlots[lane], rayStarts.getLane(lane),
+			                        rayDirs.getLane(lane), hitDists.getLane(lane));
+		}
+	}
+
+	template void TriangleBVH::raycast_Packet<4>(float3p4 const&, float3p4 const&, floatp4 const&,
+	                                             HitResult (&)[4]) const;
+	template void TriangleBVH::raycast_Packet<8>(float3p8 const&, float3p8 const&, floatp8 const&,
+	                                             HitResult (&)[8]) const;
+} // namespace VaporWorldVR
@@ -2,12 +2,17 @@
 
 #include <queue>
 #include <variant>
+#include <vector>
 
 #include <android/native_window_jni.h>
 #include "VrApi.h"
 #include "VrApi_Helpers.h"
 
 #include "logging.h"
+#include "collision_utils.h"
+#include "density_field.h"
+#include "occlusion_buffer.h"
+#include "parallel_for.h"
 #include "vwgl.h"
 #include "runnable_thread.h"
 #include "event.h"
@@ -17,6 +22,9 @@
 #include "utility.h"
 
 #define VW_TEXTURE_SWAPCHAIN_MAX_LEN 16
+#define VW_OCCLUSION_BUFFER_SIZE 128
+#define VW_RENDER_COMMAND_POOL_CAPACITY 32
+#define VW_APPLICATION_EVENT_POOL_CAPACITY 8
 
 
 static char const shaderVersionString[] = "#version 320 es\n";
@@ -494,6 +502,14 @@ namespace VaporWorldVR
 		GLuint vertexBuffer;
 		size_t indirectDrawArgsOffset;
 		bool dirty;
+
+		/* The occluder of the chunk and the bounds of its surface, built on
+		   the CPU while the mesh is generated, see buildChunkOccluder(). */
+		/// @{
+		::std::vector<float3> occluderVertices;
+		float3 surfaceMin;
+		float3 surfaceMax;
+		/// @}
 	};
 
 
@@ -618,6 +634,7 @@ namespace VaporWorldVR
 					"layout(binding = 1) uniform lowp sampler3D noiseTextureSampler1;"
 					"layout(binding = 2) uniform lowp sampler3D noiseTextureSampler2;"
 
+					// Same as DensityField::sample()
 					"float sampleDensity(vec3 pos)"
 					"{"
 					"	float density = 0.0;"
@@ -711,14 +728,18 @@ namespace VaporWorldVR
 		GLuint indirectDrawArgsBuffer;
 		GLuint noiseTextures[4];
 		Chunk chunk;
+
+		/* The density field of the terrain, evaluated on the CPU for
+		   collision queries. Same chunk grid as initChunk(). */
+		DensityField densityField{{-1.f, -1.f, -1.f}, 2.f, 64};
 	};
 
 
-	struct PerlinNoise
+	/* Returns the chunks of the scene, indexed by the visible chunk lists. */
+	static FORCE_INLINE ::std::span<Chunk const> getSceneChunks(Scene const& scene)
 	{
-		float3 grads[512];
-		uint32_t perms[512];
-	};
+		return {&scene.chunk, 1};
+	}
 
 
 	static void initChunk(Chunk& chunk, uint32_t idx)
@@ -741,135 +762,28 @@ namespace VaporWorldVR
 	}
 
 
-	static void initPerlinNoiseGenerator(PerlinNoise& noiseGen)
-	{
-		for (uint32_t i = 0; i < 256; ++i)
-		{
-			noiseGen.perms[i] = i;
-		}
-
-		for (uint32_t i = 0; i < 256; ++i)
-		{
-			uint32_t j = rand() & 0xff;
-			::std::swap(noiseGen.perms[i], noiseGen.perms[j]);
-		}
-
-		for (uint32_t i = 0; i < 256; ++i)
-		{
-			constexpr float deltaAngle = (M_PI * 2.f) / 256;
-			noiseGen.grads[i] = {Math::cos(noiseGen.perms[i] * deltaAngle),
-			                     Math::cos(noiseGen.perms[noiseGen.perms[i]] * deltaAngle),
-								 Math::sin(noiseGen.perms[i] * deltaAngle)};
-		}
-	}
-
-
-	static float perlinGradientValue(PerlinNoise const& noise, float3 p, int3 i, int3 period)
-	{
-		float3 grad = noise.grads[noise.perms[(noise.perms[(noise.perms[i.x % period.x] + i.y) % period.y] + i.z) % period.z]];
-		return p.dot(grad);
-	}
-
-
-	static float perlinNoiseSample3D(PerlinNoise const& noise, float3 pos, int3 period)
+	/* Uploads the noise textures of the density field to the GPU. */
+	static void initNoiseTextures(GLuint textures[], DensityField const& field)
 	{
-		static constexpr int3 voxelVertices[] = {{0, 0, 0},
-		                                         {1, 0, 0},
-		                                         {0, 1, 0},
-		                                         {1, 1, 0},
-		                                         {0, 0, 1},
-		                                         {1, 0, 1},
-		                                         {0, 1, 1},
-		                                         {1, 1, 1}};
-
-		int3 i = (int3)pos;
-		float3 t = pos - (float3)i;
-		float3 w = t * t * (3.f - t * 2.f);
-
-		return Math::lerp(
-			Math::lerp(
-				Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[0], i + voxelVertices[0], period),
-				           perlinGradientValue(noise, t - (float3)voxelVertices[1], i + voxelVertices[1], period), w.x),
-				Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[2], i + voxelVertices[2], period),
-				           perlinGradientValue(noise, t - (float3)voxelVertices[3], i + voxelVertices[3], period), w.x),
-				w.y
-			),
-			Math::lerp(
-				Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[4], i + voxelVertices[4], period),
-				           perlinGradientValue(noise, t - (float3)voxelVertices[5], i + voxelVertices[5], period), w.x),
-				Math::lerp(perlinGradientValue(noise, t - (float3)voxelVertices[6], i + voxelVertices[6], period),
-				           perlinGradientValue(noise, t - (float3)voxelVertices[7], i + voxelVertices[7], period), w.x),
-				w.y
-			),
-			w.z
-		);
-	}
-
-
-	static float perlinNoiseSampleOctaves3D(PerlinNoise const& noise, float3 const& pos, int3 period, uint32_t numOctaves)
-	{
-		float value = 0.f;
-		float freq = 1.f;
-		float ampl = 0.5f;
-
-		for (uint32_t octave = 0; octave < numOctaves; octave++)
-		{
-			value += perlinNoiseSample3D(noise, pos * freq, period) * ampl;
-			freq *= 2.f;
-			period *= 2;
-			ampl *= 0.5f;
-		}
-
-		return value;
-	}
-
-
-	static void initNoiseTextures(GLuint textures[], uint32_t numTextures, uint3 const& textureRes)
-	{
-		// The size of the texture buffer in Bytes
-		size_t const textureBufferSize = textureRes.x * textureRes.y * textureRes.z * sizeof(float);
-		float3 const textureDensity{textureRes / 4};
-
 		// Generate GL textures
-		glGenTextures(numTextures, textures);
+		glGenTextures(DensityField::numOctaves, textures);
 
-		// Buffer used to store texture temporary data
-		float* textureBuffer = (float*)::malloc(textureBufferSize);
-
-		for (uint32_t idx = 0; idx < numTextures; ++idx)
+		for (uint32_t idx = 0; idx < DensityField::numOctaves; ++idx)
 		{
-			VW_LOG_DEBUG("Generating noise texture #%u", idx);
-
-			// Noise generator
-			PerlinNoise noiseGen;
-			initPerlinNoiseGenerator(noiseGen);
-
-			for (uint32_t i = 0; i < textureRes.x; ++i)
-			{
-				for (uint32_t j = 0; j < textureRes.y; ++j)
-				{
-					for (uint32_t k = 0; k < textureRes.z; ++k)
-					{
-						size_t const pixelIdx = ((i * textureRes.y) + j) * textureRes.z + k;
-						float3 pos{i / textureDensity.x, j / textureDensity.y, k / textureDensity.z};
-						textureBuffer[pixelIdx] = perlinNoiseSampleOctaves3D(noiseGen, pos, 4, 5);
-					}
-				}
-			}
+			NoiseTexture const& texture = field.getNoiseTexture(idx);
+			uint3 const& textureRes = texture.resolution;
 
 			glBindTexture(GL_TEXTURE_3D, textures[idx]);
 			glTexStorage3D(GL_TEXTURE_3D, 1, GL_R32F, textureRes.x, textureRes.y, textureRes.z);
 			glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, textureRes.x, textureRes.y, textureRes.z, GL_RED, GL_FLOAT,
-			                textureBuffer);
+			                texture.texels.data());
 			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 			glBindTexture(GL_TEXTURE_3D, 0);
 		}
-
-		::free(textureBuffer);
 	}
 
 
@@ -913,7 +827,8 @@ namespace VaporWorldVR
 	{
 	public:
 		Renderer(EGLState& inShareEglState)
-			: java{}
+			: MessageTarget{VW_RENDER_COMMAND_POOL_CAPACITY}
+			, java{}
 			, eglState{}
 			, shareEglState{inShareEglState}
 			, state{State_Created}
@@ -923,6 +838,8 @@ namespace VaporWorldVR
 			, eyeTextureType{VRAPI_TEXTURE_TYPE_2D}
 			, eyeTextureSize{}
 			, requestExit{false}
+			, occlusionBuffers{{VW_OCCLUSION_BUFFER_SIZE, VW_OCCLUSION_BUFFER_SIZE},
+			                   {VW_OCCLUSION_BUFFER_SIZE, VW_OCCLUSION_BUFFER_SIZE}}
 		{}
 
 		FORCE_INLINE void setJavaInfo(JavaVM* jvm, jobject activity)
@@ -935,6 +852,10 @@ namespace VaporWorldVR
 		{
 			// Set exit flag
 			requestExit = true;
+
+			[[maybe_unused]] BlockPoolStats const poolStats = getMessagePoolStats();
+			VW_LOG_DEBUG("Render command pool: capacity %zu, high water mark %zu, %zu slabs", poolStats.capacity,
+			             poolStats.highWaterMark, poolStats.numSlabs);
 		}
 
 		FORCE_INLINE void processMessage(RenderCommandBeginFrame const& cmd)
@@ -957,6 +878,12 @@ namespace VaporWorldVR
 			}
 			layer.Header.Flags |= VRAPI_FRAME_LAYER_FLAG_CHROMATIC_ABERRATION_CORRECTION;
 
+			// Cull once for both eyes, the visible chunks are shared by the
+			// eye passes. Then drop the chunks hidden behind the terrain
+			size_t numVisibleChunks = cmd.scene ? cullChunks(*cmd.scene, cmd.tracking) : 0;
+			if (numVisibleChunks > 0)
+				numVisibleChunks = cullOccludedChunks(*cmd.scene, cmd.tracking, numVisibleChunks);
+
 			for (int eyeIdx = 0; eyeIdx < numBuffers; ++eyeIdx)
 			{
 				glUseProgram(program);
@@ -1017,14 +944,25 @@ namespace VaporWorldVR
 						glBindVertexArray(0);
 					}
 
-					// Draw chunk
+					// Draw the chunks visible in this pass. With multiview, both
+					// eyes are rendered in one pass
+					uint8_t const passEyeMask = numBuffers == 1 ? 0x3 : 1 << eyeIdx;
+					::std::span<Chunk const> const chunks = getSceneChunks(*cmd.scene);
 					glBindVertexArray(cmd.scene->vao);
-					glBindVertexBuffer(0, cmd.scene->chunk.vertexBuffer, 0, sizeof(ChunkVertexPositionOnly));
-					glBindVertexBuffer(1, cmd.scene->chunk.vertexBuffer,
-					                   cmd.scene->chunk.info.maxVertexCount * sizeof(ChunkVertexPositionOnly),
-									   sizeof(ChunkVertexVaryings));
 					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmd.scene->indirectDrawArgsBuffer);
-					glDrawArraysIndirect(GL_TRIANGLES, (void*)cmd.scene->chunk.indirectDrawArgsOffset);
+					for (size_t i = 0; i < numVisibleChunks; ++i)
+					{
+						if (!(visibleChunkEyeMasks[i] & passEyeMask))
+							// Only visible in the other eye
+							continue;
+
+						Chunk const& chunk = chunks[visibleChunks[i]];
+						glBindVertexBuffer(0, chunk.vertexBuffer, 0, sizeof(ChunkVertexPositionOnly));
+						glBindVertexBuffer(1, chunk.vertexBuffer,
+						                   chunk.info.maxVertexCount * sizeof(ChunkVertexPositionOnly),
+						                   sizeof(ChunkVertexVaryings));
+						glDrawArraysIndirect(GL_TRIANGLES, (void*)chunk.indirectDrawArgsOffset);
+					}
 					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 					glBindVertexArray(0);
 					GL_CHECK_ERRORS;
@@ -1117,6 +1055,27 @@ namespace VaporWorldVR
 		uint2 eyeTextureSize;
 		bool requestExit;
 
+		/* Bounds of the chunks of the scene, in SoA layout. */
+		/// @{
+		::std::vector<float> chunkMins[3];
+		::std::vector<float> chunkMaxs[3];
+		/// @}
+
+		/* The indices of the chunks visible in at least one eye, and for
+		   each of them the mask of the eyes that see it. Computed once per
+		   frame and shared by both eye passes. */
+		/// @{
+		::std::vector<uint32_t> visibleChunks;
+		::std::vector<uint8_t> visibleChunkEyeMasks;
+		/// @}
+
+		/* The occlusion buffer of each eye, and for each visible chunk a
+		   flag set if it is hidden from the eye. */
+		/// @{
+		OcclusionBuffer occlusionBuffers[2];
+		::std::vector<uint8_t> occludedChunks[2];
+		/// @}
+
 		virtual void run() override
 		{
 			// Set up renderer
@@ -1135,6 +1094,93 @@ namespace VaporWorldVR
 			teardown();
 		}
 
+		/* Culls the chunks of the scene against the union of the eye
+		   frusta, and returns the number of visible chunks. */
+		size_t cullChunks(Scene const& scene, ovrTracking2 const& tracking)
+		{
+			float4x4 views[2], projections[2];
+			for (int eyeIdx = 0; eyeIdx < 2; ++eyeIdx)
+			{
+				::memcpy(&views[eyeIdx], &tracking.Eye[eyeIdx].ViewMatrix, sizeof(float4x4));
+				::memcpy(&projections[eyeIdx], &tracking.Eye[eyeIdx].ProjectionMatrix, sizeof(float4x4));
+			}
+			StereoFrustum const frustum{views, projections};
+
+			::std::span<Chunk const> const chunks = getSceneChunks(scene);
+			for (int i = 0; i < 3; ++i)
+			{
+				chunkMins[i].resize(chunks.size());
+				chunkMaxs[i].resize(chunks.size());
+			}
+			for (size_t chunkIdx = 0; chunkIdx < chunks.size(); ++chunkIdx)
+			{
+				ChunkInfo const& info = chunks[chunkIdx].info;
+				for (int i = 0; i < 3; ++i)
+				{
+					chunkMins[i][chunkIdx] = info.origin[i];
+					chunkMaxs[i][chunkIdx] = info.origin[i] + info.size;
+				}
+			}
+
+			visibleChunks.resize(chunks.size());
+			visibleChunkEyeMasks.resize(chunks.size());
+			return cullAABBs_Stereo(frustum, Vec3SoA<float const>{chunkMins[0], chunkMins[1], chunkMins[2]},
+			                        Vec3SoA<float const>{chunkMaxs[0], chunkMaxs[1], chunkMaxs[2]}, visibleChunks,
+			                        visibleChunkEyeMasks);
+		}
+
+		/* Renders the occluders of the visible chunks in the occlusion buffer
+		   of each eye, on the parallelFor() workers, and removes the chunks
+		   hidden from both eyes. Returns the number of visible chunks
+		   left. */
+		size_t cullOccludedChunks(Scene const& scene, ovrTracking2 const& tracking, size_t numVisibleChunks)
+		{
+			::std::span<Chunk const> const chunks = getSceneChunks(scene);
+			parallelFor(2, 1, [&](size_t begin, size_t end) {
+
+				for (size_t eyeIdx = begin; eyeIdx < end; ++eyeIdx)
+				{
+					float4x4 view, projection;
+					::memcpy(&view, &tracking.Eye[eyeIdx].ViewMatrix, sizeof(float4x4));
+					::memcpy(&projection, &tracking.Eye[eyeIdx].ProjectionMatrix, sizeof(float4x4));
+
+					uint8_t const eyeMask = 1 << eyeIdx;
+					OcclusionBuffer& buffer = occlusionBuffers[eyeIdx];
+					buffer.begin(projection.dot(view));
+					for (size_t i = 0; i < numVisibleChunks; ++i)
+					{
+						if (visibleChunkEyeMasks[i] & eyeMask)
+							buffer.renderTriangles(chunks[visibleChunks[i]].occluderVertices);
+					}
+					buffer.end();
+
+					::std::vector<uint8_t>& occluded = occludedChunks[eyeIdx];
+					occluded.resize(numVisibleChunks);
+					for (size_t i = 0; i < numVisibleChunks; ++i)
+					{
+						Chunk const& chunk = chunks[visibleChunks[i]];
+						occluded[i] = (visibleChunkEyeMasks[i] & eyeMask)
+						           && !buffer.testAABB(chunk.surfaceMin, chunk.surfaceMax);
+					}
+				}
+			});
+
+			// Clear the eyes from which each chunk is hidden, and compact the
+			// visible chunks
+			size_t numUnoccludedChunks = 0;
+			for (size_t i = 0; i < numVisibleChunks; ++i)
+			{
+				uint8_t const eyeMask = visibleChunkEyeMasks[i] & ~(occludedChunks[0][i] | occludedChunks[1][i] << 1);
+				if (eyeMask)
+				{
+					visibleChunks[numUnoccludedChunks] = visibleChunks[i];
+					visibleChunkEyeMasks[numUnoccludedChunks] = eyeMask;
+					numUnoccludedChunks++;
+				}
+			}
+			return numUnoccludedChunks;
+		}
+
 		void setup()
 		{
 			state = State_Started;
@@ -1494,7 +1540,8 @@ namespace VaporWorldVR
 	{
 	public:
 		Application()
-			: nativeWindow{nullptr}
+			: MessageTarget{VW_APPLICATION_EVENT_POOL_CAPACITY}
+			, nativeWindow{nullptr}
 			, java{}
 			, ovr{nullptr}
 			, eglState{}
@@ -1546,13 +1593,17 @@ namespace VaporWorldVR
 				displayTime = vrapi_GetPredictedDisplayTime(ovr, frameCounter);
 				tracking = vrapi_GetPredictedTracking2(ovr, displayTime);
 
+				// Record the commands of the frame, they are submitted to the
+				// renderer at once
+				Renderer::MessageBatch frameCmds{*renderer};
+
 				// Begin next frame.
 				RenderCommandBeginFrame beginFrameCmd{};
 				beginFrameCmd.frameIdx = frameCounter;
-				renderer->postMessage(beginFrameCmd);
+				frameCmds.postMessage(beginFrameCmd);
 
 				// TODO: Render scene
-				updateScene();
+				updateScene(frameCmds);
 
 				// End current frame.
 				static constexpr uint32_t swapInterval = 1;
@@ -1563,7 +1614,8 @@ namespace VaporWorldVR
 				endFrameCmd.swapInterval = swapInterval;
 				endFrameCmd.tracking = tracking;
 				endFrameCmd.scene = scene;
-				renderer->postMessage(endFrameCmd, MessageWait_Received);
+				frameCmds.postMessage(endFrameCmd, MessageWait_Received);
+				frameCmds.submit();
 			}
 
 			// Tear down application
@@ -1735,14 +1787,15 @@ namespace VaporWorldVR
 			glBufferData(GL_SHADER_STORAGE_BUFFER, MAX_CHUNKS * sizeof(ChunkInfo), NULL, GL_DYNAMIC_COPY);
 			glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-			// Create and upload noise textures
-			initNoiseTextures(scene->noiseTextures, 3, 64);
+			// Generate the density field, and upload its noise textures
+			scene->densityField.initNoiseTextures(64);
+			initNoiseTextures(scene->noiseTextures, scene->densityField);
 
 			// Initialize first chunk
 			initChunk(scene->chunk, 0);
 		}
 
-		void updateScene()
+		void updateScene(Renderer::MessageBatch& frameCmds)
 		{
 			if (scene->chunk.dirty)
 			{
@@ -1751,12 +1804,29 @@ namespace VaporWorldVR
 				// We need to regenerate chunk data
 				RenderCommandDispatchCompute computeCmd;
 				computeCmd.shader = new GenerateChunkComputeShader(scene->chunk, scene->indirectDrawArgsBuffer,
-				                                                   scene->noiseTextures, 3);
+				                                                   scene->noiseTextures,
+				                                                   DensityField::numOctaves);
 				computeCmd.groups = {8, 8, 8};
 				computeCmd.fence = &fence;
-				renderer->postMessage(computeCmd, MessageWait_Processed);
+				MessageHandle dispatch = frameCmds.postMessageAsync(computeCmd);
 				scene->chunk.dirty = false;
 
+				// The mesh is needed in this frame, submit the commands now
+				frameCmds.submit();
+
+				// The render thread reads the occluders of the previous frame
+				// until it has processed its end frame command. Messages are
+				// processed in order, so the occluders are free once the
+				// dispatch is processed, which also creates the fence
+				dispatch.wait();
+
+				// Build the occluder of the chunk while the GPU generates the
+				// mesh
+				Chunk& chunk = scene->chunk;
+				chunk.occluderVertices.clear();
+				buildChunkOccluder(scene->densityField, scene->densityField.getChunkIndex(chunk.info.origin),
+				                   chunk.occluderVertices, &chunk.surfaceMin, &chunk.surfaceMax);
+
 				// Wait for compute shader to terminate execution
 				glWaitSync(fence, 0, 0);
 				glBindBuffer(GL_SHADER_STORAGE_BUFFER, scene->indirectDrawArgsBuffer);
@@ -0,0 +1,957 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "math/math.h"
+#include "collision_utils.h"
+#include "aabb_tree.h"
+#include "density_field.h"
+#include "triangle_bvh.h"
+#include "terrain_collision.h"
+#include "occlusion_buffer.h"
+#include "broadphase.h"
+
+
+using namespace VaporWorldVR;
+
+
+namespace
+{
+	float randomFloat()
+	{
+		return (float)rand() / RAND_MAX * 2.f - 1.f;
+	}
+
+	/* Returns the view-projection matrix of a camera at the origin looking
+	   down -Z, with an infinite far plane. */
+	float4x4 makeTestViewProj()
+	{
+		return {1.f, 0.f, 0.f,  0.f,
+		        0.f, 1.f, 0.f,  0.f,
+		        0.f, 0.f, -1.f, -0.2f,
+		        0.f, 0.f, -1.f, 0.f};
+	}
+
+	/* Like makeTestViewProj(), but with the far plane at the given
+	   distance. */
+	float4x4 makeTestViewProj(float farZ)
+	{
+		float const nearZ = 0.1f;
+		return {1.f, 0.f, 0.f,                              0.f,
+		        0.f, 1.f, 0.f,                              0.f,
+		        0.f, 0.f, -(farZ + nearZ) / (farZ - nearZ), -2.f * farZ * nearZ / (farZ - nearZ),
+		        0.f, 0.f, -1.f,                             0.f};
+	}
+
+	/* Chunk bounds on a grid around the camera, like the loaded chunks. */
+	struct ChunkBounds
+	{
+		std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+		explicit ChunkBounds(size_t count)
+			: minX(count), minY(count), minZ(count), maxX(count), maxY(count), maxZ(count)
+		{
+			srand(0x5eed);
+			for (size_t i = 0; i < count; ++i)
+			{
+				minX[i] = randomFloat() * 512.f;
+				minY[i] = randomFloat() * 64.f;
+				minZ[i] = randomFloat() * 512.f;
+				maxX[i] = minX[i] + 16.f;
+				maxY[i] = minY[i] + 16.f;
+				maxZ[i] = minZ[i] + 16.f;
+			}
+		}
+
+		Vec3SoA<float const> getMins() const
+		{
+			return {minX, minY, minZ};
+		}
+
+		Vec3SoA<float const> getMaxs() const
+		{
+			return {maxX, maxY, maxZ};
+		}
+	};
+
+	/* Chunks of a world that grows with the number of chunks, four chunks
+	   high. The density is constant, so the number of chunks within the
+	   view distance doesn't depend on the size of the world. */
+	struct ChunkWorld : public ChunkBounds
+	{
+		/* The tree of the chunks, the user data is the chunk index. */
+		AABBTree tree;
+
+		/* The proxy of each chunk. */
+		std::vector<uint32_t> proxies;
+
+		explicit ChunkWorld(size_t count)
+			: ChunkBounds(count)
+			, proxies(count)
+		{
+			float const halfSize = sqrtf(static_cast<float>(count) / 4.f) * 8.f;
+			for (size_t i = 0; i < count; ++i)
+			{
+				minX[i] = randomFloat() * halfSize;
+				minY[i] = randomFloat() * 32.f;
+				minZ[i] = randomFloat() * halfSize;
+				maxX[i] = minX[i] + 16.f;
+				maxY[i] = minY[i] + 16.f;
+				maxZ[i] = minZ[i] + 16.f;
+				proxies[i] = tree.insert({minX[i], minY[i], minZ[i]}, {maxX[i], maxY[i], maxZ[i]},
+				                         static_cast<uint32_t>(i));
+			}
+		}
+	};
+
+	/* Returns the density field of the scene, generated once. */
+	DensityField const& getTestDensityField()
+	{
+		static DensityField const field = [] {
+
+			srand(0x5eed);
+			DensityField field{{-1.f, -1.f, -1.f}, 2.f, 64};
+			field.initNoiseTextures(64);
+			return field;
+		}();
+		return field;
+	}
+	/* Returns a cache of the test density field, with the chunks around the
+	   origin. */
+	DensityGridCache const& getTestDensityGridCache()
+	{
+		static DensityGridCache const cache = [] {
+
+			DensityField const& field = getTestDensityField();
+			float minHeight, maxHeight;
+			field.getSurfaceHeightRange(minHeight, maxHeight);
+			DensityGridCache cache{field};
+			cache.prepare({-12.f, minHeight - 2.f, -12.f}, {12.f, maxHeight + 2.f, 12.f});
+			return cache;
+		}();
+		return cache;
+	}
+
+	/* Returns the triangles of a heightfield with random heights, like the
+	   mesh of a chunk, three vertices per triangle. */
+	std::vector<float4> makeHeightfieldMesh(uint32_t gridSize)
+	{
+		srand(0x5eed);
+		std::vector<float> heights((gridSize + 1) * (gridSize + 1));
+		for (float& height : heights)
+		{
+			height = randomFloat();
+		}
+
+		std::vector<float4> vertices;
+		vertices.reserve(gridSize * gridSize * 6);
+		auto const getVertex = [&](uint32_t x, uint32_t z) -> float4 {
+
+			return {static_cast<float>(x), heights[z * (gridSize + 1) + x], static_cast<float>(z), 1.f};
+		};
+		for (uint32_t z = 0; z < gridSize; ++z)
+		{
+			for (uint32_t x = 0; x < gridSize; ++x)
+			{
+				vertices.insert(vertices.end(), {getVertex(x, z), getVertex(x + 1, z), getVertex(x, z + 1)});
+				vertices.insert(vertices.end(), {getVertex(x + 1, z), getVertex(x + 1, z + 1), getVertex(x, z + 1)});
+			}
+		}
+		return vertices;
+	}
+
+	/* Returns the tree of a heightfield of 128x128 cells, built once. */
+	TriangleBVH const& getTestTriangleBVH()
+	{
+		static TriangleBVH const bvh = [] {
+
+			TriangleBVH bvh;
+			bvh.build(makeHeightfieldMesh(128));
+			return bvh;
+		}();
+		return bvh;
+	}
+
+	/* The chunks of the test density field crossed by the surface, on a grid
+	   of 24x24 chunks around the origin, with their occluders. The bounds
+	   are the bounds of the surface in each chunk. */
+	struct OccluderWorld : public ChunkBounds
+	{
+		/* The triangles of the occluder of each chunk. */
+		std::vector<std::vector<float3>> occluders;
+
+		OccluderWorld()
+			: ChunkBounds(24 * 24)
+			, occluders(24 * 24)
+		{
+			DensityField const& field = getTestDensityField();
+			for (int z = 0; z < 24; ++z)
+			{
+				for (int x = 0; x < 24; ++x)
+				{
+					size_t const chunkIdx = z * 24 + x;
+					float3 surfaceMin, surfaceMax;
+					buildChunkOccluder(field, {x - 12, 0, z - 12}, occluders[chunkIdx], &surfaceMin, &surfaceMax);
+					minX[chunkIdx] = surfaceMin.x;
+					minY[chunkIdx] = surfaceMin.y;
+					minZ[chunkIdx] = surfaceMin.z;
+					maxX[chunkIdx] = surfaceMax.x;
+					maxY[chunkIdx] = surfaceMax.y;
+					maxZ[chunkIdx] = surfaceMax.z;
+				}
+			}
+		}
+	};
+
+	/* Returns the occluder world, built once. */
+	OccluderWorld const& getTestOccluderWorld()
+	{
+		static OccluderWorld const world;
+		return world;
+	}
+
+	/* A keyframe of a recorded camera path: the position on the XZ plane,
+	   the height of the eyes above the terrain, the heading and the
+	   pitch. */
+	struct CameraKeyframe
+	{
+		float x, z, height, yaw, pitch;
+	};
+
+	/* A walk through the hills with the camera near the ground, and a
+	   flyover looking down. */
+	/// @{
+	constexpr CameraKeyframe walkPath[] = {{-10.f, 10.f, 0.1f, 0.8f, 0.f},   {-4.f, 6.f, 0.1f, 0.4f, 0.f},
+	                                       {0.f, 0.f, 0.1f, 0.f, 0.f},       {2.f, -6.f, 0.1f, -0.6f, 0.f},
+	                                       {8.f, -8.f, 0.1f, -1.6f, 0.f},    {10.f, 0.f, 0.1f, -3.f, 0.f},
+	                                       {4.f, 8.f, 0.1f, 2.4f, 0.f}};
+	constexpr CameraKeyframe flyoverPath[] = {{-10.f, -10.f, 2.f, -2.4f, -0.3f}, {0.f, -6.f, 2.f, -1.6f, -0.4f},
+	                                          {10.f, 0.f, 2.f, -0.8f, -0.3f},    {0.f, 10.f, 2.f, 0.8f, -0.5f},
+	                                          {-10.f, 0.f, 2.f, 2.4f, -0.3f}};
+	/// @}
+
+	/* Returns the view-projection matrices of the frames of a camera path,
+	   interpolated between the keyframes. */
+	std::vector<float4x4> makeCameraPath(std::span<CameraKeyframe const> keyframes, uint32_t numFrames)
+	{
+		DensityField const& field = getTestDensityField();
+		float minHeight, maxHeight;
+		field.getSurfaceHeightRange(minHeight, maxHeight);
+
+		std::vector<float4x4> frames(numFrames);
+		for (uint32_t frameIdx = 0; frameIdx < numFrames; ++frameIdx)
+		{
+			float const t = static_cast<float>(frameIdx) / numFrames * (keyframes.size() - 1);
+			size_t const keyIdx = static_cast<size_t>(t);
+			CameraKeyframe const& a = keyframes[keyIdx];
+			CameraKeyframe const& b = keyframes[Math::min(keyIdx + 1, keyframes.size() - 1)];
+			float const alpha = t - keyIdx;
+			float const x = Math::lerp(a.x, b.x, alpha), z = Math::lerp(a.z, b.z, alpha);
+			float const yaw = Math::lerp(a.yaw, b.yaw, alpha), pitch = Math::lerp(a.pitch, b.pitch, alpha);
+
+			// Follow the terrain
+			HitResult const ground = raycastTerrain(field, {x, maxHeight + 1.f, z}, {0.f, -1.f, 0.f},
+			                                        maxHeight - minHeight + 2.f);
+			float3 const eye{x, ground.hitPosition.y + Math::lerp(a.height, b.height, alpha), z};
+
+			float3 const forward{-sinf(yaw) * cosf(pitch), sinf(pitch), -cosf(yaw) * cosf(pitch)};
+			float3 const right{cosf(yaw), 0.f, -sinf(yaw)};
+			float3 const up = right.cross(forward);
+			float4x4 const view{right.x,    right.y,    right.z,    -right.dot(eye),
+			                    up.x,       up.y,       up.z,       -up.dot(eye),
+			                    -forward.x, -forward.y, -forward.z, forward.dot(eye),
+			                    0.f,        0.f,        0.f,        1.f};
+			float4x4 const projection{1.f, 0.f, 0.f,  0.f,
+			                          0.f, 1.f, 0.f,  0.f,
+			                          0.f, 0.f, -1.f, -0.1f,
+			                          0.f, 0.f, -1.f, 0.f};
+			frames[frameIdx] = projection.dot(view);
+		}
+		return frames;
+	}
+} // namespace
+
+
+static void BM_FrustumAABBOverlapTest(benchmark::State& state)
+{
+	float4x4 const viewProj = makeTestViewProj();
+	ChunkBounds const bounds(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = 0;
+		for (size_t i = 0; i < bounds.minX.size(); ++i)
+		{
+			if (frustumAABBOverlapTest(viewProj, {bounds.minX[i], bounds.minY[i], bounds.minZ[i]},
+			                           {bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]}))
+				indices[numVisible++] = static_cast<uint32_t>(i);
+		}
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FrustumAABBOverlapTest)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_Frustum_TestAABB_Loop(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj()};
+	ChunkBounds const bounds(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = 0;
+		for (size_t i = 0; i < bounds.minX.size(); ++i)
+		{
+			if (frustum.testAABB({bounds.minX[i], bounds.minY[i], bounds.minZ[i]},
+			                     {bounds.maxX[i], bounds.maxY[i], bounds.maxZ[i]}))
+				indices[numVisible++] = static_cast<uint32_t>(i);
+		}
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Frustum_TestAABB_Loop)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_CullAABBs(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj()};
+	ChunkBounds const bounds(state.range(0));
+	std::vector<uint32_t> mask(getVisibilityMaskSize(state.range(0)));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = cullAABBs(frustum, bounds.getMins(), bounds.getMaxs(), mask);
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CullAABBs)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_CullAABBs_Compact(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj()};
+	ChunkBounds const bounds(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = cullAABBs_Compact(frustum, bounds.getMins(), bounds.getMaxs(), indices);
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CullAABBs_Compact)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_CullSpheres_Compact(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj()};
+	ChunkBounds const bounds(state.range(0));
+	std::vector<float> radii(state.range(0), 14.f);
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = cullSpheres_Compact(frustum, bounds.getMins(), radii, indices);
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CullSpheres_Compact)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_Frustum_TestSphere_Loop(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj()};
+	ChunkBounds const bounds(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = 0;
+		for (size_t i = 0; i < bounds.minX.size(); ++i)
+		{
+			if (frustum.testSphere({bounds.minX[i], bounds.minY[i], bounds.minZ[i]}, 14.f))
+				indices[numVisible++] = static_cast<uint32_t>(i);
+		}
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Frustum_TestSphere_Loop)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_CullSpheres(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj()};
+	ChunkBounds const bounds(state.range(0));
+	std::vector<float> radii(state.range(0), 14.f);
+	std::vector<uint32_t> mask(getVisibilityMaskSize(state.range(0)));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = cullSpheres(frustum, bounds.getMins(), radii, mask);
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CullSpheres)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_CullAABBs_Stereo(benchmark::State& state)
+{
+	// Both eyes of a headset, 6.4 cm apart
+	float4x4 const viewProj = makeTestViewProj();
+	float4x4 const projections[] = {viewProj, viewProj};
+	float4x4 const views[] = {float4x4{1.f, 0.f, 0.f, 0.032f,
+	                                   0.f, 1.f, 0.f, 0.f,
+	                                   0.f, 0.f, 1.f, 0.f,
+	                                   0.f, 0.f, 0.f, 1.f},
+	                          float4x4{1.f, 0.f, 0.f, -0.032f,
+	                                   0.f, 1.f, 0.f, 0.f,
+	                                   0.f, 0.f, 1.f, 0.f,
+	                                   0.f, 0.f, 0.f, 1.f}};
+	StereoFrustum const frustum{views, projections};
+	ChunkBounds const bounds(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+	std::vector<uint8_t> eyeMasks(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = cullAABBs_Stereo(frustum, bounds.getMins(), bounds.getMaxs(), indices, eyeMasks);
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CullAABBs_Stereo)->RangeMultiplier(4)->Range(1 << 10, 1 << 14);
+
+static void BM_ChunkWorld_CullAABBs_Compact(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj(256.f)};
+	ChunkWorld const world(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = cullAABBs_Compact(frustum, world.getMins(), world.getMaxs(), indices);
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ChunkWorld_CullAABBs_Compact)->RangeMultiplier(4)->Range(1 << 10, 1 << 16)->Complexity();
+
+static void BM_AABBTree_CullFrustum(benchmark::State& state)
+{
+	Frustum const frustum{makeTestViewProj(256.f)};
+	ChunkWorld const world(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numVisible = world.tree.cullFrustum(frustum, indices);
+		benchmark::DoNotOptimize(numVisible);
+		benchmark::ClobberMemory();
+	}
+	state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_AABBTree_CullFrustum)->RangeMultiplier(4)->Range(1 << 10, 1 << 16)->Complexity();
+
+static void BM_AABBTree_QuerySphere(benchmark::State& state)
+{
+	ChunkWorld const world(state.range(0));
+	std::vector<uint32_t> indices(state.range(0));
+
+	for (auto _ : state)
+	{
+		size_t numFound = world.tree.querySphere({randomFloat() * 64.f, 0.f, randomFloat() * 64.f}, 24.f, indices);
+		benchmark::DoNotOptimize(numFound);
+		benchmark::ClobberMemory();
+	}
+	state.SetComplexityN(state.range(0));
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AABBTree_QuerySphere)->RangeMultiplier(4)->Range(1 << 10, 1 << 16)->Complexity();
+
+static void BM_AABBTree_Raycast(benchmark::State& state)
+{
+	ChunkWorld const world(state.range(0));
+
+	for (auto _ : state)
+	{
+		// Find the chunks hit by a ray from the origin, within the view
+		// distance
+		size_t numHits = 0;
+		float3 const rayDir = float3{randomFloat(), randomFloat() * 0.1f, randomFloat()}.normalize();
+		world.tree.raycast({0.f, 0.f, 0.f}, rayDir, 256.f, [&](uint32_t, float maxDist) {
+
+			numHits++;
+			return maxDist;
+		});
+		benchmark::DoNotOptimize(numHits);
+	}
+	state.SetComplexityN(state.range(0));
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AABBTree_Raycast)->RangeMultiplier(4)->Range(1 << 10, 1 << 16)->Complexity();
+
+static void BM_AABBTree_Refit(benchmark::State& state)
+{
+	ChunkWorld world(state.range(0));
+
+	size_t idx = 0;
+	for (auto _ : state)
+	{
+		// Move a chunk out of its fat box, which reinserts it
+		size_t const i = idx++ % world.proxies.size();
+		float3 const offset{randomFloat() * 64.f, 0.f, randomFloat() * 64.f};
+		world.tree.refit(world.proxies[i], float3{world.minX[i], world.minY[i], world.minZ[i]} + offset,
+		                 float3{world.maxX[i], world.maxY[i], world.maxZ[i]} + offset);
+	}
+	state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_AABBTree_Refit)->RangeMultiplier(4)->Range(1 << 10, 1 << 16)->Complexity();
+
+static void BM_RaycastTerrain(benchmark::State& state)
+{
+	DensityField const& field = getTestDensityField();
+	float minHeight, maxHeight;
+	field.getSurfaceHeightRange(minHeight, maxHeight);
+
+	// Rays from above the terrain, the argument is the slope of the ray in
+	// percent. Shallow rays cross more voxels
+	float const slope = state.range(0) / 100.f;
+	size_t numHits = 0;
+	for (auto _ : state)
+	{
+		float3 const rayStart{randomFloat() * 10.f, maxHeight + 0.5f, randomFloat() * 10.f};
+		float3 const rayDir{randomFloat(), -slope, randomFloat()};
+		HitResult hit = raycastTerrain(field, rayStart, rayDir, 100.f);
+		numHits += hit;
+		benchmark::DoNotOptimize(hit);
+	}
+	state.counters["HitRate"] = static_cast<double>(numHits) / state.iterations();
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_RaycastTerrain)->Arg(100)->Arg(20)->Arg(5);
+
+static void BM_TriangleBVH_Build(benchmark::State& state)
+{
+	std::vector<float4> const vertices = makeHeightfieldMesh(state.range(0));
+	TriangleBVH bvh;
+
+	for (auto _ : state)
+	{
+		bvh.build(vertices);
+		benchmark::DoNotOptimize(bvh.getNodes().data());
+	}
+	state.SetItemsProcessed(state.iterations() * (vertices.size() / 3));
+}
+BENCHMARK(BM_TriangleBVH_Build)->Arg(32)->Arg(128)->Unit(benchmark::kMillisecond);
+
+static void BM_TriangleBVH_Raycast(benchmark::State& state)
+{
+	TriangleBVH const& bvh = getTestTriangleBVH();
+
+	// Rays from a point above the mesh, in a cone like a controller laser
+	float3 const rayStart{64.f, 8.f, 64.f};
+	size_t numHits = 0;
+	for (auto _ : state)
+	{
+		float3 const rayDir{randomFloat() * 0.02f + 0.5f, -0.5f, randomFloat() * 0.02f + 0.5f};
+		HitResult hit = bvh.raycast(rayStart, rayDir, 100.f);
+		numHits += hit;
+		benchmark::DoNotOptimize(hit);
+	}
+	state.SetItemsProcessed(state.iterations());
+	state.counters["HitRate"] = static_cast<double>(numHits) / state.iterations();
+}
+BENCHMARK(BM_TriangleBVH_Raycast);
+
+template<int N>
+static void BM_TriangleBVH_Raycast_Packet(benchmark::State& state)
+{
+	TriangleBVH const& bvh = getTestTriangleBVH();
+
+	float3 const rayStart{64.f, 8.f, 64.f};
+	size_t numHits = 0;
+	for (auto _ : state)
+	{
+		Math::Packet<float3, N> rayDirs;
+		for (int lane = 0; lane < N; ++lane)
+		{
+			rayDirs.setLane(lane, {randomFloat() * 0.02f + 0.5f, -0.5f, randomFloat() * 0.02f + 0.5f});
+		}
+		HitResult hits[N];
+		bvh.raycast_Packet<N>(rayStart, rayDirs, 100.f, hits);
+		for (HitResult const& hit : hits)
+		{
+			numHits += hit;
+		}
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations() * N);
+	state.counters["HitRate"] = static_cast<double>(numHits) / (state.iterations() * N);
+}
+BENCHMARK(BM_TriangleBVH_Raycast_Packet<4>);
+BENCHMARK(BM_TriangleBVH_Raycast_Packet<8>);
+
+static void BM_RaySphereIntersect_Loop(benchmark::State& state)
+{
+	// Pick the closest of many interactable objects with a controller ray
+	ChunkBounds const bounds(state.range(0));
+	std::vector<float> const radii(state.range(0), 8.f);
+	float3 const rayStart{0.f, 0.f, 0.f}, rayDir{0.f, 0.f, -1.f};
+
+	for (auto _ : state)
+	{
+		HitResult closestHit;
+		float closestDist = INFINITY;
+		for (size_t i = 0; i < radii.size(); ++i)
+		{
+			HitResult const hit = raySphereIntersect(rayStart, rayDir, {bounds.minX[i], bounds.minY[i],
+			                                                            bounds.minZ[i]}, radii[i]);
+			if (float const dist = (hit.hitPosition - rayStart).getSize(); hit && dist < closestDist)
+			{
+				closestHit = hit;
+				closestDist = dist;
+			}
+		}
+		benchmark::DoNotOptimize(closestHit);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RaySphereIntersect_Loop)->RangeMultiplier(4)->Range(1 << 6, 1 << 12);
+
+static void BM_RaySpheresIntersect(benchmark::State& state)
+{
+	ChunkBounds const bounds(state.range(0));
+	std::vector<float> const radii(state.range(0), 8.f);
+	float3 const rayStart{0.f, 0.f, 0.f}, rayDir{0.f, 0.f, -1.f};
+
+	for (auto _ : state)
+	{
+		HitResult closestHit;
+		if (BatchHitResult const hit = raySpheresIntersect(rayStart, rayDir, bounds.getMins(), radii, INFINITY))
+			closestHit = getRaySphereHit(rayStart, rayDir, hit.dist, {bounds.minX[hit.index],
+			                                                          bounds.minY[hit.index],
+			                                                          bounds.minZ[hit.index]}, radii[hit.index]);
+		benchmark::DoNotOptimize(closestHit);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RaySpheresIntersect)->RangeMultiplier(4)->Range(1 << 6, 1 << 12);
+
+static void BM_RayAABBsIntersect(benchmark::State& state)
+{
+	ChunkBounds const bounds(state.range(0));
+	float3 const rayStart{0.f, 0.f, 0.f}, rayDir{0.f, 0.f, -1.f};
+
+	for (auto _ : state)
+	{
+		HitResult closestHit;
+		if (BatchHitResult const hit = rayAABBsIntersect(rayStart, rayDir, bounds.getMins(), bounds.getMaxs(),
+		                                                 INFINITY))
+			closestHit = getRayAABBHit(rayStart, rayDir, hit.dist,
+			                           {bounds.minX[hit.index], bounds.minY[hit.index], bounds.minZ[hit.index]},
+			                           {bounds.maxX[hit.index], bounds.maxY[hit.index], bounds.maxZ[hit.index]});
+		benchmark::DoNotOptimize(closestHit);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RayAABBsIntersect)->RangeMultiplier(4)->Range(1 << 6, 1 << 12);
+
+static void BM_RaysSphereIntersect_Loop(benchmark::State& state)
+{
+	// Many rays against one object, e.g. the particles of an effect
+	ChunkBounds const bounds(state.range(0));
+	float3 const center{0.f, 0.f, 0.f};
+
+	for (auto _ : state)
+	{
+		size_t numHits = 0;
+		for (size_t i = 0; i < bounds.minX.size(); ++i)
+		{
+			float3 const rayStart{bounds.minX[i], bounds.minY[i], bounds.minZ[i]};
+			numHits += raySphereIntersect(rayStart, center - rayStart + float3{bounds.maxX[i], 0.f, 0.f}, center, 64.f);
+		}
+		benchmark::DoNotOptimize(numHits);
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RaysSphereIntersect_Loop)->RangeMultiplier(4)->Range(1 << 6, 1 << 12);
+
+static void BM_RaysSphereIntersect(benchmark::State& state)
+{
+	ChunkBounds const bounds(state.range(0));
+	std::vector<float> dirXs(state.range(0)), dirYs(state.range(0)), dirZs(state.range(0)), dists(state.range(0));
+	for (size_t i = 0; i < dirXs.size(); ++i)
+	{
+		dirXs[i] = bounds.maxX[i] - bounds.minX[i];
+		dirYs[i] = -bounds.minY[i];
+		dirZs[i] = -bounds.minZ[i];
+	}
+
+	for (auto _ : state)
+	{
+		BatchHitResult hit = raysSphereIntersect(bounds.getMins(), {dirXs, dirYs, dirZs}, {0.f, 0.f, 0.f}, 64.f,
+		                                         INFINITY, dists);
+		benchmark::DoNotOptimize(hit);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RaysSphereIntersect)->RangeMultiplier(4)->Range(1 << 6, 1 << 12);
+
+static void BM_RaysAABBIntersect(benchmark::State& state)
+{
+	ChunkBounds const bounds(state.range(0));
+	std::vector<float> dirXs(state.range(0)), dirYs(state.range(0)), dirZs(state.range(0)), dists(state.range(0));
+	for (size_t i = 0; i < dirXs.size(); ++i)
+	{
+		dirXs[i] = bounds.maxX[i] - bounds.minX[i];
+		dirYs[i] = -bounds.minY[i];
+		dirZs[i] = -bounds.minZ[i];
+	}
+
+	for (auto _ : state)
+	{
+		BatchHitResult hit = raysAABBIntersect(bounds.getMins(), {dirXs, dirYs, dirZs}, {-64.f, -64.f, -64.f},
+		                                       {64.f, 64.f, 64.f}, INFINITY, dists);
+		benchmark::DoNotOptimize(hit);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_RaysAABBIntersect)->RangeMultiplier(4)->Range(1 << 6, 1 << 12);
+
+static void BM_OverlapSphereTerrain(benchmark::State& state)
+{
+	// Bodies above and near the surface, the argument enables the cache
+	DensityField const& field = getTestDensityField();
+	DensityGridCache const* const cache = state.range(0) ? &getTestDensityGridCache() : nullptr;
+	float minHeight, maxHeight;
+	field.getSurfaceHeightRange(minHeight, maxHeight);
+
+	size_t numContacts = 0;
+	for (auto _ : state)
+	{
+		float3 const center{randomFloat() * 10.f, minHeight + (randomFloat() + 1.f) * (maxHeight - minHeight + 1.f),
+		                    randomFloat() * 10.f};
+		ContactResult contact = overlapSphereTerrain(field, center, 0.25f, cache);
+		numContacts += contact;
+		benchmark::DoNotOptimize(contact);
+	}
+	state.counters["ContactRate"] = static_cast<double>(numContacts) / state.iterations();
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_OverlapSphereTerrain)->Arg(0)->Arg(1);
+
+static void BM_SweepSphereTerrain(benchmark::State& state)
+{
+	// Bodies dropped on the terrain, the argument enables the cache
+	DensityField const& field = getTestDensityField();
+	DensityGridCache const* const cache = state.range(0) ? &getTestDensityGridCache() : nullptr;
+	float minHeight, maxHeight;
+	field.getSurfaceHeightRange(minHeight, maxHeight);
+
+	for (auto _ : state)
+	{
+		float3 const center{randomFloat() * 10.f, maxHeight + 1.f, randomFloat() * 10.f};
+		ContactResult contact = sweepSphereTerrain(field, center, 0.25f, {0.f, -1.f, 0.f}, maxHeight - minHeight + 2.f,
+		                                           nullptr, cache);
+		benchmark::DoNotOptimize(contact);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SweepSphereTerrain)->Arg(0)->Arg(1);
+
+static void BM_SweepSpheresTerrain(benchmark::State& state)
+{
+	// Many bodies dropped on the terrain, processed in parallel
+	DensityField const& field = getTestDensityField();
+	DensityGridCache const& cache = getTestDensityGridCache();
+	float minHeight, maxHeight;
+	field.getSurfaceHeightRange(minHeight, maxHeight);
+
+	size_t const count = state.range(0);
+	std::vector<float> xs(count), ys(count, maxHeight + 1.f), zs(count), radii(count, 0.25f);
+	std::vector<float> motionXs(count, 0.f), motionYs(count, minHeight - maxHeight - 2.f), motionZs(count, 0.f);
+	std::vector<float> fractions(count);
+	std::vector<ContactResult> contacts(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs[i] = randomFloat() * 10.f;
+		zs[i] = randomFloat() * 10.f;
+	}
+
+	for (auto _ : state)
+	{
+		sweepSpheresTerrain(field, {xs, ys, zs}, radii, {motionXs, motionYs, motionZs}, contacts, fractions, &cache);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SweepSpheresTerrain)->RangeMultiplier(4)->Range(1 << 4, 1 << 10)->UseRealTime();
+
+static void BM_BuildChunkOccluder(benchmark::State& state)
+{
+	DensityField const& field = getTestDensityField();
+	std::vector<float3> vertices;
+	int chunkIdx = 0;
+	for (auto _ : state)
+	{
+		vertices.clear();
+		size_t numTriangles = buildChunkOccluder(field, {chunkIdx++ % 16, 0, 0}, vertices);
+		benchmark::DoNotOptimize(numTriangles);
+	}
+}
+BENCHMARK(BM_BuildChunkOccluder)->Unit(benchmark::kMicrosecond);
+
+static void BM_OcclusionCulling_CameraPath(benchmark::State& state)
+{
+	// Chunks culled against the frustum, then against the occluders of the
+	// visible chunks, one frame of the path per iteration. The argument
+	// selects the path
+	OccluderWorld const& world = getTestOccluderWorld();
+	std::vector<float4x4> const frames = state.range(0) == 0 ? makeCameraPath(walkPath, 256)
+	                                                         : makeCameraPath(flyoverPath, 256);
+	OcclusionBuffer buffer{128, 128};
+	std::vector<uint32_t> visibleChunks(world.occluders.size());
+
+	size_t frameIdx = 0, numFrustumVisible = 0, numOccluded = 0;
+	for (auto _ : state)
+	{
+		float4x4 const& viewProj = frames[frameIdx++ % frames.size()];
+		size_t const numVisible = cullAABBs_Compact(Frustum{viewProj}, world.getMins(), world.getMaxs(),
+		                                            visibleChunks);
+		buffer.begin(viewProj);
+		for (size_t i = 0; i < numVisible; ++i)
+		{
+			buffer.renderTriangles(world.occluders[visibleChunks[i]]);
+		}
+		buffer.end();
+
+		for (size_t i = 0; i < numVisible; ++i)
+		{
+			uint32_t const chunkIdx = visibleChunks[i];
+			numOccluded += !buffer.testAABB({world.minX[chunkIdx], world.minY[chunkIdx], world.minZ[chunkIdx]},
+			                                {world.maxX[chunkIdx], world.maxY[chunkIdx], world.maxZ[chunkIdx]});
+		}
+		numFrustumVisible += numVisible;
+	}
+	state.counters["FrustumVisible"] = static_cast<double>(numFrustumVisible) / state.iterations();
+	state.counters["OcclusionCullRate"] = static_cast<double>(numOccluded) / Math::max(numFrustumVisible, size_t{1});
+}
+BENCHMARK(BM_OcclusionCulling_CameraPath)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+static void BM_SpatialHash_MovingSpheres(benchmark::State& state)
+{
+	// Spheres bouncing in a box with about one sphere per unit of volume,
+	// one frame at 90 Hz per iteration: the proxies are moved, then the
+	// pairs are found and their contacts computed
+	size_t const count = state.range(0);
+	float const halfSize = cbrtf(static_cast<float>(count)) * 0.5f;
+	std::vector<float> xs(count), ys(count), zs(count), radii(count);
+	std::vector<float3> velocities(count);
+	SpatialHash hash{0.5f};
+	std::vector<uint32_t> proxies(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs[i] = randomFloat() * halfSize;
+		ys[i] = randomFloat() * halfSize;
+		zs[i] = randomFloat() * halfSize;
+		radii[i] = 0.15f + randomFloat() * 0.1f;
+		velocities[i] = float3{randomFloat(), randomFloat(), randomFloat()} * 2.f;
+		proxies[i] = hash.insert({xs[i], ys[i], zs[i]}, radii[i], static_cast<uint32_t>(i));
+	}
+
+	std::vector<BroadphasePair> pairs;
+	std::vector<ContactResult> contacts;
+	size_t numPairs = 0;
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			float3 const velocity = velocities[i];
+			float* position[3] = {&xs[i], &ys[i], &zs[i]};
+			for (int j = 0; j < 3; ++j)
+			{
+				*position[j] += velocity[j] / 90.f;
+				velocities[i][j] = fabsf(*position[j]) > halfSize ? -velocity[j] : velocity[j];
+			}
+			hash.move(proxies[i], {xs[i], ys[i], zs[i]}, radii[i]);
+		}
+
+		hash.findPairs(pairs);
+		contacts.resize(pairs.size());
+		overlapSpherePairs(pairs, {xs, ys, zs}, radii, contacts);
+		numPairs += pairs.size();
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+	state.counters["Pairs"] = static_cast<double>(numPairs) / state.iterations();
+}
+BENCHMARK(BM_SpatialHash_MovingSpheres)->RangeMultiplier(4)->Range(1 << 10, 1 << 14)->Arg(10000)->UseRealTime()
+                                       ->Unit(benchmark::kMicrosecond);
+
+static void BM_OverlapSphereSphere_Loop(benchmark::State& state)
+{
+	// The narrow phase of a frame, one pair at a time
+	size_t const count = state.range(0);
+	std::vector<float> xs(count), ys(count), zs(count), radii(count);
+	std::vector<BroadphasePair> pairs(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs[i] = randomFloat();
+		ys[i] = randomFloat();
+		zs[i] = randomFloat();
+		radii[i] = 0.5f;
+		pairs[i] = {static_cast<uint32_t>(i), static_cast<uint32_t>(rand() % count)};
+	}
+	std::vector<ContactResult> contacts(count);
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint32_t const a = pairs[i].a, b = pairs[i].b;
+			contacts[i] = overlapSphereSphere({xs[a], ys[a], zs[a]}, radii[a], {xs[b], ys[b], zs[b]}, radii[b]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_OverlapSphereSphere_Loop)->RangeMultiplier(4)->Range(1 << 8, 1 << 14);
+
+static void BM_OverlapSpherePairs(benchmark::State& state)
+{
+	size_t const count = state.range(0);
+	std::vector<float> xs(count), ys(count), zs(count), radii(count);
+	std::vector<BroadphasePair> pairs(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs[i] = randomFloat();
+		ys[i] = randomFloat();
+		zs[i] = randomFloat();
+		radii[i] = 0.5f;
+		pairs[i] = {static_cast<uint32_t>(i), static_cast<uint32_t>(rand() % count)};
+	}
+	std::vector<ContactResult> contacts(count);
+
+	for (auto _ : state)
+	{
+		overlapSpherePairs(pairs, {xs, ys, zs}, radii, contacts);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_OverlapSpherePairs)->RangeMultiplier(4)->Range(1 << 8, 1 << 14)->UseRealTime();
@@ -0,0 +1,760 @@
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "math/math.h"
+#include "transform_batch.h"
+#include "pack_batch.h"
+
+
+using namespace VaporWorldVR;
+
+
+namespace
+{
+	/* Number of operands generated for each benchmark. Operands are read in
+	   round robin to prevent the compiler from folding the operations. */
+	constexpr size_t numOperands = 1024;
+
+	float randomFloat()
+	{
+		return (float)rand() / RAND_MAX * 2.f - 1.f;
+	}
+
+	float2 randomFloat2()
+	{
+		return {randomFloat(), randomFloat()};
+	}
+
+	float3 randomFloat3()
+	{
+		return {randomFloat(), randomFloat(), randomFloat()};
+	}
+
+	float4 randomFloat4()
+	{
+		return {randomFloat(), randomFloat(), randomFloat(), randomFloat()};
+	}
+
+	float4x4 randomFloat4x4()
+	{
+		// Add a diagonal bias so that the matrix is always invertible
+		return float4x4{randomFloat4(), randomFloat4(), randomFloat4(), randomFloat4()} + float4x4::eye * 4.f;
+	}
+
+	quat randomQuat()
+	{
+		return quat{randomFloat3().getNormal(), randomFloat() * 3.f};
+	}
+
+	template<typename T>
+	std::vector<T> makeOperands(T (*generator)())
+	{
+		srand(0x5eed);
+		std::vector<T> operands(numOperands);
+		for (auto& operand : operands)
+		{
+			operand = generator();
+		}
+		return operands;
+	}
+} // namespace
+
+
+template<typename VecT, VecT (*generator)()>
+static void BM_Vec_Add(benchmark::State& state)
+{
+	auto const operands = makeOperands(generator);
+	VecT acc;
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		acc += operands[i++ % numOperands];
+		benchmark::DoNotOptimize(acc);
+	}
+}
+BENCHMARK_TEMPLATE(BM_Vec_Add, float2, randomFloat2)->Name("BM_Vec2_Add");
+BENCHMARK_TEMPLATE(BM_Vec_Add, float3, randomFloat3)->Name("BM_Vec3_Add");
+BENCHMARK_TEMPLATE(BM_Vec_Add, float4, randomFloat4)->Name("BM_Vec4_Add");
+
+template<typename VecT, VecT (*generator)()>
+static void BM_Vec_Mul(benchmark::State& state)
+{
+	auto const operands = makeOperands(generator);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		VecT v = operands[i % numOperands] * operands[(i + 1) % numOperands];
+		benchmark::DoNotOptimize(v);
+		i++;
+	}
+}
+BENCHMARK_TEMPLATE(BM_Vec_Mul, float2, randomFloat2)->Name("BM_Vec2_Mul");
+BENCHMARK_TEMPLATE(BM_Vec_Mul, float3, randomFloat3)->Name("BM_Vec3_Mul");
+BENCHMARK_TEMPLATE(BM_Vec_Mul, float4, randomFloat4)->Name("BM_Vec4_Mul");
+
+template<typename VecT, VecT (*generator)()>
+static void BM_Vec_Dot(benchmark::State& state)
+{
+	auto const operands = makeOperands(generator);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float d = operands[i % numOperands].dot(operands[(i + 1) % numOperands]);
+		benchmark::DoNotOptimize(d);
+		i++;
+	}
+}
+BENCHMARK_TEMPLATE(BM_Vec_Dot, float2, randomFloat2)->Name("BM_Vec2_Dot");
+BENCHMARK_TEMPLATE(BM_Vec_Dot, float3, randomFloat3)->Name("BM_Vec3_Dot");
+BENCHMARK_TEMPLATE(BM_Vec_Dot, float4, randomFloat4)->Name("BM_Vec4_Dot");
+
+static void BM_Vec3_Cross(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomFloat3);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float3 v = operands[i % numOperands].cross(operands[(i + 1) % numOperands]);
+		benchmark::DoNotOptimize(v);
+		i++;
+	}
+}
+BENCHMARK(BM_Vec3_Cross);
+
+template<typename VecT, VecT (*generator)()>
+static void BM_Vec_GetSize(benchmark::State& state)
+{
+	auto const operands = makeOperands(generator);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float s = operands[i++ % numOperands].getSize();
+		benchmark::DoNotOptimize(s);
+	}
+}
+BENCHMARK_TEMPLATE(BM_Vec_GetSize, float2, randomFloat2)->Name("BM_Vec2_GetSize");
+BENCHMARK_TEMPLATE(BM_Vec_GetSize, float3, randomFloat3)->Name("BM_Vec3_GetSize");
+BENCHMARK_TEMPLATE(BM_Vec_GetSize, float4, randomFloat4)->Name("BM_Vec4_GetSize");
+
+template<typename VecT, VecT (*generator)()>
+static void BM_Vec_GetSize_Fast(benchmark::State& state)
+{
+	auto const operands = makeOperands(generator);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float s = operands[i++ % numOperands].getSize_Fast();
+		benchmark::DoNotOptimize(s);
+	}
+}
+BENCHMARK_TEMPLATE(BM_Vec_GetSize_Fast, float2, randomFloat2)->Name("BM_Vec2_GetSize_Fast");
+BENCHMARK_TEMPLATE(BM_Vec_GetSize_Fast, float3, randomFloat3)->Name("BM_Vec3_GetSize_Fast");
+BENCHMARK_TEMPLATE(BM_Vec_GetSize_Fast, float4, randomFloat4)->Name("BM_Vec4_GetSize_Fast");
+
+template<typename VecT, VecT (*generator)()>
+static void BM_Vec_Normalize(benchmark::State& state)
+{
+	auto const operands = makeOperands(generator);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		VecT v = operands[i++ % numOperands].getNormal();
+		benchmark::DoNotOptimize(v);
+	}
+}
+BENCHMARK_TEMPLATE(BM_Vec_Normalize, float2, randomFloat2)->Name("BM_Vec2_Normalize");
+BENCHMARK_TEMPLATE(BM_Vec_Normalize, float3, randomFloat3)->Name("BM_Vec3_Normalize");
+BENCHMARK_TEMPLATE(BM_Vec_Normalize, float4, randomFloat4)->Name("BM_Vec4_Normalize");
+
+static void BM_Quat_Compose(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomQuat);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		quat q = operands[i % numOperands] * operands[(i + 1) % numOperands];
+		benchmark::DoNotOptimize(q);
+		i++;
+	}
+}
+BENCHMARK(BM_Quat_Compose);
+
+static void BM_Quat_RotateVector(benchmark::State& state)
+{
+	auto const rotations = makeOperands(randomQuat);
+	auto const vectors = makeOperands(randomFloat3);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float3 v = rotations[i % numOperands].rotateVector(vectors[i % numOperands]);
+		benchmark::DoNotOptimize(v);
+		i++;
+	}
+}
+BENCHMARK(BM_Quat_RotateVector);
+
+static void BM_Quat_Slerp(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomQuat);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		quat q = Math::slerp(operands[i % numOperands], operands[(i + 1) % numOperands], 0.3f);
+		benchmark::DoNotOptimize(q);
+		i++;
+	}
+}
+BENCHMARK(BM_Quat_Slerp);
+
+static void BM_Mat4_MatMul(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomFloat4x4);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float4x4 m = operands[i % numOperands].dot(operands[(i + 1) % numOperands]);
+		benchmark::DoNotOptimize(m);
+		i++;
+	}
+}
+BENCHMARK(BM_Mat4_MatMul);
+
+static void BM_Mat4_MatVec(benchmark::State& state)
+{
+	auto const matrices = makeOperands(randomFloat4x4);
+	auto const vectors = makeOperands(randomFloat4);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float4 v = matrices[i % numOperands].dot(vectors[i % numOperands]);
+		benchmark::DoNotOptimize(v);
+		i++;
+	}
+}
+BENCHMARK(BM_Mat4_MatVec);
+
+static void BM_Mat4_Inverse(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomFloat4x4);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float4x4 m = !operands[i++ % numOperands];
+		benchmark::DoNotOptimize(m);
+	}
+}
+BENCHMARK(BM_Mat4_Inverse);
+
+static void BM_Mat4_Transpose(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomFloat4x4);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float4x4 m = operands[i++ % numOperands].getTransposed();
+		benchmark::DoNotOptimize(m);
+	}
+}
+BENCHMARK(BM_Mat4_Transpose);
+
+static Math::TransformationMatrix randomTransformationMatrix()
+{
+	return Math::TransformationMatrix{randomFloat3(), randomQuat(), float3{1.f + randomFloat() * 0.5f}};
+}
+
+static void BM_TransformationMatrix_Construct(benchmark::State& state)
+{
+	auto const rotations = makeOperands(randomQuat);
+	auto const translations = makeOperands(randomFloat3);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		Math::TransformationMatrix m{translations[i % numOperands], rotations[i % numOperands], float3{2.f}};
+		benchmark::DoNotOptimize(m);
+		i++;
+	}
+}
+BENCHMARK(BM_TransformationMatrix_Construct);
+
+static void BM_TransformationMatrix_Dot(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomTransformationMatrix);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		Math::TransformationMatrix m = operands[i % numOperands].dot(operands[(i + 1) % numOperands]);
+		benchmark::DoNotOptimize(m);
+		i++;
+	}
+}
+BENCHMARK(BM_TransformationMatrix_Dot);
+
+static void BM_TransformationMatrix_Inverse(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomTransformationMatrix);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		Math::TransformationMatrix m = !operands[i++ % numOperands];
+		benchmark::DoNotOptimize(m);
+	}
+}
+BENCHMARK(BM_TransformationMatrix_Inverse);
+
+static void BM_TransformationMatrix_GetRotation(benchmark::State& state)
+{
+	auto const operands = makeOperands(randomTransformationMatrix);
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		quat q = operands[i++ % numOperands].getRotation();
+		benchmark::DoNotOptimize(q);
+	}
+}
+BENCHMARK(BM_TransformationMatrix_GetRotation);
+
+static void BM_TransformPoints_Loop(benchmark::State& state)
+{
+	auto const matrix = randomFloat4x4();
+	std::vector<float3> points(state.range(0)), transformed(state.range(0));
+	for (auto& point : points)
+	{
+		point = randomFloat4().xyz;
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < points.size(); ++i)
+		{
+			transformed[i] = matrix.transformVector(points[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransformPoints_Loop)->RangeMultiplier(8)->Range(1 << 10, 1 << 18);
+
+static void BM_TransformPoints_Batch(benchmark::State& state)
+{
+	auto const matrix = randomFloat4x4();
+	std::vector<float3> points(state.range(0)), transformed(state.range(0));
+	for (auto& point : points)
+	{
+		point = randomFloat4().xyz;
+	}
+
+	for (auto _ : state)
+	{
+		transformPoints(matrix, points, transformed);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransformPoints_Batch)->RangeMultiplier(8)->Range(1 << 10, 1 << 18)->UseRealTime();
+
+static void BM_TransformPoints_BatchSoA(benchmark::State& state)
+{
+	auto const matrix = randomFloat4x4();
+	std::vector<float> xs(state.range(0)), ys(state.range(0)), zs(state.range(0));
+	for (int64_t i = 0; i < state.range(0); ++i)
+	{
+		xs[i] = randomFloat();
+		ys[i] = randomFloat();
+		zs[i] = randomFloat();
+	}
+	std::vector<float> outXs(xs.size()), outYs(ys.size()), outZs(zs.size());
+
+	for (auto _ : state)
+	{
+		transformPoints(matrix, Vec3SoA<float>{xs, ys, zs}, Vec3SoA<float>{outXs, outYs, outZs});
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransformPoints_BatchSoA)->RangeMultiplier(8)->Range(1 << 10, 1 << 18)->UseRealTime();
+
+static void BM_TransformVectors_Loop(benchmark::State& state)
+{
+	auto const matrix = randomFloat4x4();
+	std::vector<float4> vectors(state.range(0)), transformed(state.range(0));
+	for (auto& vector : vectors)
+	{
+		vector = randomFloat4();
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < vectors.size(); ++i)
+		{
+			transformed[i] = matrix.dot(vectors[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransformVectors_Loop)->RangeMultiplier(8)->Range(1 << 10, 1 << 18);
+
+static void BM_TransformVectors_Batch(benchmark::State& state)
+{
+	auto const matrix = randomFloat4x4();
+	std::vector<float4> vectors(state.range(0)), transformed(state.range(0));
+	for (auto& vector : vectors)
+	{
+		vector = randomFloat4();
+	}
+
+	for (auto _ : state)
+	{
+		transformVectors(matrix, vectors, transformed);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TransformVectors_Batch)->RangeMultiplier(8)->Range(1 << 10, 1 << 18)->UseRealTime();
+
+static void BM_Vec3_Normalize_Loop(benchmark::State& state)
+{
+	std::vector<float3> vectors(state.range(0)), normals(state.range(0));
+	for (auto& vector : vectors)
+	{
+		vector = randomFloat4().xyz + float3{2.f};
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < vectors.size(); ++i)
+		{
+			normals[i] = vectors[i].getNormal();
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Vec3_Normalize_Loop)->Arg(1 << 12);
+
+template<typename PacketT>
+static void BM_Vec3_Normalize_Packet(benchmark::State& state)
+{
+	std::vector<float3> vectors(state.range(0)), normals(state.range(0));
+	for (auto& vector : vectors)
+	{
+		vector = randomFloat4().xyz + float3{2.f};
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < vectors.size(); i += PacketT::numLanes)
+		{
+			PacketT::loadAoS(&vectors[i]).getNormal().storeAoS(&normals[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_TEMPLATE(BM_Vec3_Normalize_Packet, float3p4)->Arg(1 << 12);
+BENCHMARK_TEMPLATE(BM_Vec3_Normalize_Packet, float3p8)->Arg(1 << 12);
+
+static void BM_Affine_Compose(benchmark::State& state)
+{
+	auto const operands = makeOperands(+[]() { return float3x4{randomFloat4x4()}; });
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float3x4 m = operands[i % numOperands].dot(operands[(i + 1) % numOperands]);
+		benchmark::DoNotOptimize(m);
+		i++;
+	}
+}
+BENCHMARK(BM_Affine_Compose);
+
+static void BM_Affine_Inverse(benchmark::State& state)
+{
+	auto const operands = makeOperands(+[]() { return float3x4{randomFloat4x4()}; });
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float3x4 m = !operands[i++ % numOperands];
+		benchmark::DoNotOptimize(m);
+	}
+}
+BENCHMARK(BM_Affine_Inverse);
+
+static void BM_Affine_InverseRigid(benchmark::State& state)
+{
+	auto const operands = makeOperands(+[]() {
+
+		return float3x4{randomFloat4().xyz, quat{randomFloat4().xyz.getNormal(), randomFloat() * 3.f}};
+	});
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		float3x4 m = operands[i++ % numOperands].getInverseRigid();
+		benchmark::DoNotOptimize(m);
+	}
+}
+BENCHMARK(BM_Affine_InverseRigid);
+
+static Math::Transform randomTransform()
+{
+	return Math::Transform{randomFloat3(), randomQuat(), float3{1.f + randomFloat() * 0.5f}};
+}
+
+static void BM_Transform_Compose(benchmark::State& state)
+{
+	auto const operands = makeOperands(+[]() { return randomTransform(); });
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		Math::Transform t = operands[i % numOperands].dot(operands[(i + 1) % numOperands]);
+		benchmark::DoNotOptimize(t);
+		i++;
+	}
+}
+BENCHMARK(BM_Transform_Compose);
+
+static void BM_Transform_Inverse(benchmark::State& state)
+{
+	auto const operands = makeOperands(+[]() { return randomTransform(); });
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		Math::Transform t = !operands[i++ % numOperands];
+		benchmark::DoNotOptimize(t);
+	}
+}
+BENCHMARK(BM_Transform_Inverse);
+
+static void BM_Transform_Lerp(benchmark::State& state)
+{
+	auto const operands = makeOperands(+[]() { return randomTransform(); });
+	size_t i = 0;
+	for (auto _ : state)
+	{
+		Math::Transform t = Math::lerp(operands[i % numOperands], operands[(i + 1) % numOperands], 0.3f);
+		benchmark::DoNotOptimize(t);
+		i++;
+	}
+}
+BENCHMARK(BM_Transform_Lerp);
+
+static void BM_BakeTransforms_Loop(benchmark::State& state)
+{
+	std::vector<Math::Transform> transforms(state.range(0));
+	std::vector<float4x4> matrices(state.range(0));
+	for (auto& transform : transforms)
+	{
+		transform = randomTransform();
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < transforms.size(); ++i)
+		{
+			matrices[i] = static_cast<float4x4>(transforms[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BakeTransforms_Loop)->Arg(1 << 12);
+
+static void BM_BakeTransforms_Batch(benchmark::State& state)
+{
+	std::vector<Math::Transform> transforms(state.range(0));
+	std::vector<float4x4> matrices(state.range(0));
+	for (auto& transform : transforms)
+	{
+		transform = randomTransform();
+	}
+
+	for (auto _ : state)
+	{
+		bakeTransforms(transforms, matrices);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_BakeTransforms_Batch)->Arg(1 << 12);
+
+template<float (*fn)(float)>
+static void BM_Transcendental(benchmark::State& state)
+{
+	// Inputs in [-1, 1], valid for all functions
+	std::vector<float> inputs(1024), outputs(1024);
+	for (auto& input : inputs)
+	{
+		input = randomFloat();
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			outputs[i] = fn(inputs[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+
+namespace
+{
+	/* Transcendental functions backends. */
+	/// @{
+	float libmSin(float x)  { return ::sinf(x); }
+	float libmAtan(float x) { return ::atanf(x); }
+	float libmAcos(float x) { return ::acosf(x); }
+	float libmSqrt(float x) { return ::sqrtf(::fabsf(x)); }
+	float fastSqrt(float x) { return Math::Fast::sqrt(::fabsf(x)); }
+#if VW_MATH_USE_GCEM
+	float gcemSin(float x)  { return ::gcem::sin(x); }
+	float gcemAtan(float x) { return ::gcem::atan(x); }
+	float gcemAcos(float x) { return ::gcem::acos(x); }
+	float gcemSqrt(float x) { return ::gcem::sqrt(::fabsf(x)); }
+#endif
+	/// @}
+} // namespace
+
+BENCHMARK_TEMPLATE(BM_Transcendental, libmSin)->Name("BM_Sin/libm");
+BENCHMARK_TEMPLATE(BM_Transcendental, Math::Fast::sin)->Name("BM_Sin/fast");
+BENCHMARK_TEMPLATE(BM_Transcendental, libmAtan)->Name("BM_Atan/libm");
+BENCHMARK_TEMPLATE(BM_Transcendental, Math::Fast::atan)->Name("BM_Atan/fast");
+BENCHMARK_TEMPLATE(BM_Transcendental, libmAcos)->Name("BM_Acos/libm");
+BENCHMARK_TEMPLATE(BM_Transcendental, Math::Fast::acos)->Name("BM_Acos/fast");
+BENCHMARK_TEMPLATE(BM_Transcendental, libmSqrt)->Name("BM_Sqrt/libm");
+BENCHMARK_TEMPLATE(BM_Transcendental, fastSqrt)->Name("BM_Sqrt/fast");
+#if VW_MATH_USE_GCEM
+BENCHMARK_TEMPLATE(BM_Transcendental, gcemSin)->Name("BM_Sin/gcem");
+BENCHMARK_TEMPLATE(BM_Transcendental, gcemAtan)->Name("BM_Atan/gcem");
+BENCHMARK_TEMPLATE(BM_Transcendental, gcemAcos)->Name("BM_Acos/gcem");
+BENCHMARK_TEMPLATE(BM_Transcendental, gcemSqrt)->Name("BM_Sqrt/gcem");
+#endif
+
+template<Math::Accuracy accuracy>
+static void BM_Packet_SinCos(benchmark::State& state)
+{
+	std::vector<float> inputs(1024), sines(1024), cosines(1024);
+	for (auto& input : inputs)
+	{
+		input = randomFloat() * 10.f;
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < inputs.size(); i += floatp8::numLanes)
+		{
+			floatp8 s, c;
+			Math::sincos<accuracy>(floatp8::load(&inputs[i]), s, c);
+			s.store(&sines[i]);
+			c.store(&cosines[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+BENCHMARK_TEMPLATE(BM_Packet_SinCos, Math::Accuracy::Low);
+BENCHMARK_TEMPLATE(BM_Packet_SinCos, Math::Accuracy::Medium);
+BENCHMARK_TEMPLATE(BM_Packet_SinCos, Math::Accuracy::High);
+
+template<Math::Accuracy accuracy>
+static void BM_Packet_Log2(benchmark::State& state)
+{
+	std::vector<float> inputs(1024), outputs(1024);
+	for (auto& input : inputs)
+	{
+		input = ::expf(randomFloat() * 20.f);
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < inputs.size(); i += floatp8::numLanes)
+		{
+			Math::log2<accuracy>(floatp8::load(&inputs[i])).store(&outputs[i]);
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * inputs.size());
+}
+BENCHMARK_TEMPLATE(BM_Packet_Log2, Math::Accuracy::Low);
+BENCHMARK_TEMPLATE(BM_Packet_Log2, Math::Accuracy::Medium);
+BENCHMARK_TEMPLATE(BM_Packet_Log2, Math::Accuracy::High);
+
+static void BM_PackOctNormals_Loop(benchmark::State& state)
+{
+	std::vector<float3> normals(state.range(0));
+	std::vector<octnormal> packed(state.range(0));
+	for (auto& normal : normals)
+	{
+		normal = randomFloat4().xyz.getNormal();
+	}
+
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < normals.size(); ++i)
+		{
+			packed[i] = octnormal{normals[i]};
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PackOctNormals_Loop)->Arg(1 << 14);
+
+static void BM_PackOctNormals_Batch(benchmark::State& state)
+{
+	std::vector<float3> normals(state.range(0));
+	std::vector<octnormal> packed(state.range(0));
+	for (auto& normal : normals)
+	{
+		normal = randomFloat4().xyz.getNormal();
+	}
+
+	for (auto _ : state)
+	{
+		packOctNormals(normals, packed);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PackOctNormals_Batch)->Arg(1 << 14);
+
+static void BM_PackHalf_Batch(benchmark::State& state)
+{
+	std::vector<float> values(state.range(0));
+	std::vector<half> packed(state.range(0));
+	for (auto& value : values)
+	{
+		value = randomFloat() * 100.f;
+	}
+
+	for (auto _ : state)
+	{
+		packHalf(values, packed);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_PackHalf_Batch)->Arg(1 << 14);
+
+static void BM_Morton_EncodeDecode(benchmark::State& state)
+{
+	std::vector<int3> coords(1024);
+	for (auto& coord : coords)
+	{
+		coord = {rand() % 4096 - 2048, rand() % 4096 - 2048, rand() % 4096 - 2048};
+	}
+
+	for (auto _ : state)
+	{
+		for (auto& coord : coords)
+		{
+			coord = Math::decodeMortonSigned(Math::encodeMorton(coord));
+		}
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * coords.size());
+}
+BENCHMARK(BM_Morton_EncodeDecode);
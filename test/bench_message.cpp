@@ -0,0 +1,167 @@
+#include "benchmark/benchmark.h"
+#include "message.h"
+#include "runnable_thread.h"
+
+
+using namespace VaporWorldVR;
+
+
+namespace
+{
+	/* A message about the size of the render commands. */
+	struct BenchMessage : public Message
+	{
+		uint32_t values[16];
+	};
+
+	/* Stops the consumer thread. */
+	struct BenchMessageStop : public Message {};
+
+	/* A target that drains its queue on its own thread, like the renderer. */
+	class BenchTarget : public Runnable, public MessageTarget<BenchTarget, BenchMessage, BenchMessageStop>
+	{
+	public:
+		/* The sum of the processed values. */
+		uint64_t sum = 0;
+
+		/* Set when the stop message is processed. */
+		bool stopped = false;
+
+		virtual void run() override
+		{
+			while (!stopped)
+			{
+				flushMessages(true);
+			}
+		}
+
+		void processMessage(BenchMessage const& msg)
+		{
+			sum += msg.values[0];
+		}
+
+		void processMessage(BenchMessageStop const&)
+		{
+			stopped = true;
+		}
+	};
+
+	/* The target shared by the producer threads of a benchmark, and the
+	   thread that consumes its messages. */
+	/// @{
+	BenchTarget* benchTarget = nullptr;
+	RunnableThread* benchConsumer = nullptr;
+	/// @}
+
+	/* Creates the shared target on the first benchmark thread. The threads
+	   are synchronized before the loop. */
+	void startBenchTarget(benchmark::State& state)
+	{
+		if (state.thread_index() == 0)
+		{
+			benchTarget = new BenchTarget;
+			benchConsumer = createRunnableThread(benchTarget);
+			benchConsumer->start();
+		}
+	}
+
+	/* Destroys the shared target on the first benchmark thread. The threads
+	   are synchronized after the loop, and must not hold any handle. */
+	void stopBenchTarget(benchmark::State& state)
+	{
+		if (state.thread_index() == 0)
+		{
+			benchTarget->postMessage(BenchMessageStop{}, MessageWait_Processed);
+			destroyRunnableThread(benchConsumer);
+			delete benchTarget;
+		}
+	}
+
+	/* Posts messages to the shared target from each benchmark thread, with
+	   the given ack flags. */
+	void postMessages(benchmark::State& state, int sendFlags)
+	{
+		startBenchTarget(state);
+
+		BenchMessage msg{};
+		msg.values[0] = state.thread_index();
+		for (auto _ : state)
+		{
+			benchTarget->postMessage(msg, sendFlags);
+		}
+		state.SetItemsProcessed(state.iterations());
+
+		stopBenchTarget(state);
+	}
+} // namespace
+
+
+static void BM_PostMessage(benchmark::State& state)
+{
+	// Producers never wait, measures the cost of posting
+	postMessages(state, MessageWait_None);
+}
+BENCHMARK(BM_PostMessage)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_PostMessage_Received(benchmark::State& state)
+{
+	postMessages(state, MessageWait_Received);
+}
+BENCHMARK(BM_PostMessage_Received)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_PostMessage_Processed(benchmark::State& state)
+{
+	// Each post waits for the consumer, measures the round trip latency
+	postMessages(state, MessageWait_Processed);
+}
+BENCHMARK(BM_PostMessage_Processed)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_PostMessageAsync(benchmark::State& state)
+{
+	// Keeps a batch of messages in flight, and waits for all of them
+	constexpr uint32_t numInFlight = 8;
+	startBenchTarget(state);
+
+	BenchMessage msg{};
+	msg.values[0] = state.thread_index();
+	MessageHandle handles[numInFlight];
+	for (auto _ : state)
+	{
+		for (MessageHandle& handle : handles)
+		{
+			handle = benchTarget->postMessageAsync(msg);
+		}
+		for (MessageHandle& handle : handles)
+		{
+			handle.wait();
+			handle.reset();
+		}
+	}
+	state.SetItemsProcessed(state.iterations() * numInFlight);
+
+	stopBenchTarget(state);
+}
+BENCHMARK(BM_PostMessageAsync)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_PostMessageBatch(benchmark::State& state)
+{
+	// Records the messages in a batch, and submits them at once
+	uint32_t const batchSize = static_cast<uint32_t>(state.range(0));
+	startBenchTarget(state);
+
+	BenchMessage msg{};
+	msg.values[0] = state.thread_index();
+	BenchTarget::MessageBatch batch{*benchTarget};
+	for (auto _ : state)
+	{
+		for (uint32_t i = 0; i < batchSize; ++i)
+		{
+			batch.postMessage(msg);
+		}
+		batch.submit();
+	}
+	state.SetItemsProcessed(state.iterations() * batchSize);
+
+	stopBenchTarget(state);
+}
+BENCHMARK(BM_PostMessageBatch)->RangeMultiplier(4)->Range(1, 64)->Threads(1)->Threads(8)->UseRealTime();
@@ -0,0 +1,8 @@
+#include "test_collision.h"
+
+
+int main(int argc, char** argv)
+{
+	testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}
@@ -0,0 +1,1548 @@
+#pragma once
+
+#include <math.h>
+
+#include <algorithm>
+#include <bit>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "math/math.h"
+#include "collision_utils.h"
+#include "aabb_tree.h"
+#include "density_field.h"
+#include "triangle_bvh.h"
+#include "terrain_collision.h"
+#include "occlusion_buffer.h"
+#include "broadphase.h"
+
+
+using namespace VaporWorldVR;
+
+
+namespace
+{
+	/* Returns an OpenGL perspective projection with an infinite far plane,
+	   like the ones created by VrApi. */
+	float4x4 makeInfiniteProjection(float tanHalfFov, float aspect, float nearZ)
+	{
+		float const f = 1.f / tanHalfFov;
+		return {f / aspect, 0.f, 0.f,  0.f,
+		        0.f,        f,   0.f,  0.f,
+		        0.f,        0.f, -1.f, -2.f * nearZ,
+		        0.f,        0.f, -1.f, 0.f};
+	}
+
+	/* Camera at <1, 2, 3> looking down -Z, 90 degrees field of view. */
+	float4x4 const testViewProj = makeInfiniteProjection(1.f, 1.f, 0.1f).dot(float4x4{1.f, 0.f, 0.f, -1.f,
+	                                                                                 0.f, 1.f, 0.f, -2.f,
+	                                                                                 0.f, 0.f, 1.f, -3.f,
+	                                                                                 0.f, 0.f, 0.f, 1.f});
+
+	/* Deterministic pseudo-random generator, returns values in [lo, hi). */
+	struct Random
+	{
+		uint32_t state = 0x9e3779b9u;
+
+		float operator()(float lo, float hi)
+		{
+			// xorshift32
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return lo + (hi - lo) * static_cast<float>(state >> 8) / static_cast<float>(1 << 24);
+		}
+	};
+	/* Returns a grid of triangles with random heights, like the mesh of a
+	   chunk, three vertices per triangle. */
+	std::vector<float4> makeHeightfieldMesh(Random& random, uint32_t gridSize, float cellSize)
+	{
+		std::vector<float4> vertices;
+		vertices.reserve(gridSize * gridSize * 6);
+		std::vector<float> heights((gridSize + 1) * (gridSize + 1));
+		for (float& height : heights)
+		{
+			height = random(-1.f, 1.f);
+		}
+
+		auto const getVertex = [&](uint32_t x, uint32_t z) -> float4 {
+
+			return {x * cellSize, heights[z * (gridSize + 1) + x], z * cellSize, 1.f};
+		};
+		for (uint32_t z = 0; z < gridSize; ++z)
+		{
+			for (uint32_t x = 0; x < gridSize; ++x)
+			{
+				vertices.insert(vertices.end(), {getVertex(x, z), getVertex(x + 1, z), getVertex(x, z + 1)});
+				vertices.insert(vertices.end(), {getVertex(x + 1, z), getVertex(x + 1, z + 1), getVertex(x, z + 1)});
+			}
+		}
+		return vertices;
+	}
+
+	/* Returns the distance to the closest triangle hit by the ray, or a
+	   negative value, by testing all triangles. */
+	float raycastTrianglesBruteForce(std::vector<float4> const& vertices, float3 const& rayStart, float3 const& rayDir,
+	                                 float maxDist)
+	{
+		float hitDist = -1.f;
+		for (size_t i = 0; i < vertices.size(); i += 3)
+		{
+			float3 const& v0 = vertices[i].xyz;
+			float3 const e1 = vertices[i + 1].xyz - v0;
+			float3 const e2 = vertices[i + 2].xyz - v0;
+			float3 const p = rayDir.cross(e2);
+			float const det = e1.dot(p);
+			if (det == 0.f)
+				continue;
+
+			float3 const s = rayStart - v0;
+			float3 const q = s.cross(e1);
+			float const u = s.dot(p) / det, v = rayDir.dot(q) / det, t = e2.dot(q) / det;
+			if (u >= 0.f && v >= 0.f && u + v <= 1.f && t >= 0.f && t < maxDist && (hitDist < 0.f || t < hitDist))
+				hitDist = t;
+		}
+		return hitDist;
+	}
+
+	using double3 = Math::Vec3<double>;
+
+	/* Converts a vector to double precision. */
+	double3 toDouble(float3 const& v)
+	{
+		return {v.x, v.y, v.z};
+	}
+
+	/* Extracts the planes of a frustum in double precision, normalized and
+	   facing inwards. Planes with a null normal, like the far plane of an
+	   infinite projection, are set to zero. */
+	void getFrustumPlanesReference(float4x4 const& viewProj, double outPlanes[6][4])
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			int const row = i / 2;
+			double const sign = i % 2 ? -1.0 : 1.0;
+			for (int j = 0; j < 4; ++j)
+			{
+				outPlanes[i][j] = static_cast<double>(viewProj[3][j]) + sign * viewProj[row][j];
+			}
+
+			double const normalSize = sqrt(outPlanes[i][0] * outPlanes[i][0] + outPlanes[i][1] * outPlanes[i][1]
+			                               + outPlanes[i][2] * outPlanes[i][2]);
+			for (int j = 0; j < 4; ++j)
+			{
+				outPlanes[i][j] = normalSize > 1e-9 ? outPlanes[i][j] / normalSize : 0.0;
+			}
+		}
+	}
+
+	/* Returns the smallest signed distance of a sphere from the planes of a
+	   frustum, negative if the sphere is outside of a plane. */
+	double getFrustumSphereMargin(double const planes[6][4], double3 const& center, double radius)
+	{
+		double margin = INFINITY;
+		for (int i = 0; i < 6; ++i)
+		{
+			if (planes[i][0] != 0.0 || planes[i][1] != 0.0 || planes[i][2] != 0.0)
+				margin = std::min(margin, planes[i][0] * center.x + planes[i][1] * center.y + planes[i][2] * center.z
+				                        + planes[i][3] + radius);
+		}
+		return margin;
+	}
+
+	/* Returns the smallest signed distance of the p-vertices of a box from
+	   the planes of a frustum, negative if the box is outside of a plane. */
+	double getFrustumAABBMargin(double const planes[6][4], double3 const& min, double3 const& max)
+	{
+		double margin = INFINITY;
+		for (int i = 0; i < 6; ++i)
+		{
+			if (planes[i][0] != 0.0 || planes[i][1] != 0.0 || planes[i][2] != 0.0)
+				margin = std::min(margin, planes[i][0] * (planes[i][0] >= 0.0 ? max.x : min.x)
+				                        + planes[i][1] * (planes[i][1] >= 0.0 ? max.y : min.y)
+				                        + planes[i][2] * (planes[i][2] >= 0.0 ? max.z : min.z) + planes[i][3]);
+		}
+		return margin;
+	}
+
+	/* Returns the distances at which a ray enters and exits a sphere, in
+	   units of the length of the direction, or false if the line misses
+	   the sphere. The discriminant is returned to skip grazing rays. */
+	bool getRaySphereDistsReference(double3 const& rayStart, double3 const& rayDir, double3 const& center,
+	                                double radius, double& outDist0, double& outDist1, double& outDiscriminant)
+	{
+		double3 const offset = rayStart - center;
+		double const a = rayDir.dot(rayDir), b = offset.dot(rayDir), c = offset.dot(offset) - radius * radius;
+		outDiscriminant = (b * b - a * c) / (a * radius * radius);
+		if (outDiscriminant < 0.0)
+			return false;
+
+		double const root = sqrt(b * b - a * c);
+		outDist0 = (-b - root) / a;
+		outDist1 = (-b + root) / a;
+		return true;
+	}
+
+	/* Returns the distance at which a ray enters a box, zero if it starts
+	   inside, or infinity if it misses the box within the maximum
+	   distance. Also returns the axis of the entry face, and how far the
+	   ray is from changing the result, to skip ambiguous rays. */
+	double getRayAABBDistReference(double3 const& rayStart, double3 const& rayDir, double3 const& min,
+	                               double3 const& max, double maxDist, int& outAxis, double& outMargin)
+	{
+		double entries[3], exits[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			if (rayDir[i] == 0.0)
+			{
+				bool const inside = rayStart[i] >= min[i] && rayStart[i] <= max[i];
+				entries[i] = inside ? -INFINITY : INFINITY;
+				exits[i] = inside ? INFINITY : -INFINITY;
+				continue;
+			}
+
+			double const t0 = (min[i] - rayStart[i]) / rayDir[i], t1 = (max[i] - rayStart[i]) / rayDir[i];
+			entries[i] = std::min(t0, t1);
+			exits[i] = std::max(t0, t1);
+		}
+
+		outAxis = static_cast<int>(std::max_element(entries, entries + 3) - entries);
+		double const tMin = std::max(entries[outAxis], 0.0);
+		double const tMax = std::min(std::min(exits[0], exits[1]), std::min(exits[2], maxDist));
+		outMargin = std::min(fabs(tMax - tMin), fabs(entries[outAxis]));
+		for (int i = 0; i < 3; ++i)
+		{
+			if (i != outAxis)
+				outMargin = std::min(outMargin, entries[outAxis] - entries[i]);
+		}
+		return tMin <= tMax ? tMin : INFINITY;
+	}
+} // namespace
+
+
+TEST(Collision, Frustum)
+{
+	// The far plane is at infinity, so it contains everything
+	Frustum const frustum{testViewProj};
+	for (int i = 0; i < 5; ++i)
+	{
+		EXPECT_NEAR(frustum.planes[i].xyz.getSize(), 1.f, 1e-5f) << "plane " << i;
+	}
+	EXPECT_EQ(frustum.planes[5].xyz.getSize2(), 0.f);
+	EXPECT_GT(frustum.planes[5].w, 0.f);
+
+	// Points
+	EXPECT_TRUE(frustum.testSphere({1.f, 2.f, -5.f}, 0.f));
+	EXPECT_FALSE(frustum.testSphere({1.f, 2.f, 5.f}, 0.f));
+	EXPECT_FALSE(frustum.testSphere({1.f, 2.f, 2.95f}, 0.f));
+	EXPECT_TRUE(frustum.testSphere({1.f, 2.f, 2.85f}, 0.f));
+	EXPECT_TRUE(frustum.testSphere({1.f, 2.f, -1e6f}, 0.f));
+	EXPECT_FALSE(frustum.testSphere({-10.f, 2.f, -5.f}, 0.f));
+
+	// Spheres, the left plane is at x = 1 + (z - 3)
+	EXPECT_TRUE(frustum.testSphere({-10.f, 2.f, -5.f}, 2.5f));
+	EXPECT_FALSE(frustum.testSphere({-10.f, 2.f, -5.f}, 1.5f));
+
+	// Boxes, including a box that contains the camera and a box with only
+	// one corner inside
+	EXPECT_TRUE(frustum.testAABB({0.f, 1.f, -6.f}, {2.f, 3.f, -4.f}));
+	EXPECT_TRUE(frustum.testAABB({-100.f, -100.f, -100.f}, {100.f, 100.f, 100.f}));
+	EXPECT_TRUE(frustum.testAABB({-10.f, -10.f, -10.f}, {1.f, 2.f, -5.f}));
+	EXPECT_FALSE(frustum.testAABB({-30.f, -10.f, -10.f}, {-28.f, -8.f, -8.f}));
+	EXPECT_FALSE(frustum.testAABB({0.f, 1.f, 4.f}, {2.f, 3.f, 6.f}));
+	EXPECT_TRUE(frustumAABBOverlapTest(testViewProj, {-10.f, -10.f, -10.f}, {1.f, 2.f, -5.f}));
+	EXPECT_FALSE(frustumAABBOverlapTest(testViewProj, {0.f, 1.f, 4.f}, {2.f, 3.f, 6.f}));
+	EXPECT_TRUE(frustumSphereOverlapTest(testViewProj, {1.f, 2.f, -5.f}, 1.f));
+}
+
+TEST(Collision, CullBatch)
+{
+	Frustum const frustum{testViewProj};
+
+	// Odd size, to exercise the scalar remainder
+	constexpr size_t count = 1003;
+	Random random;
+	std::vector<float> minX(count), minY(count), minZ(count), maxX(count), maxY(count), maxZ(count), radii(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		minX[i] = random(-20.f, 20.f);
+		minY[i] = random(-20.f, 20.f);
+		minZ[i] = random(-20.f, 20.f);
+		maxX[i] = minX[i] + random(0.f, 4.f);
+		maxY[i] = minY[i] + random(0.f, 4.f);
+		maxZ[i] = minZ[i] + random(0.f, 4.f);
+		radii[i] = random(0.f, 2.f);
+	}
+	Vec3SoA<float const> const mins{minX, minY, minZ}, maxs{maxX, maxY, maxZ};
+
+	std::vector<uint32_t> mask(getVisibilityMaskSize(count)), indices(count);
+	size_t const numVisibleBoxes = cullAABBs(frustum, mins, maxs, mask);
+	size_t const numCompactBoxes = cullAABBs_Compact(frustum, mins, maxs, indices);
+	ASSERT_EQ(numVisibleBoxes, numCompactBoxes);
+
+	size_t expectedVisible = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		bool const expected = frustum.testAABB({minX[i], minY[i], minZ[i]}, {maxX[i], maxY[i], maxZ[i]});
+		ASSERT_EQ((mask[i / 32] >> (i % 32)) & 1u, expected ? 1u : 0u) << "box " << i;
+		if (expected)
+		{
+			ASSERT_EQ(indices[expectedVisible++], i) << "box " << i;
+		}
+	}
+	EXPECT_EQ(numVisibleBoxes, expectedVisible);
+	EXPECT_GT(numVisibleBoxes, 0u);
+	EXPECT_LT(numVisibleBoxes, count);
+
+	// Spheres, centered on the min corners
+	size_t const numVisibleSpheres = cullSpheres(frustum, mins, radii, mask);
+	size_t const numCompactSpheres = cullSpheres_Compact(frustum, mins, radii, indices);
+	ASSERT_EQ(numVisibleSpheres, numCompactSpheres);
+
+	expectedVisible = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		bool const expected = frustum.testSphere({minX[i], minY[i], minZ[i]}, radii[i]);
+		ASSERT_EQ((mask[i / 32] >> (i % 32)) & 1u, expected ? 1u : 0u) << "sphere " << i;
+		if (expected)
+		{
+			ASSERT_EQ(indices[expectedVisible++], i) << "sphere " << i;
+		}
+	}
+	EXPECT_EQ(numVisibleSpheres, expectedVisible);
+}
+
+TEST(Collision, StereoFrustum)
+{
+	// Parallel eyes, and eyes slightly rotated outwards
+	float4x4 const projection = makeInfiniteProjection(1.2f, 0.9f, 0.1f);
+	float4x4 const projections[] = {projection, projection};
+	float4x4 const parallelViews[] = {float4x4{1.f, 0.f, 0.f, 0.032f,
+	                                           0.f, 1.f, 0.f, -1.6f,
+	                                           0.f, 0.f, 1.f, 0.f,
+	                                           0.f, 0.f, 0.f, 1.f},
+	                                  float4x4{1.f, 0.f, 0.f, -0.032f,
+	                                           0.f, 1.f, 0.f, -1.6f,
+	                                           0.f, 0.f, 1.f, 0.f,
+	                                           0.f, 0.f, 0.f, 1.f}};
+	float const c = cosf(0.05f), s = sinf(0.05f);
+	float4x4 const cantedViews[] = {float4x4{c,   0.f, -s,  0.032f,
+	                                         0.f, 1.f, 0.f, -1.6f,
+	                                         s,   0.f, c,   0.f,
+	                                         0.f, 0.f, 0.f, 1.f},
+	                                float4x4{c,   0.f, s,   -0.032f,
+	                                         0.f, 1.f, 0.f, -1.6f,
+	                                         -s,  0.f, c,   0.f,
+	                                         0.f, 0.f, 0.f, 1.f}};
+
+	for (auto const* views : {&parallelViews, &cantedViews})
+	{
+		StereoFrustum const frustum{*views, projections};
+
+		// Everything visible in one eye must be visible in the combined
+		// frustum, and the eye masks must match the eye tests
+		constexpr size_t count = 4001;
+		Random random;
+		std::vector<float> minX(count), minY(count), minZ(count), maxX(count), maxY(count), maxZ(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			minX[i] = random(-30.f, 30.f);
+			minY[i] = random(-30.f, 30.f);
+			minZ[i] = random(-30.f, 30.f);
+			maxX[i] = minX[i] + random(0.f, 0.5f);
+			maxY[i] = minY[i] + random(0.f, 0.5f);
+			maxZ[i] = minZ[i] + random(0.f, 0.5f);
+		}
+
+		std::vector<uint32_t> indices(count);
+		std::vector<uint8_t> eyeMasks(count);
+		size_t const numVisible = cullAABBs_Stereo(frustum, Vec3SoA<float const>{minX, minY, minZ},
+		                                           Vec3SoA<float const>{maxX, maxY, maxZ}, indices, eyeMasks);
+
+		size_t expectedVisible = 0, numCombinedOnly = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			float3 const min{minX[i], minY[i], minZ[i]}, max{maxX[i], maxY[i], maxZ[i]};
+			uint8_t const expectedMask = static_cast<uint8_t>(frustum.eyes[0].testAABB(min, max))
+			                           | static_cast<uint8_t>(frustum.eyes[1].testAABB(min, max)) << 1;
+			bool const combined = frustum.combined.testAABB(min, max);
+			ASSERT_TRUE(combined || !expectedMask) << "box " << i;
+			numCombinedOnly += combined && !expectedMask;
+
+			if (expectedMask)
+			{
+				ASSERT_LT(expectedVisible, numVisible);
+				ASSERT_EQ(indices[expectedVisible], i);
+				ASSERT_EQ(eyeMasks[expectedVisible], expectedMask) << "box " << i;
+				expectedVisible++;
+			}
+		}
+		EXPECT_EQ(numVisible, expectedVisible);
+
+		// The combined frustum must not be much larger than the union
+		EXPECT_LT(numCombinedOnly, numVisible / 20);
+	}
+}
+
+TEST(Collision, RaySphere)
+{
+	HitResult closestHit, furthestHit;
+	ASSERT_TRUE(raySphereIntersect({0.f, 0.f, 0.f}, {0.f, 0.f, -2.f}, {0.f, 0.f, -5.f}, 1.f, closestHit, furthestHit));
+	EXPECT_TRUE(closestHit);
+	EXPECT_EQ(closestHit.hitPosition.z, -4.f);
+	EXPECT_EQ(closestHit.hitNormal.z, 1.f);
+	EXPECT_TRUE(furthestHit);
+	EXPECT_EQ(furthestHit.hitPosition.z, -6.f);
+	EXPECT_EQ(furthestHit.hitNormal.z, -1.f);
+
+	// Starts inside, the first actual hit is the exit point
+	HitResult hit = raySphereIntersect({0.f, 0.f, -5.f}, {0.f, 0.f, -1.f}, {0.f, 0.f, -5.f}, 1.f);
+	ASSERT_TRUE(hit);
+	EXPECT_EQ(hit.hitPosition.z, -6.f);
+	EXPECT_TRUE(raySphereIntersectTest({0.f, 0.f, -5.f}, {0.f, 0.f, 1.f}, {0.f, 0.f, -5.f}, 1.f));
+
+	// Sphere behind the ray
+	EXPECT_FALSE(raySphereIntersect({0.f, 0.f, 0.f}, {0.f, 0.f, 1.f}, {0.f, 0.f, -5.f}, 1.f));
+	EXPECT_FALSE(raySphereIntersectTest({0.f, 0.f, 0.f}, {0.f, 0.f, 1.f}, {0.f, 0.f, -5.f}, 1.f));
+	EXPECT_FALSE(raySphereIntersectTest({0.f, 2.f, 0.f}, {0.f, 0.f, -1.f}, {0.f, 0.f, -5.f}, 1.f));
+}
+
+TEST(Collision, RayBatch)
+{
+	// Not a multiple of the SIMD block size
+	constexpr size_t count = 103;
+	Random random;
+	std::vector<float> xs(count), ys(count), zs(count), radii(count);
+	std::vector<float> maxXs(count), maxYs(count), maxZs(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs[i] = random(-20.f, 20.f);
+		ys[i] = random(-20.f, 20.f);
+		zs[i] = random(-20.f, 20.f);
+		radii[i] = random(0.5f, 3.f);
+		maxXs[i] = xs[i] + radii[i];
+		maxYs[i] = ys[i] + radii[i] * 0.5f;
+		maxZs[i] = zs[i] + radii[i] * 2.f;
+	}
+	Vec3SoA<float const> const centers{xs, ys, zs}, mins{xs, ys, zs}, maxs{maxXs, maxYs, maxZs};
+
+	// One ray against all objects
+	for (int i = 0; i < 100; ++i)
+	{
+		float3 const rayStart{random(-20.f, 20.f), random(-20.f, 20.f), random(-20.f, 20.f)};
+		float3 rayDir{random(-1.f, 1.f), random(-1.f, 1.f), i % 10 ? random(-1.f, 1.f) : 0.f};
+		float const maxDist = i % 4 ? 100.f : 10.f;
+
+		BatchHitResult expectedSphere, expectedAABB;
+		for (size_t j = 0; j < count; ++j)
+		{
+			float3 const center{xs[j], ys[j], zs[j]};
+			if (HitResult const sphereHit = raySphereIntersect(rayStart, rayDir, center, radii[j]))
+			{
+				float const dist = (sphereHit.hitPosition - rayStart).getSize() / rayDir.getSize();
+				if (dist < maxDist && dist < expectedSphere.dist)
+					expectedSphere = {static_cast<uint32_t>(j), dist};
+			}
+
+			// Clip the ray against the slabs
+			float tMin = 0.f, tMax = maxDist;
+			float3 const max{maxXs[j], maxYs[j], maxZs[j]};
+			for (int k = 0; k < 3; ++k)
+			{
+				if (rayDir[k] == 0.f)
+				{
+					tMax = rayStart[k] < center[k] || rayStart[k] > max[k] ? -1.f : tMax;
+					continue;
+				}
+
+				float const t0 = (center[k] - rayStart[k]) / rayDir[k], t1 = (max[k] - rayStart[k]) / rayDir[k];
+				tMin = std::max(tMin, std::min(t0, t1));
+				tMax = std::min(tMax, std::max(t0, t1));
+			}
+			if (tMin <= tMax && tMin < maxDist && tMin < expectedAABB.dist)
+				expectedAABB = {static_cast<uint32_t>(j), tMin};
+		}
+
+		BatchHitResult const sphereHit = raySpheresIntersect(rayStart, rayDir, centers, radii, maxDist);
+		EXPECT_EQ(sphereHit.index, expectedSphere.index) << "ray " << i;
+		if (sphereHit && expectedSphere)
+		{
+			EXPECT_NEAR(sphereHit.dist, expectedSphere.dist, 1e-3f) << "ray " << i;
+		}
+
+		BatchHitResult const aabbHit = rayAABBsIntersect(rayStart, rayDir, mins, maxs, maxDist);
+		EXPECT_EQ(aabbHit.index, expectedAABB.index) << "ray " << i;
+		if (!aabbHit || !expectedAABB)
+			continue;
+
+		EXPECT_NEAR(aabbHit.dist, expectedAABB.dist, 1e-4f) << "ray " << i;
+		float3 const min{xs[aabbHit.index], ys[aabbHit.index], zs[aabbHit.index]};
+		float3 const max{maxXs[aabbHit.index], maxYs[aabbHit.index], maxZs[aabbHit.index]};
+		HitResult const hit = getRayAABBHit(rayStart, rayDir, aabbHit.dist, min, max);
+		EXPECT_NEAR(hit.hitNormal.getSize(), 1.f, 1e-6f) << "ray " << i;
+		EXPECT_LE(hit.hitNormal.dot(rayDir), 0.f) << "ray " << i;
+	}
+
+	// All rays (the objects) against one object
+	std::vector<float> dirXs(count), dirYs(count), dirZs(count), dists(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		dirXs[i] = -xs[i] + random(-2.f, 2.f);
+		dirYs[i] = -ys[i] + random(-2.f, 2.f);
+		dirZs[i] = i % 10 ? -zs[i] + random(-2.f, 2.f) : 0.f;
+	}
+	Vec3SoA<float const> const rayDirs{dirXs, dirYs, dirZs};
+	float3 const origin{0.f, 0.f, 0.f};
+	float const zeros[] = {0.f}, radius[] = {4.f};
+	float const boxMin[] = {-4.f, -2.f, -8.f}, boxMax[] = {4.f, 2.f, 8.f};
+
+	BatchHitResult hit = raysSphereIntersect(centers, rayDirs, origin, 4.f, 0.9f, dists);
+	size_t numHits = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		float3 const rayStart{xs[i], ys[i], zs[i]}, rayDir{dirXs[i], dirYs[i], dirZs[i]};
+		BatchHitResult const expected = raySpheresIntersect(rayStart, rayDir, {zeros, zeros, zeros}, radius, 0.9f);
+		ASSERT_EQ(dists[i] < INFINITY, bool(expected)) << "ray " << i;
+		if (expected)
+		{
+			EXPECT_NEAR(dists[i], expected.dist, 1e-4f) << "ray " << i;
+		}
+		numHits += expected;
+	}
+	EXPECT_GT(numHits, 0u);
+	ASSERT_TRUE(hit);
+	EXPECT_EQ(dists[hit.index], hit.dist);
+	EXPECT_EQ(*std::min_element(dists.begin(), dists.end()), hit.dist);
+
+	hit = raysAABBIntersect(centers, rayDirs, {boxMin[0], boxMin[1], boxMin[2]}, {boxMax[0], boxMax[1], boxMax[2]}, 0.9f,
+	                        dists);
+	numHits = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		float3 const rayStart{xs[i], ys[i], zs[i]}, rayDir{dirXs[i], dirYs[i], dirZs[i]};
+		BatchHitResult const expected = rayAABBsIntersect(rayStart, rayDir, {{boxMin, 1}, {boxMin + 1, 1}, {boxMin + 2, 1}},
+		                                                  {{boxMax, 1}, {boxMax + 1, 1}, {boxMax + 2, 1}}, 0.9f);
+		ASSERT_EQ(dists[i] < INFINITY, bool(expected)) << "ray " << i;
+		if (expected)
+		{
+			EXPECT_NEAR(dists[i], expected.dist, 1e-4f) << "ray " << i;
+		}
+		numHits += expected;
+	}
+	EXPECT_GT(numHits, 0u);
+	ASSERT_TRUE(hit);
+	EXPECT_EQ(*std::min_element(dists.begin(), dists.end()), hit.dist);
+
+	// Normals are computed for the closest hit only
+	HitResult const sphereHit = getRaySphereHit({xs[0], ys[0], zs[0]}, {dirXs[0], dirYs[0], dirZs[0]}, 0.5f, origin,
+	                                            4.f);
+	EXPECT_TRUE(sphereHit);
+	EXPECT_NEAR((sphereHit.hitNormal - sphereHit.hitPosition * 0.25f).getSize(), 0.f, 1e-6f);
+}
+
+TEST(Collision, DoubleReference)
+{
+	// Every intersection and overlap test against a brute-force reference
+	// in double precision, on random inputs. Inputs within the tolerance
+	// of the boundary of a test may go either way, and are skipped
+	constexpr double tolerance = 1e-3;
+	Random random;
+
+	// Single ray and sphere
+	size_t numHits = 0, numInside = 0;
+	for (int i = 0; i < 2000; ++i)
+	{
+		float3 const center{random(-10.f, 10.f), random(-10.f, 10.f), random(-10.f, 10.f)};
+		float const radius = random(0.5f, 4.f);
+		float3 const rayStart = i % 8 ? float3{random(-10.f, 10.f), random(-10.f, 10.f), random(-10.f, 10.f)}
+		                              : center + float3{random(-0.3f, 0.3f), random(-0.3f, 0.3f), 0.f} * radius;
+		float3 const target = center + float3{random(-1.f, 1.f), random(-1.f, 1.f), random(-1.f, 1.f)} * radius * 1.5f;
+		float3 const rayDir = (target - rayStart) * (i % 2 ? random(0.1f, 2.f) : -1.f);
+
+		double dist0, dist1, discriminant;
+		bool const lineHit = getRaySphereDistsReference(toDouble(rayStart), toDouble(rayDir), toDouble(center), radius,
+		                                                dist0, dist1, discriminant);
+		if (fabs(discriminant) < tolerance || (lineHit && (fabs(dist0) < tolerance || fabs(dist1) < tolerance)))
+			continue;
+
+		bool const inside = lineHit && dist0 < 0.0 && dist1 > 0.0;
+		double const firstDist = !lineHit ? INFINITY : dist0 >= 0.0 ? dist0 : dist1 >= 0.0 ? dist1 : INFINITY;
+		numHits += firstDist < INFINITY;
+		numInside += inside;
+
+		HitResult closestHit, furthestHit;
+		ASSERT_EQ(raySphereIntersect(rayStart, rayDir, center, radius, closestHit, furthestHit), lineHit) << "ray " << i;
+		EXPECT_EQ(raySphereIntersectTest(rayStart, rayDir, center, radius), firstDist < INFINITY) << "ray " << i;
+		HitResult const hit = raySphereIntersect(rayStart, rayDir, center, radius);
+		ASSERT_EQ(bool(hit), firstDist < INFINITY) << "ray " << i;
+		if (!lineHit)
+			continue;
+
+		EXPECT_EQ(bool(closestHit), dist0 >= 0.0) << "ray " << i;
+		EXPECT_EQ(bool(furthestHit), dist1 >= 0.0) << "ray " << i;
+		double3 const expectedPositions[] = {toDouble(rayStart) + toDouble(rayDir) * dist0,
+		                                     toDouble(rayStart) + toDouble(rayDir) * dist1};
+		HitResult const* const hits[] = {&closestHit, &furthestHit};
+		for (int j = 0; j < 2; ++j)
+		{
+			double3 const expectedNormal = (expectedPositions[j] - toDouble(center)) / static_cast<double>(radius);
+			EXPECT_LT((toDouble(hits[j]->hitPosition) - expectedPositions[j]).getSize(), tolerance) << "ray " << i;
+			EXPECT_LT((toDouble(hits[j]->hitNormal) - expectedNormal).getSize(), tolerance) << "ray " << i;
+		}
+		if (hit)
+		{
+			EXPECT_LT((toDouble(hit.hitPosition) - expectedPositions[dist0 >= 0.0 ? 0 : 1]).getSize(), tolerance)
+			    << "ray " << i;
+		}
+	}
+	EXPECT_GT(numHits, 500u);
+	EXPECT_GT(numInside, 50u);
+
+	// Batches of spheres and boxes, not a multiple of the SIMD block size
+	constexpr size_t count = 67;
+	std::vector<float> xs(count), ys(count), zs(count), radii(count), maxXs(count), maxYs(count), maxZs(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		xs[i] = random(-20.f, 20.f);
+		ys[i] = random(-20.f, 20.f);
+		zs[i] = random(-20.f, 20.f);
+		radii[i] = random(0.5f, 3.f);
+		maxXs[i] = xs[i] + random(0.5f, 6.f);
+		maxYs[i] = ys[i] + random(0.5f, 6.f);
+		maxZs[i] = zs[i] + random(0.5f, 6.f);
+	}
+	Vec3SoA<float const> const centers{xs, ys, zs}, mins{xs, ys, zs}, maxs{maxXs, maxYs, maxZs};
+
+	// One ray against many objects, the closest hit must be unambiguous
+	size_t numSphereHits = 0, numAABBHits = 0;
+	for (int i = 0; i < 500; ++i)
+	{
+		float3 const rayStart{random(-20.f, 20.f), random(-20.f, 20.f), random(-20.f, 20.f)};
+		float3 const rayDir{random(-1.f, 1.f), random(-1.f, 1.f), i % 10 ? random(-1.f, 1.f) : 0.f};
+		float const maxDist = i % 4 ? 100.f : 20.f;
+
+		double bestSphereDist = INFINITY, secondSphereDist = INFINITY, bestAABBDist = INFINITY;
+		double secondAABBDist = INFINITY;
+		uint32_t bestSphere = BatchHitResult::invalidIndex, bestAABB = BatchHitResult::invalidIndex;
+		int bestAxis = -1;
+		bool ambiguous = false;
+		for (size_t j = 0; j < count; ++j)
+		{
+			double3 const start = toDouble(rayStart), dir = toDouble(rayDir);
+			double dist0, dist1, discriminant;
+			if (getRaySphereDistsReference(start, dir, {xs[j], ys[j], zs[j]}, radii[j], dist0, dist1, discriminant))
+			{
+				double const dist = dist0 >= 0.0 ? dist0 : dist1;
+				ambiguous |= fabs(discriminant) < tolerance || fabs(dist0) < tolerance || fabs(dist1) < tolerance
+				          || fabs(dist - maxDist) < tolerance;
+				if (dist >= 0.0 && dist < maxDist && dist < secondSphereDist)
+				{
+					secondSphereDist = std::max(dist, bestSphereDist);
+					bestSphere = dist < bestSphereDist ? static_cast<uint32_t>(j) : bestSphere;
+					bestSphereDist = std::min(dist, bestSphereDist);
+				}
+			}
+			else
+				ambiguous |= fabs(discriminant) < tolerance;
+
+			int axis;
+			double margin;
+			double const dist = getRayAABBDistReference(start, dir, {xs[j], ys[j], zs[j]}, {maxXs[j], maxYs[j], maxZs[j]},
+			                                            maxDist, axis, margin);
+			ambiguous |= margin < tolerance;
+			if (dist < secondAABBDist)
+			{
+				secondAABBDist = std::max(dist, bestAABBDist);
+				bestAxis = dist < bestAABBDist ? axis : bestAxis;
+				bestAABB = dist < bestAABBDist ? static_cast<uint32_t>(j) : bestAABB;
+				bestAABBDist = std::min(dist, bestAABBDist);
+			}
+		}
+		if (ambiguous || secondSphereDist - bestSphereDist < tolerance || secondAABBDist - bestAABBDist < tolerance)
+			continue;
+
+		BatchHitResult const sphereHit = raySpheresIntersect(rayStart, rayDir, centers, radii, maxDist);
+		ASSERT_EQ(sphereHit.index, bestSphere) << "ray " << i;
+		if (sphereHit)
+		{
+			EXPECT_NEAR(sphereHit.dist, bestSphereDist, tolerance) << "ray " << i;
+			numSphereHits++;
+		}
+
+		BatchHitResult const aabbHit = rayAABBsIntersect(rayStart, rayDir, mins, maxs, maxDist);
+		ASSERT_EQ(aabbHit.index, bestAABB) << "ray " << i;
+		if (!aabbHit)
+			continue;
+
+		EXPECT_NEAR(aabbHit.dist, bestAABBDist, tolerance) << "ray " << i;
+		numAABBHits++;
+		if (bestAABBDist == 0.0)
+			continue;
+
+		// The normal is the one of the entry face
+		float3 const min{xs[bestAABB], ys[bestAABB], zs[bestAABB]};
+		float3 const max{maxXs[bestAABB], maxYs[bestAABB], maxZs[bestAABB]};
+		HitResult const hit = getRayAABBHit(rayStart, rayDir, aabbHit.dist, min, max);
+		double3 expectedNormal{0.0, 0.0, 0.0};
+		expectedNormal[bestAxis] = rayDir[bestAxis] > 0.f ? -1.0 : 1.0;
+		EXPECT_LT((toDouble(hit.hitNormal) - expectedNormal).getSize(), tolerance) << "ray " << i;
+		EXPECT_LT((toDouble(hit.hitPosition) - (toDouble(rayStart) + toDouble(rayDir) * bestAABBDist)).getSize(),
+		          tolerance) << "ray " << i;
+	}
+	EXPECT_GT(numSphereHits, 50u);
+	EXPECT_GT(numAABBHits, 50u);
+
+	// All rays (the objects) against one sphere and one box
+	std::vector<float> dirXs(count), dirYs(count), dirZs(count), dists(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		dirXs[i] = -xs[i] + random(-3.f, 3.f);
+		dirYs[i] = -ys[i] + random(-3.f, 3.f);
+		dirZs[i] = i % 10 ? -zs[i] + random(-3.f, 3.f) : 0.f;
+	}
+	Vec3SoA<float const> const rayDirs{dirXs, dirYs, dirZs};
+	float3 const boxMin{-4.f, -2.f, -8.f}, boxMax{4.f, 2.f, 8.f};
+	for (int shape = 0; shape < 2; ++shape)
+	{
+		float const maxDist = 0.9f;
+		BatchHitResult const hit = shape == 0 ? raysSphereIntersect(centers, rayDirs, {0.f, 0.f, 0.f}, 4.f, maxDist, dists)
+		                                      : raysAABBIntersect(centers, rayDirs, boxMin, boxMax, maxDist, dists);
+		numHits = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			double3 const start{xs[i], ys[i], zs[i]}, dir{dirXs[i], dirYs[i], dirZs[i]};
+			double expected, margin;
+			if (shape == 0)
+			{
+				double dist0, dist1;
+				bool const lineHit = getRaySphereDistsReference(start, dir, {0.0, 0.0, 0.0}, 4.0, dist0, dist1, margin);
+				expected = lineHit && dist1 >= 0.0 ? (dist0 >= 0.0 ? dist0 : dist1) : INFINITY;
+				expected = expected < maxDist ? expected : INFINITY;
+				margin = std::min(fabs(margin), lineHit ? std::min(std::min(fabs(dist0), fabs(dist1)),
+				                                                   fabs(dist0 - maxDist)) : INFINITY);
+			}
+			else
+			{
+				int axis;
+				expected = getRayAABBDistReference(start, dir, toDouble(boxMin), toDouble(boxMax), maxDist, axis, margin);
+			}
+			if (margin < tolerance)
+				continue;
+
+			ASSERT_EQ(dists[i] < INFINITY, expected < INFINITY) << "shape " << shape << " ray " << i;
+			if (expected < INFINITY)
+			{
+				EXPECT_NEAR(dists[i], expected, tolerance) << "shape " << shape << " ray " << i;
+			}
+			numHits += expected < INFINITY;
+		}
+		EXPECT_GT(numHits, 0u) << "shape " << shape;
+		ASSERT_TRUE(hit) << "shape " << shape;
+		EXPECT_EQ(*std::min_element(dists.begin(), dists.end()), hit.dist) << "shape " << shape;
+	}
+
+	// Frustum tests, one at a time and in batches
+	double planes[6][4];
+	getFrustumPlanesReference(testViewProj, planes);
+	Frustum const frustum{testViewProj};
+	std::vector<uint32_t> sphereMask(getVisibilityMaskSize(count)), aabbMask(getVisibilityMaskSize(count));
+	cullSpheres(frustum, centers, radii, sphereMask);
+	cullAABBs(frustum, mins, maxs, aabbMask);
+	size_t numVisible = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		float3 const center{xs[i], ys[i], zs[i]}, max{maxXs[i], maxYs[i], maxZs[i]};
+		if (double const margin = getFrustumSphereMargin(planes, toDouble(center), radii[i]); fabs(margin) > tolerance)
+		{
+			EXPECT_EQ(frustum.testSphere(center, radii[i]), margin > 0.0) << "sphere " << i;
+			EXPECT_EQ(frustumSphereOverlapTest(testViewProj, center, radii[i]), margin > 0.0) << "sphere " << i;
+			EXPECT_EQ((sphereMask[i / 32] >> (i % 32)) & 1u, margin > 0.0 ? 1u : 0u) << "sphere " << i;
+		}
+		if (double const margin = getFrustumAABBMargin(planes, toDouble(center), toDouble(max));
+		    fabs(margin) > tolerance)
+		{
+			EXPECT_EQ(frustum.testAABB(center, max), margin > 0.0) << "box " << i;
+			EXPECT_EQ(frustumAABBOverlapTest(testViewProj, center, max), margin > 0.0) << "box " << i;
+			EXPECT_EQ((aabbMask[i / 32] >> (i % 32)) & 1u, margin > 0.0 ? 1u : 0u) << "box " << i;
+			numVisible += margin > 0.0;
+		}
+	}
+	EXPECT_GT(numVisible, 0u);
+	EXPECT_LT(numVisible, count);
+
+	// Stereo culling, each eye against its own reference
+	float4x4 const projection = makeInfiniteProjection(1.2f, 0.9f, 0.1f);
+	float4x4 const projections[] = {projection, projection};
+	float const c = cosf(0.05f), s = sinf(0.05f);
+	float4x4 const views[] = {float4x4{c,   0.f, -s,  0.032f,
+	                                   0.f, 1.f, 0.f, -1.6f,
+	                                   s,   0.f, c,   0.f,
+	                                   0.f, 0.f, 0.f, 1.f},
+	                          float4x4{c,   0.f, s,   -0.032f,
+	                                   0.f, 1.f, 0.f, -1.6f,
+	                                   -s,  0.f, c,   0.f,
+	                                   0.f, 0.f, 0.f, 1.f}};
+	double eyePlanes[2][6][4];
+	for (int eye = 0; eye < 2; ++eye)
+	{
+		float4x4 viewProj;
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+			{
+				double value = 0.0;
+				for (int k = 0; k < 4; ++k)
+				{
+					value += static_cast<double>(projections[eye][i][k]) * views[eye][k][j];
+				}
+				viewProj[i][j] = static_cast<float>(value);
+			}
+		}
+		getFrustumPlanesReference(viewProj, eyePlanes[eye]);
+	}
+
+	std::vector<uint32_t> indices(count);
+	std::vector<uint8_t> eyeMasks(count);
+	size_t const numStereoVisible = cullAABBs_Stereo(StereoFrustum{views, projections}, mins, maxs, indices, eyeMasks);
+	for (size_t i = 0, visibleIdx = 0; i < count; ++i)
+	{
+		uint8_t expectedMask = 0;
+		bool ambiguous = false;
+		for (int eye = 0; eye < 2; ++eye)
+		{
+			double const margin = getFrustumAABBMargin(eyePlanes[eye], {xs[i], ys[i], zs[i]},
+			                                           {maxXs[i], maxYs[i], maxZs[i]});
+			expectedMask |= static_cast<uint8_t>(margin > 0.0) << eye;
+			ambiguous |= fabs(margin) <= tolerance;
+		}
+
+		bool const visible = visibleIdx < numStereoVisible && indices[visibleIdx] == i;
+		if (!ambiguous)
+		{
+			ASSERT_EQ(visible, expectedMask != 0) << "box " << i;
+			if (visible)
+			{
+				EXPECT_EQ(eyeMasks[visibleIdx], expectedMask) << "box " << i;
+			}
+		}
+		visibleIdx += visible;
+	}
+
+	// Sphere pairs
+	size_t numContacts = 0;
+	for (int i = 0; i < 1000; ++i)
+	{
+		float3 const centerA{random(-2.f, 2.f), random(-2.f, 2.f), random(-2.f, 2.f)};
+		float3 const centerB{random(-2.f, 2.f), random(-2.f, 2.f), random(-2.f, 2.f)};
+		float const radiusA = random(0.1f, 1.5f), radiusB = random(0.1f, 1.5f);
+		double3 const delta = toDouble(centerA) - toDouble(centerB);
+		double const depth = static_cast<double>(radiusA) + radiusB - delta.getSize();
+		if (fabs(depth) < tolerance || delta.getSize() < tolerance)
+			continue;
+
+		ContactResult const contact = overlapSphereSphere(centerA, radiusA, centerB, radiusB);
+		ASSERT_EQ(bool(contact), depth > 0.0) << "pair " << i;
+		if (!contact)
+			continue;
+
+		double3 const normal = delta / delta.getSize();
+		EXPECT_NEAR(contact.penetrationDepth, depth, tolerance) << "pair " << i;
+		EXPECT_LT((toDouble(contact.contactNormal) - normal).getSize(), tolerance) << "pair " << i;
+		EXPECT_LT((toDouble(contact.contactPoint) - (toDouble(centerB) + normal * static_cast<double>(radiusB))).getSize(),
+		          tolerance) << "pair " << i;
+		numContacts++;
+	}
+	EXPECT_GT(numContacts, 100u);
+}
+
+TEST(Collision, AABBTree)
+{
+	AABBTree tree{0.25f};
+	constexpr size_t count = 2003;
+	Random random;
+	std::vector<uint32_t> proxies(count);
+	std::vector<bool> alive(count, true);
+	auto insertRandom = [&](size_t i) -> void {
+
+		float3 const min{random(-60.f, 60.f), random(-20.f, 20.f), random(-60.f, 60.f)};
+		float3 const max = min + float3{random(0.f, 4.f), random(0.f, 4.f), random(0.f, 4.f)};
+		proxies[i] = tree.insert(min, max, static_cast<uint32_t>(i));
+	};
+	for (size_t i = 0; i < count; ++i)
+	{
+		insertRandom(i);
+	}
+	EXPECT_EQ(tree.getNumProxies(), count);
+
+	// Remove some proxies and insert some back, then move others by a
+	// small amount (stays in the fat box) and a large amount
+	for (size_t i = 0; i < count; i += 3)
+	{
+		tree.remove(proxies[i]);
+		alive[i] = false;
+	}
+	for (size_t i = 0; i < count; i += 6)
+	{
+		insertRandom(i);
+		alive[i] = true;
+	}
+	for (size_t i = 1; i < count; i += 3)
+	{
+		float3 min, max;
+		tree.getFatAABB(proxies[i], min, max);
+		float3 const offset = i % 2 ? float3{0.1f, 0.f, -0.1f} : float3{random(10.f, 30.f), 0.f, 0.f};
+		bool const reinserted = tree.refit(proxies[i], min + 0.25f + offset, max - 0.25f + offset);
+		EXPECT_EQ(reinserted, i % 2 == 0) << "proxy " << i;
+	}
+
+	size_t numAlive = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		numAlive += alive[i];
+		if (alive[i])
+		{
+			ASSERT_EQ(tree.getUserData(proxies[i]), i);
+		}
+	}
+	EXPECT_EQ(tree.getNumProxies(), numAlive);
+
+	// The tree must be balanced
+	EXPECT_LE(tree.getHeight(), 2 * std::bit_width(numAlive));
+
+	// Compares the results of a query with the expected proxies
+	auto checkQuery = [&](char const* name, std::vector<uint32_t> found, size_t numFound, auto&& testFn) -> void {
+
+		std::vector<uint32_t> expected;
+		for (size_t i = 0; i < count; ++i)
+		{
+			float3 min, max;
+			if (!alive[i])
+				continue;
+			tree.getFatAABB(proxies[i], min, max);
+			if (testFn(min, max))
+				expected.push_back(static_cast<uint32_t>(i));
+		}
+		ASSERT_EQ(numFound, expected.size()) << name;
+		found.resize(numFound);
+		std::sort(found.begin(), found.end());
+		EXPECT_EQ(found, expected) << name;
+		EXPECT_GT(numFound, 0u) << name;
+		EXPECT_LT(numFound, numAlive) << name;
+	};
+
+	std::vector<uint32_t> found(count);
+	Frustum const frustum{testViewProj};
+	checkQuery("frustum", found, tree.cullFrustum(frustum, found), [&](float3 const& min, float3 const& max) {
+
+		return frustum.testAABB(min, max);
+	});
+
+	float3 const center{5.f, 1.f, -7.f};
+	checkQuery("sphere", found, tree.querySphere(center, 12.f, found), [&](float3 const& min, float3 const& max) {
+
+		float3 const closest = Math::vmin(Math::vmax(center, min), max);
+		return (closest - center).getSize2() <= 144.f;
+	});
+
+	float3 const boxMin{-10.f, -5.f, -10.f}, boxMax{10.f, 5.f, 0.f};
+	checkQuery("box", found, tree.queryAABB(boxMin, boxMax, found), [&](float3 const& min, float3 const& max) {
+
+		return min[0] <= boxMax[0] && min[1] <= boxMax[1] && min[2] <= boxMax[2] && boxMin[0] <= max[0]
+		    && boxMin[1] <= max[1] && boxMin[2] <= max[2];
+	});
+
+	// Returns the distance at which the ray enters the box, or infinity
+	float3 const rayStart{-70.f, 0.5f, 3.f}, rayDir{1.f, 0.01f, -0.02f};
+	auto getRayDist = [&](float3 const& min, float3 const& max) -> float {
+
+		float tMin = 0.f, tMax = 200.f;
+		for (int i = 0; i < 3; ++i)
+		{
+			float const t0 = (min[i] - rayStart[i]) / rayDir[i], t1 = (max[i] - rayStart[i]) / rayDir[i];
+			tMin = std::max(tMin, std::min(t0, t1));
+			tMax = std::min(tMax, std::max(t0, t1));
+		}
+		return tMin <= tMax ? tMin : INFINITY;
+	};
+
+	size_t numHits = 0;
+	tree.raycast(rayStart, rayDir, 200.f, [&](uint32_t userData, float maxDist) {
+
+		found[numHits++] = userData;
+		return maxDist;
+	});
+	checkQuery("ray", found, numHits, [&](float3 const& min, float3 const& max) {
+
+		return getRayDist(min, max) <= 200.f;
+	});
+
+	// Clip the ray to the closest hit
+	float closestDist = INFINITY;
+	for (size_t i = 0; i < count; ++i)
+	{
+		float3 min, max;
+		if (!alive[i])
+			continue;
+		tree.getFatAABB(proxies[i], min, max);
+		closestDist = std::min(closestDist, getRayDist(min, max));
+	}
+	size_t numVisited = 0;
+	float treeClosestDist = INFINITY;
+	tree.raycast(rayStart, rayDir, 200.f, [&](uint32_t userData, float maxDist) {
+
+		float3 min, max;
+		tree.getFatAABB(proxies[userData], min, max);
+		treeClosestDist = std::min(treeClosestDist, getRayDist(min, max));
+		numVisited++;
+		return std::min(maxDist, treeClosestDist);
+	});
+	EXPECT_NEAR(treeClosestDist, closestDist, 1e-3f);
+	EXPECT_LT(numVisited, numHits);
+
+	// Remove everything
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (alive[i])
+			tree.remove(proxies[i]);
+	}
+	EXPECT_EQ(tree.getNumProxies(), 0u);
+	EXPECT_EQ(tree.cullFrustum(frustum, found), 0u);
+}
+
+TEST(Collision, RaycastTerrain)
+{
+	// Without noise, the terrain is the plane y = 0
+	DensityField const flatField{{-1.f, -1.f, -1.f}, 2.f, 64};
+	HitResult hit = raycastTerrain(flatField, {0.3f, 5.f, 0.2f}, {1.f, -1.f, 0.f}, 100.f);
+	ASSERT_TRUE(hit);
+	EXPECT_NEAR(hit.hitPosition.x, 5.3f, 1e-4f);
+	EXPECT_NEAR(hit.hitPosition.y, 0.f, 1e-4f);
+	EXPECT_NEAR(hit.hitNormal.y, 1.f, 1e-5f);
+	EXPECT_FALSE(raycastTerrain(flatField, {0.3f, 5.f, 0.2f}, {1.f, -1.f, 0.f}, 7.f));
+	EXPECT_FALSE(raycastTerrain(flatField, {0.3f, 5.f, 0.2f}, {1.f, 1.f, 0.f}, 100.f));
+	EXPECT_FALSE(raycastTerrain(flatField, {0.3f, 5.f, 0.2f}, {1.f, 0.f, 0.f}, 100.f));
+	hit = raycastTerrain(flatField, {0.3f, -1.f, 0.2f}, {1.f, 1.f, 0.f}, 100.f);
+	ASSERT_TRUE(hit);
+	EXPECT_EQ(hit.hitPosition.y, -1.f);
+
+	srand(0x5eed);
+	DensityField field{{-1.f, -1.f, -1.f}, 2.f, 64};
+	field.initNoiseTextures(16);
+	float minHeight, maxHeight;
+	field.getSurfaceHeightRange(minHeight, maxHeight);
+	ASSERT_LT(minHeight, maxHeight);
+
+	// The analytic gradient must match the finite differences, except
+	// near the edges of the texels where the gradient is not continuous
+	Random random;
+	int numGradientErrors = 0;
+	for (int i = 0; i < 100; ++i)
+	{
+		float3 const pos{random(-10.f, 10.f), random(minHeight, maxHeight), random(-10.f, 10.f)};
+		float3 gradient;
+		float const density = field.sample(pos, &gradient);
+		float3 expected;
+		for (int j = 0; j < 3; ++j)
+		{
+			float3 offset;
+			offset[j] = 2e-4f;
+			expected[j] = (field.sample(pos + offset) - field.sample(pos - offset)) / 4e-4f;
+		}
+		EXPECT_LE(density, maxHeight - pos.y + 1e-5f);
+		EXPECT_LE(gradient.getSize(), field.getMaxGradient());
+		numGradientErrors += (gradient - expected).getSize() > 1e-2f * expected.getSize();
+	}
+	EXPECT_LE(numGradientErrors, 5);
+
+	// Compare with a ray marched in small steps
+	constexpr int numRays = 200;
+	int numHits = 0, numMismatches = 0;
+	for (int i = 0; i < numRays; ++i)
+	{
+		float3 const rayStart{random(-10.f, 10.f), maxHeight + 0.5f, random(-10.f, 10.f)};
+		float3 const rayDir = float3{random(-1.f, 1.f), random(-1.f, -0.05f), random(-1.f, 1.f)}.normalize();
+		HitResult const hit = raycastTerrain(field, rayStart, rayDir, 100.f);
+
+		float expectedDist = -1.f;
+		float const step = field.getVoxelSize() * 0.125f;
+		for (float t = step; t < 100.f; t += step)
+		{
+			if (field.sample(rayStart + rayDir * t) > 0.f)
+			{
+				expectedDist = t;
+				break;
+			}
+		}
+
+		ASSERT_EQ(hit.hitOccured, expectedDist >= 0.f) << "ray " << i;
+		if (!hit)
+			continue;
+
+		numHits++;
+		EXPECT_NEAR(field.sample(hit.hitPosition), 0.f, 1e-3f) << "ray " << i;
+		EXPECT_NEAR(hit.hitNormal.getSize(), 1.f, 1e-4f) << "ray " << i;
+		EXPECT_LT(hit.hitNormal.dot(rayDir), 0.f) << "ray " << i;
+		numMismatches += fabsf((hit.hitPosition - rayStart).getSize() - expectedDist) > step;
+	}
+	EXPECT_GT(numHits, numRays / 2);
+	EXPECT_LE(numMismatches, numRays / 50);
+}
+
+
+TEST(Collision, TriangleBVH)
+{
+	TriangleBVH bvh;
+	bvh.build({});
+	EXPECT_FALSE(bvh.raycast({0.f, 1.f, 0.f}, {0.f, -1.f, 0.f}, 10.f));
+
+	Random random;
+	std::vector<float4> vertices = makeHeightfieldMesh(random, 32, 0.5f);
+	// Add some sliver and degenerate triangles
+	for (int i = 0; i < 64; ++i)
+	{
+		float3 const a{random(0.f, 16.f), random(-1.f, 1.f), random(0.f, 16.f)};
+		float3 const b = a + float3{random(-1.f, 1.f), random(-1.f, 1.f), random(-1.f, 1.f)};
+		vertices.insert(vertices.end(), {float4{a, 1.f}, float4{b, 1.f}, float4{i % 8 ? (a + b) * 0.5f + 0.01f : b,
+		                                                                           1.f}});
+	}
+	size_t const numTriangles = vertices.size() / 3;
+	bvh.build(vertices);
+	ASSERT_EQ(bvh.getNumTriangles(), numTriangles);
+
+	// Each node must contain its children, and each triangle must be in
+	// exactly one leaf
+	auto const nodes = bvh.getNodes();
+	size_t numLeafTriangles = 0;
+	for (TriangleBVHNode const& node : nodes)
+	{
+		if (node.isLeaf())
+		{
+			EXPECT_LE(node.numTriangles, TriangleBVH::maxLeafSize);
+			numLeafTriangles += node.numTriangles;
+			continue;
+		}
+
+		ASSERT_LT(node.leftOrFirst + 1, nodes.size());
+		for (uint32_t childIdx : {node.leftOrFirst, node.leftOrFirst + 1})
+		{
+			TriangleBVHNode const& child = nodes[childIdx];
+			for (int j = 0; j < 3; ++j)
+			{
+				EXPECT_LE(node.min[j], child.min[j]);
+				EXPECT_GE(node.max[j], child.max[j]);
+			}
+		}
+	}
+	EXPECT_EQ(numLeafTriangles, numTriangles);
+
+	// Compare with all triangles, in packets of rays from the same point
+	int numHits = 0;
+	for (int i = 0; i < 32; ++i)
+	{
+		float3 const eye{random(-4.f, 20.f), random(1.f, 4.f), random(-4.f, 20.f)};
+		float3 const target{random(0.f, 16.f), 0.f, random(0.f, 16.f)};
+		float3 rayDirs[8];
+		float maxDists[8];
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			float3 const offset{random(-1.f, 1.f), random(-1.f, 1.f), random(-1.f, 1.f)};
+			rayDirs[lane] = (target + offset - eye).normalize();
+			maxDists[lane] = lane == 7 ? 1.f : 100.f;
+		}
+
+		float3p8 const rayDirs8 = float3p8::loadAoS(rayDirs);
+		float3p4 const rayDirs4 = float3p4::loadAoS(rayDirs);
+		HitResult hits8[8], hits4[4];
+		bvh.raycast_Packet<8>(eye, rayDirs8, floatp8::load(maxDists), hits8);
+		bvh.raycast_Packet<4>(eye, rayDirs4, floatp4::load(maxDists), hits4);
+
+		for (int lane = 0; lane < 8; ++lane)
+		{
+			uint32_t triIdx;
+			HitResult const hit = bvh.raycast(eye, rayDirs[lane], maxDists[lane], &triIdx);
+			float const expectedDist = raycastTrianglesBruteForce(vertices, eye, rayDirs[lane], maxDists[lane]);
+			ASSERT_EQ(hit.hitOccured, expectedDist >= 0.f) << "packet " << i << ", lane " << lane;
+			ASSERT_EQ(hits8[lane].hitOccured, hit.hitOccured) << "packet " << i << ", lane " << lane;
+			if (lane < 4)
+			{
+				ASSERT_EQ(hits4[lane].hitOccured, hit.hitOccured) << "packet " << i << ", lane " << lane;
+			}
+			if (!hit)
+				continue;
+
+			numHits++;
+			ASSERT_LT(triIdx, numTriangles);
+			EXPECT_NEAR((hit.hitPosition - eye).getSize(), expectedDist, 1e-4f);
+			EXPECT_NEAR((hits8[lane].hitPosition - hit.hitPosition).getSize(), 0.f, 1e-4f);
+			if (lane < 4)
+			{
+				EXPECT_NEAR((hits4[lane].hitPosition - hit.hitPosition).getSize(), 0.f, 1e-4f);
+			}
+			EXPECT_NEAR(hit.hitNormal.getSize(), 1.f, 1e-4f);
+			EXPECT_LE(hit.hitNormal.dot(rayDirs[lane]), 0.f);
+		}
+	}
+	EXPECT_GT(numHits, 32 * 4);
+}
+
+
+TEST(Collision, TerrainContact)
+{
+	// Without noise, the terrain is the plane y = 0
+	DensityField const flatField{{-1.f, -1.f, -1.f}, 2.f, 64};
+	ContactResult contact = overlapSphereTerrain(flatField, {0.3f, 0.5f, 0.2f}, 1.f);
+	ASSERT_TRUE(contact);
+	EXPECT_NEAR(contact.penetrationDepth, 0.5f, 1e-4f);
+	EXPECT_NEAR(contact.contactPoint.y, 0.f, 1e-4f);
+	EXPECT_NEAR(contact.contactNormal.y, 1.f, 1e-5f);
+	EXPECT_FALSE(overlapSphereTerrain(flatField, {0.3f, 0.5f, 0.2f}, 0.4f));
+	contact = overlapSphereTerrain(flatField, {0.3f, -0.5f, 0.2f}, 1.f);
+	ASSERT_TRUE(contact);
+	EXPECT_NEAR(contact.penetrationDepth, 1.5f, 1e-4f);
+
+	contact = overlapCapsuleTerrain(flatField, {0.f, 2.f, 0.f}, {3.f, 0.5f, 0.f}, 1.f);
+	ASSERT_TRUE(contact);
+	EXPECT_NEAR(contact.penetrationDepth, 0.5f, 1e-3f);
+	EXPECT_NEAR(contact.contactPoint.x, 3.f, 1e-2f);
+	EXPECT_FALSE(overlapCapsuleTerrain(flatField, {0.f, 2.f, 0.f}, {3.f, 1.5f, 0.f}, 1.f));
+
+	float dist = -1.f;
+	contact = sweepSphereTerrain(flatField, {0.f, 5.f, 0.f}, 1.f, {1.f, -1.f, 0.f}, 10.f, &dist);
+	ASSERT_TRUE(contact);
+	EXPECT_NEAR(dist, 4.f * sqrtf(2.f), 1e-2f);
+	EXPECT_NEAR(contact.contactPoint.x, 4.f, 1e-2f);
+	EXPECT_FALSE(sweepSphereTerrain(flatField, {0.f, 5.f, 0.f}, 1.f, {1.f, -1.f, 0.f}, 5.f));
+	contact = sweepCapsuleTerrain(flatField, {0.f, 5.f, 0.f}, {0.f, 6.f, 0.f}, 0.5f, {0.f, -1.f, 0.f}, 10.f, &dist);
+	ASSERT_TRUE(contact);
+	EXPECT_NEAR(dist, 4.5f, 1e-2f);
+
+	srand(0x5eed);
+	DensityField field{{-1.f, -1.f, -1.f}, 2.f, 64};
+	field.initNoiseTextures(16);
+	float minHeight, maxHeight;
+	field.getSurfaceHeightRange(minHeight, maxHeight);
+
+	// The packet samples must match the scalar ones
+	Random random;
+	float3 positions[8];
+	for (float3& pos : positions)
+	{
+		pos = {random(-10.f, 10.f), random(minHeight, maxHeight), random(-10.f, 10.f)};
+	}
+	float3p8 gradients;
+	floatp8 const densities = field.sample_Packet<8>(float3p8::loadAoS(positions), &gradients);
+	for (int lane = 0; lane < 8; ++lane)
+	{
+		float3 gradient;
+		EXPECT_NEAR(densities.getLane(lane), field.sample(positions[lane], &gradient), 1e-5f);
+		EXPECT_NEAR((gradients.getLane(lane) - gradient).getSize(), 0.f, 1e-4f);
+	}
+
+	// The cached bounds must not exceed the actual distances
+	DensityGridCache cache{field};
+	cache.prepare({-10.f, minHeight - 1.f, -10.f}, {10.f, maxHeight + 1.f, 10.f});
+	EXPECT_GT(cache.getNumChunks(), 0u);
+	for (int i = 0; i < 200; ++i)
+	{
+		float3 const pos{random(-10.f, 10.f), random(minHeight - 1.f, maxHeight + 1.f), random(-10.f, 10.f)};
+		float dist;
+		ASSERT_TRUE(cache.getDistanceLowerBound(pos, dist));
+		EXPECT_LE(dist, -field.sample(pos) / field.getMaxGradient() + 1e-5f);
+	}
+
+	// Compare with points sampled inside the spheres, the cache must not
+	// change the results
+	constexpr size_t numSpheres = 200;
+	std::vector<float> xs(numSpheres), ys(numSpheres), zs(numSpheres), radii(numSpheres);
+	for (size_t i = 0; i < numSpheres; ++i)
+	{
+		xs[i] = random(-8.f, 8.f);
+		ys[i] = random(minHeight - 0.5f, maxHeight + 0.5f);
+		zs[i] = random(-8.f, 8.f);
+		radii[i] = random(0.1f, 0.5f);
+	}
+	std::vector<ContactResult> contacts(numSpheres), cachedContacts(numSpheres);
+	overlapSpheresTerrain(field, {xs, ys, zs}, radii, contacts);
+	overlapSpheresTerrain(field, {xs, ys, zs}, radii, cachedContacts, &cache);
+
+	int numContacts = 0, numMismatches = 0;
+	for (size_t i = 0; i < numSpheres; ++i)
+	{
+		float3 const center{xs[i], ys[i], zs[i]};
+		ContactResult const expected = overlapSphereTerrain(field, center, radii[i]);
+		ASSERT_EQ(contacts[i].contactOccured, expected.contactOccured) << "sphere " << i;
+		ASSERT_EQ(cachedContacts[i].contactOccured, expected.contactOccured) << "sphere " << i;
+
+		bool anyInside = field.sample(center) > 0.f;
+		for (int j = 0; j < 64 && !anyInside; ++j)
+		{
+			float3 const offset{random(-1.f, 1.f), random(-1.f, 1.f), random(-1.f, 1.f)};
+			anyInside = offset.getSize2() <= 1.f && field.sample(center + offset * radii[i]) > 0.f;
+		}
+		numMismatches += anyInside && !expected;
+		if (!expected)
+			continue;
+
+		numContacts++;
+		EXPECT_EQ(cachedContacts[i].penetrationDepth, expected.penetrationDepth) << "sphere " << i;
+		EXPECT_GT(expected.penetrationDepth, 0.f) << "sphere " << i;
+		EXPECT_NEAR(field.sample(expected.contactPoint), 0.f, 1e-3f) << "sphere " << i;
+		EXPECT_NEAR(expected.contactNormal.getSize(), 1.f, 1e-4f) << "sphere " << i;
+		EXPECT_NEAR((expected.contactPoint - center).getSize(), fabsf(radii[i] - expected.penetrationDepth),
+		            1e-3f) << "sphere " << i;
+	}
+	EXPECT_GT(numContacts, static_cast<int>(numSpheres / 4));
+	EXPECT_LE(numMismatches, static_cast<int>(numSpheres / 20));
+
+	// Spheres dropped on the terrain must stop on its surface
+	std::vector<float> motionXs(numSpheres, 0.f), motionYs(numSpheres), motionZs(numSpheres, 0.f);
+	std::vector<float> fractions(numSpheres);
+	for (size_t i = 0; i < numSpheres; ++i)
+	{
+		ys[i] = maxHeight + 1.f;
+		motionYs[i] = minHeight - maxHeight - 2.f;
+	}
+	// The penetration is measured along the gradient, so it may jump on
+	// curved terrain
+	sweepSpheresTerrain(field, {xs, ys, zs}, radii, {motionXs, motionYs, motionZs}, contacts, fractions, &cache);
+	int numDeepContacts = 0;
+	for (size_t i = 0; i < numSpheres; ++i)
+	{
+		ASSERT_TRUE(contacts[i]) << "sphere " << i;
+		EXPECT_GT(fractions[i], 0.f) << "sphere " << i;
+		EXPECT_LT(fractions[i], 1.f) << "sphere " << i;
+		numDeepContacts += contacts[i].penetrationDepth > field.getVoxelSize();
+		float3 const center{xs[i], ys[i] + motionYs[i] * fractions[i], zs[i]};
+		EXPECT_FALSE(overlapSphereTerrain(field, center + float3{0.f, radii[i], 0.f}, radii[i])) << "sphere " << i;
+	}
+	EXPECT_LE(numDeepContacts, static_cast<int>(numSpheres / 50));
+}
+
+
+TEST(Collision, OcclusionBuffer)
+{
+	// Without noise, the occluder of a chunk crossed by the plane y = 0 is
+	// a single quad on the plane, facing up
+	DensityField const flatField{{-1.f, -1.f, -1.f}, 2.f, 64};
+	std::vector<float3> vertices;
+	ASSERT_EQ(buildChunkOccluder(flatField, {0, 0, 0}, vertices), 2);
+	ASSERT_EQ(vertices.size(), 6);
+	for (float3 const& vertex : vertices)
+	{
+		EXPECT_EQ(vertex.y, 0.f);
+	}
+	EXPECT_GT((vertices[1] - vertices[0]).cross(vertices[2] - vertices[0]).y, 0.f);
+	EXPECT_GT((vertices[4] - vertices[3]).cross(vertices[5] - vertices[3]).y, 0.f);
+	EXPECT_EQ(buildChunkOccluder(flatField, {0, 1, 0}, vertices), 0);
+	EXPECT_EQ(buildChunkOccluder(flatField, {0, -1, 0}, vertices), 0);
+
+	vertices.clear();
+	for (int z = -2; z < 2; ++z)
+	{
+		for (int x = -2; x < 2; ++x)
+		{
+			buildChunkOccluder(flatField, {x, 0, z}, vertices);
+		}
+	}
+
+	// The floor spans [-5, 3] along X and Z, the camera is above it
+	OcclusionBuffer buffer{64, 64};
+	buffer.begin(testViewProj);
+	buffer.renderTriangles(vertices);
+	buffer.end();
+	EXPECT_FALSE(buffer.testAABB({0.f, -1.f, -3.f}, {1.f, -0.5f, -2.f}));
+	EXPECT_FALSE(buffer.testAABB({-2.f, -2.f, -2.2f}, {2.f, -0.5f, -2.f}));
+	EXPECT_TRUE(buffer.testAABB({0.f, 0.5f, -3.f}, {1.f, 1.f, -2.f}));
+	EXPECT_TRUE(buffer.testAABB({0.f, -1.f, -3.f}, {1.f, 0.1f, -2.f}));
+	EXPECT_TRUE(buffer.testAABB({0.f, -1.f, -21.f}, {1.f, -0.5f, -20.f}));
+	EXPECT_FALSE(buffer.testAABB({100.f, 0.f, -3.f}, {101.f, 1.f, -2.f}));
+
+	// Back faces are culled
+	for (size_t i = 0; i < vertices.size(); i += 3)
+	{
+		std::swap(vertices[i + 1], vertices[i + 2]);
+	}
+	buffer.begin(testViewProj);
+	buffer.renderTriangles(vertices);
+	buffer.end();
+	EXPECT_TRUE(buffer.testAABB({0.f, -1.f, -3.f}, {1.f, -0.5f, -2.f}));
+
+	srand(0x5eed);
+	DensityField field{{-1.f, -1.f, -1.f}, 2.f, 64};
+	field.initNoiseTextures(16);
+	float minHeight, maxHeight;
+	field.getSurfaceHeightRange(minHeight, maxHeight);
+
+	vertices.clear();
+	for (int z = -4; z < 3; ++z)
+	{
+		for (int y = -1; y <= 1; ++y)
+		{
+			for (int x = -3; x < 3; ++x)
+			{
+				buildChunkOccluder(field, {x, y, z}, vertices);
+			}
+		}
+	}
+	ASSERT_FALSE(vertices.empty());
+
+	// The occluders must be inside the terrain
+	Random random;
+	int numOutsidePoints = 0;
+	for (size_t i = 0; i < vertices.size(); i += 3)
+	{
+		float const u = random(0.f, 1.f), v = random(0.f, 1.f - u);
+		float3 const point = vertices[i] + (vertices[i + 1] - vertices[i]) * u + (vertices[i + 2] - vertices[i]) * v;
+		numOutsidePoints += field.sample(point) < 0.f;
+	}
+	EXPECT_EQ(numOutsidePoints, 0);
+
+	// Camera just above the terrain, looking down -Z
+	float3 const eye{0.3f, maxHeight + 0.1f, 4.f};
+	float4x4 const viewProj = makeInfiniteProjection(1.f, 1.f, 0.1f).dot(float4x4{1.f, 0.f, 0.f, -eye.x,
+	                                                                              0.f, 1.f, 0.f, -eye.y,
+	                                                                              0.f, 0.f, 1.f, -eye.z,
+	                                                                              0.f, 0.f, 0.f, 1.f});
+	Frustum const frustum{viewProj};
+	buffer.begin(viewProj);
+	buffer.renderTriangles(vertices);
+	buffer.end();
+
+	// Occluded boxes must be hidden by the terrain, the rays from the eye
+	// to their corners and center must hit it. A few boxes visible through
+	// gaps smaller than a pixel may be culled
+	int numBoxes = 0, numOccludedBoxes = 0, numVisibleOccludedBoxes = 0;
+	for (int i = 0; i < 500; ++i)
+	{
+		float3 const min{random(-5.f, 5.f), random(minHeight - 0.5f, maxHeight), random(-8.f, 2.f)};
+		float3 const max = min + float3{0.1f, 0.1f, 0.1f};
+		if (!frustum.testAABB(min, max))
+			continue;
+
+		numBoxes++;
+		if (buffer.testAABB(min, max))
+			continue;
+
+		numOccludedBoxes++;
+		auto const isHidden = [&](float3 const& point) -> bool {
+
+			return raycastTerrain(field, eye, point - eye, (point - eye).getSize());
+		};
+
+		bool hidden = isHidden((min + max) * 0.5f);
+		for (int j = 0; j < 8; ++j)
+		{
+			hidden &= isHidden({j & 1 ? max.x : min.x, j & 2 ? max.y : min.y, j & 4 ? max.z : min.z});
+		}
+		numVisibleOccludedBoxes += !hidden;
+	}
+	EXPECT_GT(numOccludedBoxes, numBoxes / 10);
+	EXPECT_LE(numVisibleOccludedBoxes, numOccludedBoxes / 50);
+}
+
+TEST(Collision, SpatialHash)
+{
+	// Touching spheres
+	ContactResult contact = overlapSphereSphere({1.f, 0.f, 0.f}, 0.5f, {0.f, 0.f, 0.f}, 0.75f);
+	ASSERT_TRUE(contact);
+	EXPECT_FLOAT_EQ(contact.penetrationDepth, 0.25f);
+	EXPECT_FLOAT_EQ(contact.contactNormal[0], 1.f);
+	EXPECT_FLOAT_EQ(contact.contactPoint[0], 0.75f);
+	EXPECT_FALSE(overlapSphereSphere({2.f, 0.f, 0.f}, 0.5f, {0.f, 0.f, 0.f}, 0.75f));
+
+	// Mostly small spheres, and a few large ones in coarser levels
+	SpatialHash hash{0.5f};
+	constexpr size_t count = 3001;
+	Random random;
+	std::vector<uint32_t> proxies(count);
+	std::vector<bool> alive(count, true);
+	std::vector<float> xs(count), ys(count), zs(count), radii(count);
+	auto const randomize = [&](size_t i) -> void {
+
+		xs[i] = random(-15.f, 15.f);
+		ys[i] = random(-5.f, 5.f);
+		zs[i] = random(-15.f, 15.f);
+		radii[i] = i % 50 == 0 ? random(1.f, 4.f) : random(0.05f, 0.25f);
+	};
+	for (size_t i = 0; i < count; ++i)
+	{
+		randomize(i);
+		proxies[i] = hash.insert({xs[i], ys[i], zs[i]}, radii[i], static_cast<uint32_t>(i));
+	}
+	EXPECT_EQ(hash.getNumProxies(), count);
+	EXPECT_FALSE(hash.move(proxies[1], {xs[1], ys[1], zs[1]}, radii[1]));
+
+	// Remove some proxies and insert some back, then move others
+	for (size_t i = 0; i < count; i += 3)
+	{
+		hash.remove(proxies[i]);
+		alive[i] = false;
+	}
+	for (size_t i = 0; i < count; i += 6)
+	{
+		randomize(i);
+		proxies[i] = hash.insert({xs[i], ys[i], zs[i]}, radii[i], static_cast<uint32_t>(i));
+		alive[i] = true;
+	}
+	for (size_t i = 1; i < count; i += 3)
+	{
+		xs[i] += random(-1.f, 1.f);
+		zs[i] += random(-1.f, 1.f);
+		hash.move(proxies[i], {xs[i], ys[i], zs[i]}, radii[i]);
+	}
+
+	size_t numAlive = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		numAlive += alive[i];
+		if (alive[i])
+		{
+			ASSERT_EQ(hash.getUserData(proxies[i]), i);
+		}
+	}
+	EXPECT_EQ(hash.getNumProxies(), numAlive);
+
+	// Compare with all pairs
+	std::vector<BroadphasePair> pairs;
+	hash.findPairs(pairs);
+	std::vector<uint64_t> found, expected;
+	for (BroadphasePair const& pair : pairs)
+	{
+		found.push_back(static_cast<uint64_t>(std::min(pair.a, pair.b)) << 32 | std::max(pair.a, pair.b));
+	}
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (size_t j = i + 1; j < count; ++j)
+		{
+			float3 const delta{xs[i] - xs[j], ys[i] - ys[j], zs[i] - zs[j]};
+			float const radiusSum = radii[i] + radii[j];
+			if (alive[i] && alive[j] && delta.getSize2() <= radiusSum * radiusSum)
+				expected.push_back(static_cast<uint64_t>(i) << 32 | j);
+		}
+	}
+	std::sort(found.begin(), found.end());
+	std::sort(expected.begin(), expected.end());
+	ASSERT_GT(expected.size(), 0u);
+	EXPECT_EQ(found, expected);
+
+	// The narrow phase of the pairs matches the single pair test
+	std::vector<ContactResult> contacts(pairs.size());
+	overlapSpherePairs(pairs, {xs, ys, zs}, radii, contacts);
+	for (size_t i = 0; i < pairs.size(); ++i)
+	{
+		uint32_t const a = pairs[i].a, b = pairs[i].b;
+		ContactResult const expectedContact = overlapSphereSphere({xs[a], ys[a], zs[a]}, radii[a],
+		                                                          {xs[b], ys[b], zs[b]}, radii[b]);
+		ASSERT_TRUE(contacts[i]) << "pair " << i;
+		EXPECT_EQ(contacts[i].penetrationDepth, expectedContact.penetrationDepth) << "pair " << i;
+	}
+
+	// Removing all proxies leaves no cells
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (alive[i])
+			hash.remove(proxies[i]);
+	}
+	EXPECT_EQ(hash.getNumProxies(), 0u);
+	EXPECT_EQ(hash.getNumCells(), 0u);
+}
@@ -1,13 +1,669 @@
 #pragma once
 
+#include <math.h>
+
+#include <bit>
+#include <limits>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "math/math.h"
+#include "transform_batch.h"
+#include "pack_batch.h"
 
 
 using namespace VaporWorldVR;
 
 
+#if VW_MATH_SIMD
+/* Only the SIMD specializations can be constant-evaluated, the generic
+   templates read union members that the constructors did not initialize. */
+# define VW_TEST_CONSTEXPR constexpr
+# define VW_TEST_STATIC_ASSERT(...) static_assert(__VA_ARGS__)
+#else
+# define VW_TEST_CONSTEXPR const
+# define VW_TEST_STATIC_ASSERT(...)
+#endif
+
+
+namespace
+{
+	constexpr float4x4 testMatrixA{2.f, 0.f, 1.f, 3.f,
+	                               1.f, 3.f, 0.f, -1.f,
+	                               0.f, 1.f, 4.f, 2.f,
+	                               1.f, 0.f, 0.f, 1.f};
+	constexpr float4x4 testMatrixB{1.f, 2.f, 0.f, 0.f,
+	                               0.f, 1.f, -2.f, 1.f,
+	                               3.f, 0.f, 1.f, 0.f,
+	                               0.f, 1.f, 0.f, 2.f};
+	constexpr float4 testVector{1.f, -2.f, 3.f, 0.5f};
+
+	/* Copies a value so that operations on it are evaluated at runtime. */
+	template<typename T>
+	T runtime(T const& value)
+	{
+		T volatile const* ptr = &value;
+		return *const_cast<T const*>(ptr);
+	}
+
+	/* Returns the distance in ULPs between a float and a double-precision
+	   reference value. */
+	int64_t ulpDistance(float x, double reference)
+	{
+		auto const toOrdered = [](float f) {
+
+			int32_t const bits = ::std::bit_cast<int32_t>(f);
+			return bits < 0 ? int64_t{INT32_MIN} - bits : int64_t{bits};
+		};
+		int64_t const d = toOrdered(x) - toOrdered(static_cast<float>(reference));
+		return d < 0 ? -d : d;
+	}
+
+	/* Returns the maximum error in ULPs of a function over a range. */
+	template<typename FnT>
+	int64_t maxUlpError(FnT&& fn, double (*referenceFn)(double), float lo, float hi, int numSamples = 100000)
+	{
+		int64_t maxError = 0;
+		for (int i = 0; i <= numSamples; ++i)
+		{
+			float const x = lo + (hi - lo) * (static_cast<double>(i) / numSamples);
+			int64_t const error = ulpDistance(fn(x), referenceFn(static_cast<double>(x)));
+			maxError = error > maxError ? error : maxError;
+		}
+		return maxError;
+	}
+
+	/* Error measures between a result and the double-precision reference. */
+	/// @{
+	double absError(float x, double reference)
+	{
+		return ::fabs(x - reference);
+	}
+
+	double relError(float x, double reference)
+	{
+		return ::fabs(x - reference) / ::fabs(reference);
+	}
+
+	double ulpError(float x, double reference)
+	{
+		return static_cast<double>(ulpDistance(x, reference));
+	}
+	/// @}
+
+	/* Returns the maximum error of a packet kernel over a range, 8 lanes at
+	   a time. If logSpaced is true, the range must be positive and samples
+	   are evenly spaced in the exponent. */
+	template<typename KernelT>
+	double maxPacketError(KernelT&& kernel, double (*referenceFn)(double), double (*errorFn)(float, double), float lo,
+	                      float hi, bool logSpaced = false, int numSamples = 100000)
+	{
+		double maxError = 0.;
+		for (int i = 0; i <= numSamples; i += 8)
+		{
+			float inputs[8], outputs[8];
+			for (int j = 0; j < 8; ++j)
+			{
+				double const t = static_cast<double>(Math::min(i + j, numSamples)) / numSamples;
+				inputs[j] = logSpaced ? ::exp2(::log2(lo) + (::log2(hi) - ::log2(lo)) * t) : lo + (hi - lo) * t;
+			}
+
+			kernel(floatp8::load(inputs)).store(outputs);
+			for (int j = 0; j < 8; ++j)
+			{
+				double const error = errorFn(outputs[j], referenceFn(inputs[j]));
+				maxError = error > maxError ? error : maxError;
+			}
+		}
+		return maxError;
+	}
+
+	/* Checks the error bounds of the packet kernels for the given accuracy
+	   tier, measured in ULP for the High tier. */
+	template<Math::Accuracy accuracy>
+	void expectPacketMathError(double sinCosBound, double exp2Bound, double log2Bound, double rsqrtBound,
+	                           double atan2Bound)
+	{
+		constexpr bool high = accuracy == Math::Accuracy::High;
+		float const angleRange = high ? 64.f : 8192.f;
+		auto const sinKernel = [](floatp8 const& x) {
+
+			floatp8 s, c;
+			Math::sincos<accuracy>(x, s, c);
+			return s;
+		};
+		auto const cosKernel = [](floatp8 const& x) {
+
+			floatp8 s, c;
+			Math::sincos<accuracy>(x, s, c);
+			return c;
+		};
+
+		EXPECT_LE(maxPacketError(sinKernel, ::sin, high ? ulpError : absError, -angleRange, angleRange), sinCosBound);
+		EXPECT_LE(maxPacketError(cosKernel, ::cos, high ? ulpError : absError, -angleRange, angleRange), sinCosBound);
+		EXPECT_LE(maxPacketError(Math::exp2<accuracy, 8>, ::exp2, high ? ulpError : relError, -126.f, 127.99f),
+		          exp2Bound);
+		EXPECT_LE(maxPacketError(Math::log2<accuracy, 8>, ::log2, high ? ulpError : relError,
+		                         ::std::numeric_limits<float>::denorm_min(), ::std::numeric_limits<float>::max(), true),
+		          log2Bound);
+		EXPECT_LE(maxPacketError(Math::rsqrt<accuracy, 8>, [](double x) { return 1. / ::sqrt(x); },
+		                         high ? ulpError : relError, ::std::numeric_limits<float>::min(),
+		                         ::std::numeric_limits<float>::max(), true),
+		          rsqrtBound);
+
+		// Sweep the unit circle, the inputs are rounded to float first
+		auto const atan2Kernel = [](floatp8 const& t) {
+
+			floatp8 y, x;
+			for (int i = 0; i < 8; ++i)
+			{
+				y.setLane(i, static_cast<float>(::sin(static_cast<double>(t.getLane(i)))));
+				x.setLane(i, static_cast<float>(::cos(static_cast<double>(t.getLane(i)))));
+			}
+			return Math::atan2<accuracy>(y, x);
+		};
+		auto const atan2Reference = [](double t) -> double {
+
+			double const angle = static_cast<float>(t);
+			return ::atan2(static_cast<float>(::sin(angle)), static_cast<float>(::cos(angle)));
+		};
+		EXPECT_LE(maxPacketError(atan2Kernel, atan2Reference, high ? ulpError : absError, -3.14159f, 3.14159f),
+		          atan2Bound);
+	}
+
+	void expectNear(float4x4 const& m, float4x4 const& n, float tolerance = 1e-5f)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			EXPECT_NEAR(m.data[i], n.data[i], tolerance) << "element " << i;
+		}
+	}
+} // namespace
+
+
 TEST(Math, Vec3)
 {
 	SUCCEED();
 }
+
+TEST(Math, Vec4)
+{
+	VW_TEST_CONSTEXPR float4 u = testVector + float4{1.f, 2.f, 3.f, 4.f} * 2.f;
+	VW_TEST_CONSTEXPR float d = u.dot(testVector);
+	VW_TEST_STATIC_ASSERT(u.coords[0] == 3.f && u.coords[1] == 2.f && u.coords[2] == 9.f && u.coords[3] == 8.5f);
+	VW_TEST_STATIC_ASSERT(d == 3.f - 4.f + 27.f + 4.25f);
+
+	float4 const v = runtime(testVector) + runtime(float4{1.f, 2.f, 3.f, 4.f}) * 2.f;
+	EXPECT_EQ(v.x, u.x);
+	EXPECT_EQ(v.y, u.y);
+	EXPECT_EQ(v.z, u.z);
+	EXPECT_EQ(v.w, u.w);
+	EXPECT_FLOAT_EQ(v.dot(runtime(testVector)), d);
+	EXPECT_FLOAT_EQ((v / runtime(float4{2.f})).x, 1.5f);
+	EXPECT_FLOAT_EQ((v - runtime(testVector)).w, 8.f);
+}
+
+TEST(Math, Mat4Dot)
+{
+	// Constant-evaluated results use the scalar path
+	VW_TEST_CONSTEXPR float4x4 m = testMatrixA.dot(testMatrixB);
+	VW_TEST_CONSTEXPR float4 v = testMatrixA.dot(testVector);
+	VW_TEST_CONSTEXPR float4x4 t = testMatrixA.getTransposed();
+	VW_TEST_STATIC_ASSERT(m.data[0] == 5.f && m.data[7] == 1.f && t.data[1] == 1.f && v.coords[0] == 6.5f);
+
+	expectNear(runtime(testMatrixA).dot(runtime(testMatrixB)), m);
+	expectNear(runtime(testMatrixA).getTransposed(), t);
+
+	float4 const u = runtime(testMatrixA).dot(runtime(testVector));
+	for (int i = 0; i < 4; ++i)
+	{
+		EXPECT_FLOAT_EQ(u[i], v[i]);
+	}
+}
+
+TEST(Math, Mat4Inverse)
+{
+	expectNear(runtime(testMatrixA).dot(!runtime(testMatrixA)), float4x4::eye);
+	expectNear((!runtime(testMatrixB)).dot(runtime(testMatrixB)), float4x4::eye);
+}
+
+TEST(Math, AffineMatrix)
+{
+	float3x4 const rigid{float3{1.f, -2.f, 3.f}, quat{float3{0.f, 0.6f, 0.8f}, 0.7f}};
+	float3x4 const affine{float3{-4.f, 0.5f, 2.f}, quat{float3{1.f, 0.f, 0.f}, -1.2f}, float3{2.f, 0.5f, 3.f}};
+	float3x4 const sheared{testMatrixA};
+	float3 const v{0.25f, -1.f, 2.f};
+
+	// Conversions and composition must match the equivalent Mat4
+	float4x4 const m = static_cast<float4x4>(sheared);
+	expectNear(static_cast<float4x4>(float3x4{m}), m);
+	expectNear(static_cast<float4x4>(rigid.dot(sheared)), static_cast<float4x4>(rigid).dot(m));
+
+	float3 const p = affine.transformPoint(v), d = affine.transformDirection(v);
+	float4 const expectedPoint = static_cast<float4x4>(affine).dot(float4{v, 1.f});
+	float4 const expectedDirection = static_cast<float4x4>(affine).dot(float4{v, 0.f});
+	for (int i = 0; i < 3; ++i)
+	{
+		EXPECT_FLOAT_EQ(p[i], expectedPoint[i]);
+		EXPECT_FLOAT_EQ(d[i], expectedDirection[i]);
+	}
+
+	expectNear(static_cast<float4x4>(rigid.getInverseRigid().dot(rigid)), float4x4::eye);
+	expectNear(static_cast<float4x4>(rigid.getInverseRigid()), static_cast<float4x4>(!rigid));
+	expectNear(static_cast<float4x4>(affine.dot(!affine)), float4x4::eye);
+	expectNear(static_cast<float4x4>(!sheared), !m);
+}
+
+TEST(Math, Transform)
+{
+	Math::Transform const a{float3{1.f, -2.f, 3.f}, quat{float3{0.f, 0.6f, 0.8f}, 0.7f}, float3{2.f}};
+	Math::Transform const b{float3{-4.f, 0.5f, 2.f}, quat{float3{1.f, 0.f, 0.f}, -1.2f}, float3{0.5f}};
+	float3 const v{0.25f, -1.f, 2.f};
+
+	// Baked matrices, composition and inversion must match the equivalent
+	// Mat4 operations
+	float4x4 const ma = static_cast<float4x4>(a), mb = static_cast<float4x4>(b);
+	float4 const expectedPoint = ma.dot(float4{v, 1.f});
+	float3 const p = a.transformPoint(v);
+	for (int i = 0; i < 3; ++i)
+	{
+		EXPECT_NEAR(p[i], expectedPoint[i], 1e-5f);
+	}
+	expectNear(static_cast<float4x4>(a.dot(b)), ma.dot(mb));
+	expectNear(static_cast<float4x4>(!a), !ma);
+	expectNear(static_cast<float4x4>(a.dot(!a)), float4x4::eye);
+
+	// Interpolation hits both ends, and the midpoint rotation of slerp is
+	// halfway along the shortest path, i.e. the same as nlerp
+	expectNear(static_cast<float4x4>(Math::slerp(a, b, 0.f)), ma);
+	expectNear(static_cast<float4x4>(Math::slerp(a, b, 1.f)), mb);
+	expectNear(static_cast<float4x4>(Math::lerp(a, b, 1.f)), mb);
+	expectNear(static_cast<float4x4>(Math::slerp(a, b, 0.5f)), static_cast<float4x4>(Math::lerp(a, b, 0.5f)));
+
+	quat const q0{float3{0.f, 0.f, 1.f}, 0.2f}, q1{float3{0.f, 0.f, 1.f}, 1.4f};
+	quat const q1Flipped{-q1.x, -q1.y, -q1.z, -q1.w};
+	for (float t : {0.25f, 0.5f, 0.9f})
+	{
+		EXPECT_NEAR(Math::slerp(q0, q1, t).getAngle(), 0.2f + 1.2f * t, 1e-4f) << "t = " << t;
+		EXPECT_NEAR(Math::slerp(q0, q1Flipped, t).getAngle(), 0.2f + 1.2f * t, 1e-4f) << "t = " << t;
+	}
+
+	// Odd size, to exercise the scalar remainder
+	constexpr size_t count = 1027;
+	std::vector<Math::Transform> transforms(count);
+	std::vector<float4x4> baked(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		float const t = static_cast<float>(i);
+		transforms[i] = Math::Transform{float3{sinf(t), t * 0.5f, -t}, quat{float3{0.f, 0.6f, 0.8f}, t * 0.1f},
+		                                float3{1.f + cosf(t) * 0.5f, 2.f, 0.5f}};
+	}
+	bakeTransforms(transforms, baked);
+	for (size_t i = 0; i < count; ++i)
+	{
+		float4x4 const expected = static_cast<float4x4>(transforms[i]);
+		for (int j = 0; j < 16; ++j)
+		{
+			ASSERT_NEAR(baked[i].data[j], expected.data[j], 1e-5f) << "transform " << i << ", element " << j;
+		}
+	}
+}
+
+TEST(Math, TransformBatch)
+{
+	// Odd size, to exercise the scalar remainder
+	constexpr size_t count = 4099;
+	std::vector<float3> points(count), transformed(count);
+	std::vector<float> xs(count), ys(count), zs(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		points[i] = {i * 0.5f, 1.f - i, i * 0.25f - 7.f};
+		xs[i] = points[i].x;
+		ys[i] = points[i].y;
+		zs[i] = points[i].z;
+	}
+
+	transformPoints(testMatrixA, points, transformed);
+	for (size_t i = 0; i < count; ++i)
+	{
+		float4 const expected = testMatrixA.dot(float4{points[i], 1.f});
+		ASSERT_FLOAT_EQ(transformed[i].x, expected.x) << "point " << i;
+		ASSERT_FLOAT_EQ(transformed[i].y, expected.y) << "point " << i;
+		ASSERT_FLOAT_EQ(transformed[i].z, expected.z) << "point " << i;
+	}
+
+	// In-place, SoA
+	transformDirections(testMatrixA, Vec3SoA<float>{xs, ys, zs}, Vec3SoA<float>{xs, ys, zs});
+	for (size_t i = 0; i < count; ++i)
+	{
+		float4 const expected = testMatrixA.dot(float4{points[i], 0.f});
+		ASSERT_FLOAT_EQ(xs[i], expected.x) << "direction " << i;
+		ASSERT_FLOAT_EQ(ys[i], expected.y) << "direction " << i;
+		ASSERT_FLOAT_EQ(zs[i], expected.z) << "direction " << i;
+	}
+
+	std::vector<float4> vectors(count), transformedVectors(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		vectors[i] = {points[i], i * 0.125f};
+	}
+	transformVectors(testMatrixB, vectors, transformedVectors);
+	for (size_t i = 0; i < count; ++i)
+	{
+		float4 const expected = testMatrixB.dot(vectors[i]);
+		for (int j = 0; j < 4; ++j)
+		{
+			ASSERT_FLOAT_EQ(transformedVectors[i][j], expected[j]) << "vector " << i;
+		}
+	}
+}
+
+TEST(Math, FastMath)
+{
+	// Constant evaluation uses gcem, or the fast polynomials if disabled
+	constexpr float s = Math::sin(0.5f), c = Math::cos(0.5f), r = Math::sqrt(2.f);
+	static_assert(s > 0.4794254f && s < 0.4794257f);
+	static_assert(c > 0.8775824f && c < 0.8775827f);
+	static_assert(r == 1.41421356f);
+	static_assert(Math::Fast::sqrt(0.f) == 0.f && Math::Fast::sqrt(1e-20f) == 1e-10f);
+
+	// Error bounds documented in fast_math.h
+	EXPECT_LE(maxUlpError(Math::Fast::sin, ::sin, -64.f, 64.f), 2);
+	EXPECT_LE(maxUlpError(Math::Fast::cos, ::cos, -64.f, 64.f), 2);
+	EXPECT_LE(maxUlpError(Math::Fast::tan, ::tan, -1.5f, 1.5f), 3);
+	EXPECT_LE(maxUlpError(Math::Fast::atan, ::atan, -100.f, 100.f), 3);
+	EXPECT_LE(maxUlpError(Math::Fast::asin, ::asin, -1.f, 1.f), 2);
+	EXPECT_LE(maxUlpError(Math::Fast::acos, ::acos, -1.f, 1.f), 1);
+	EXPECT_LE(maxUlpError([](float x) { return Math::Fast::atan2(x, -0.7f); },
+	                      [](double x) { return ::atan2(x, -0.7f); }, -10.f, 10.f), 3);
+	EXPECT_LE(maxUlpError(Math::Fast::sqrt, ::sqrt, 0.f, 1000.f), 0);
+
+	float maxAbsError = 0.f;
+	for (float x = -8192.f; x <= 8192.f; x += 0.37f)
+	{
+		float sinX = 0.f, cosX = 0.f;
+		Math::Fast::sincos(x, sinX, cosX);
+		maxAbsError = Math::max(maxAbsError, Math::max(::fabsf(sinX - ::sin(x)), ::fabsf(cosX - ::cos(x))));
+	}
+	EXPECT_LT(maxAbsError, 1e-7f);
+
+	// Angles outside the domain of the polynomials fall back to libm
+	for (float x : {-3e9f, -1e6f, -8192.5f, 8192.5f, 1e6f, 3e9f, 1e30f})
+	{
+		EXPECT_EQ(Math::sin(x), ::sinf(x)) << x;
+		EXPECT_EQ(Math::cos(x), ::cosf(x)) << x;
+		EXPECT_EQ(Math::tan(x), ::tanf(x)) << x;
+	}
+	EXPECT_TRUE(::isnan(Math::sin(INFINITY)));
+	EXPECT_TRUE(::isnan(Math::cos(NAN)));
+
+	// Signed zeros select the half-plane, like libm
+	for (float y : {0.f, -0.f})
+	{
+		for (float x : {0.f, -0.f})
+		{
+			float const angle = Math::Fast::atan2(y, x), expected = ::atan2f(y, x);
+			EXPECT_EQ(angle, expected) << y << ", " << x;
+			EXPECT_EQ(::signbit(angle), ::signbit(expected)) << y << ", " << x;
+		}
+	}
+}
+
+TEST(Math, Packet)
+{
+	float3 vectors[8], others[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		vectors[i] = {i - 3.f, 0.5f * i, 2.f - i * i};
+		others[i] = {1.f, -2.f * i, i + 0.25f};
+	}
+
+	float3p8 const u = float3p8::loadAoS(vectors), v = float3p8::loadAoS(others);
+	floatp8 const d = u.dot(v);
+	float3p8 const c = u.cross(v);
+	float3p8 const n = (u + float3{0.f, 0.f, 5.f}).getNormal();
+	maskp8 const m = u.x < floatp8{0.f};
+	float3p8 const s = select(m, u, v);
+	float3p8 const l = lerp(u, v, floatp8{0.25f});
+
+	float3 out[8];
+	c.storeAoS(out);
+	for (int i = 0; i < 8; ++i)
+	{
+		float3 const expectedCross = vectors[i].cross(others[i]);
+		float3 const expectedNormal = (vectors[i] + float3{0.f, 0.f, 5.f}).getNormal();
+		float3 const expectedSelect = vectors[i].x < 0.f ? vectors[i] : others[i];
+		float3 const expectedLerp = lerp(vectors[i], others[i], 0.25f);
+		EXPECT_FLOAT_EQ(d.getLane(i), vectors[i].dot(others[i]));
+		for (int j = 0; j < 3; ++j)
+		{
+			EXPECT_FLOAT_EQ(out[i][j], expectedCross[j]) << "lane " << i;
+			EXPECT_FLOAT_EQ(n.getLane(i)[j], expectedNormal[j]) << "lane " << i;
+			EXPECT_EQ(s.getLane(i)[j], expectedSelect[j]) << "lane " << i;
+			EXPECT_FLOAT_EQ(l.getLane(i)[j], expectedLerp[j]) << "lane " << i;
+		}
+	}
+
+	EXPECT_EQ(m.getBits(), 0b111u);
+	EXPECT_TRUE(m.any());
+	EXPECT_FALSE(m.all());
+	EXPECT_TRUE((m | ~m).all());
+	EXPECT_TRUE((m & ~m).none());
+
+	floatp4 p = floatp4::load(vectors[0].coords);
+	p.setLane(2, 10.f);
+	EXPECT_EQ(min(p, floatp4{0.f}).getLane(0), -3.f);
+	EXPECT_EQ(max(p, floatp4{0.f}).getLane(2), 10.f);
+	EXPECT_EQ(abs(-p).getLane(2), 10.f);
+	EXPECT_FLOAT_EQ(sqrt(p).getLane(2), ::sqrtf(10.f));
+}
+
+TEST(Math, PacketMath)
+{
+	using Math::Accuracy;
+
+	// Error bounds documented in packet_math.h
+	expectPacketMathError<Accuracy::Low>(5e-4, 2e-4, 5e-4, 4e-4, 5e-4);
+	expectPacketMathError<Accuracy::Medium>(2e-6, 5e-6, 1e-5, 5e-6, 1e-5);
+	expectPacketMathError<Accuracy::High>(2, 2, 2, 1, 3);
+
+	floatp8 sinX, cosX;
+	Math::sincos(floatp8{8192.f}, sinX, cosX);
+	EXPECT_NEAR(sinX.getLane(0), ::sin(8192.), 1e-7);
+	EXPECT_NEAR(cosX.getLane(0), ::cos(8192.), 1e-7);
+
+	// Special values, each lane is independent
+	constexpr float inf = ::std::numeric_limits<float>::infinity();
+	float const inputs[8] = {-200.f, 200.f, 0.f, -0.f, -1.f, inf, 8.f, 1e-40f};
+	floatp8 const x = floatp8::load(inputs);
+	floatp8 const e = Math::exp2(x), l = Math::log2(x), a = Math::atan2(x, floatp8{0.f});
+	EXPECT_EQ(e.getLane(0), 0.f);
+	EXPECT_EQ(e.getLane(1), inf);
+	EXPECT_EQ(e.getLane(2), 1.f);
+	EXPECT_EQ(e.getLane(6), 256.f);
+	EXPECT_EQ(l.getLane(2), -inf);
+	EXPECT_EQ(l.getLane(3), -inf);
+	EXPECT_TRUE(::isnan(l.getLane(4)));
+	EXPECT_EQ(l.getLane(5), inf);
+	EXPECT_EQ(l.getLane(6), 3.f);
+	EXPECT_FLOAT_EQ(l.getLane(7), ::log2f(1e-40f));
+	EXPECT_FLOAT_EQ(a.getLane(0), -Math::Fast::Impl::halfPi);
+	EXPECT_EQ(a.getLane(2), 0.f);
+	EXPECT_FLOAT_EQ(Math::atan2(floatp4{-0.f}, floatp4{-1.f}).getLane(0), -Math::Fast::Impl::pi);
+	EXPECT_FLOAT_EQ(Math::rsqrt(floatp4{4.f}).getLane(3), 0.5f);
+}
+
+TEST(Math, Packed)
+{
+	static_assert(half{1.f}.bits == 0x3c00 && half{-2.f}.bits == 0xc000 && half{65504.f}.bits == 0x7bff);
+	static_assert(half{1e6f}.bits == 0x7c00 && half{5.96046448e-8f}.bits == 0x0001);
+	static_assert(half::fromBits(0x3555) == 0.333251953125f);
+	VW_TEST_STATIC_ASSERT(rgb10a2{float4{1.f, 0.f, 1.f, 1.f}}.bits == 0xfff003ffu);
+
+	// All halves except NaN round-trip exactly
+	for (uint32_t bits = 0; bits <= 0xffff; ++bits)
+	{
+		half const h = half::fromBits(static_cast<uint16_t>(bits));
+		if (::isnan(static_cast<float>(h)))
+			EXPECT_EQ(half{static_cast<float>(h)}.bits & 0x7e00, 0x7e00);
+		else
+			ASSERT_EQ(half{static_cast<float>(h)}.bits, bits);
+	}
+
+	// The result is the nearest half, ties to even
+	for (uint32_t bits = 0x30000000; bits < 0x477fe000; bits += 0x1001)
+	{
+		float const f = ::std::bit_cast<float>(bits);
+		half const h{f};
+		double const error = ::fabs(f - static_cast<double>(h));
+		double const prevError = ::fabs(f - static_cast<double>(half::fromBits(h.bits - 1)));
+		double const nextError = ::fabs(f - static_cast<double>(half::fromBits(h.bits + 1)));
+		ASSERT_TRUE(h.bits == 0 || error < prevError || (error == prevError && (h.bits & 1) == 0)) << f;
+		ASSERT_TRUE(error < nextError || (error == nextError && (h.bits & 1) == 0)) << f;
+	}
+
+	// Octahedral encoding error, in degrees
+	float maxAngle = 0.f;
+	for (int i = 0; i < 10000; ++i)
+	{
+		float3 const n = i == 0 ? float3{0.f, 0.f, -1.f}
+		                        : float3{::sinf(i * 1.3f), ::cosf(i * 0.7f), ::sinf(i * 2.9f + 1.f)}.getNormal();
+		float3 const decoded = octnormal{n};
+		maxAngle = Math::max(maxAngle, ::atan2f(n.cross(decoded).getSize(), n.dot(decoded)) * 57.2957795f);
+	}
+	EXPECT_LT(maxAngle, 0.005f);
+
+	float4 const v{0.25f, -0.5f, 1.5f, -1.f};
+	float4 const u = unorm8x4{v}, s = snorm16x4{v}, r = rgb10a2{v};
+	EXPECT_NEAR(u.x, 0.25f, 0.5f / 255.f);
+	EXPECT_EQ(u.y, 0.f);
+	EXPECT_EQ(u.z, 1.f);
+	EXPECT_NEAR(s.y, -0.5f, 0.5f / 32767.f);
+	EXPECT_EQ(s.z, 1.f);
+	EXPECT_EQ(s.w, -1.f);
+	EXPECT_NEAR(r.x, 0.25f, 0.5f / 1023.f);
+	EXPECT_EQ(r.w, 0.f);
+}
+
+TEST(Math, PackBatch)
+{
+	// Not a multiple of the block size, to test the remainder
+	constexpr size_t count = 1001;
+	std::vector<float3> normals(count);
+	std::vector<float4> vectors(count);
+	std::vector<float> values(count * 3);
+	for (size_t i = 0; i < count; ++i)
+	{
+		normals[i] = float3{::sinf(i * 1.3f), ::cosf(i * 0.7f), ::sinf(i * 2.9f + 1.f)}.getNormal();
+		vectors[i] = float4{::sinf(i * 0.37f), ::cosf(i * 1.1f), ::sinf(i * 2.3f), ::cosf(i * 0.13f)} * 1.2f;
+	}
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		// Cover subnormal, normal and overflowing halves
+		values[i] = ::sinf(i * 0.77f) * ::exp2f(static_cast<float>(i % 48) - 30.f);
+	}
+
+	std::vector<half> halves(values.size());
+	std::vector<float> unpacked(values.size());
+	packHalf(values, halves);
+	unpackHalf(halves, unpacked);
+	for (size_t i = 0; i < values.size(); ++i)
+	{
+		ASSERT_EQ(halves[i].bits, half{values[i]}.bits) << values[i];
+		ASSERT_EQ(unpacked[i], static_cast<float>(halves[i]));
+	}
+
+	std::vector<half3> halves3(count);
+	packHalf(::std::span<float3 const>{normals}, halves3);
+	std::vector<octnormal> octNormals(count);
+	packOctNormals(normals, octNormals);
+	std::vector<unorm8x4> unorms(count);
+	packUnorm8x4(vectors, unorms);
+	std::vector<snorm16x4> snorms(count);
+	packSnorm16x4(vectors, snorms);
+	std::vector<rgb10a2> rgbs(count);
+	packRGB10A2(vectors, rgbs);
+	for (size_t i = 0; i < count; ++i)
+	{
+		half3 const h{normals[i]};
+		octnormal const o{normals[i]};
+		unorm8x4 const u{vectors[i]};
+		snorm16x4 const s{vectors[i]};
+		ASSERT_EQ(halves3[i].y.bits, h.y.bits) << "vector " << i;
+		ASSERT_EQ(octNormals[i].u, o.u) << "vector " << i;
+		ASSERT_EQ(octNormals[i].v, o.v) << "vector " << i;
+		ASSERT_EQ(rgbs[i].bits, rgb10a2{vectors[i]}.bits) << "vector " << i;
+		for (int j = 0; j < 4; ++j)
+		{
+			ASSERT_EQ(unorms[i].coords[j], u.coords[j]) << "vector " << i;
+			ASSERT_EQ(snorms[i].coords[j], s.coords[j]) << "vector " << i;
+		}
+	}
+}
+
+TEST(Math, Morton)
+{
+	static_assert(Math::encodeMorton(uint3{1u, 0u, 0u}) == 1 && Math::encodeMorton(uint3{0u, 1u, 0u}) == 2);
+	static_assert(Math::encodeMorton(uint3{0u, 0u, 1u}) == 4 && Math::encodeMorton(uint3{3u, 0u, 0u}) == 9);
+	static_assert(Math::encodeMorton(uint3{0x1fffffu}) == 0x7fffffffffffffffull);
+	static_assert(Math::decodeMorton(0x7fffffffffffffffull)[1] == 0x1fffffu);
+	static_assert(Math::decodeMortonSigned(Math::encodeMorton(int3{-5, 7, -(1 << 20)}))[2] == -(1 << 20));
+
+	// Signed codes preserve the order along each axis
+	EXPECT_LT(Math::encodeMorton(int3{-1, 0, 0}), Math::encodeMorton(int3{0, 0, 0}));
+	EXPECT_LT(Math::encodeMorton(int3{0, 0, -100}), Math::encodeMorton(int3{0, 0, 100}));
+
+	uint32_t state = 1;
+	auto const next = [&state]() {
+
+		// xorshift32
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	};
+	for (int i = 0; i < 10000; ++i)
+	{
+		int3 const v{static_cast<int>(next() % (1 << 21)) - (1 << 20), static_cast<int>(next() % 2000) - 1000,
+		             static_cast<int>(next() % 64) - 32};
+		int3 const delta{static_cast<int>(next() % 7) - 3, static_cast<int>(next() % 7) - 3, 1};
+		uint64_t const code = Math::encodeMorton(v);
+
+		int3 const decoded = Math::decodeMortonSigned(code);
+		ASSERT_EQ(decoded.x, v.x);
+		ASSERT_EQ(decoded.y, v.y);
+		ASSERT_EQ(decoded.z, v.z);
+		uint3 const unsignedV{next() & 0x1fffff, next() & 0x1fffff, next() & 0x1fffff};
+		uint3 const unsignedDecoded = Math::decodeMorton(Math::encodeMorton(unsignedV));
+		ASSERT_EQ(unsignedDecoded.x, unsignedV.x);
+		ASSERT_EQ(unsignedDecoded.y, unsignedV.y);
+		ASSERT_EQ(unsignedDecoded.z, unsignedV.z);
+
+		if (v.x + delta.x < (1 << 20) && v.x + delta.x >= -(1 << 20))
+		{
+			ASSERT_EQ(Math::offsetMorton(code, delta), Math::encodeMorton(v + delta));
+		}
+	}
+
+	// No collisions in the lower bits beyond what a random hash would give
+	constexpr int size = 32;
+	constexpr uint64_t numBuckets = 1 << 16;
+	std::vector<int> buckets(numBuckets);
+	for (int x = -size / 2; x < size / 2; ++x)
+	{
+		for (int y = -size / 2; y < size / 2; ++y)
+		{
+			for (int z = -size / 2; z < size / 2; ++z)
+			{
+				buckets[Math::hash(int3{x, y, z}) & (numBuckets - 1)]++;
+			}
+		}
+	}
+	int maxLoad = 0;
+	for (int load : buckets)
+	{
+		maxLoad = Math::max(maxLoad, load);
+	}
+	EXPECT_LE(maxLoad, 6);
+	EXPECT_NE(Math::hash(int3{1, 2, 3}), Math::hash(int3{3, 2, 1}));
+}
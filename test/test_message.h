@@ -0,0 +1,671 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "message.h"
+#include "block_pool.h"
+#include "runnable_thread.h"
+
+
+using namespace VaporWorldVR;
+
+
+/* The number of calls to the global operator new, used to check that
+   messages are not allocated from the heap. */
+static ::std::atomic<size_t> numHeapAllocations{0};
+
+void* operator new(size_t size)
+{
+	numHeapAllocations.fetch_add(1, ::std::memory_order_relaxed);
+	if (void* ptr = malloc(size ? size : 1))
+		return ptr;
+	throw ::std::bad_alloc{};
+}
+
+// The operators are not inlined, otherwise GCC sees free() called on
+// memory returned by operator new, and warns about a mismatch
+__attribute__((noinline)) void operator delete(void* ptr) noexcept
+{
+	free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept
+{
+	::operator delete(ptr);
+}
+
+
+namespace
+{
+	/* The maximum number of producers of a test. */
+	constexpr uint32_t maxProducers = 8;
+
+	/* A message tagged with the producer that sent it and its position in
+	   the sequence of the producer. */
+	struct TestMessageValue : public Message
+	{
+		uint32_t producer;
+		uint32_t seq;
+	};
+
+	/* Stops the consumer thread. */
+	struct TestMessageStop : public Message {};
+
+	/* Posts itself again to the target, until the count is zero. */
+	struct TestMessageRepost : public Message
+	{
+		uint32_t count;
+	};
+
+	/* Blocks the consumer thread until the flag is set. */
+	struct TestMessageBlock : public Message
+	{
+		::std::atomic<uint32_t>* entered;
+		::std::atomic<uint32_t>* release;
+	};
+
+	/* A target that records the messages it processes. */
+	class TestTarget : public Runnable, public MessageTarget<TestTarget, TestMessageValue, TestMessageStop,
+	                                                         TestMessageRepost, TestMessageBlock>
+	{
+	public:
+		/* The messages processed, in order. */
+		::std::vector<TestMessageValue> values;
+
+		/* The number of messages processed for each producer, read by the
+		   producers to check the acks. */
+		::std::atomic<uint32_t> counts[maxProducers] = {};
+
+		/* Set when the stop message is processed. */
+		bool stopped = false;
+
+		/* The number of repost messages processed. */
+		uint32_t numReposts = 0;
+
+		explicit TestTarget(size_t poolCapacity = defaultMessagePoolCapacity)
+			: MessageTarget{poolCapacity}
+		{}
+
+		virtual void run() override
+		{
+			while (!stopped)
+			{
+				flushMessages(true);
+			}
+		}
+
+		/* Reproduces a producer that pushes a message while the consumer
+		   pushes back the stub after popping the last message. The first
+		   message is being popped, the second one is before the stub, and
+		   its producer has not linked it yet. Returns the node to link and
+		   the node it must be linked to. */
+		::std::pair<MessageState*, MessageState*> pushRacingStub(TestMessageValue const& first,
+		                                                         TestMessageValue const& second)
+		{
+			postMessage(first);
+
+			// The consumer skips the stub, and finds the last message
+			MessageState* last = stub.next.load(::std::memory_order_relaxed);
+			tail.store(last, ::std::memory_order_relaxed);
+
+			// The producer swaps the head, but is preempted before linking
+			MessageState* wrapper = createMessage(second, MessageWait_None, 1);
+			wrapper->next.store(nullptr, ::std::memory_order_relaxed);
+			MessageState* prev = head.exchange(wrapper, ::std::memory_order_seq_cst);
+
+			// The consumer pushes back the stub after it
+			pushNodes(&stub, &stub);
+			return {wrapper, prev};
+		}
+
+		void processMessage(TestMessageValue const& msg)
+		{
+			values.push_back(msg);
+			counts[msg.producer].fetch_add(1, ::std::memory_order_relaxed);
+		}
+
+		void processMessage(TestMessageStop const&)
+		{
+			stopped = true;
+		}
+
+		void processMessage(TestMessageRepost const& msg)
+		{
+			++numReposts;
+			if (msg.count > 0)
+				postMessage(TestMessageRepost{{}, msg.count - 1});
+		}
+
+		void processMessage(TestMessageBlock const& msg)
+		{
+			msg.entered->store(1, ::std::memory_order_release);
+			while (msg.release->load(::std::memory_order_acquire) == 0)
+			{
+				futexWait(*msg.release, 0);
+			}
+		}
+	};
+
+	/* Posts a sequence of messages to a target, and checks the acks. */
+	class TestProducer : public Runnable
+	{
+	public:
+		TestProducer(TestTarget* inTarget, uint32_t inProducer, uint32_t inNumMessages, int inSendFlags)
+			: target{inTarget}
+			, producer{inProducer}
+			, numMessages{inNumMessages}
+			, sendFlags{inSendFlags}
+			, numAckErrors{0}
+		{}
+
+		/* The number of acks received before the message was processed, or
+		   after the next one was. */
+		uint32_t getNumAckErrors() const
+		{
+			return numAckErrors;
+		}
+
+		virtual void run() override
+		{
+			for (uint32_t seq = 0; seq < numMessages; ++seq)
+			{
+				target->postMessage(TestMessageValue{{}, producer, seq}, sendFlags);
+
+				// Messages of a producer are processed in order, and each one
+				// is acked before the next is posted
+				uint32_t const count = target->counts[producer].load(::std::memory_order_relaxed);
+				if ((sendFlags & MessageWait_Processed) && count != seq + 1)
+					++numAckErrors;
+				else if ((sendFlags & MessageWait_Received) && count != seq && count != seq + 1)
+					++numAckErrors;
+			}
+		}
+
+	protected:
+		TestTarget* target;
+		uint32_t producer;
+		uint32_t numMessages;
+		int sendFlags;
+		uint32_t numAckErrors;
+	};
+
+	/* Allocates and frees blocks of a pool from another thread. */
+	class TestPoolUser : public Runnable
+	{
+	public:
+		TestPoolUser(BlockPool* inPool, uint32_t inNumIterations)
+			: pool{inPool}
+			, numIterations{inNumIterations}
+			, numErrors{0}
+		{}
+
+		/* The number of blocks that were overwritten while in use. */
+		uint32_t getNumErrors() const
+		{
+			return numErrors;
+		}
+
+		virtual void run() override
+		{
+			uint64_t* blocks[8];
+			for (uint32_t it = 0; it < numIterations; ++it)
+			{
+				// Tag the blocks with this thread and iteration, any other
+				// thread that gets the same block would overwrite them
+				uint64_t const tag = reinterpret_cast<uintptr_t>(this) ^ it;
+				for (uint64_t*& block : blocks)
+				{
+					block = static_cast<uint64_t*>(pool->allocate());
+					*block = tag;
+				}
+				for (uint64_t* block : blocks)
+				{
+					numErrors += *block != tag;
+					pool->free(block);
+				}
+			}
+		}
+
+	protected:
+		BlockPool* pool;
+		uint32_t numIterations;
+		uint32_t numErrors;
+	};
+
+	/* Checks that the messages of each producer were processed in order,
+	   and that none is missing. */
+	void expectMessagesInOrder(::std::vector<TestMessageValue> const& values, uint32_t numProducers,
+	                           uint32_t numMessages)
+	{
+		uint32_t nextSeqs[maxProducers] = {};
+		for (TestMessageValue const& value : values)
+		{
+			ASSERT_LT(value.producer, numProducers);
+			ASSERT_EQ(value.seq, nextSeqs[value.producer]) << "Producer " << value.producer;
+			++nextSeqs[value.producer];
+		}
+		for (uint32_t producer = 0; producer < numProducers; ++producer)
+		{
+			EXPECT_EQ(nextSeqs[producer], numMessages) << "Producer " << producer;
+		}
+	}
+} // namespace
+
+
+TEST(Message, Order)
+{
+	TestTarget target;
+	EXPECT_TRUE(target.isEmpty());
+
+	// Interleave the messages of two producers on the same thread
+	for (uint32_t seq = 0; seq < 100; ++seq)
+	{
+		target.postMessage(TestMessageValue{{}, 0, seq});
+		target.postMessage(TestMessageValue{{}, 1, seq});
+	}
+	EXPECT_FALSE(target.isEmpty());
+
+	target.flushMessages();
+	EXPECT_TRUE(target.isEmpty());
+	ASSERT_EQ(target.values.size(), 200u);
+	for (uint32_t i = 0; i < 200; ++i)
+	{
+		EXPECT_EQ(target.values[i].producer, i % 2);
+		EXPECT_EQ(target.values[i].seq, i / 2);
+	}
+
+	// The queue can be reused after being drained
+	target.values.clear();
+	target.flushMessages();
+	EXPECT_TRUE(target.values.empty());
+	target.postMessage(TestMessageValue{{}, 0, 100});
+	target.flushMessages();
+	ASSERT_EQ(target.values.size(), 1u);
+	EXPECT_EQ(target.values[0].seq, 100u);
+}
+
+TEST(Message, Acks)
+{
+	TestTarget target;
+	RunnableThread* consumer = createRunnableThread(&target);
+	consumer->start();
+
+	// Runs on this thread, so the consumer sleeps between the messages
+	TestProducer received{&target, 0, 100, MessageWait_Received};
+	received.run();
+	EXPECT_EQ(received.getNumAckErrors(), 0u);
+
+	TestProducer processed{&target, 1, 100, MessageWait_Processed};
+	processed.run();
+	EXPECT_EQ(processed.getNumAckErrors(), 0u);
+
+	target.postMessage(TestMessageStop{}, MessageWait_Processed);
+	destroyRunnableThread(consumer);
+	EXPECT_TRUE(target.isEmpty());
+	expectMessagesInOrder(target.values, 2, 100);
+}
+
+TEST(Message, MultipleProducers)
+{
+	constexpr uint32_t numMessages = 10000;
+
+	for (uint32_t numProducers : {1u, 2u, maxProducers})
+	{
+		TestTarget target;
+		RunnableThread* consumer = createRunnableThread(&target);
+		consumer->start();
+
+		// The last producer waits for its messages, the others don't
+		::std::vector<TestProducer> producers;
+		producers.reserve(numProducers);
+		for (uint32_t producer = 0; producer < numProducers; ++producer)
+		{
+			int const sendFlags = producer == numProducers - 1 && numProducers > 1 ? MessageWait_Processed
+			                                                                       : MessageWait_None;
+			producers.emplace_back(&target, producer, numMessages, sendFlags);
+		}
+
+		::std::vector<RunnableThread*> threads;
+		for (TestProducer& producer : producers)
+		{
+			threads.push_back(createRunnableThread(&producer));
+			threads.back()->start();
+		}
+		for (RunnableThread* thread : threads)
+		{
+			destroyRunnableThread(thread);
+		}
+
+		target.postMessage(TestMessageStop{}, MessageWait_Processed);
+		destroyRunnableThread(consumer);
+		EXPECT_TRUE(target.isEmpty());
+
+		expectMessagesInOrder(target.values, numProducers, numMessages);
+		for (TestProducer const& producer : producers)
+		{
+			EXPECT_EQ(producer.getNumAckErrors(), 0u);
+		}
+	}
+}
+
+TEST(Message, FlushSnapshot)
+{
+	TestTarget target;
+
+	// Messages posted by the handlers are processed by the next flush
+	target.postMessage(TestMessageRepost{{}, 3});
+	target.postMessage(TestMessageValue{{}, 0, 0});
+	for (uint32_t flush = 1; flush <= 4; ++flush)
+	{
+		target.flushMessages();
+		EXPECT_EQ(target.numReposts, flush);
+		EXPECT_EQ(target.isEmpty(), flush == 4);
+	}
+	EXPECT_EQ(target.values.size(), 1u);
+}
+
+TEST(Message, StubRace)
+{
+	TestTarget target;
+
+	// The queue is not empty while messages are queued before the stub,
+	// otherwise the consumer would sleep and never process them
+	auto [wrapper, prev] = target.pushRacingStub(TestMessageValue{{}, 0, 0}, TestMessageValue{{}, 0, 1});
+	EXPECT_FALSE(target.isEmpty());
+	target.flushMessages();
+	EXPECT_TRUE(target.values.empty());
+	EXPECT_FALSE(target.isEmpty());
+
+	prev->next.store(wrapper, ::std::memory_order_release);
+	target.postMessage(TestMessageValue{{}, 0, 2});
+	target.flushMessages();
+	EXPECT_TRUE(target.isEmpty());
+	expectMessagesInOrder(target.values, 1, 3);
+}
+
+TEST(Message, FlushSnapshotStub)
+{
+	TestTarget target;
+
+	// The stub is the last node, but messages are queued before it
+	auto [wrapper, prev] = target.pushRacingStub(TestMessageValue{{}, 0, 0}, TestMessageValue{{}, 0, 1});
+	prev->next.store(wrapper, ::std::memory_order_release);
+	target.flushMessages();
+	EXPECT_TRUE(target.isEmpty());
+	expectMessagesInOrder(target.values, 1, 2);
+}
+
+TEST(Message, PostWhileProcessing)
+{
+	TestTarget target;
+	RunnableThread* consumer = createRunnableThread(&target);
+	consumer->start();
+
+	// Posting never waits for the handler that is running
+	::std::atomic<uint32_t> entered{0}, release{0};
+	target.postMessage(TestMessageBlock{{}, &entered, &release});
+	while (entered.load(::std::memory_order_acquire) == 0)
+	{
+		::std::this_thread::yield();
+	}
+	for (uint32_t seq = 0; seq < 100; ++seq)
+	{
+		target.postMessage(TestMessageValue{{}, 0, seq});
+	}
+	EXPECT_EQ(target.counts[0].load(::std::memory_order_relaxed), 0u);
+
+	release.store(1, ::std::memory_order_release);
+	futexWake(release);
+	target.postMessage(TestMessageStop{}, MessageWait_Processed);
+	destroyRunnableThread(consumer);
+	expectMessagesInOrder(target.values, 1, 100);
+}
+
+TEST(Message, Handles)
+{
+	TestTarget target;
+
+	// Adds one to the counter in the payload
+	MessageCallback const increment = [](void* payload) -> void {
+
+		++*static_cast<uint32_t*>(payload);
+	};
+
+	MessageHandle handle = target.postMessageAsync(TestMessageValue{{}, 0, 0});
+	ASSERT_TRUE(handle.isValid());
+	EXPECT_FALSE(handle.isDone());
+	EXPECT_FALSE(handle.waitFor(1000000));
+
+	// Continuations set before the message is processed run on the target
+	uint32_t numCallbacks = 0;
+	handle.then(increment, &numCallbacks);
+	EXPECT_EQ(numCallbacks, 0u);
+	target.flushMessages();
+	EXPECT_EQ(numCallbacks, 1u);
+	EXPECT_TRUE(handle.isDone());
+	EXPECT_TRUE(handle.waitFor(0));
+	handle.wait();
+
+	// Continuations set after the message is processed run immediately
+	MessageHandle other = target.postMessageAsync(TestMessageValue{{}, 0, 1});
+	MessageHandle copy = other;
+	other.reset();
+	EXPECT_FALSE(other.isValid());
+	target.flushMessages();
+	copy.then(increment, &numCallbacks);
+	EXPECT_EQ(numCallbacks, 2u);
+	EXPECT_TRUE(copy.isDone());
+
+	copy = ::std::move(handle);
+	EXPECT_FALSE(handle.isValid());
+	EXPECT_TRUE(copy.isDone());
+	copy.reset();
+	EXPECT_EQ(target.getMessagePoolStats().numUsed, 0u);
+}
+
+TEST(Message, HandlesInFlight)
+{
+	TestTarget target{64};
+	RunnableThread* consumer = createRunnableThread(&target);
+	consumer->start();
+
+	// Block the consumer, the handles time out
+	::std::atomic<uint32_t> entered{0}, release{0};
+	target.postMessage(TestMessageBlock{{}, &entered, &release});
+	::std::vector<MessageHandle> handles;
+	for (uint32_t seq = 0; seq < 64; ++seq)
+	{
+		handles.push_back(target.postMessageAsync(TestMessageValue{{}, 0, seq}));
+	}
+	EXPECT_FALSE(handles.front().waitFor(1000000));
+	EXPECT_FALSE(handles.back().isDone());
+
+	// Continuations run on the consumer thread, in order
+	::std::atomic<uint32_t> numCallbacks{0};
+	handles.back().then([](void* payload) -> void {
+
+		static_cast<::std::atomic<uint32_t>*>(payload)->fetch_add(1, ::std::memory_order_relaxed);
+	}, &numCallbacks);
+
+	release.store(1, ::std::memory_order_release);
+	futexWake(release);
+	for (uint32_t seq = 0; seq < 64; ++seq)
+	{
+		handles[seq].wait();
+		EXPECT_GE(target.counts[0].load(::std::memory_order_relaxed), seq + 1);
+	}
+	EXPECT_EQ(numCallbacks.load(::std::memory_order_relaxed), 1u);
+	handles.clear();
+
+	target.postMessage(TestMessageStop{}, MessageWait_Processed);
+	destroyRunnableThread(consumer);
+	expectMessagesInOrder(target.values, 1, 64);
+	EXPECT_EQ(target.getMessagePoolStats().numUsed, 0u);
+}
+
+TEST(Message, Batch)
+{
+	TestTarget target;
+
+	// Messages are not visible before the batch is submitted
+	TestTarget::MessageBatch batch{target};
+	target.postMessage(TestMessageValue{{}, 0, 0});
+	batch.postMessage(TestMessageValue{{}, 0, 1});
+	batch.postMessage(TestMessageRepost{{}, 0});
+	MessageHandle handle = batch.postMessageAsync(TestMessageValue{{}, 0, 2});
+	EXPECT_EQ(batch.getNumMessages(), 3u);
+	target.flushMessages();
+	EXPECT_EQ(target.values.size(), 1u);
+	EXPECT_TRUE(target.isEmpty());
+
+	batch.submit();
+	EXPECT_EQ(batch.getNumMessages(), 0u);
+	EXPECT_FALSE(target.isEmpty());
+	EXPECT_FALSE(handle.isDone());
+	target.flushMessages();
+	EXPECT_TRUE(handle.isDone());
+	EXPECT_EQ(target.numReposts, 1u);
+	expectMessagesInOrder(target.values, 1, 3);
+
+	// Empty batches and batches destroyed before submitting
+	batch.submit();
+	EXPECT_TRUE(target.isEmpty());
+	{
+		TestTarget::MessageBatch other{target};
+		other.postMessage(TestMessageValue{{}, 0, 3});
+	}
+	target.flushMessages();
+	expectMessagesInOrder(target.values, 1, 4);
+	handle.reset();
+	EXPECT_EQ(target.getMessagePoolStats().numUsed, 0u);
+}
+
+TEST(Message, BatchAcks)
+{
+	TestTarget target;
+	RunnableThread* consumer = createRunnableThread(&target);
+	consumer->start();
+
+	// Submit waits for the ack of the last message that requested one
+	for (uint32_t frame = 0; frame < 100; ++frame)
+	{
+		TestTarget::MessageBatch batch{target};
+		batch.postMessage(TestMessageValue{{}, 0, frame * 4}, MessageWait_Processed);
+		batch.postMessage(TestMessageValue{{}, 0, frame * 4 + 1});
+		batch.postMessage(TestMessageValue{{}, 0, frame * 4 + 2}, MessageWait_Received);
+		batch.postMessage(TestMessageValue{{}, 0, frame * 4 + 3});
+		batch.submit();
+
+		uint32_t const count = target.counts[0].load(::std::memory_order_relaxed);
+		EXPECT_GE(count, frame * 4 + 2);
+		EXPECT_LE(count, frame * 4 + 4);
+	}
+
+	target.postMessage(TestMessageStop{}, MessageWait_Processed);
+	destroyRunnableThread(consumer);
+	expectMessagesInOrder(target.values, 1, 400);
+	EXPECT_EQ(target.getMessagePoolStats().numUsed, 0u);
+}
+
+TEST(Message, BlockPool)
+{
+	BlockPool pool{24, 8, 4};
+	BlockPoolStats stats = pool.getStats();
+	EXPECT_EQ(stats.capacity, 4u);
+	EXPECT_EQ(stats.numSlabs, 1u);
+
+	// Grow past the initial capacity, blocks must be distinct and aligned
+	::std::set<void*> blocks;
+	for (uint32_t i = 0; i < 10; ++i)
+	{
+		void* block = pool.allocate();
+		ASSERT_NE(block, nullptr);
+		EXPECT_EQ(reinterpret_cast<uintptr_t>(block) % 8, 0u);
+		EXPECT_TRUE(blocks.insert(block).second);
+	}
+	stats = pool.getStats();
+	EXPECT_EQ(stats.capacity, 12u);
+	EXPECT_EQ(stats.numUsed, 10u);
+	EXPECT_EQ(stats.highWaterMark, 10u);
+	EXPECT_EQ(stats.numSlabs, 2u);
+
+	for (void* block : blocks)
+	{
+		pool.free(block);
+	}
+	EXPECT_EQ(pool.getStats().numUsed, 0u);
+
+	// Freed blocks are reused before growing again
+	blocks.clear();
+	for (uint32_t i = 0; i < 12; ++i)
+	{
+		blocks.insert(pool.allocate());
+	}
+	stats = pool.getStats();
+	EXPECT_EQ(blocks.size(), 12u);
+	EXPECT_EQ(stats.numSlabs, 2u);
+	EXPECT_EQ(stats.highWaterMark, 12u);
+	for (void* block : blocks)
+	{
+		pool.free(block);
+	}
+
+	// Concurrent allocations never return the same block twice
+	BlockPool sharedPool{sizeof(uint64_t), alignof(uint64_t), 16};
+	::std::vector<TestPoolUser> users;
+	users.reserve(4);
+	for (uint32_t i = 0; i < 4; ++i)
+	{
+		users.emplace_back(&sharedPool, 20000);
+	}
+	::std::vector<RunnableThread*> threads;
+	for (TestPoolUser& user : users)
+	{
+		threads.push_back(createRunnableThread(&user));
+		threads.back()->start();
+	}
+	for (RunnableThread* thread : threads)
+	{
+		destroyRunnableThread(thread);
+	}
+	for (TestPoolUser const& user : users)
+	{
+		EXPECT_EQ(user.getNumErrors(), 0u);
+	}
+	stats = sharedPool.getStats();
+	EXPECT_EQ(stats.numUsed, 0u);
+	EXPECT_LE(stats.highWaterMark, 4u * 8);
+	EXPECT_GE(stats.capacity, stats.highWaterMark);
+}
+
+TEST(Message, NoHeapAllocations)
+{
+	TestTarget target{8};
+	target.values.reserve(1000);
+
+	// Once the pool is large enough, frames don't allocate
+	size_t const numAllocations = numHeapAllocations.load(::std::memory_order_relaxed);
+	for (uint32_t frame = 0; frame < 100; ++frame)
+	{
+		for (uint32_t seq = 0; seq < 8; ++seq)
+		{
+			target.postMessage(TestMessageValue{{}, 0, frame * 8 + seq});
+		}
+		target.flushMessages();
+	}
+	EXPECT_EQ(numHeapAllocations.load(::std::memory_order_relaxed), numAllocations);
+	expectMessagesInOrder(target.values, 1, 800);
+
+	BlockPoolStats const stats = target.getMessagePoolStats();
+	EXPECT_EQ(stats.numSlabs, 1u);
+	EXPECT_EQ(stats.highWaterMark, 8u);
+	EXPECT_EQ(stats.numUsed, 0u);
+}